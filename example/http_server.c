@@ -1,7 +1,9 @@
 #include "../src/xnet.h"
 #include "../src/xnet_packer.h"
+#include "../src/xnet_static.h"
 
 static int g_s = -1;
+static xnet_static_t *g_static;
 
 static void
 error_func(struct xnet_context_t *ctx, int sock_id, short what) {
@@ -26,7 +28,7 @@ recv_func(struct xnet_context_t *ctx, int sock_id, char *buffer, int size, xnet_
 }
 
 static void
-response(xnet_context_t *ctx, int sock_id, xnet_httpresponse_t *rsp) {
+response(xnet_context_t *ctx, int sock_id, xnet_httpresponse_t *rsp, bool keep_alive) {
 	xnet_string_t out_str;
 	xnet_string_init(&out_str);
 printf("pack http response\n");
@@ -35,7 +37,8 @@ printf("send http response, sz:[%d]\n", xnet_string_get_size(&out_str));
 printf("[%s]\n", xnet_string_get_c_str(&out_str));
 	xnet_tcp_send_buffer(ctx, sock_id, xnet_string_get_str(&out_str), xnet_string_get_size(&out_str), true);
 	//xnet_string_clear(&out_str);
-	xnet_close_socket(ctx, sock_id);
+	if (!keep_alive)
+		xnet_close_socket(ctx, sock_id);
 	xnet_clear_http_rsp(rsp);
 }
 
@@ -56,11 +59,30 @@ http_request(xnet_unpacker_t *up, void *arg) {
 
 	xnet_set_http_rsp_code(&rsp, req->code);
 	xnet_add_http_rsp_header(&rsp, "Content-Type", "text/html");
-	//xnet_add_http_rsp_header(&rsp, "Transfer-Encoding", "chunked");
+	xnet_add_http_rsp_header(&rsp, "Connection", req->keep_alive ? "keep-alive" : "close");
+	if (req->code == 200 && xnet_string_compare_cs(&req->url, "/chunked") == 0) {
+		//chunked响应：先发送响应头，再逐段发送
+		xnet_add_http_rsp_header(&rsp, "Transfer-Encoding", "chunked");
+		response(ctx, sock_id, &rsp, true);
+		for (i=0; i<3; i++)
+			xnet_http_write_chunk(ctx, sock_id, "<p>hello chunk!</p>", 19);
+		xnet_http_end(ctx, sock_id);
+		if (!req->keep_alive)
+			xnet_close_socket(ctx, sock_id);
+		return;
+	}
+	if (g_static && req->code == 200) {
+		//指定了根目录时其他请求按静态文件处理
+		printf("static file, state:[%d]\n", xnet_static_serve(g_static, ctx, sock_id, req, NULL, 0));
+		if (!req->keep_alive)
+			xnet_close_socket(ctx, sock_id);
+		xnet_clear_http_rsp(&rsp);
+		return;
+	}
 	xnet_set_http_rsp_body(&rsp, "<p>hello world!</p>");
 
 	printf("respone http, state:[%d]:\n", req->code);
-	response(ctx, sock_id, &rsp);
+	response(ctx, sock_id, &rsp, req->keep_alive && req->code == 200);
 }
 
 static void
@@ -81,10 +103,12 @@ listen_func(xnet_context_t *ctx, int sock_id, int acc_sock_id) {
 	ns->unpacker = up;
 }
 
+//http_server [静态文件根目录]
 int
 main(int argc, char** argv) {
     int ret;
     xnet_context_t *ctx;
+    xnet_static_config_t conf = {0};
 
     ret = xnet_init(NULL);
     if (ret != 0) {
@@ -98,6 +122,11 @@ main(int argc, char** argv) {
     	return 1;
     }
 
+    if (argc > 1) {
+        conf.root = argv[1];
+        conf.gzip = true;
+        g_static = xnet_static_create(&conf);
+    }
     xnet_register_listener(ctx, listen_func, error_func, recv_func);
     g_s = xnet_tcp_listen(ctx, "0.0.0.0", 8080, 200);
     if (g_s == -1) goto _END;
@@ -107,6 +136,7 @@ main(int argc, char** argv) {
 	xnet_error(ctx, "------end loop------");
 _END:
     xnet_destroy_context(ctx);
+    if (g_static) xnet_static_destroy(g_static);
     xnet_deinit();
     return 0;
 }
@@ -0,0 +1,62 @@
+package.path = "lualib/?.lua;"
+
+--同一个端口接受http/1.1和h2c：连接开头是preface时按http2解析(prior knowledge)，
+--http/1.1请求带Upgrade: h2c时升级，一个http2连接上的请求可以交错到达，用req.stream_id回复
+local function reply(sid, req, code, body)
+	if not req.stream_id and xnet.http2_upgrade(sid) then
+		--升级的请求是流1
+		req.stream_id = 1
+	end
+	if req.stream_id then
+		xnet.http_respond(sid, code, {["Content-Type"] = "text/plain"}, body, req.stream_id)
+		return
+	end
+	local conn = req.keep_alive and "keep-alive" or "close"
+	xnet.http_respond(sid, code, {Connection = conn, ["Content-Type"] = "text/plain"}, body)
+	if not req.keep_alive then
+		xnet.close_socket(sid)
+	end
+end
+
+function Start()
+	local port = xnet.get_env("port") or 9090
+	local rc, sock = xnet.tcp_listen("0.0.0.0", port, 128)
+	print("http2 server listen", rc, sock, port)
+	xnet.set_conn_timeout(sock, 60000)
+	xnet.sniff(sock, {
+		{xnet.SNIFF_HTTP2, xnet.PACKER_TYPE_HTTP2, 1024*1024},
+		{xnet.SNIFF_HTTP, xnet.PACKER_TYPE_HTTP, 1024*1024},
+	})
+
+	xnet.http_route("GET", "/", function(sid, req)
+		reply(sid, req, 200, "hello " .. req.version)
+	end)
+	xnet.http_route("POST", "/echo", function(sid, req)
+		reply(sid, req, 200, req.body or "")
+	end)
+	xnet.http_route("GET", "/big/:size", function(sid, req, params)
+		reply(sid, req, 200, string.rep("x", tonumber(params.size) or 0))
+	end)
+
+	xnet.register({
+		listen = function(sid, new_sid, addr)
+		end,
+		error = function(sid, what)
+		end,
+		recv = function(sid, pkg_type, pkg, sz, addr)
+			if type(pkg) == "table" then
+				if pkg.code ~= 200 then
+					xnet.close_socket(sid)
+					return
+				end
+				reply(sid, pkg, 404, "not found " .. pkg.url)
+			end
+		end,
+	})
+end
+
+function Init()
+end
+
+function Stop()
+end
@@ -0,0 +1,54 @@
+package.path = "lualib/?.lua;"
+
+--http客户端：同一个host:port的请求复用连接池中的keep-alive连接，并在连接上pipelining
+local pending = 0
+
+function Start()
+	print("lua start!")
+	local host = xnet.get_env("host") or "127.0.0.1"
+	local port = xnet.get_env("port") or 8080
+	local count = xnet.get_env("count") or 10
+
+	xnet.register({
+		http_response = function(id, rsp)
+			pending = pending - 1
+			if rsp then
+				print("http response", id, rsp.code, rsp.reason, rsp.keep_alive, rsp.body)
+			else
+				print("http request fail", id)
+			end
+			if pending == 0 then
+				xnet.exit()
+			end
+		end,
+		error = function(sid, what)
+		end,
+		recv = function(sid, pkg_type, pkg, sz, addr)
+		end,
+		timeout = function(id)
+		end,
+		command = function(source, command, data, sz)
+		end,
+		connected = function(sid, err)
+		end,
+	})
+
+	for i = 1, count do
+		local id
+		if i % 2 == 0 then
+			id = xnet.http_request(host, port, "POST", "/", {["Content-Type"] = "text/plain"}, "hello " .. i)
+		else
+			id = xnet.http_request(host, port, "GET", "/")
+		end
+		if id ~= -1 then
+			pending = pending + 1
+		end
+	end
+	print("http request", pending)
+end
+
+function Init()
+end
+
+function Stop()
+end
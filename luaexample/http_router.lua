@@ -0,0 +1,70 @@
+package.path = "lualib/?.lua;"
+
+--按路由分发http请求，只有匹配的handler被调用，没有匹配的请求交给recv
+local users = {}
+local next_id = 1
+
+local function reply(sid, req, code, body)
+	local conn = req.keep_alive and "keep-alive" or "close"
+	xnet.http_respond(sid, code, {Connection = conn, ["Content-Type"] = "text/plain"}, body)
+	if not req.keep_alive then
+		xnet.close_socket(sid)
+	end
+end
+
+function Start()
+	local port = xnet.get_env("port") or 9090
+	local rc, sock = xnet.tcp_listen("0.0.0.0", port, 128)
+	print("http router listen", rc, sock, port)
+	xnet.set_conn_timeout(sock, 60000)
+
+	xnet.http_route("GET", "/", function(sid, req)
+		reply(sid, req, 200, "hello world")
+	end)
+	xnet.http_route("POST", "/users", function(sid, req)
+		local id = tostring(next_id)
+		next_id = next_id + 1
+		users[id] = req.body or ""
+		reply(sid, req, 201, id)
+	end)
+	xnet.http_route("GET", "/users/:id", function(sid, req, params)
+		local user = users[params.id]
+		if user then
+			reply(sid, req, 200, user)
+		else
+			reply(sid, req, 404, "no user " .. params.id)
+		end
+	end)
+	xnet.http_route("GET", "/users/:id/posts/:post", function(sid, req, params)
+		reply(sid, req, 200, "user " .. params.id .. " post " .. params.post)
+	end)
+	xnet.http_route("GET", "/files/*path", function(sid, req, params)
+		reply(sid, req, 200, "file " .. params.path)
+	end)
+	xnet.http_route("*", "/health", function(sid, req)
+		reply(sid, req, 200, "ok " .. req.method)
+	end)
+
+	xnet.register({
+		listen = function(sid, new_sid, addr)
+			xnet.register_packer(new_sid, xnet.PACKER_TYPE_HTTP)
+		end,
+		error = function(sid, what)
+		end,
+		recv = function(sid, pkg_type, pkg, sz, addr)
+			if type(pkg) == "table" then
+				if pkg.code ~= 200 then
+					xnet.close_socket(sid)
+					return
+				end
+				reply(sid, pkg, 404, "not found " .. pkg.url)
+			end
+		end,
+	})
+end
+
+function Init()
+end
+
+function Stop()
+end
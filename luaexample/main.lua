@@ -1,6 +1,5 @@
 package.path = "lualib/?.lua;"
 
-local pack = require "pack"
 local util = require "util"
 
 local socket_list = { }
@@ -10,6 +9,8 @@ function Start()
 	local port = xnet.get_env("port") or 9090
 	local rc, sock = xnet.tcp_listen("0.0.0.0", port, 5)
 	print("lua tcp_listen", rc, sock, port)
+	--keep-alive的连接空闲60秒后关闭
+	xnet.set_conn_timeout(sock, 60000)
 	print(xnet.get_env("luabooter"))
 	print(xnet.get_env("log_path"))
 
@@ -28,9 +29,14 @@ function Start()
 			print("----lua: recv", sid, pkg_type, pkg, sz, xnet.addrtoa(addr))
 			if type(pkg) == "table" then
 				util.dump_table(pkg)
-				local msg = pack.pack_http(200, nil, "hello world")
-				xnet.tcp_send_buffer(sid, msg)
-				xnet.close_socket(sid)
+				--解析出错时按错误码回复，keep_alive为false，回复后关闭
+				local conn = pkg.keep_alive and "keep-alive" or "close"
+				local body = pkg.code == 200 and "hello world" or ""
+				--响应头和body分别放入写队列，不拼接
+				xnet.http_respond(sid, pkg.code, {Connection = conn}, body)
+				if not pkg.keep_alive then
+					xnet.close_socket(sid)
+				end
 			end
 		end,
 		timeout = function(id)
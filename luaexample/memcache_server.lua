@@ -0,0 +1,196 @@
+package.path = "lualib/?.lua;"
+
+--内存中的memcached替身，支持文本协议的常用命令和二进制协议的get/set/delete等，用于和真实的客户端对比测试
+local items = {}
+local next_cas = 1
+
+local function get_item(key)
+	local item = items[key]
+	if item and item.expire and item.expire <= os.time() then
+		items[key] = nil
+		return nil
+	end
+	return item
+end
+
+--exptime大于30天时为unix时间戳
+local function expire_time(exptime)
+	if exptime == 0 then return nil end
+	if exptime < 0 then return 0 end
+	if exptime > 30 * 24 * 3600 then return exptime end
+	return os.time() + exptime
+end
+
+local function store(cmd, key, flags, exptime, data, cas)
+	local item = get_item(key)
+	if cmd == "add" and item then return "NOT_STORED" end
+	if (cmd == "replace" or cmd == "append" or cmd == "prepend") and not item then return "NOT_STORED" end
+	if cmd == "cas" then
+		if not item then return "NOT_FOUND" end
+		if item.cas ~= cas then return "EXISTS" end
+	end
+	if cmd == "append" then
+		data, flags, exptime = item.data .. data, item.flags, nil
+	elseif cmd == "prepend" then
+		data, flags, exptime = data .. item.data, item.flags, nil
+	end
+	next_cas = next_cas + 1
+	items[key] = {flags = flags, data = data, cas = next_cas,
+		expire = exptime and expire_time(exptime) or (item and item.expire)}
+	return "STORED"
+end
+
+local text = {}
+
+function text.get(req, with_cas)
+	local out = {}
+	for _, key in ipairs(req.args) do
+		local item = get_item(key)
+		if item then
+			out[#out+1] = xnet.pack_mc_value(key, item.flags, item.data, with_cas and item.cas or nil)
+		end
+	end
+	out[#out+1] = "END\r\n"
+	return table.concat(out)
+end
+
+function text.gets(req)
+	return text.get(req, true)
+end
+
+for _, cmd in ipairs({"set", "add", "replace", "append", "prepend", "cas"}) do
+	text[cmd] = function(req)
+		return store(cmd, req.args[1], req.flags, req.exptime, req.data, req.cas) .. "\r\n"
+	end
+end
+
+function text.delete(req)
+	if not get_item(req.args[1]) then return "NOT_FOUND\r\n" end
+	items[req.args[1]] = nil
+	return "DELETED\r\n"
+end
+
+local function incr(req, sign)
+	local item = get_item(req.args[1])
+	local delta = math.tointeger(tonumber(req.args[2]))
+	if not item then return "NOT_FOUND\r\n" end
+	local v = math.tointeger(tonumber(item.data))
+	if not v or not delta then
+		return "CLIENT_ERROR cannot increment or decrement non-numeric value\r\n"
+	end
+	v = math.max(v + sign * delta, 0)
+	item.data = tostring(v)
+	next_cas = next_cas + 1
+	item.cas = next_cas
+	return item.data .. "\r\n"
+end
+
+function text.incr(req)
+	return incr(req, 1)
+end
+
+function text.decr(req)
+	return incr(req, -1)
+end
+
+function text.touch(req)
+	local item = get_item(req.args[1])
+	if not item then return "NOT_FOUND\r\n" end
+	item.expire = expire_time(math.tointeger(tonumber(req.args[2])) or 0)
+	return "TOUCHED\r\n"
+end
+
+function text.flush_all(req)
+	items = {}
+	return "OK\r\n"
+end
+
+function text.version(req)
+	return "VERSION xnet-memcache\r\n"
+end
+
+--二进制协议
+local OP_GET, OP_SET, OP_ADD, OP_REPLACE, OP_DELETE = 0x00, 0x01, 0x02, 0x03, 0x04
+local OP_QUIT, OP_GETQ, OP_NOOP, OP_VERSION, OP_GETK, OP_GETKQ = 0x07, 0x09, 0x0a, 0x0b, 0x0c, 0x0d
+local STATUS_OK, STATUS_NOT_FOUND, STATUS_EXISTS, STATUS_NOT_STORED, STATUS_UNKNOWN = 0, 1, 2, 5, 0x81
+local store_ops = {[OP_SET] = "set", [OP_ADD] = "add", [OP_REPLACE] = "replace"}
+local status_of = {STORED = STATUS_OK, NOT_STORED = STATUS_NOT_STORED, EXISTS = STATUS_EXISTS, NOT_FOUND = STATUS_NOT_FOUND}
+
+local function binary(req)
+	local op = req.opcode
+	local rsp = {opcode = op, opaque = req.opaque}
+	if op == OP_GET or op == OP_GETQ or op == OP_GETK or op == OP_GETKQ then
+		local item = get_item(req.key)
+		local with_key = (op == OP_GETK or op == OP_GETKQ) and req.key or nil
+		if not item then
+			if op == OP_GETQ or op == OP_GETKQ then return nil end
+			rsp.status = STATUS_NOT_FOUND
+			return xnet.pack_mc_binary(rsp, nil, with_key, "Not found")
+		end
+		rsp.cas = item.cas
+		return xnet.pack_mc_binary(rsp, string.pack(">I4", item.flags), with_key, item.data)
+	elseif store_ops[op] then
+		local flags, exptime = string.unpack(">I4I4", req.extras)
+		local cmd = store_ops[op]
+		if req.cas ~= 0 then cmd = "cas" end
+		local r = store(cmd, req.key, flags, exptime, req.value, req.cas)
+		rsp.status = status_of[r]
+		if r == "STORED" then rsp.cas = items[req.key].cas end
+		return xnet.pack_mc_binary(rsp)
+	elseif op == OP_DELETE then
+		rsp.status = get_item(req.key) and STATUS_OK or STATUS_NOT_FOUND
+		items[req.key] = nil
+		return xnet.pack_mc_binary(rsp)
+	elseif op == OP_NOOP or op == OP_QUIT then
+		return xnet.pack_mc_binary(rsp)
+	elseif op == OP_VERSION then
+		return xnet.pack_mc_binary(rsp, nil, nil, "xnet-memcache")
+	end
+	rsp.status = STATUS_UNKNOWN
+	return xnet.pack_mc_binary(rsp, nil, nil, "Unknown command")
+end
+
+function Start()
+	print("lua start!")
+	local port = xnet.get_env("port") or 11212
+	local rc, sock = xnet.tcp_listen("0.0.0.0", port, 128)
+	print("lua tcp_listen", rc, sock, port)
+
+	xnet.register({
+		listen = function(sid, new_sid, addr)
+			xnet.register_packer(new_sid, xnet.PACKER_TYPE_MEMCACHE)
+		end,
+		error = function(sid, what)
+		end,
+		recv = function(sid, pkg_type, req, sz, addr)
+			local reply
+			if req.binary then
+				reply = binary(req)
+			elseif req.cmd ~= "quit" then
+				local f = text[req.cmd]
+				reply = f and f(req) or "ERROR\r\n"
+				if req.noreply then reply = nil end
+			end
+			if reply then
+				xnet.tcp_send_buffer(sid, reply)
+			end
+			if req.cmd == "quit" or req.opcode == OP_QUIT then
+				xnet.close_socket(sid)
+			end
+		end,
+		timeout = function(id)
+		end,
+		command = function(source, command, data, sz)
+		end,
+		connected = function(sid, err)
+		end,
+	})
+end
+
+function Init()
+	print "lua init!"
+end
+
+function Stop()
+	print "lua stop!"
+end
@@ -0,0 +1,94 @@
+package.path = "lualib/?.lua;"
+
+--用xnet实现的redis替身，只支持少量命令，用于测试RESP解包和作为代理的后端
+local db = {}
+local commands = {}
+
+function commands.PING(msg)
+	if msg then return msg end
+	return {ok = "PONG"}
+end
+
+function commands.ECHO(msg)
+	return msg
+end
+
+function commands.SET(key, value)
+	db[key] = value
+	return {ok = "OK"}
+end
+
+function commands.GET(key)
+	return db[key]
+end
+
+function commands.DEL(...)
+	local n = 0
+	for _, key in ipairs({...}) do
+		if db[key] then
+			db[key] = nil
+			n = n + 1
+		end
+	end
+	return n
+end
+
+function commands.INCR(key)
+	local v = math.tointeger(tonumber(db[key] or 0))
+	if not v then
+		return {err = "ERR value is not an integer or out of range"}
+	end
+	db[key] = tostring(v + 1)
+	return v + 1
+end
+
+function commands.MGET(...)
+	local r = {}
+	for i, key in ipairs({...}) do
+		r[i] = db[key] or xnet.RESP_NULL
+	end
+	return r
+end
+
+function Start()
+	print("lua start!")
+	local port = xnet.get_env("port") or 6380
+	local rc, sock = xnet.tcp_listen("0.0.0.0", port, 128)
+	print("lua tcp_listen", rc, sock, port)
+
+	xnet.register({
+		listen = function(sid, new_sid, addr)
+			xnet.register_packer(new_sid, xnet.PACKER_TYPE_RESP)
+		end,
+		error = function(sid, what)
+		end,
+		recv = function(sid, pkg_type, cmd, sz, addr)
+			local reply
+			if type(cmd) ~= "table" or type(cmd[1]) ~= "string" then
+				reply = {err = "ERR Protocol error"}
+			else
+				local f = commands[string.upper(cmd[1])]
+				if f then
+					reply = f(table.unpack(cmd, 2))
+				else
+					reply = {err = "ERR unknown command '" .. cmd[1] .. "'"}
+				end
+			end
+			xnet.tcp_send_buffer(sid, xnet.pack_resp_reply(reply))
+		end,
+		timeout = function(id)
+		end,
+		command = function(source, command, data, sz)
+		end,
+		connected = function(sid, err)
+		end,
+	})
+end
+
+function Init()
+	print "lua init!"
+end
+
+function Stop()
+	print "lua stop!"
+end
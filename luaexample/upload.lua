@@ -0,0 +1,59 @@
+package.path = "lualib/?.lua;"
+
+local pack = require "pack"
+
+--流式接收http body，上传大文件时内存占用与文件大小无关
+local uploads = { }
+
+function Start()
+	print("lua start!")
+	local port = xnet.get_env("port") or 9090
+	local rc, sock = xnet.tcp_listen("0.0.0.0", port, 5)
+	print("lua tcp_listen", rc, sock, port)
+
+	xnet.register({
+		listen = function(sid, new_sid, addr)
+			--body不限制大小，按片段回调
+			xnet.register_packer(new_sid, xnet.PACKER_TYPE_HTTP, 0, true)
+		end,
+		error = function(sid, what)
+			uploads[sid] = nil
+		end,
+		recv = function(sid, pkg_type, pkg, sz, addr)
+			if pkg_type == xnet.PACKER_TYPE_HTTP then
+				if pkg.code ~= 200 then
+					xnet.tcp_send_buffer(sid, pack.pack_http(pkg.code, {Connection = "close"}))
+					xnet.close_socket(sid)
+					return
+				end
+				--请求头到达，body随后分段到达
+				uploads[sid] = {req = pkg, size = 0}
+			elseif pkg_type == xnet.PACKER_TYPE_HTTP_BODY then
+				local upload = uploads[sid]
+				if sz > 0 then
+					upload.size = upload.size + sz
+					return
+				end
+				--长度为0的片段表示body接收完成
+				uploads[sid] = nil
+				local conn = upload.req.keep_alive and "keep-alive" or "close"
+				xnet.tcp_send_buffer(sid, pack.pack_http(200, {Connection = conn}, "received " .. upload.size))
+				if not upload.req.keep_alive then
+					xnet.close_socket(sid)
+				end
+			end
+		end,
+		timeout = function(id)
+		end,
+		command = function(source, command, data, sz)
+		end,
+		connected = function(sid, err)
+		end,
+	})
+end
+
+function Init()
+end
+
+function Stop()
+end
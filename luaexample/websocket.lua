@@ -0,0 +1,48 @@
+package.path = "lualib/?.lua;"
+
+--websocket echo服务：http请求中带Upgrade: websocket时升级连接，之后收到的消息原样返回
+function Start()
+	print("lua start!")
+	local port = xnet.get_env("port") or 9090
+	local rc, sock = xnet.tcp_listen("0.0.0.0", port, 5)
+	print("lua tcp_listen", rc, sock, port)
+
+	xnet.register({
+		listen = function(sid, new_sid, addr)
+			xnet.register_packer(new_sid, xnet.PACKER_TYPE_HTTP)
+		end,
+		error = function(sid, what)
+			print("----lua: error", sid, what)
+		end,
+		recv = function(sid, pkg_type, pkg, sz, addr, opcode)
+			if pkg_type == xnet.PACKER_TYPE_HTTP then
+				--必须在http请求的回调中升级，失败时按普通http请求回复
+				if not xnet.websocket_upgrade(sid) then
+					xnet.http_respond(sid, 400, {Connection = "close"}, "websocket only")
+					xnet.close_socket(sid)
+				end
+			elseif pkg_type == xnet.PACKER_TYPE_WEBSOCKET then
+				if opcode == xnet.WS_TEXT or opcode == xnet.WS_BINARY then
+					xnet.websocket_send(sid, pkg, opcode)
+				elseif opcode == xnet.WS_CLOSE then
+					--close帧已经自动回复，连接随后关闭
+					print("----lua: websocket close", sid)
+				end
+			end
+		end,
+		timeout = function(id)
+		end,
+		command = function(source, command, data, sz)
+		end,
+		connected = function(sid, err)
+		end,
+	})
+end
+
+function Init()
+	print "lua init!"
+end
+
+function Stop()
+	print "lua stop!"
+end
@@ -1,4 +1,14 @@
 #include "xnet_util.h"
+#include "xnet_httpclient.h"
+#include "xnet_websocket.h"
+#include "xnet_resp.h"
+#include "xnet_memcache.h"
+#include "xnet_sniff.h"
+#include "xnet_proxyproto.h"
+#include "xnet_static.h"
+#include "xnet_router.h"
+#include "xnet_http2.h"
+#include <stddef.h>
 
 #define GET_XNET_CTX xnet_context_t *ctx;            \
 lua_getfield((L), LUA_REGISTRYINDEX, "xnet_ctx");    \
@@ -12,6 +22,12 @@ lua_pop(L, 1);                                       \
 #define XNET_PACKER_TYPE_HTTP         1
 #define XNET_PACKER_TYPE_SIZEBUFFER   2
 #define XNET_PACKER_TYPE_LINE         3
+#define XNET_PACKER_TYPE_HTTP_BODY    4 //流式接收的http body片段
+#define XNET_PACKER_TYPE_WEBSOCKET    5
+#define XNET_PACKER_TYPE_LENGTHFIELD  6
+#define XNET_PACKER_TYPE_RESP         7
+#define XNET_PACKER_TYPE_MEMCACHE     8
+#define XNET_PACKER_TYPE_HTTP2        9 //请求以PACKER_TYPE_HTTP回调，带stream_id
 
 static int
 _xnet_tcp_connect(lua_State *L) {
@@ -68,6 +84,394 @@ _xnet_tcp_send_buffer(lua_State *L) {
 	return 0;
 }
 
+static int
+_xnet_http_write_chunk(lua_State *L) {
+	GET_XNET_CTX
+	int sock_id = luaL_checkinteger(L, 1);
+	size_t sz = 0;
+	const char *data = luaL_checklstring(L, 2, &sz);
+	lua_pushinteger(L, xnet_http_write_chunk(ctx, sock_id, data, (int)sz));
+	return 1;
+}
+
+static int
+_xnet_http_end(lua_State *L) {
+	GET_XNET_CTX
+	int sock_id = luaL_checkinteger(L, 1);
+	lua_pushinteger(L, xnet_http_end(ctx, sock_id));
+	return 1;
+}
+
+//把idx位置的header表格式化成"Key: value\r\n"追加到out
+static void
+pack_lua_fields(lua_State *L, int idx, xnet_string_t *out) {
+	size_t ksz, vsz;
+	const char *k, *v;
+	if (!lua_istable(L, idx)) return;
+	lua_pushnil(L);
+	while (lua_next(L, idx) != 0) {
+		k = lua_tolstring(L, -2, &ksz);
+		v = lua_tolstring(L, -1, &vsz);
+		if (k && v) {
+			xnet_string_append_buff(out, k, ksz);
+			xnet_string_append_buff(out, ": ", 2);
+			xnet_string_append_buff(out, v, vsz);
+			xnet_string_append_buff(out, "\r\n", 2);
+		}
+		lua_pop(L, 1);
+	}
+}
+
+//pack_http(code, header, body)，返回完整的响应
+static int
+_xnet_pack_http(lua_State *L) {
+	int code = (int)luaL_checkinteger(L, 1);
+	size_t body_sz = 0;
+	const char *body = luaL_optlstring(L, 3, NULL, &body_sz);
+	xnet_string_t fields, out;
+	luaL_Buffer b;
+
+	xnet_string_init(&fields);
+	xnet_string_init(&out);
+	pack_lua_fields(L, 2, &fields);
+	xnet_pack_http_head(code, xnet_string_get_str(&fields), xnet_string_get_size(&fields),
+		body ? (int64_t)body_sz : -1, &out);
+	luaL_buffinitsize(L, &b, xnet_string_get_size(&out) + body_sz);
+	luaL_addlstring(&b, xnet_string_get_str(&out), xnet_string_get_size(&out));
+	if (body_sz > 0) luaL_addlstring(&b, body, body_sz);
+	xnet_string_clear(&fields);
+	xnet_string_clear(&out);
+	luaL_pushresult(&b);
+	return 1;
+}
+
+//{offset=0, width=4, big_endian=false, adjust=0, strip=0}，缺省的字段取默认值
+static void
+check_lengthfield_conf(lua_State *L, int idx, xnet_lengthfield_conf_t *conf) {
+	lua_Integer v;
+	luaL_checktype(L, idx, LUA_TTABLE);
+	memset(conf, 0, sizeof(*conf));
+	lua_getfield(L, idx, "offset");
+	v = luaL_optinteger(L, -1, 0);
+	luaL_argcheck(L, v >= 0 && v <= 255, idx, "offset must be in [0, 255]");
+	conf->offset = (uint8_t)v;
+	lua_getfield(L, idx, "width");
+	v = luaL_optinteger(L, -1, 4);
+	luaL_argcheck(L, v == 0 || v == 1 || v == 2 || v == 4 || v == 8, idx, "width must be 0(varint), 1, 2, 4 or 8");
+	conf->width = (uint8_t)v;
+	lua_getfield(L, idx, "big_endian");
+	conf->big_endian = lua_toboolean(L, -1);
+	lua_getfield(L, idx, "adjust");
+	conf->adjust = (int32_t)luaL_optinteger(L, -1, 0);
+	lua_getfield(L, idx, "strip");
+	v = luaL_optinteger(L, -1, 0);
+	luaL_argcheck(L, v >= 0, idx, "strip must be >= 0");
+	conf->strip = (uint32_t)v;
+	lua_pop(L, 5);
+}
+
+//pack_lengthfield(conf, body, head)，head为长度字段前的offset字节
+static int
+_xnet_pack_lengthfield(lua_State *L) {
+	xnet_lengthfield_conf_t conf;
+	size_t sz = 0, head_sz = 0;
+	const char *body, *head;
+	xnet_string_t out;
+
+	check_lengthfield_conf(L, 1, &conf);
+	body = luaL_checklstring(L, 2, &sz);
+	head = luaL_optlstring(L, 3, NULL, &head_sz);
+	luaL_argcheck(L, head == NULL || head_sz == conf.offset, 3, "head size must be equal to offset");
+	xnet_string_init(&out);
+	if (xnet_pack_lengthfield(&conf, head, body, (uint32_t)sz, &out) != 0) {
+		xnet_string_clear(&out);
+		return luaL_error(L, "body size %d can not be packed", (int)sz);
+	}
+	lua_pushlstring(L, xnet_string_get_str(&out), xnet_string_get_size(&out));
+	xnet_string_clear(&out);
+	return 1;
+}
+
+/*
+ * resp和lua值的转换，同redis脚本的约定：status为{ok=str}，error为{err=str}，
+ * nil bulk和nil数组为xnet.RESP_NULL(lightuserdata NULL)
+ */
+static void
+push_resp_elem(lua_State *L, xnet_resp_elem_t *elems, uint32_t *i) {
+	xnet_resp_elem_t *e = &elems[(*i)++];
+	uint32_t j;
+
+	luaL_checkstack(L, 3, "resp nested too deep");
+	switch (e->type) {
+	case XNET_RESP_STRING:
+	case XNET_RESP_ERROR:
+		lua_createtable(L, 0, 1);
+		lua_pushlstring(L, e->len ? e->str : "", e->len);
+		lua_setfield(L, -2, e->type == XNET_RESP_STRING ? "ok" : "err");
+		break;
+	case XNET_RESP_INTEGER:
+		lua_pushinteger(L, e->integer);
+		break;
+	case XNET_RESP_BULK:
+		if (e->nil)
+			lua_pushlightuserdata(L, NULL);
+		else
+			lua_pushlstring(L, e->len ? e->str : "", e->len);
+		break;
+	default:
+		if (e->nil) {
+			lua_pushlightuserdata(L, NULL);
+			break;
+		}
+		lua_createtable(L, e->count, 0);
+		for (j=1; j<=e->count; j++) {
+			push_resp_elem(L, elems, i);
+			lua_rawseti(L, -2, j);
+		}
+		break;
+	}
+}
+
+static void
+pack_resp_value(lua_State *L, int idx, int depth, xnet_string_t *out) {
+	size_t sz;
+	const char *str;
+	lua_Integer i, n;
+	char type;
+
+	if (depth > XNET_RESP_MAX_DEPTH)
+		luaL_error(L, "resp nested too deep");
+	switch (lua_type(L, idx)) {
+	case LUA_TNIL:
+	case LUA_TLIGHTUSERDATA:
+		xnet_pack_resp_bulk(NULL, 0, out);
+		break;
+	case LUA_TBOOLEAN:
+		if (lua_toboolean(L, idx))
+			xnet_pack_resp_integer(1, out);
+		else
+			xnet_pack_resp_bulk(NULL, 0, out);
+		break;
+	case LUA_TNUMBER:
+		if (lua_isinteger(L, idx)) {
+			xnet_pack_resp_integer(lua_tointeger(L, idx), out);
+			break;
+		}
+		//fall through
+	case LUA_TSTRING:
+		str = lua_tolstring(L, idx, &sz);
+		xnet_pack_resp_bulk(str, (uint32_t)sz, out);
+		break;
+	case LUA_TTABLE:
+		type = 0;
+		if (lua_getfield(L, idx, "ok") == LUA_TSTRING) {
+			type = XNET_RESP_STRING;
+		} else {
+			lua_pop(L, 1);
+			if (lua_getfield(L, idx, "err") == LUA_TSTRING)
+				type = XNET_RESP_ERROR;
+		}
+		if (type) {
+			str = lua_tolstring(L, -1, &sz);
+			xnet_pack_resp_simple(type, str, (uint32_t)sz, out);
+			lua_pop(L, 1);
+			break;
+		}
+		lua_pop(L, 1);
+		n = luaL_len(L, idx);
+		xnet_pack_resp_array(n, out);
+		for (i=1; i<=n; i++) {
+			luaL_checkstack(L, 2, "resp nested too deep");
+			lua_rawgeti(L, idx, i);
+			pack_resp_value(L, lua_gettop(L), depth + 1, out);
+			lua_pop(L, 1);
+		}
+		break;
+	default:
+		luaL_error(L, "can not pack %s to resp", luaL_typename(L, idx));
+	}
+}
+
+//pack_resp(cmd, arg1, arg2, ...)，所有参数转为bulk string组成的命令
+static int
+_xnet_pack_resp(lua_State *L) {
+	int i, n = lua_gettop(L);
+	size_t sz;
+	const char *str;
+	xnet_string_t out;
+
+	xnet_string_init(&out);
+	xnet_pack_resp_array(n, &out);
+	for (i=1; i<=n; i++) {
+		str = luaL_tolstring(L, i, &sz);
+		xnet_pack_resp_bulk(str, (uint32_t)sz, &out);
+		lua_pop(L, 1);
+	}
+	lua_pushlstring(L, xnet_string_get_str(&out), xnet_string_get_size(&out));
+	xnet_string_clear(&out);
+	return 1;
+}
+
+//pack_resp_reply(value)，按上面的约定把lua值转为回复
+static int
+_xnet_pack_resp_reply(lua_State *L) {
+	xnet_string_t out;
+	lua_settop(L, 1);
+	xnet_string_init(&out);
+	pack_resp_value(L, 1, 0, &out);
+	lua_pushlstring(L, xnet_string_get_str(&out), xnet_string_get_size(&out));
+	xnet_string_clear(&out);
+	return 1;
+}
+
+/*
+ * memcache消息转为lua table
+ * 文本协议：{cmd=, args={...}, noreply=}，存储命令另有flags、exptime、cas、data
+ * 二进制协议：{binary=true, magic=, opcode=, status=, data_type=, opaque=, cas=, extras=, key=, value=}
+ */
+#define PUSH_MC_SLICE(s) lua_pushlstring(L, (s).len ? (s).str : "", (s).len)
+static void
+push_memcache(lua_State *L, xnet_memcache_t *mc) {
+	uint32_t i;
+
+	lua_createtable(L, 0, 10);
+	if (mc->binary) {
+		lua_pushboolean(L, 1);
+		lua_setfield(L, -2, "binary");
+		lua_pushinteger(L, mc->header.magic);
+		lua_setfield(L, -2, "magic");
+		lua_pushinteger(L, mc->header.opcode);
+		lua_setfield(L, -2, "opcode");
+		lua_pushinteger(L, mc->header.status);
+		lua_setfield(L, -2, "status");
+		lua_pushinteger(L, mc->header.data_type);
+		lua_setfield(L, -2, "data_type");
+		lua_pushinteger(L, mc->header.opaque);
+		lua_setfield(L, -2, "opaque");
+		lua_pushinteger(L, (lua_Integer)mc->header.cas);
+		lua_setfield(L, -2, "cas");
+		PUSH_MC_SLICE(mc->extras);
+		lua_setfield(L, -2, "extras");
+		PUSH_MC_SLICE(mc->key);
+		lua_setfield(L, -2, "key");
+		PUSH_MC_SLICE(mc->data);
+		lua_setfield(L, -2, "value");
+		return;
+	}
+	PUSH_MC_SLICE(mc->tokens[0]);
+	lua_setfield(L, -2, "cmd");
+	lua_createtable(L, mc->ntokens - 1, 0);
+	for (i=1; i<mc->ntokens; i++) {
+		PUSH_MC_SLICE(mc->tokens[i]);
+		lua_rawseti(L, -2, i);
+	}
+	lua_setfield(L, -2, "args");
+	lua_pushboolean(L, mc->noreply);
+	lua_setfield(L, -2, "noreply");
+	if (mc->storage) {
+		lua_pushinteger(L, mc->flags);
+		lua_setfield(L, -2, "flags");
+		lua_pushinteger(L, mc->exptime);
+		lua_setfield(L, -2, "exptime");
+		lua_pushinteger(L, (lua_Integer)mc->cas);
+		lua_setfield(L, -2, "cas");
+		PUSH_MC_SLICE(mc->data);
+		lua_setfield(L, -2, "data");
+	}
+}
+
+//pack_mc_value(key, flags, data, cas)，get的回复中的一项，有cas时为gets的格式
+static int
+_xnet_pack_mc_value(lua_State *L) {
+	size_t key_sz, sz;
+	const char *key = luaL_checklstring(L, 1, &key_sz);
+	uint32_t flags = (uint32_t)luaL_checkinteger(L, 2);
+	const char *data = luaL_checklstring(L, 3, &sz);
+	bool with_cas = !lua_isnoneornil(L, 4);
+	uint64_t cas = with_cas ? (uint64_t)luaL_checkinteger(L, 4) : 0;
+	xnet_string_t out;
+
+	xnet_string_init(&out);
+	xnet_pack_mc_value(key, (uint32_t)key_sz, flags, data, (uint32_t)sz, with_cas, cas, &out);
+	lua_pushlstring(L, xnet_string_get_str(&out), xnet_string_get_size(&out));
+	xnet_string_clear(&out);
+	return 1;
+}
+
+//pack_mc_binary({magic=, opcode=, status=, data_type=, opaque=, cas=}, extras, key, value)
+static int
+_xnet_pack_mc_binary(lua_State *L) {
+	xnet_mc_header_t h;
+	size_t extras_sz = 0, key_sz = 0, value_sz = 0;
+	const char *extras = luaL_optlstring(L, 2, "", &extras_sz);
+	const char *key = luaL_optlstring(L, 3, "", &key_sz);
+	const char *value = luaL_optlstring(L, 4, "", &value_sz);
+	xnet_string_t out;
+
+	luaL_checktype(L, 1, LUA_TTABLE);
+	luaL_argcheck(L, extras_sz <= 0xFF, 2, "extras too long");
+	luaL_argcheck(L, key_sz <= 0xFFFF, 3, "key too long");
+	memset(&h, 0, sizeof(h));
+	lua_getfield(L, 1, "magic");
+	h.magic = (uint8_t)luaL_optinteger(L, -1, XNET_MC_MAGIC_RESPONSE);
+	lua_getfield(L, 1, "opcode");
+	h.opcode = (uint8_t)luaL_optinteger(L, -1, 0);
+	lua_getfield(L, 1, "status");
+	h.status = (uint16_t)luaL_optinteger(L, -1, 0);
+	lua_getfield(L, 1, "data_type");
+	h.data_type = (uint8_t)luaL_optinteger(L, -1, 0);
+	lua_getfield(L, 1, "opaque");
+	h.opaque = (uint32_t)luaL_optinteger(L, -1, 0);
+	lua_getfield(L, 1, "cas");
+	h.cas = (uint64_t)luaL_optinteger(L, -1, 0);
+	lua_pop(L, 6);
+
+	xnet_string_init(&out);
+	xnet_pack_mc_binary(&h, extras, (uint8_t)extras_sz, key, (uint16_t)key_sz, value, (uint32_t)value_sz, &out);
+	lua_pushlstring(L, xnet_string_get_str(&out), xnet_string_get_size(&out));
+	xnet_string_clear(&out);
+	return 1;
+}
+
+//流水线中的http2解包器
+static xnet_http2_t *
+get_http2(xnet_socket_t *s) {
+	xnet_unpacker_t *up = s ? (xnet_unpacker_t *)s->unpacker : NULL;
+	while (up && up->um != xnet_unpack_http2)
+		up = up->next;
+	return up ? (xnet_http2_t *)up->arg : NULL;
+}
+
+/*
+ * http_respond(sid, code, header, body, stream_id)，响应头和body分别放入写队列，不再拼接。
+ * stream_id为http2请求的req.stream_id，在这个流上回复，流不存在时返回-1
+ */
+static int
+_xnet_http_respond(lua_State *L) {
+	GET_XNET_CTX
+	int sock_id = (int)luaL_checkinteger(L, 1);
+	int code = (int)luaL_checkinteger(L, 2);
+	size_t body_sz = 0;
+	const char *body = luaL_optlstring(L, 4, NULL, &body_sz);
+	xnet_string_t fields;
+	xnet_http2_t *h2;
+	int rc;
+
+	xnet_string_init(&fields);
+	pack_lua_fields(L, 3, &fields);
+	if (!lua_isnoneornil(L, 5)) {
+		h2 = get_http2(xnet_get_socket(ctx, sock_id));
+		rc = h2 ? xnet_http2_respond(h2, (uint32_t)luaL_checkinteger(L, 5), code, xnet_string_get_str(&fields),
+			xnet_string_get_size(&fields), body, (uint32_t)body_sz) : -1;
+	} else {
+		rc = xnet_http_respond(ctx, sock_id, code, xnet_string_get_str(&fields), xnet_string_get_size(&fields),
+			body, (int)body_sz, false);
+	}
+	xnet_string_clear(&fields);
+	lua_pushinteger(L, rc);
+	return 1;
+}
+
 static int
 _xnet_close_socket(lua_State *L) {
 	GET_XNET_CTX
@@ -76,6 +480,61 @@ _xnet_close_socket(lua_State *L) {
 	return 0;
 }
 
+static int
+_xnet_set_cork(lua_State *L) {
+	GET_XNET_CTX
+	xnet_set_cork(ctx, lua_toboolean(L, 1));
+	return 0;
+}
+
+static int
+_xnet_set_read_budget(lua_State *L) {
+	GET_XNET_CTX
+	int bytes = luaL_checkinteger(L, 1);
+	int msgs = luaL_optinteger(L, 2, 0);
+	xnet_set_read_budget(ctx, bytes, msgs);
+	return 0;
+}
+
+static int
+_xnet_flush(lua_State *L) {
+	GET_XNET_CTX
+	int sock_id = luaL_checkinteger(L, 1);
+	lua_pushinteger(L, xnet_flush(ctx, sock_id));
+	return 1;
+}
+
+static int
+_xnet_set_watermark(lua_State *L) {
+	GET_XNET_CTX
+	int sock_id = luaL_checkinteger(L, 1);
+	lua_Integer low = luaL_checkinteger(L, 2);
+	lua_Integer high = luaL_checkinteger(L, 3);
+	lua_Integer hard = luaL_optinteger(L, 4, 0);
+	lua_pushinteger(L, xnet_set_watermark(ctx, sock_id, low, high, hard));
+	return 1;
+}
+
+static int
+_xnet_set_read_link(lua_State *L) {
+	GET_XNET_CTX
+	int sock_id = luaL_checkinteger(L, 1);
+	int link_id = luaL_optinteger(L, 2, -1);
+	lua_pushinteger(L, xnet_set_read_link(ctx, sock_id, link_id));
+	return 1;
+}
+
+static int
+_xnet_set_conn_timeout(lua_State *L) {
+	GET_XNET_CTX
+	int sock_id = luaL_checkinteger(L, 1);
+	int read_timeout = luaL_optinteger(L, 2, 0);
+	int write_timeout = luaL_optinteger(L, 3, 0);
+	int life_timeout = luaL_optinteger(L, 4, 0);
+	lua_pushinteger(L, xnet_set_conn_timeout(ctx, sock_id, read_timeout, write_timeout, life_timeout));
+	return 1;
+}
+
 static int
 _xnet_add_timer(lua_State *L) {
 	GET_XNET_CTX
@@ -87,6 +546,17 @@ _xnet_add_timer(lua_State *L) {
 	return 1;
 }
 
+static int
+_xnet_add_timer_us(lua_State *L) {
+	GET_XNET_CTX
+	int id = luaL_checkinteger(L, 1);
+	lua_Integer timeout = luaL_checkinteger(L, 2);
+
+	int rc = xnet_add_timer_us(ctx, id, timeout);
+	lua_pushinteger(L, rc);
+	return 1;
+}
+
 static int
 _xnet_exit(lua_State *L) {
 	GET_XNET_CTX
@@ -199,29 +669,591 @@ _register(lua_State *L) {
 }
 
 static int
-_xnet_addrtoa(lua_State *L) {
+_xnet_addrtoa(lua_State *L) {
+	size_t sz = 0;
+	const char *addr_string = luaL_checklstring(L, 1, &sz);
+	if (sz != sizeof(xnet_addr_t)) {
+		luaL_error(L, "error addr");
+	}
+
+	xnet_addr_t addr;
+	memcpy(&addr, addr_string, sizeof(addr));
+	char str[64] = {0};
+	xnet_addrtoa(&addr, str);
+	lua_pushstring(L, str);
+	return 1;
+}
+
+static void
+push_http_request(lua_State *L, xnet_httprequest_t *req, bool stream) {
+	int i;
+	lua_newtable(L);
+	lua_pushinteger(L, req->code);
+	lua_setfield(L, -2, "code");
+	lua_pushboolean(L, req->keep_alive);
+	lua_setfield(L, -2, "keep_alive");
+	//字段都是指向接收缓存的view，直接按长度压栈
+	lua_pushlstring(L, xnet_string_get_str(&req->method), xnet_string_get_size(&req->method));
+	lua_setfield(L, -2, "method");
+	lua_pushlstring(L, xnet_string_get_str(&req->url), xnet_string_get_size(&req->url));
+	lua_setfield(L, -2, "url");
+	lua_pushlstring(L, xnet_string_get_str(&req->version), xnet_string_get_size(&req->version));
+	lua_setfield(L, -2, "version");
+
+	lua_newtable(L);
+	for (i=0; i<req->header_count; i++) {
+		lua_pushlstring(L, xnet_string_get_str(&req->header[i].key), xnet_string_get_size(&req->header[i].key));
+		lua_pushlstring(L, xnet_string_get_str(&req->header[i].value), xnet_string_get_size(&req->header[i].value));
+		lua_rawset(L, -3);
+	}
+	lua_setfield(L, -2, "header");
+
+	if (stream) {
+		//body随后以PACKER_TYPE_HTTP_BODY分段到达，长度为0的片段表示结束
+		lua_pushboolean(L, 1);
+		lua_setfield(L, -2, "stream");
+		lua_pushinteger(L, req->content_length);
+		lua_setfield(L, -2, "content_length");
+		lua_pushboolean(L, req->chunked);
+		lua_setfield(L, -2, "chunked");
+	} else if (req->body) {
+		lua_pushlstring(L, xnet_string_get_str(req->body), xnet_string_get_size(req->body));
+		lua_setfield(L, -2, "body");
+	}
+}
+
+//调用recv(sid, XNET_PACKER_TYPE_HTTP_BODY, data, sz, addr)
+static void
+push_http_body(xnet_context_t *ctx, lua_State *L, int sock_id, const char *data, uint32_t sz) {
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	int top = lua_gettop(L);
+
+	if (lua_getfield(L, LUA_REGISTRYINDEX, "reg_funcs") != LUA_TTABLE ||
+		lua_getfield(L, -1, "recv") != LUA_TFUNCTION) {
+		xnet_error(ctx, "recv is not a function");
+		lua_settop(L, top);
+		return;
+	}
+	lua_pushinteger(L, sock_id);
+	lua_pushinteger(L, XNET_PACKER_TYPE_HTTP_BODY);
+	lua_pushlstring(L, data, sz);
+	lua_pushinteger(L, sz);
+	lua_pushlstring(L, (char*)&s->addr_info, sizeof(xnet_addr_t));
+	if (lua_pcall(L, 5, 0, 0) != LUA_OK) {
+		xnet_error(ctx, "http body call recv error:%s", lua_tostring(L, -1));
+	}
+	lua_settop(L, top);
+}
+
+static xnet_router_t *
+get_router(lua_State *L) {
+	xnet_router_t *r;
+	lua_getfield(L, LUA_REGISTRYINDEX, "xnet_router");
+	r = lua_touserdata(L, -1);
+	lua_pop(L, 1);
+	return r;
+}
+
+//按路由调用handler(sid, req, params, addr)，没有匹配的路由时返回false，交给recv；http2的请求带stream_id
+static bool
+route_http_request(xnet_context_t *ctx, lua_State *L, xnet_socket_t *s, int sock_id, xnet_httprequest_t *req, uint32_t stream_id) {
+	xnet_router_t *r = get_router(L);
+	xnet_route_match_t m;
+	void *h;
+	int i, top;
+
+	if (r == NULL || req->code != 200) return false;
+	h = xnet_router_match(r, xnet_string_get_str(&req->method), xnet_string_get_size(&req->method),
+		xnet_string_get_str(&req->url), xnet_string_get_size(&req->url), &m);
+	if (h == NULL) return false;
+
+	top = lua_gettop(L);
+	lua_getfield(L, LUA_REGISTRYINDEX, "xnet_route_funcs");
+	lua_rawgeti(L, -1, (lua_Integer)(intptr_t)h);
+	lua_pushinteger(L, sock_id);
+	push_http_request(L, req, false);
+	if (stream_id) {
+		lua_pushinteger(L, stream_id);
+		lua_setfield(L, -2, "stream_id");
+	}
+	lua_createtable(L, 0, m.param_count);
+	for (i=0; i<m.param_count; i++) {
+		lua_pushlstring(L, m.params[i].key, m.params[i].key_sz);
+		lua_pushlstring(L, m.params[i].value, m.params[i].value_sz);
+		lua_rawset(L, -3);
+	}
+	lua_pushlstring(L, (char*)&s->addr_info, sizeof(xnet_addr_t));
+	if (lua_pcall(L, 4, 0, 0) != LUA_OK) {
+		xnet_error(ctx, "http route call error:%s", lua_tostring(L, -1));
+	}
+	lua_settop(L, top);
+	return true;
+}
+
+static void
+http_callback(xnet_unpacker_t *up, void *arg) {
+	xnet_httprequest_t *req = (xnet_httprequest_t *) arg;
+	xnet_context_t *ctx = (xnet_context_t *)up->user_ptr;
+	int sock_id = (long)up->user_arg;
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	lua_State *L = ctx->user_ptr;
+
+	//流式接收的请求已经在请求头完成时回调过了，这里只通知body结束
+	if (up->sm && req->code == 200) {
+		push_http_body(ctx, L, sock_id, "", 0);
+		return;
+	}
+	if (route_http_request(ctx, L, s, sock_id, req, 0))
+		return;
+
+	int ftype = lua_getfield(L, LUA_REGISTRYINDEX, "reg_funcs");
+	if (ftype != LUA_TTABLE) {
+		xnet_error(ctx, "reg_funcs is not a table %d", ftype);
+		return;
+	}
+
+	if (lua_getfield(L, -1, "recv") != LUA_TFUNCTION) {
+		xnet_error(ctx, "recv is not a function");
+		return;
+	}
+
+	lua_pushinteger(L, sock_id);
+	lua_pushinteger(L, XNET_PACKER_TYPE_HTTP);
+	push_http_request(L, req, false);
+	lua_pushnil(L);
+	lua_pushlstring(L, (char*)&s->addr_info, sizeof(xnet_addr_t));
+	if (lua_pcall(L, 5, 0, 0) != LUA_OK) {
+		xnet_error(ctx, "http call recv error:%s", lua_tostring(L, -1));
+	}
+}
+
+static void
+http_stream(xnet_unpacker_t *up, void *arg, const char *data, uint32_t sz) {
+	xnet_httprequest_t *req = (xnet_httprequest_t *) arg;
+	xnet_context_t *ctx = (xnet_context_t *)up->user_ptr;
+	int sock_id = (long)up->user_arg;
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	lua_State *L = ctx->user_ptr;
+	int top = lua_gettop(L);
+
+	if (data) {
+		push_http_body(ctx, L, sock_id, data, sz);
+		return;
+	}
+
+	//请求头完成，先把请求交给lua
+	if (lua_getfield(L, LUA_REGISTRYINDEX, "reg_funcs") != LUA_TTABLE ||
+		lua_getfield(L, -1, "recv") != LUA_TFUNCTION) {
+		xnet_error(ctx, "recv is not a function");
+		lua_settop(L, top);
+		return;
+	}
+	req->code = 200;
+	lua_pushinteger(L, sock_id);
+	lua_pushinteger(L, XNET_PACKER_TYPE_HTTP);
+	push_http_request(L, req, true);
+	lua_pushnil(L);
+	lua_pushlstring(L, (char*)&s->addr_info, sizeof(xnet_addr_t));
+	if (lua_pcall(L, 5, 0, 0) != LUA_OK) {
+		xnet_error(ctx, "http stream call recv error:%s", lua_tostring(L, -1));
+	}
+	lua_settop(L, top);
+}
+
+static void
+push_http_response(lua_State *L, xnet_httpresponse_t *rsp) {
+	int i;
+	lua_newtable(L);
+	lua_pushinteger(L, rsp->code);
+	lua_setfield(L, -2, "code");
+	lua_pushlstring(L, xnet_string_get_str(&rsp->reason), xnet_string_get_size(&rsp->reason));
+	lua_setfield(L, -2, "reason");
+	lua_pushlstring(L, xnet_string_get_str(&rsp->version), xnet_string_get_size(&rsp->version));
+	lua_setfield(L, -2, "version");
+	lua_pushboolean(L, rsp->keep_alive);
+	lua_setfield(L, -2, "keep_alive");
+
+	lua_newtable(L);
+	for (i=0; i<rsp->header_count; i++) {
+		lua_pushlstring(L, xnet_string_get_str(&rsp->header[i].key), xnet_string_get_size(&rsp->header[i].key));
+		lua_pushlstring(L, xnet_string_get_str(&rsp->header[i].value), xnet_string_get_size(&rsp->header[i].value));
+		lua_rawset(L, -3);
+	}
+	lua_setfield(L, -2, "header");
+
+	if (rsp->body)
+		lua_pushlstring(L, xnet_string_get_str(rsp->body), xnet_string_get_size(rsp->body));
+	else
+		lua_pushliteral(L, "");
+	lua_setfield(L, -2, "body");
+}
+
+//调用http_response(req_id, rsp)，请求失败时rsp为nil
+static void
+http_response_callback(xnet_httpclient_t *cli, int req_id, xnet_httpresponse_t *rsp, void *ud) {
+	xnet_context_t *ctx = (xnet_context_t *)ud;
+	lua_State *L = ctx->user_ptr;
+	int top = lua_gettop(L);
+
+	if (lua_getfield(L, LUA_REGISTRYINDEX, "reg_funcs") != LUA_TTABLE ||
+		lua_getfield(L, -1, "http_response") != LUA_TFUNCTION) {
+		xnet_error(ctx, "http_response is not a function");
+		lua_settop(L, top);
+		return;
+	}
+	lua_pushinteger(L, req_id);
+	if (rsp)
+		push_http_response(L, rsp);
+	else
+		lua_pushnil(L);
+	if (lua_pcall(L, 2, 0, 0) != LUA_OK) {
+		xnet_error(ctx, "call http_response error:%s", lua_tostring(L, -1));
+	}
+	lua_settop(L, top);
+}
+
+//第一次发起请求时创建，由xnet_release_lua在退出时销毁
+static xnet_httpclient_t *
+get_http_client(lua_State *L, xnet_context_t *ctx) {
+	xnet_httpclient_t *cli;
+	lua_getfield(L, LUA_REGISTRYINDEX, "xnet_httpclient");
+	cli = lua_touserdata(L, -1);
+	lua_pop(L, 1);
+	if (!cli) {
+		cli = xnet_httpclient_create(ctx, http_response_callback, 4, 8);
+		lua_pushlightuserdata(L, cli);
+		lua_setfield(L, LUA_REGISTRYINDEX, "xnet_httpclient");
+	}
+	return cli;
+}
+
+//http客户端的定时器，返回0表示已经处理
+static int
+http_client_timeout(lua_State *L, int id) {
+	xnet_httpclient_t *cli;
+	if (id != XNET_HTTPCLIENT_TIMER) return -1;
+	lua_getfield(L, LUA_REGISTRYINDEX, "xnet_httpclient");
+	cli = lua_touserdata(L, -1);
+	lua_pop(L, 1);
+	if (cli) xnet_httpclient_timeout(cli, id);
+	return 0;
+}
+
+//http_request(host, port, method, url, headers, body)，返回请求id，-1表示失败
+static int
+_xnet_http_request(lua_State *L) {
+	GET_XNET_CTX
+	const char *host = luaL_checkstring(L, 1);
+	int port = (int)luaL_checkinteger(L, 2);
+	const char *method = luaL_checkstring(L, 3);
+	const char *url = luaL_checkstring(L, 4);
+	size_t body_sz = 0;
+	const char *body = luaL_optlstring(L, 6, NULL, &body_sz);
+	xnet_string_t headers;
+	int id;
+
+	xnet_string_init(&headers);
+	pack_lua_fields(L, 5, &headers);
+
+	id = xnet_httpclient_request(get_http_client(L, ctx), host, port, method, url,
+		xnet_string_get_size(&headers) > 0 ? xnet_string_get_c_str(&headers) : NULL, body, (int)body_sz, ctx);
+	xnet_string_clear(&headers);
+	lua_pushinteger(L, id);
+	return 1;
+}
+
+//ping自动回复pong，其余消息调用recv(sid, XNET_PACKER_TYPE_WEBSOCKET, data, sz, addr, opcode)
+static void
+websocket_callback(xnet_unpacker_t *up, void *arg) {
+	xnet_websocket_t *ws = (xnet_websocket_t *)arg;
+	xnet_context_t *ctx = (xnet_context_t *)up->user_ptr;
+	int sock_id = (long)up->user_arg;
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	lua_State *L = ctx->user_ptr;
+	int top = lua_gettop(L);
+	uint16_t code;
+	char payload[2];
+
+	if (ws->opcode == XNET_WS_PING) {
+		xnet_websocket_send(ctx, sock_id, XNET_WS_PONG, ws->data, ws->size, false);
+		return;
+	}
+	//流水线中间级，数据消息交给下一级，控制帧照常处理
+	if (up->next && (ws->opcode == XNET_WS_TEXT || ws->opcode == XNET_WS_BINARY)) {
+		xnet_unpacker_emit(up, ws->data, ws->size);
+		return;
+	}
+
+	if (lua_getfield(L, LUA_REGISTRYINDEX, "reg_funcs") == LUA_TTABLE &&
+		lua_getfield(L, -1, "recv") == LUA_TFUNCTION) {
+		lua_pushinteger(L, sock_id);
+		lua_pushinteger(L, XNET_PACKER_TYPE_WEBSOCKET);
+		lua_pushlstring(L, ws->size ? ws->data : "", ws->size);
+		lua_pushinteger(L, ws->size);
+		lua_pushlstring(L, (char*)&s->addr_info, sizeof(xnet_addr_t));
+		lua_pushinteger(L, ws->opcode);
+		if (lua_pcall(L, 6, 0, 0) != LUA_OK) {
+			xnet_error(ctx, "websocket call recv error:%s", lua_tostring(L, -1));
+		}
+	} else {
+		xnet_error(ctx, "recv is not a function");
+	}
+	lua_settop(L, top);
+
+	if (ws->opcode == XNET_WS_CLOSE) {
+		//回复close后关闭连接，格式错误时回复对应的状态码
+		code = ws->error ? ws->error : (ws->close_code ? ws->close_code : XNET_WS_CLOSE_NORMAL);
+		payload[0] = (char)(code >> 8);
+		payload[1] = (char)code;
+		xnet_websocket_send(ctx, sock_id, XNET_WS_CLOSE, payload, 2, false);
+		xnet_close_socket(ctx, sock_id);
+		up->close = true;
+	}
+}
+
+//http2的每个请求调用一次，和http相同，req.stream_id用于回复
+static void
+http2_callback(xnet_unpacker_t *up, void *arg) {
+	xnet_http2_t *h2 = (xnet_http2_t *)arg;
+	xnet_context_t *ctx = (xnet_context_t *)up->user_ptr;
+	int sock_id = (long)up->user_arg;
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	lua_State *L = ctx->user_ptr;
+	int top = lua_gettop(L);
+
+	if (route_http_request(ctx, L, s, sock_id, &h2->req, h2->stream_id))
+		return;
+	if (lua_getfield(L, LUA_REGISTRYINDEX, "reg_funcs") != LUA_TTABLE ||
+		lua_getfield(L, -1, "recv") != LUA_TFUNCTION) {
+		xnet_error(ctx, "recv is not a function");
+		lua_settop(L, top);
+		return;
+	}
+	lua_pushinteger(L, sock_id);
+	lua_pushinteger(L, XNET_PACKER_TYPE_HTTP);
+	push_http_request(L, &h2->req, false);
+	lua_pushinteger(L, h2->stream_id);
+	lua_setfield(L, -2, "stream_id");
+	lua_pushnil(L);
+	lua_pushlstring(L, (char*)&s->addr_info, sizeof(xnet_addr_t));
+	if (lua_pcall(L, 5, 0, 0) != LUA_OK) {
+		xnet_error(ctx, "http2 call recv error:%s", lua_tostring(L, -1));
+	}
+	lua_settop(L, top);
+}
+
+static xnet_unpacker_t *
+new_http2_unpacker(xnet_context_t *ctx, int sock_id, uint32_t limit) {
+	xnet_unpacker_t *up = xnet_unpacker_new(sizeof(xnet_http2_t), http2_callback, xnet_unpack_http2, xnet_clear_http2, limit);
+	up->fm = xnet_free_http2;
+	up->user_ptr = ctx;
+	up->user_arg = (void*)(long)sock_id;
+	return up;
+}
+
+static xnet_unpacker_t *
+new_websocket_unpacker(xnet_context_t *ctx, int sock_id, uint32_t limit) {
+	xnet_unpacker_t *up = xnet_unpacker_new(sizeof(xnet_websocket_t), websocket_callback, xnet_unpack_websocket, xnet_clear_websocket, limit);
+	up->fm = xnet_free_websocket;
+	up->user_ptr = ctx;
+	up->user_arg = (void*)(long)sock_id;
+	return up;
+}
+
+//流水线中正在回调的http解包器，不在http请求的recv回调中时返回NULL
+static xnet_unpacker_t *
+busy_http_unpacker(xnet_socket_t *s) {
+	xnet_unpacker_t *up = s ? (xnet_unpacker_t *)s->unpacker : NULL;
+	//http可以是流水线中的任意一级
+	while (up && up->cb != http_callback)
+		up = up->next;
+	return (up && up->busy) ? up : NULL;
+}
+
+/*
+ * websocket_upgrade(sid, protocol, limit)，只能在http请求的recv回调中调用，
+ * 握手成功时回复101并把解包器切换为websocket，返回true；不是合法的升级请求返回false
+ */
+static int
+_xnet_websocket_upgrade(lua_State *L) {
+	GET_XNET_CTX
+	int sock_id = (int)luaL_checkinteger(L, 1);
+	const char *protocol = luaL_optstring(L, 2, NULL);
+	uint32_t limit = (uint32_t)luaL_optinteger(L, 3, 64*1024);
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	xnet_unpacker_t *up = busy_http_unpacker(s);
+	xnet_unpacker_t *head;
+	xnet_string_t out;
+
+	if (up == NULL)
+		return luaL_error(L, "websocket upgrade must be called in http recv callback");
+	xnet_string_init(&out);
+	if (xnet_pack_websocket_handshake((xnet_httprequest_t *)up->arg, protocol, &out) != 0) {
+		xnet_string_clear(&out);
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	xnet_tcp_send_buffer(ctx, sock_id, out.str, xnet_string_get_size(&out), true);
+	//之后的数据按websocket解析，http解包器还在回调中，返回后释放
+	head = s->unpacker;
+	xnet_unpacker_replace(&head, up, new_websocket_unpacker(ctx, sock_id, limit));
+	s->unpacker = head;
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+/*
+ * http2_upgrade(sid, limit)，只能在http请求的recv回调中调用，处理Upgrade: h2c：
+ * 回复101并把解包器切换为http2，返回true，这个请求成为流1，用http_respond(sid, code, header, body, 1)回复；
+ * 不是合法的升级请求返回false。limit为每个请求的body大小限制
+ */
+static int
+_xnet_http2_upgrade(lua_State *L) {
+	GET_XNET_CTX
+	int sock_id = (int)luaL_checkinteger(L, 1);
+	uint32_t limit = (uint32_t)luaL_optinteger(L, 2, 64*1024);
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	xnet_unpacker_t *up = busy_http_unpacker(s);
+	xnet_unpacker_t *h2, *head;
+
+	if (up == NULL)
+		return luaL_error(L, "http2 upgrade must be called in http recv callback");
+	h2 = new_http2_unpacker(ctx, sock_id, limit);
+	if (xnet_http2_upgrade((xnet_http2_t *)h2->arg, ctx, sock_id, (xnet_httprequest_t *)up->arg) != 0) {
+		xnet_unpacker_free(h2);
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	//preface可能和升级请求一起到达，剩余的数据交给http2解包器
+	head = s->unpacker;
+	xnet_unpacker_replace(&head, up, h2);
+	s->unpacker = head;
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+static xnet_static_t *
+get_static(lua_State *L) {
+	xnet_static_t *st;
+	lua_getfield(L, LUA_REGISTRYINDEX, "xnet_static");
+	st = lua_touserdata(L, -1);
+	lua_pop(L, 1);
+	return st;
+}
+
+/*
+ * static_init(root, opt)，设置静态文件的根目录，重复调用时替换。
+ * opt为{index, cache_size, max_file, max_entries, check_interval, gzip}，说明见xnet_static.h
+ */
+static int
+_xnet_static_init(lua_State *L) {
+	xnet_static_config_t conf;
+	xnet_static_t *st;
+
+	memset(&conf, 0, sizeof(conf));
+	conf.root = luaL_checkstring(L, 1);
+	if (lua_istable(L, 2)) {
+		if (lua_getfield(L, 2, "index") == LUA_TSTRING) conf.index = lua_tostring(L, -1);
+		if (lua_getfield(L, 2, "cache_size") == LUA_TNUMBER) conf.cache_size = lua_tointeger(L, -1);
+		if (lua_getfield(L, 2, "max_file") == LUA_TNUMBER) conf.max_file = (uint32_t)lua_tointeger(L, -1);
+		if (lua_getfield(L, 2, "max_entries") == LUA_TNUMBER) conf.max_entries = (uint32_t)lua_tointeger(L, -1);
+		if (lua_getfield(L, 2, "check_interval") == LUA_TNUMBER) conf.check_interval = (uint32_t)lua_tointeger(L, -1);
+		lua_getfield(L, 2, "gzip");
+		conf.gzip = lua_toboolean(L, -1);
+	}
+	//创建时复制了字符串，之后才能弹出
+	st = xnet_static_create(&conf);
+	lua_settop(L, 2);
+	if (st == NULL)
+		return luaL_error(L, "static init error");
+	if (get_static(L))
+		xnet_static_destroy(get_static(L));
+	lua_pushlightuserdata(L, st);
+	lua_setfield(L, LUA_REGISTRYINDEX, "xnet_static");
+	return 0;
+}
+
+/*
+ * static_serve(sid, path)，只能在http请求的recv回调中调用，path为nil时使用请求的url。
+ * 返回发送的状态码，请求不保持连接时由脚本关闭连接
+ */
+static int
+_xnet_static_serve(lua_State *L) {
+	GET_XNET_CTX
+	int sock_id = (int)luaL_checkinteger(L, 1);
+	size_t sz = 0;
+	const char *path = luaL_optlstring(L, 2, NULL, &sz);
+	xnet_unpacker_t *up = busy_http_unpacker(xnet_get_socket(ctx, sock_id));
+	xnet_static_t *st = get_static(L);
+
+	if (up == NULL)
+		return luaL_error(L, "static serve must be called in http recv callback");
+	if (st == NULL)
+		return luaL_error(L, "static_init is not called");
+	lua_pushinteger(L, xnet_static_serve(st, ctx, sock_id, (xnet_httprequest_t *)up->arg, path, (uint32_t)sz));
+	return 1;
+}
+
+/*
+ * http_route(method, path, fn)，method为"*"时匹配所有method，路径格式见xnet_router.h，重复添加时替换。
+ * 匹配的请求调用fn(sid, req, params, addr)，params为参数名到值的表，不再调用recv；
+ * 没有匹配的请求和流式接收的请求仍然交给recv
+ */
+static int
+_xnet_http_route(lua_State *L) {
+	const char *method = luaL_checkstring(L, 1);
+	const char *path = luaL_checkstring(L, 2);
+	xnet_router_t *r = get_router(L);
+	void *old = NULL;
+	int ref;
+
+	luaL_checktype(L, 3, LUA_TFUNCTION);
+	if (r == NULL) {
+		r = xnet_router_create();
+		lua_pushlightuserdata(L, r);
+		lua_setfield(L, LUA_REGISTRYINDEX, "xnet_router");
+		lua_newtable(L);
+		lua_setfield(L, LUA_REGISTRYINDEX, "xnet_route_funcs");
+	}
+	lua_settop(L, 3);
+	lua_getfield(L, LUA_REGISTRYINDEX, "xnet_route_funcs");
+	lua_pushvalue(L, 3);
+	ref = luaL_ref(L, 4);
+	if (xnet_router_add(r, method, path, (void*)(intptr_t)ref, &old) != 0) {
+		luaL_unref(L, 4, ref);
+		return luaL_error(L, "invalid http route %s %s", method, path);
+	}
+	if (old)
+		luaL_unref(L, 4, (int)(intptr_t)old);
+	return 0;
+}
+
+//websocket_send(sid, data, opcode)，opcode默认为WS_TEXT
+static int
+_xnet_websocket_send(lua_State *L) {
+	GET_XNET_CTX
+	int sock_id = (int)luaL_checkinteger(L, 1);
 	size_t sz = 0;
-	const char *addr_string = luaL_checklstring(L, 1, &sz);
-	if (sz != sizeof(xnet_addr_t)) {
-		luaL_error(L, "error addr");
-	}
-
-	xnet_addr_t addr;
-	memcpy(&addr, addr_string, sizeof(addr));
-	char str[64] = {0};
-	xnet_addrtoa(&addr, str);
-	lua_pushstring(L, str);
+	const char *data = luaL_checklstring(L, 2, &sz);
+	int opcode = (int)luaL_optinteger(L, 3, XNET_WS_TEXT);
+	lua_pushinteger(L, xnet_websocket_send(ctx, sock_id, opcode, data, (int)sz, false));
 	return 1;
 }
 
 static void
-http_callback(xnet_unpacker_t *up, void *arg) {
-	xnet_httprequest_t *req = (xnet_httprequest_t *) arg;
+sizebuffer_callback(xnet_unpacker_t *up, void *arg) {
+	xnet_sizebuffer_t *sb = (xnet_sizebuffer_t *)arg;
 	xnet_context_t *ctx = (xnet_context_t *)up->user_ptr;
 	int sock_id = (long)up->user_arg;
 	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
 	lua_State *L = ctx->user_ptr;
 
+	//流水线中间级，帧内容交给下一级
+	if (up->next) {
+		xnet_unpacker_emit(up, sb->recv_buffer, sb->buffer_size);
+		return;
+	}
+
 	int ftype = lua_getfield(L, LUA_REGISTRYINDEX, "reg_funcs");
 	if (ftype != LUA_TTABLE) {
 		xnet_error(ctx, "reg_funcs is not a table %d", ftype);
@@ -232,66 +1264,96 @@ http_callback(xnet_unpacker_t *up, void *arg) {
 		xnet_error(ctx, "recv is not a function");
 		return;
 	}
-
-	int i;
 	lua_pushinteger(L, sock_id);
-	lua_pushinteger(L, XNET_PACKER_TYPE_HTTP);
-
-	lua_newtable(L);
-	lua_pushinteger(L, req->code);
-	lua_setfield(L, -2, "code");
-	lua_pushstring(L, xnet_string_get_c_str(&req->method));
-	lua_setfield(L, -2, "method");
-	lua_pushstring(L, xnet_string_get_c_str(&req->url));
-	lua_setfield(L, -2, "url");
-	lua_pushstring(L, xnet_string_get_c_str(&req->version));
-	lua_setfield(L, -2, "version");	
-
-	lua_newtable(L);
-	for (i=0; i<req->header_count; i++) {
-		lua_pushstring(L, xnet_string_get_c_str(&req->header[i].value));
-		lua_setfield(L, -2, xnet_string_get_c_str(&req->header[i].key));
-	}
-	lua_setfield(L, -2, "header");
-
-	if (req->body) {
-		lua_pushstring(L, xnet_string_get_c_str(req->body));
-		lua_setfield(L, -2, "body");
-	}
-	
-	lua_pushnil(L);
+	lua_pushinteger(L, XNET_PACKER_TYPE_SIZEBUFFER);
+	lua_pushlstring(L, sb->recv_buffer, sb->buffer_size);
+	lua_pushinteger(L, sb->buffer_size);
 	lua_pushlstring(L, (char*)&s->addr_info, sizeof(xnet_addr_t));
 	if (lua_pcall(L, 5, 0, 0) != LUA_OK) {
-		xnet_error(ctx, "http call recv error:%s", lua_tostring(L, -1));
+		xnet_error(ctx, "sizebuffer call recv error:%s", lua_tostring(L, -1));
 	}
 }
 
 static void
-sizebuffer_callback(xnet_unpacker_t *up, void *arg) {
-	xnet_sizebuffer_t *sb = (xnet_sizebuffer_t *)arg;
+lengthfield_callback(xnet_unpacker_t *up, void *arg) {
+	xnet_lengthfield_t *lf = (xnet_lengthfield_t *)arg;
 	xnet_context_t *ctx = (xnet_context_t *)up->user_ptr;
 	int sock_id = (long)up->user_arg;
 	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
 	lua_State *L = ctx->user_ptr;
+	int top = lua_gettop(L);
 
-	int ftype = lua_getfield(L, LUA_REGISTRYINDEX, "reg_funcs");
-	if (ftype != LUA_TTABLE) {
-		xnet_error(ctx, "reg_funcs is not a table %d", ftype);
+	if (up->next) {
+		xnet_unpacker_emit(up, lf->data, lf->size);
 		return;
 	}
 
-	if (lua_getfield(L, -1, "recv") != LUA_TFUNCTION) {
+	if (lua_getfield(L, LUA_REGISTRYINDEX, "reg_funcs") == LUA_TTABLE &&
+		lua_getfield(L, -1, "recv") == LUA_TFUNCTION) {
+		lua_pushinteger(L, sock_id);
+		lua_pushinteger(L, XNET_PACKER_TYPE_LENGTHFIELD);
+		lua_pushlstring(L, lf->size ? lf->data : "", lf->size);
+		lua_pushinteger(L, lf->size);
+		lua_pushlstring(L, (char*)&s->addr_info, sizeof(xnet_addr_t));
+		if (lua_pcall(L, 5, 0, 0) != LUA_OK) {
+			xnet_error(ctx, "lengthfield call recv error:%s", lua_tostring(L, -1));
+		}
+	} else {
 		xnet_error(ctx, "recv is not a function");
-		return;
 	}
-	lua_pushinteger(L, sock_id);
-	lua_pushinteger(L, XNET_PACKER_TYPE_SIZEBUFFER);
-	lua_pushlstring(L, sb->recv_buffer, sb->buffer_size);
-	lua_pushinteger(L, sb->buffer_size);
-	lua_pushlstring(L, (char*)&s->addr_info, sizeof(xnet_addr_t));
-	if (lua_pcall(L, 5, 0, 0) != LUA_OK) {
-		xnet_error(ctx, "sizebuffer call recv error:%s", lua_tostring(L, -1));
+	lua_settop(L, top);
+}
+
+//recv(sid, XNET_PACKER_TYPE_RESP, value, sz, addr)，sz为消息的字节数
+static void
+resp_callback(xnet_unpacker_t *up, void *arg) {
+	xnet_resp_t *r = (xnet_resp_t *)arg;
+	xnet_context_t *ctx = (xnet_context_t *)up->user_ptr;
+	int sock_id = (long)up->user_arg;
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	lua_State *L = ctx->user_ptr;
+	int top = lua_gettop(L);
+	uint32_t i = 0;
+
+	if (lua_getfield(L, LUA_REGISTRYINDEX, "reg_funcs") == LUA_TTABLE &&
+		lua_getfield(L, -1, "recv") == LUA_TFUNCTION) {
+		lua_pushinteger(L, sock_id);
+		lua_pushinteger(L, XNET_PACKER_TYPE_RESP);
+		push_resp_elem(L, r->elems, &i);
+		lua_pushinteger(L, r->pos);
+		lua_pushlstring(L, (char*)&s->addr_info, sizeof(xnet_addr_t));
+		if (lua_pcall(L, 5, 0, 0) != LUA_OK) {
+			xnet_error(ctx, "resp call recv error:%s", lua_tostring(L, -1));
+		}
+	} else {
+		xnet_error(ctx, "recv is not a function");
+	}
+	lua_settop(L, top);
+}
+
+static void
+memcache_callback(xnet_unpacker_t *up, void *arg) {
+	xnet_memcache_t *mc = (xnet_memcache_t *)arg;
+	xnet_context_t *ctx = (xnet_context_t *)up->user_ptr;
+	int sock_id = (long)up->user_arg;
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	lua_State *L = ctx->user_ptr;
+	int top = lua_gettop(L);
+
+	if (lua_getfield(L, LUA_REGISTRYINDEX, "reg_funcs") == LUA_TTABLE &&
+		lua_getfield(L, -1, "recv") == LUA_TFUNCTION) {
+		lua_pushinteger(L, sock_id);
+		lua_pushinteger(L, XNET_PACKER_TYPE_MEMCACHE);
+		push_memcache(L, mc);
+		lua_pushinteger(L, mc->need);
+		lua_pushlstring(L, (char*)&s->addr_info, sizeof(xnet_addr_t));
+		if (lua_pcall(L, 5, 0, 0) != LUA_OK) {
+			xnet_error(ctx, "memcache call recv error:%s", lua_tostring(L, -1));
+		}
+	} else {
+		xnet_error(ctx, "recv is not a function");
 	}
+	lua_settop(L, top);
 }
 
 static void
@@ -302,6 +1364,11 @@ linebuffer_callback(xnet_unpacker_t *up, void *arg) {
 	lua_State *L = ctx->user_ptr;
 	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
 
+	if (up->next) {
+		xnet_unpacker_emit(up, xnet_string_get_str(&lb->line_str), xnet_string_get_size(&lb->line_str));
+		return;
+	}
+
 	int ftype = lua_getfield(L, LUA_REGISTRYINDEX, "reg_funcs");
 	if (ftype != LUA_TTABLE) {
 		xnet_error(ctx, "reg_funcs is not a table %d", ftype);
@@ -314,8 +1381,8 @@ linebuffer_callback(xnet_unpacker_t *up, void *arg) {
 	}
 	lua_pushinteger(L, sock_id);
 	lua_pushinteger(L, XNET_PACKER_TYPE_LINE);
-	lua_pushstring(L, xnet_string_get_c_str(&lb->line_str));
-	lua_pushnil(L);
+	lua_pushlstring(L, xnet_string_get_str(&lb->line_str), xnet_string_get_size(&lb->line_str));
+	lua_pushinteger(L, xnet_string_get_size(&lb->line_str));
 	lua_pushlstring(L, (char*)&s->addr_info, sizeof(xnet_addr_t));
 	if (lua_pcall(L, 5, 0, 0) != LUA_OK) {
 		xnet_error(ctx, "linebuffer call recv error:%s", lua_tostring(L, -1));
@@ -323,42 +1390,509 @@ linebuffer_callback(xnet_unpacker_t *up, void *arg) {
 }
 
 
-static int
-_register_packer(lua_State *L) {
-	GET_XNET_CTX
-	int sock_id = luaL_checkinteger(L, 1);
-	int pack_type = luaL_checkinteger(L, 2);
-
-	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
-	if (s == NULL) {
-		luaL_error(L, "error sock id: %s", sock_id);
+//流水线中的第pos级(从1开始)，pos为0时返回最后一级
+static xnet_unpacker_t *
+get_packer_stage(xnet_socket_t *s, lua_Integer pos) {
+	xnet_unpacker_t *up = s->unpacker;
+	lua_Integer i;
+	if (up == NULL) return NULL;
+	if (pos <= 0) {
+		while (up->next) up = up->next;
+		return up;
 	}
+	for (i=1; up && i<pos; i++)
+		up = up->next;
+	return up;
+}
 
-	if (s->unpacker) {
-		luaL_error(L, "already register pack type");
+//解包器的参数，register_packer和协议探测共用
+typedef struct {
+	int type;
+	lua_Integer limit;
+	bool stream;
+	xnet_lengthfield_conf_t lf_conf;
+	char delim[XNET_LINE_DELIM_MAX];
+	uint32_t delim_sz;
+} packer_conf_t;
+
+/*
+ * 从idx开始依次为type, limit, opt，参数错误时抛出lua错误。
+ * opt：stream为true时http body流式回调，lengthfield为帧格式，line为分隔符
+ */
+static void
+check_packer_conf(lua_State *L, int idx, packer_conf_t *conf) {
+	size_t delim_sz;
+	const char *delim;
+
+	memset(conf, 0, sizeof(*conf));
+	conf->type = (int)luaL_checkinteger(L, idx);
+	//包大小限制，http为body大小限制
+	conf->limit = luaL_optinteger(L, idx + 1, -1);
+	switch (conf->type) {
+		case XNET_PACKER_TYPE_HTTP:
+			conf->stream = lua_toboolean(L, idx + 2);
+		break;
+		case XNET_PACKER_TYPE_LINE:
+			if (lua_type(L, idx + 2) == LUA_TSTRING) {
+				delim = lua_tolstring(L, idx + 2, &delim_sz);
+				if (delim_sz == 0 || delim_sz > XNET_LINE_DELIM_MAX)
+					luaL_error(L, "line delimiter size must be in [1, %d]", XNET_LINE_DELIM_MAX);
+				memcpy(conf->delim, delim, delim_sz);
+				conf->delim_sz = (uint32_t)delim_sz;
+			}
+		break;
+		case XNET_PACKER_TYPE_LENGTHFIELD:
+			check_lengthfield_conf(L, idx + 2, &conf->lf_conf);
+		break;
+		case XNET_PACKER_TYPE_SIZEBUFFER:
+		case XNET_PACKER_TYPE_WEBSOCKET:
+		case XNET_PACKER_TYPE_RESP:
+		case XNET_PACKER_TYPE_MEMCACHE:
+		case XNET_PACKER_TYPE_HTTP2:
+		break;
+		default:
+			luaL_error(L, "unknow pack type %d", conf->type);
 	}
+}
 
+static xnet_unpacker_t *
+new_packer(xnet_context_t *ctx, int sock_id, const packer_conf_t *conf) {
 	xnet_unpacker_t *up = NULL;
-	switch (pack_type) {
+	switch (conf->type) {
 		case XNET_PACKER_TYPE_HTTP:
-			up = xnet_unpacker_new(sizeof(xnet_httprequest_t), http_callback, xnet_unpack_http, xnet_clear_http, 1024);
+			up = xnet_unpacker_new_http(http_callback, 1024);
+			if (conf->stream) up->sm = http_stream;
 		break;
 		case XNET_PACKER_TYPE_SIZEBUFFER:
 			up = xnet_unpacker_new(sizeof(xnet_sizebuffer_t), sizebuffer_callback, xnet_unpack_sizebuffer, xnet_clear_sizebuffer, 0xFFFFFFFF);
 		break;
 		case XNET_PACKER_TYPE_LINE:
 			up = xnet_unpacker_new(sizeof(xnet_linebuffer_t), linebuffer_callback, xnet_unpack_line, xnet_clear_line, 1024);
+			if (up && conf->delim_sz)
+				xnet_set_line_delim((xnet_linebuffer_t *)up->arg, conf->delim, conf->delim_sz);
 		break;
-		default:
-			luaL_error(L, "unknow pack type %d", pack_type);
+		case XNET_PACKER_TYPE_WEBSOCKET:
+			up = new_websocket_unpacker(ctx, sock_id, 64*1024);
+		break;
+		case XNET_PACKER_TYPE_RESP:
+			up = xnet_unpacker_new(sizeof(xnet_resp_t), resp_callback, xnet_unpack_resp, xnet_clear_resp, 64*1024*1024);
+			if (up) up->fm = xnet_free_resp;
+		break;
+		case XNET_PACKER_TYPE_MEMCACHE:
+			up = xnet_unpacker_new(sizeof(xnet_memcache_t), memcache_callback, xnet_unpack_memcache, xnet_clear_memcache, 2*1024*1024);
+			if (up) up->fm = xnet_free_memcache;
+		break;
+		case XNET_PACKER_TYPE_HTTP2:
+			up = new_http2_unpacker(ctx, sock_id, 64*1024);
+		break;
+		case XNET_PACKER_TYPE_LENGTHFIELD:
+			up = xnet_unpacker_new(sizeof(xnet_lengthfield_t), lengthfield_callback, xnet_unpack_lengthfield, xnet_clear_lengthfield, 64*1024);
+			if (up) {
+				up->fm = xnet_free_lengthfield;
+				((xnet_lengthfield_t *)up->arg)->conf = conf->lf_conf;
+			}
+		break;
+	}
+	if (up == NULL) return NULL;
+	if (conf->limit >= 0) up->limit = (uint32_t)conf->limit;
+	up->user_ptr = ctx;
+	up->user_arg = (void*)(long)sock_id;
+	return up;
+}
+
+/*
+ * register_packer(sid, type, limit, opt, pos)
+ * 已经注册过时新的解包器加入流水线，默认接在最后，前一级的输出交给它解包；
+ * pos指定插入后所在的级数(从1开始)。sizebuffer、lengthfield、line、websocket可以作为中间级
+ */
+static int
+_register_packer(lua_State *L) {
+	GET_XNET_CTX
+	int sock_id = luaL_checkinteger(L, 1);
+	lua_Integer pos = luaL_optinteger(L, 5, 0);
+	packer_conf_t conf;
+	xnet_unpacker_t *head, *prev, *up;
+
+	check_packer_conf(L, 2, &conf);
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	if (s == NULL) {
+		luaL_error(L, "error sock id: %s", sock_id);
+	}
+
+	prev = (pos == 1) ? NULL : get_packer_stage(s, pos - 1);
+	if (pos > 1 && prev == NULL) {
+		luaL_error(L, "packer stage %d out of range", (int)pos);
 	}
+
+	up = new_packer(ctx, sock_id, &conf);
 	if (up == NULL) {
 		luaL_error(L, "register pack type error");
 	}
+	head = s->unpacker;
+	xnet_unpacker_insert(&head, prev, up);
+	s->unpacker = head;
+
+	return 0;
+}
+
+/*
+ * remove_packer(sid, pos)，移除流水线的第pos级(默认第一级)，返回是否移除。
+ * 在该级的回调中调用时，本次接收中剩余的数据交给下一级，例如解析完PROXY头之后
+ */
+static int
+_remove_packer(lua_State *L) {
+	GET_XNET_CTX
+	int sock_id = luaL_checkinteger(L, 1);
+	lua_Integer pos = luaL_optinteger(L, 2, 1);
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	xnet_unpacker_t *head, *up;
+
+	if (s == NULL || pos < 1 || (up = get_packer_stage(s, pos)) == NULL) {
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	head = s->unpacker;
+	xnet_unpacker_remove(&head, up);
+	s->unpacker = head;
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+/*
+ * 不解包的一级，用在协议探测或者PROXY头之后，数据原样回调
+ * recv(sid, XNET_PACKER_TYPE_NORMAL, data, sz, addr)，和没有解包器时相同
+ */
+typedef struct {
+	const char *data;
+	uint32_t size;
+} normal_buffer_t;
+
+static uint32_t
+unpack_normal(xnet_unpacker_t *up, const char *buffer, uint32_t sz) {
+	normal_buffer_t *nb = (normal_buffer_t *)up->arg;
+	nb->data = buffer;
+	nb->size = sz;
+	up->full = true;
+	return sz;
+}
+
+static void
+clear_normal(void *arg) {
+	memset(arg, 0, sizeof(normal_buffer_t));
+}
+
+static void
+normal_callback(xnet_unpacker_t *up, void *arg) {
+	normal_buffer_t *nb = (normal_buffer_t *)arg;
+	xnet_context_t *ctx = (xnet_context_t *)up->user_ptr;
+	int sock_id = (long)up->user_arg;
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	lua_State *L = ctx->user_ptr;
+	int top = lua_gettop(L);
+
+	if (lua_getfield(L, LUA_REGISTRYINDEX, "reg_funcs") == LUA_TTABLE &&
+		lua_getfield(L, -1, "recv") == LUA_TFUNCTION) {
+		lua_pushinteger(L, sock_id);
+		lua_pushinteger(L, XNET_PACKER_TYPE_NORMAL);
+		lua_pushlstring(L, nb->data, nb->size);
+		lua_pushinteger(L, nb->size);
+		lua_pushlstring(L, (char*)&s->addr_info, sizeof(xnet_addr_t));
+		if (lua_pcall(L, 5, 0, 0) != LUA_OK) {
+			xnet_error(ctx, "call recv error:%s", lua_tostring(L, -1));
+		}
+	}
+	lua_settop(L, top);
+}
+
+static xnet_unpacker_t *
+new_normal_unpacker(xnet_context_t *ctx, int sock_id) {
+	xnet_unpacker_t *up = xnet_unpacker_new(sizeof(normal_buffer_t), normal_callback, unpack_normal, clear_normal, 0);
+	up->user_ptr = ctx;
+	up->user_arg = (void*)(long)sock_id;
+	return up;
+}
+
+/*
+ * 协议探测规则，每个监听socket一份，新连接的探测解包器引用它，
+ * 用引用计数保证监听socket换了规则或者关闭之后，还在探测的连接仍然可以使用
+ */
+#define SNIFF_PACKER_CLOSE (-1)
+typedef struct {
+	int ref;
+	xnet_sniff_table_t table;
+	packer_conf_t packers[XNET_SNIFF_MAX + 1];//下标为规则的序号，最后一个在都不匹配时使用
+} sniff_rules_t;
+
+#define SNIFF_RULES(t) ((sniff_rules_t *)((char *)(t) - offsetof(sniff_rules_t, table)))
+
+static void
+sniff_rules_release(sniff_rules_t *rules) {
+	if (rules && --rules->ref == 0)
+		free(rules);
+}
+
+static sniff_rules_t *
+get_sniff_rules(lua_State *L, int sock_id) {
+	sniff_rules_t *rules = NULL;
+	int top = lua_gettop(L);
+	if (lua_getfield(L, LUA_REGISTRYINDEX, "sniff_rules") == LUA_TTABLE &&
+		lua_rawgeti(L, -1, sock_id) == LUA_TLIGHTUSERDATA)
+		rules = (sniff_rules_t *)lua_touserdata(L, -1);
+	lua_settop(L, top);
+	return rules;
+}
+
+static void
+set_sniff_rules(lua_State *L, int sock_id, sniff_rules_t *rules) {
+	sniff_rules_release(get_sniff_rules(L, sock_id));
+	if (lua_getfield(L, LUA_REGISTRYINDEX, "sniff_rules") != LUA_TTABLE) {
+		lua_pop(L, 1);
+		lua_newtable(L);
+		lua_pushvalue(L, -1);
+		lua_setfield(L, LUA_REGISTRYINDEX, "sniff_rules");
+	}
+	if (rules)
+		lua_pushlightuserdata(L, rules);
+	else
+		lua_pushnil(L);
+	lua_rawseti(L, -2, sock_id);
+	lua_pop(L, 1);
+}
+
+//监听socket关闭时取消探测
+static void
+sniff_close(lua_State *L, int sock_id) {
+	if (get_sniff_rules(L, sock_id))
+		set_sniff_rules(L, sock_id, NULL);
+}
+
+static void
+sniff_free(void *arg) {
+	xnet_sniff_t *sn = (xnet_sniff_t *)arg;
+	const xnet_sniff_table_t *t = sn->table;
+	xnet_free_sniff(arg);
+	sniff_rules_release(SNIFF_RULES(t));
+}
+
+//换成规则对应的解包器，收到的数据交给它
+static void
+sniff_callback(xnet_unpacker_t *up, void *arg) {
+	xnet_sniff_t *sn = (xnet_sniff_t *)arg;
+	xnet_context_t *ctx = (xnet_context_t *)up->user_ptr;
+	int sock_id = (long)up->user_arg;
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	sniff_rules_t *rules = SNIFF_RULES(sn->table);
+	const packer_conf_t *conf = &rules->packers[sn->proto >= 0 ? sn->proto : XNET_SNIFF_MAX];
+	xnet_unpacker_t *head = s->unpacker;
+	xnet_unpacker_t *next = NULL;
+
+	if (conf->type == XNET_PACKER_TYPE_NORMAL)
+		next = new_normal_unpacker(ctx, sock_id);
+	else if (conf->type != SNIFF_PACKER_CLOSE)
+		next = new_packer(ctx, sock_id, conf);
+	if (next == NULL) {
+		xnet_sniff_forward(&head, up, NULL);
+		s->unpacker = head;
+	} else {
+		//转发前先更新流水线，下一级在回调中可能替换自己(websocket、http2升级)
+		xnet_unpacker_replace(&head, up, next);
+		s->unpacker = head;
+		xnet_unpacker_emit(up, sn->data, sn->size);
+	}
+	if (conf->type == SNIFF_PACKER_CLOSE)
+		xnet_close_socket(ctx, sock_id);
+}
+
+//新连接的listen回调中没有注册解包器时，按监听socket的规则先探测协议
+static void
+sniff_accept(xnet_context_t *ctx, lua_State *L, int listen_id, int sock_id) {
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	sniff_rules_t *rules;
+	xnet_unpacker_t *up;
+
+	if (s == NULL || s->type == SOCKET_TYPE_INVALID || s->closing || s->unpacker)
+		return;
+	rules = get_sniff_rules(L, listen_id);
+	if (rules == NULL)
+		return;
+	up = xnet_unpacker_new(sizeof(xnet_sniff_t), sniff_callback, xnet_unpack_sniff, xnet_clear_sniff, 0);
+	up->fm = sniff_free;
+	up->user_ptr = ctx;
+	up->user_arg = (void*)(long)sock_id;
+	((xnet_sniff_t *)up->arg)->table = &rules->table;
+	rules->ref++;
+	s->unpacker = up;
+}
+
+/*
+ * PROXY protocol：开启的监听socket上，新连接的流水线前面加一级PROXY头解析，
+ * 解析完用代理前的客户端地址替换socket的addr_info，然后移除这一级，
+ * 之后的recv回调中addr为真实的客户端地址(listen回调时还是负载均衡的地址)
+ */
+static void
+proxyproto_callback(xnet_unpacker_t *up, void *arg) {
+	xnet_proxyproto_t *pp = (xnet_proxyproto_t *)arg;
+	xnet_context_t *ctx = (xnet_context_t *)up->user_ptr;
+	int sock_id = (long)up->user_arg;
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	xnet_unpacker_t *head = s->unpacker;
+
+	if (pp->has_addr)
+		s->addr_info = pp->src;
+	xnet_unpacker_remove(&head, up);
+	s->unpacker = head;
+}
+
+//头部格式错误时不能再相信这个连接，直接关闭
+static uint32_t
+unpack_proxyproto(xnet_unpacker_t *up, const char *buffer, uint32_t sz) {
+	uint32_t ret = xnet_unpack_proxyproto(up, buffer, sz);
+	if (ret == 0)
+		xnet_close_socket((xnet_context_t *)up->user_ptr, (long)up->user_arg);
+	return ret;
+}
+
+//返回监听socket的头部长度限制，-1表示没有开启
+static lua_Integer
+get_proxyproto_limit(lua_State *L, int sock_id) {
+	lua_Integer limit = -1;
+	int top = lua_gettop(L);
+	if (lua_getfield(L, LUA_REGISTRYINDEX, "proxyproto_listeners") == LUA_TTABLE &&
+		lua_rawgeti(L, -1, sock_id) == LUA_TNUMBER)
+		limit = lua_tointeger(L, -1);
+	lua_settop(L, top);
+	return limit;
+}
+
+static void
+proxyproto_accept(xnet_context_t *ctx, lua_State *L, int listen_id, int sock_id) {
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	lua_Integer limit = get_proxyproto_limit(L, listen_id);
+	xnet_unpacker_t *head, *up;
+
+	if (limit < 0 || s == NULL || s->type == SOCKET_TYPE_INVALID || s->closing)
+		return;
+	up = xnet_unpacker_new(sizeof(xnet_proxyproto_t), proxyproto_callback, unpack_proxyproto, xnet_clear_proxyproto, (uint32_t)limit);
+	up->fm = xnet_free_proxyproto;
 	up->user_ptr = ctx;
 	up->user_arg = (void*)(long)sock_id;
-	s->unpacker = up;	
+	//没有注册解包器时，头部之后的数据原样回调
+	head = s->unpacker ? (xnet_unpacker_t *)s->unpacker : new_normal_unpacker(ctx, sock_id);
+	xnet_unpacker_insert(&head, NULL, up);
+	s->unpacker = head;
+}
+
+static void
+set_proxyproto_limit(lua_State *L, int sock_id, lua_Integer limit) {
+	if (lua_getfield(L, LUA_REGISTRYINDEX, "proxyproto_listeners") != LUA_TTABLE) {
+		lua_pop(L, 1);
+		lua_newtable(L);
+		lua_pushvalue(L, -1);
+		lua_setfield(L, LUA_REGISTRYINDEX, "proxyproto_listeners");
+	}
+	if (limit >= 0)
+		lua_pushinteger(L, limit);
+	else
+		lua_pushnil(L);
+	lua_rawseti(L, -2, sock_id);
+	lua_pop(L, 1);
+}
+
+//监听socket关闭时关闭PROXY protocol
+static void
+proxyproto_close(lua_State *L, int sock_id) {
+	if (get_proxyproto_limit(L, sock_id) >= 0)
+		set_proxyproto_limit(L, sock_id, -1);
+}
+
+/*
+ * proxy_protocol(listen_sid, enable, limit)，监听socket上的连接都以PROXY protocol v1或v2头开始，
+ * 头部格式错误时关闭连接；limit限制v2头部(含TLV)的长度，默认4096
+ */
+static int
+_xnet_proxy_protocol(lua_State *L) {
+	int sock_id = (int)luaL_checkinteger(L, 1);
+	lua_Integer limit = luaL_optinteger(L, 3, 4096);
+	luaL_argcheck(L, limit >= XNET_PROXY_V2_HEADER, 3, "limit is too small");
+	set_proxyproto_limit(L, sock_id, lua_toboolean(L, 2) ? limit : -1);
+	return 0;
+}
 
+//table[first], table[first+1], table[first+2]为type, limit, opt，type为false或nil时关闭连接
+static void
+check_sniff_packer(lua_State *L, int idx, int first, packer_conf_t *conf) {
+	lua_geti(L, idx, first);
+	lua_geti(L, idx, first + 1);
+	lua_geti(L, idx, first + 2);
+	if (lua_isnoneornil(L, -3) || (lua_isboolean(L, -3) && !lua_toboolean(L, -3))) {
+		memset(conf, 0, sizeof(*conf));
+		conf->type = SNIFF_PACKER_CLOSE;
+	} else if (lua_isinteger(L, -3) && lua_tointeger(L, -3) == XNET_PACKER_TYPE_NORMAL) {
+		memset(conf, 0, sizeof(*conf));
+		conf->type = XNET_PACKER_TYPE_NORMAL;
+	} else {
+		check_packer_conf(L, lua_gettop(L) - 2, conf);
+	}
+	lua_pop(L, 3);
+}
+
+/*
+ * sniff(listen_sid, rules, default)，为监听socket设置协议探测，rules为nil时取消。
+ * rules的每一项为{match, type, limit, opt, offset}，按顺序有优先级：
+ * match为内置签名(xnet.SNIFF_HTTP、SNIFF_TLS、SNIFF_PROXY、SNIFF_HTTP2)或者出现在offset处的魔数字符串，
+ * type, limit, opt同register_packer，type为PACKER_TYPE_NORMAL时不解包，为false时关闭连接；
+ * default为{type, limit, opt}，都不匹配时使用，默认关闭连接
+ */
+static int
+_xnet_sniff(lua_State *L) {
+	int sock_id = (int)luaL_checkinteger(L, 1);
+	sniff_rules_t *rules, *tmp;
+	lua_Integer n, i, offset;
+	size_t magic_sz;
+	const char *magic;
+	int ret;
+
+	if (lua_isnoneornil(L, 2)) {
+		set_sniff_rules(L, sock_id, NULL);
+		return 0;
+	}
+	luaL_checktype(L, 2, LUA_TTABLE);
+	n = luaL_len(L, 2);
+	luaL_argcheck(L, n > 0 && n <= XNET_SNIFF_MAX, 2, "rule count out of range");
+	//先在userdata中解析，出错时由gc回收
+	tmp = (sniff_rules_t *)lua_newuserdata(L, sizeof(sniff_rules_t));
+	memset(tmp, 0, sizeof(*tmp));
+	for (i=1; i<=n; i++) {
+		lua_geti(L, 2, i);
+		luaL_argcheck(L, lua_type(L, -1) == LUA_TTABLE, 2, "rule must be a table");
+		check_sniff_packer(L, lua_gettop(L), 2, &tmp->packers[i-1]);
+		lua_geti(L, -1, 1);
+		if (lua_type(L, -1) == LUA_TSTRING) {
+			magic = lua_tolstring(L, -1, &magic_sz);
+			lua_geti(L, -2, 5);
+			offset = luaL_optinteger(L, -1, 0);
+			luaL_argcheck(L, offset >= 0 && offset <= 255, 2, "offset must be in [0, 255]");
+			luaL_argcheck(L, magic_sz <= XNET_SNIFF_MAGIC_MAX, 2, "magic is too long");
+			ret = xnet_sniff_add(&tmp->table, (int)(i-1), magic, (uint8_t)magic_sz, (uint8_t)offset);
+			lua_pop(L, 1);
+		} else {
+			ret = xnet_sniff_add_builtin(&tmp->table, (int)luaL_checkinteger(L, -1), (int)(i-1));
+		}
+		if (ret != 0)
+			return luaL_error(L, "sniff rule %d error", (int)i);
+		lua_pop(L, 2);
+	}
+	if (lua_type(L, 3) == LUA_TTABLE)
+		check_sniff_packer(L, 3, 1, &tmp->packers[XNET_SNIFF_MAX]);
+	else
+		tmp->packers[XNET_SNIFF_MAX].type = SNIFF_PACKER_CLOSE;
+
+	rules = malloc(sizeof(sniff_rules_t));
+	if (rules == NULL)
+		return luaL_error(L, "sniff rules out of memory");
+	memcpy(rules, tmp, sizeof(sniff_rules_t));
+	rules->ref = 1;
+	set_sniff_rules(L, sock_id, rules);
 	return 0;
 }
 
@@ -422,6 +1956,7 @@ _xnet_error(lua_State *L) {
 	return 0;
 }
 
+//单调时钟，毫秒
 static int
 _xnet_now(lua_State *L) {
 	uint64_t nowtime = get_time();
@@ -429,6 +1964,22 @@ _xnet_now(lua_State *L) {
 	return 1;
 }
 
+//单调时钟，微秒
+static int
+_xnet_now_us(lua_State *L) {
+	uint64_t nowtime = get_time_us();
+	lua_pushinteger(L, nowtime);
+	return 1;
+}
+
+//unix时间，毫秒
+static int
+_xnet_wall_time(lua_State *L) {
+	uint64_t walltime = get_wall_time();
+	lua_pushinteger(L, walltime);
+	return 1;
+}
+
 static void
 xnet_bind_lua(lua_State *L, xnet_context_t *ctx, xnet_config_t *config) {
 	ctx->user_ptr = L;
@@ -455,6 +2006,45 @@ xnet_bind_lua(lua_State *L, xnet_context_t *ctx, xnet_config_t *config) {
 	lua_pushcfunction(L, _xnet_tcp_send_buffer);
 	lua_setfield(L, -2, "tcp_send_buffer");
 
+	//xnet_http_write_chunk
+	lua_pushcfunction(L, _xnet_http_write_chunk);
+	lua_setfield(L, -2, "http_write_chunk");
+
+	//xnet_http_end
+	lua_pushcfunction(L, _xnet_http_end);
+	lua_setfield(L, -2, "http_end");
+
+	//websocket
+	lua_pushcfunction(L, _xnet_websocket_upgrade);
+	lua_setfield(L, -2, "websocket_upgrade");
+	lua_pushcfunction(L, _xnet_http2_upgrade);
+	lua_setfield(L, -2, "http2_upgrade");
+	lua_pushcfunction(L, _xnet_websocket_send);
+	lua_setfield(L, -2, "websocket_send");
+
+	lua_pushcfunction(L, _xnet_pack_lengthfield);
+	lua_setfield(L, -2, "pack_lengthfield");
+	lua_pushcfunction(L, _xnet_pack_resp);
+	lua_setfield(L, -2, "pack_resp");
+	lua_pushcfunction(L, _xnet_pack_resp_reply);
+	lua_setfield(L, -2, "pack_resp_reply");
+	lua_pushcfunction(L, _xnet_pack_mc_value);
+	lua_setfield(L, -2, "pack_mc_value");
+	lua_pushcfunction(L, _xnet_pack_mc_binary);
+	lua_setfield(L, -2, "pack_mc_binary");
+
+	//xnet_pack_http_head
+	lua_pushcfunction(L, _xnet_pack_http);
+	lua_setfield(L, -2, "pack_http");
+
+	//xnet_http_respond
+	lua_pushcfunction(L, _xnet_http_respond);
+	lua_setfield(L, -2, "http_respond");
+
+	//xnet_http_request
+	lua_pushcfunction(L, _xnet_http_request);
+	lua_setfield(L, -2, "http_request");
+
 	//xnet_udp_listen
 	lua_pushcfunction(L, _xnet_udp_listen);
 	lua_setfield(L, -2, "udp_listen");
@@ -478,9 +2068,30 @@ xnet_bind_lua(lua_State *L, xnet_context_t *ctx, xnet_config_t *config) {
 	//xnet_close_socket
 	lua_pushcfunction(L, _xnet_close_socket);
 	lua_setfield(L, -2, "close_socket");
+	//xnet_set_cork
+	lua_pushcfunction(L, _xnet_set_cork);
+	lua_setfield(L, -2, "set_cork");
+	//xnet_set_read_budget
+	lua_pushcfunction(L, _xnet_set_read_budget);
+	lua_setfield(L, -2, "set_read_budget");
+	//xnet_flush
+	lua_pushcfunction(L, _xnet_flush);
+	lua_setfield(L, -2, "flush");
+	//xnet_set_watermark
+	lua_pushcfunction(L, _xnet_set_watermark);
+	lua_setfield(L, -2, "set_watermark");
+	//xnet_set_read_link
+	lua_pushcfunction(L, _xnet_set_read_link);
+	lua_setfield(L, -2, "set_read_link");
+	//xnet_set_conn_timeout
+	lua_pushcfunction(L, _xnet_set_conn_timeout);
+	lua_setfield(L, -2, "set_conn_timeout");
 	//xnet_add_timer
 	lua_pushcfunction(L, _xnet_add_timer);
 	lua_setfield(L, -2, "add_timer");
+	//xnet_add_timer_us
+	lua_pushcfunction(L, _xnet_add_timer_us);
+	lua_setfield(L, -2, "add_timer_us");
 	//xnet_exit
 	lua_pushcfunction(L, _xnet_exit);
 	lua_setfield(L, -2, "exit");
@@ -496,6 +2107,18 @@ xnet_bind_lua(lua_State *L, xnet_context_t *ctx, xnet_config_t *config) {
 	//register_packer
 	lua_pushcfunction(L, _register_packer);
 	lua_setfield(L, -2, "register_packer");
+	lua_pushcfunction(L, _remove_packer);
+	lua_setfield(L, -2, "remove_packer");
+	lua_pushcfunction(L, _xnet_sniff);
+	lua_setfield(L, -2, "sniff");
+	lua_pushcfunction(L, _xnet_proxy_protocol);
+	lua_setfield(L, -2, "proxy_protocol");
+	lua_pushcfunction(L, _xnet_static_init);
+	lua_setfield(L, -2, "static_init");
+	lua_pushcfunction(L, _xnet_static_serve);
+	lua_setfield(L, -2, "static_serve");
+	lua_pushcfunction(L, _xnet_http_route);
+	lua_setfield(L, -2, "http_route");
 
 	//config interface
 	lua_pushcfunction(L, _get_env);
@@ -508,6 +2131,42 @@ xnet_bind_lua(lua_State *L, xnet_context_t *ctx, xnet_config_t *config) {
 	lua_setfield(L, -2, "PACKER_TYPE_SIZEBUFFER");
 	lua_pushinteger(L, XNET_PACKER_TYPE_LINE);
 	lua_setfield(L, -2, "PACKER_TYPE_LINE");
+	lua_pushinteger(L, XNET_PACKER_TYPE_HTTP_BODY);
+	lua_setfield(L, -2, "PACKER_TYPE_HTTP_BODY");
+	lua_pushinteger(L, XNET_PACKER_TYPE_WEBSOCKET);
+	lua_setfield(L, -2, "PACKER_TYPE_WEBSOCKET");
+	lua_pushinteger(L, XNET_PACKER_TYPE_LENGTHFIELD);
+	lua_setfield(L, -2, "PACKER_TYPE_LENGTHFIELD");
+	lua_pushinteger(L, XNET_PACKER_TYPE_RESP);
+	lua_setfield(L, -2, "PACKER_TYPE_RESP");
+	lua_pushlightuserdata(L, NULL);
+	lua_setfield(L, -2, "RESP_NULL");
+	lua_pushinteger(L, XNET_PACKER_TYPE_MEMCACHE);
+	lua_setfield(L, -2, "PACKER_TYPE_MEMCACHE");
+	lua_pushinteger(L, XNET_PACKER_TYPE_HTTP2);
+	lua_setfield(L, -2, "PACKER_TYPE_HTTP2");
+	lua_pushinteger(L, XNET_PACKER_TYPE_NORMAL);
+	lua_setfield(L, -2, "PACKER_TYPE_NORMAL");
+	lua_pushinteger(L, XNET_SNIFF_HTTP);
+	lua_setfield(L, -2, "SNIFF_HTTP");
+	lua_pushinteger(L, XNET_SNIFF_TLS);
+	lua_setfield(L, -2, "SNIFF_TLS");
+	lua_pushinteger(L, XNET_SNIFF_PROXY);
+	lua_setfield(L, -2, "SNIFF_PROXY");
+	lua_pushinteger(L, XNET_SNIFF_HTTP2);
+	lua_setfield(L, -2, "SNIFF_HTTP2");
+
+	//websocket opcode
+	lua_pushinteger(L, XNET_WS_TEXT);
+	lua_setfield(L, -2, "WS_TEXT");
+	lua_pushinteger(L, XNET_WS_BINARY);
+	lua_setfield(L, -2, "WS_BINARY");
+	lua_pushinteger(L, XNET_WS_CLOSE);
+	lua_setfield(L, -2, "WS_CLOSE");
+	lua_pushinteger(L, XNET_WS_PING);
+	lua_setfield(L, -2, "WS_PING");
+	lua_pushinteger(L, XNET_WS_PONG);
+	lua_setfield(L, -2, "WS_PONG");
 
 	//protocol type
 	lua_pushinteger(L, SOCKET_PROTOCOL_TCP);
@@ -517,6 +2176,22 @@ xnet_bind_lua(lua_State *L, xnet_context_t *ctx, xnet_config_t *config) {
 	lua_pushinteger(L, SOCKET_PROTOCOL_UDP_IPV6);
 	lua_setfield(L, -2, "PROTOCOL_UDP_IPV6");
 
+	//error what
+	lua_pushinteger(L, XNET_ERROR_CLOSE);
+	lua_setfield(L, -2, "ERROR_CLOSE");
+	lua_pushinteger(L, XNET_ERROR_POLL);
+	lua_setfield(L, -2, "ERROR_POLL");
+	lua_pushinteger(L, XNET_ERROR_EOF);
+	lua_setfield(L, -2, "ERROR_EOF");
+	lua_pushinteger(L, XNET_ERROR_WB_OVERFLOW);
+	lua_setfield(L, -2, "ERROR_WB_OVERFLOW");
+	lua_pushinteger(L, XNET_ERROR_READ_TIMEOUT);
+	lua_setfield(L, -2, "ERROR_READ_TIMEOUT");
+	lua_pushinteger(L, XNET_ERROR_WRITE_TIMEOUT);
+	lua_setfield(L, -2, "ERROR_WRITE_TIMEOUT");
+	lua_pushinteger(L, XNET_ERROR_LIFE_TIMEOUT);
+	lua_setfield(L, -2, "ERROR_LIFE_TIMEOUT");
+
 	//error
 	lua_pushcfunction(L, _xnet_error);
 	lua_setfield(L, -2, "error");
@@ -524,6 +2199,34 @@ xnet_bind_lua(lua_State *L, xnet_context_t *ctx, xnet_config_t *config) {
 	//now
 	lua_pushcfunction(L, _xnet_now);
 	lua_setfield(L, -2, "now");
+	lua_pushcfunction(L, _xnet_now_us);
+	lua_setfield(L, -2, "now_us");
+	lua_pushcfunction(L, _xnet_wall_time);
+	lua_setfield(L, -2, "wall_time");
 
 	lua_setglobal(L, "xnet");
 }
+
+//释放xnet_bind_lua之后创建的资源，未完成的http请求以nil回调
+static void
+xnet_release_lua(lua_State *L) {
+	xnet_httpclient_t *cli;
+	lua_getfield(L, LUA_REGISTRYINDEX, "xnet_httpclient");
+	cli = lua_touserdata(L, -1);
+	lua_pop(L, 1);
+	if (cli) {
+		xnet_httpclient_destroy(cli);
+		lua_pushnil(L);
+		lua_setfield(L, LUA_REGISTRYINDEX, "xnet_httpclient");
+	}
+	if (get_static(L)) {
+		xnet_static_destroy(get_static(L));
+		lua_pushnil(L);
+		lua_setfield(L, LUA_REGISTRYINDEX, "xnet_static");
+	}
+	if (get_router(L)) {
+		xnet_router_destroy(get_router(L));
+		lua_pushnil(L);
+		lua_setfield(L, LUA_REGISTRYINDEX, "xnet_router");
+	}
+}
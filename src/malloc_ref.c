@@ -26,6 +26,12 @@ mf_set_ref(void *ptr, REF_INT n) {
 	(*ref) = n;
 }
 
+REF_INT
+mf_get_ref(void *ptr) {
+	REF_INT *ref = (REF_INT *)(ptr-REF_SIZE);
+	return *ref;
+}
+
 void
 mf_free(void *ptr) {
 	REF_INT *ref = (REF_INT *)(ptr-REF_SIZE);
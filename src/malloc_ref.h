@@ -8,6 +8,7 @@
 void *mf_malloc(size_t size);
 void mf_add_ref(void *ptr);
 void mf_set_ref(void *ptr, REF_INT n);
+REF_INT mf_get_ref(void *ptr);
 void mf_free(void *ptr);
 
 #endif //_MALLOC_REF_C_
\ No newline at end of file
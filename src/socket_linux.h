@@ -1,6 +1,9 @@
 #ifndef _SOCKET_LINUX_H_
 #define _SOCKET_LINUX_H_
 
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+
 #define closesocket close
 #define XNET_EINTR EINTR
 
@@ -10,11 +13,12 @@
 	#define XNET_HAVE_WOULDBLOCK(err) ((err) == EWOULDBLOCK)
 #endif
 
+//epoll中保存socket id+1，socket slots扩容后指针会失效，0表示管道
 static int
-poll_add(SOCKET_TYPE efd, SOCKET_TYPE fd, void *ud) {
+poll_add(SOCKET_TYPE efd, SOCKET_TYPE fd, int id) {
 	struct epoll_event ev;
 	ev.events = EPOLLIN;
-	ev.data.ptr = ud;
+	ev.data.u64 = (uint64_t)(id + 1);
 	if (epoll_ctl(efd, EPOLL_CTL_ADD, fd, &ev) == -1) {
 		return 1;
 	}
@@ -34,7 +38,7 @@ poll_wait(xnet_poll_t *poll, int timeout) {
 	int n = epoll_wait(poll->epoll_fd, ev, POLL_EVENT_MAX, timeout);
 	
 	for (i=0;i<n;i++) {
-		poll_event->s[i] = ev[i].data.ptr;
+		poll_event->id[i] = (int)ev[i].data.u64 - 1;
 		unsigned flag = ev[i].events;
 		poll_event->write[i] = (flag & EPOLLOUT) != 0;
 		poll_event->read[i] = (flag & EPOLLIN) != 0;
@@ -55,7 +59,7 @@ poll_enable_write(xnet_poll_t *poll, xnet_socket_t *s, bool enable) {
     s->writing = enable;
 
 	ev.events = (s->reading ? EPOLLIN : 0) | (enable ? EPOLLOUT : 0);
-	ev.data.ptr = s;
+	ev.data.u64 = (uint64_t)(s->id + 1);
 
 	if (epoll_ctl(poll->epoll_fd, EPOLL_CTL_MOD, s->fd, &ev) == -1) {
 		return 1;
@@ -70,7 +74,7 @@ poll_enable_read(xnet_poll_t *poll, xnet_socket_t *s, bool enable) {
 	if (s->reading == enable) return 0;
 	s->reading = enable;    
 	ev.events = (enable ? EPOLLIN : 0) | (s->writing ? EPOLLOUT : 0);
-	ev.data.ptr = s;
+	ev.data.u64 = (uint64_t)(s->id + 1);
 	if (epoll_ctl(poll->epoll_fd, EPOLL_CTL_MOD, s->fd, &ev) == -1) {
 		return 1;
 	}
@@ -86,4 +90,35 @@ poll_set_nonblocking(SOCKET_TYPE fd) {
         fcntl(fd, F_SETFL, flag | O_NONBLOCK);
 }
 
+typedef struct iovec xnet_iovec_t;
+#define XNET_IOV_SET(v, p, l) ((v).iov_base = (p), (v).iov_len = (l))
+
+//more为true时后面紧接着sendfile，MSG_MORE让内核把两部分合并成完整的报文再发送
+static int
+poll_sendv(SOCKET_TYPE fd, xnet_iovec_t *iov, int n, bool more) {
+	struct msghdr msg;
+	if (!more)
+		return writev(fd, iov, n);
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = n;
+	return sendmsg(fd, &msg, MSG_MORE);
+}
+
+//文件内容由内核直接拷贝到socket，返回发送的长度，0表示文件已经到结尾
+static int
+poll_sendfile(SOCKET_TYPE fd, int file_fd, int64_t *offset, int64_t sz) {
+	off_t off = (off_t)*offset;
+	ssize_t n;
+	if (sz > (1 << 30)) sz = 1 << 30;
+	n = sendfile(fd, file_fd, &off, (size_t)sz);
+	if (n > 0) *offset = (int64_t)off;
+	return (int)n;
+}
+
+static void
+poll_close_file(int file_fd) {
+	close(file_fd);
+}
+
 #endif //_SOCKET_LINUX_H_
\ No newline at end of file
@@ -4,6 +4,9 @@
 #define XNET_EINTR WSAEINTR
 #define XNET_HAVE_WOULDBLOCK(err) (err == WSAEWOULDBLOCK)
 
+#include <io.h>
+#include <errno.h>
+
 //windows下没有pipe函数，模拟实现一个
 static int
 pipe(SOCKET_TYPE pipefd[2]) {
@@ -176,7 +179,7 @@ poll_wait(xnet_poll_t *poll, int timeout) {
             have_error = true;
 
         if (have_read || have_write || have_error) {
-            poll_event->s[n] = s;
+            poll_event->id[n] = s->id;
             poll_event->read[n] = have_read;
             poll_event->write[n] = have_write;
             poll_event->error[n] = have_error;
@@ -209,6 +212,52 @@ inet_ntop(int af, const void* src, char* dst, int size) {
     return dst;
 }
 
+typedef WSABUF xnet_iovec_t;
+#define XNET_IOV_SET(v, p, l) ((v).buf = (p), (v).len = (ULONG)(l))
+
+static int
+poll_sendv(SOCKET_TYPE fd, xnet_iovec_t *iov, int n, bool more) {
+    DWORD sent = 0;
+    if (WSASend(fd, iov, n, &sent, 0, NULL, NULL) == SOCKET_ERROR)
+        return -1;
+    return (int)sent;
+}
+
+//文件函数的错误在errno中，调用者通过WSAGetLastError读取，需要转换
+static int
+set_file_error() {
+    int err;
+    switch (errno) {
+    case EINTR: err = WSAEINTR; break;
+    case EBADF: err = WSAEBADF; break;
+    default: err = WSAEINVAL; break;
+    }
+    WSASetLastError(err);
+    return -1;
+}
+
+//没有sendfile，读到缓存后再发送，只前进实际发送的长度；缓存在栈上，多个poll同时发送互不影响
+static int
+poll_sendfile(SOCKET_TYPE fd, int file_fd, int64_t *offset, int64_t sz) {
+    char buffer[16*1024];
+    int n;
+    if (sz > (int64_t)sizeof(buffer)) sz = sizeof(buffer);
+    if (_lseeki64(file_fd, *offset, SEEK_SET) < 0)
+        return set_file_error();
+    n = _read(file_fd, buffer, (unsigned)sz);
+    if (n < 0) return set_file_error();
+    if (n == 0) return 0;
+    n = send(fd, buffer, n, 0);
+    if (n == SOCKET_ERROR) return -1;
+    *offset += n;
+    return n;
+}
+
+static void
+poll_close_file(int file_fd) {
+    _close(file_fd);
+}
+
 #ifndef SIO_UDP_CONNRESET
 #define SIO_UDP_CONNRESET _WSAIOW(IOC_VENDOR,12)
 #endif
@@ -1,6 +1,7 @@
 #include "xnet.h"
 #include "xnet_util.h"
 #include "malloc_ref.h"
+#include "xnet_websocket.h"
 #include <assert.h>
 #include <pthread.h>
 #include <stdarg.h>
@@ -33,8 +34,9 @@ static log_context_t g_log_context;
 static void
 write_log(xnet_context_t *ctx, int source, void *data, int sz) {
     char time_str[128];
-    timestring(ctx->nowtime/1000, time_str, sizeof(time_str));
-    fprintf(g_log_context.stdlog, "[%d][%s." TIME_FORMAT "]:", source, time_str, ctx->nowtime%1000);
+    uint64_t walltime = get_wall_time();
+    timestring(walltime/1000, time_str, sizeof(time_str));
+    fprintf(g_log_context.stdlog, "[%d][%s." TIME_FORMAT "]:", source, time_str, walltime%1000);
     fwrite(data, sz, 1, g_log_context.stdlog);
     fprintf(g_log_context.stdlog, "\n");
     fflush(g_log_context.stdlog);
@@ -106,7 +108,8 @@ log_deinit() {
 
 static void
 update_time_cache(xnet_context_t *ctx) {
-    ctx->nowtime = get_time();
+    ctx->nowtime_us = get_time_us();
+    ctx->nowtime = ctx->nowtime_us / 1000;
 }
 
 static void
@@ -114,7 +117,7 @@ deal_with_timeout_event(xnet_context_t *ctx) {
     xnet_timeinfo_t ti;
     uint64_t nowtime;
     if (!ctx->timeout_func) return;
-    nowtime = ctx->nowtime;
+    nowtime = ctx->nowtime_us;
 
     while (xnet_timeheap_top(&ctx->th, &ti)) {
         if (ti.expire > nowtime) break;
@@ -123,6 +126,199 @@ deal_with_timeout_event(xnet_context_t *ctx) {
     }
 }
 
+//返回最近的超时时间，0表示当前没有需要检查的超时
+static uint64_t
+conn_deadline(xnet_socket_t *s, short *what) {
+    uint64_t deadline = 0, t;
+    if (s->read_timeout) {
+        deadline = s->last_read + s->read_timeout;
+        *what = XNET_ERROR_READ_TIMEOUT;
+    }
+    if (s->write_timeout && !wb_list_empty(s)) {
+        t = s->last_write + s->write_timeout;
+        if (deadline == 0 || t < deadline) {
+            deadline = t;
+            *what = XNET_ERROR_WRITE_TIMEOUT;
+        }
+    }
+    if (s->life_timeout) {
+        t = s->start_time + s->life_timeout;
+        if (deadline == 0 || t < deadline) {
+            deadline = t;
+            *what = XNET_ERROR_LIFE_TIMEOUT;
+        }
+    }
+    return deadline;
+}
+
+static void
+check_conn_timeout(xnet_context_t *ctx, xnet_socket_t *s) {
+    int sock_id = s->id;
+    short what = 0;
+    uint64_t deadline = conn_deadline(s, &what);
+
+    if (deadline == 0) {
+        //只设置了写超时且写队列为空，过一个周期再检查
+        if (s->write_timeout)
+            xnet_wheel_link(&ctx->poll, s, ctx->nowtime + s->write_timeout);
+        return;
+    }
+    if (deadline > ctx->nowtime) {
+        xnet_wheel_link(&ctx->poll, s, deadline);
+        return;
+    }
+
+    ctx->error_func(ctx, sock_id, what);
+    s = xnet_get_socket(ctx, sock_id);
+    if (s->type != SOCKET_TYPE_INVALID)
+        xnet_poll_closefd(&ctx->poll, s);
+}
+
+//时间轮每格只检查挂在上面的socket，收发数据时只更新时间戳
+static void
+deal_with_conn_timeout(xnet_context_t *ctx) {
+    xnet_poll_t *poll = &ctx->poll;
+    xnet_socket_t *s;
+    uint64_t steps;
+    int i, n, id, *ids;
+
+    if (poll->wheel_n == 0) {
+        poll->wheel_time = ctx->nowtime;
+        return;
+    }
+    if (ctx->nowtime < poll->wheel_time + XNET_WHEEL_TICK)
+        return;
+
+    steps = (ctx->nowtime - poll->wheel_time) / XNET_WHEEL_TICK;
+    if (steps > XNET_WHEEL_SIZE) {
+        poll->wheel_time += (steps - XNET_WHEEL_SIZE) * XNET_WHEEL_TICK;
+        steps = XNET_WHEEL_SIZE;
+    }
+
+    while (steps-- > 0) {
+        poll->wheel_time += XNET_WHEEL_TICK;
+        poll->wheel_cur = (poll->wheel_cur + 1) % XNET_WHEEL_SIZE;
+
+        //先把整个槽位取出来，回调中可能会关闭或者新建socket
+        n = 0;
+        for (id=xnet_wheel_detach(poll, poll->wheel_cur); id!=-1; id=poll->slots[id].wheel_next) {
+            if (n >= ctx->due_cap) {
+                ids = realloc(ctx->due_ids, sizeof(int) * (ctx->due_cap ? ctx->due_cap * 2 : 64));
+                assert(ids);
+                ctx->due_ids = ids;
+                ctx->due_cap = ctx->due_cap ? ctx->due_cap * 2 : 64;
+            }
+            ctx->due_ids[n++] = id;
+        }
+
+        for (i=0; i<n; i++) {
+            s = xnet_get_socket(ctx, ctx->due_ids[i]);
+            if (s->type == SOCKET_TYPE_INVALID || s->wheel_slot != -1)
+                continue;
+            check_conn_timeout(ctx, s);
+        }
+    }
+}
+
+//发送过程中调用者还持有socket指针，drain_func可能新建socket导致slots扩容，也可能重入lua，
+//所以这里只记录socket id，由循环在事件处理完后回调
+static void
+push_drain_socket(xnet_context_t *ctx, xnet_socket_t *s) {
+    int new_cap;
+    int *ids;
+
+    if (!ctx->drain_func || s->drain_pending) return;
+    if (ctx->drain_n >= ctx->drain_cap) {
+        new_cap = ctx->drain_cap ? ctx->drain_cap * 2 : 32;
+        ids = realloc(ctx->drain_ids, sizeof(int) * new_cap);
+        assert(ids);
+        ctx->drain_ids = ids;
+        ctx->drain_cap = new_cap;
+    }
+    ctx->drain_ids[ctx->drain_n++] = s->id;
+    s->drain_pending = true;
+}
+
+static void
+wb_enter_high(xnet_context_t *ctx, xnet_socket_t *s) {
+    xnet_socket_t *link;
+    s->wb_blocked = true;
+    if ((link = xnet_get_read_link(&ctx->poll, s)))
+        xnet_enable_read(&ctx->poll, link, false);
+    push_drain_socket(ctx, s);
+}
+
+static void
+wb_leave_high(xnet_context_t *ctx, xnet_socket_t *s) {
+    xnet_socket_t *link;
+    s->wb_blocked = false;
+    if ((link = xnet_get_read_link(&ctx->poll, s)))
+        xnet_enable_read(&ctx->poll, link, true);
+    push_drain_socket(ctx, s);
+}
+
+//数据进入写队列后检查水位
+static void
+check_wb_high(xnet_context_t *ctx, xnet_socket_t *s) {
+    //文件节点只占用fd，按水位控制即可，硬上限只限制内存中的数据
+    if (s->wb_hard > 0 && s->wb_size - s->wb_file_size > s->wb_hard) {
+        //超过硬上限：丢弃写队列，在本轮循环结束时关闭
+        discard_send_buff(&ctx->poll, s);
+        xnet_enable_read(&ctx->poll, s, false);
+        s->closing = true;
+        s->close_what = XNET_ERROR_WB_OVERFLOW;
+        mark_dirty_socket(&ctx->poll, s);
+        return;
+    }
+    if (s->wb_high > 0 && !s->wb_blocked && s->wb_size >= s->wb_high)
+        wb_enter_high(ctx, s);
+}
+
+//发送数据后检查水位
+static void
+check_wb_low(xnet_context_t *ctx, xnet_socket_t *s) {
+    if (s->wb_blocked && s->type != SOCKET_TYPE_INVALID && s->wb_size <= s->wb_low)
+        wb_leave_high(ctx, s);
+}
+
+static void
+push_send_buff(xnet_context_t *ctx, xnet_socket_t *s, const char *buffer, int sz, bool raw) {
+    //写超时从写队列变为非空时开始计算
+    if (wb_list_empty(s)) s->last_write = ctx->nowtime;
+    append_send_buff(&ctx->poll, s, buffer, sz, raw);
+    check_wb_high(ctx, s);
+}
+
+static void
+push_send_file(xnet_context_t *ctx, xnet_socket_t *s, int fd, int64_t offset, int64_t sz) {
+    if (wb_list_empty(s)) s->last_write = ctx->nowtime;
+    append_send_file(&ctx->poll, s, fd, offset, sz);
+    check_wb_high(ctx, s);
+}
+
+static void
+push_udp_send_buff(xnet_context_t *ctx, xnet_socket_t *s, xnet_addr_t *addr, const char *buffer, int sz, bool raw) {
+    if (wb_list_empty(s)) s->last_write = ctx->nowtime;
+    append_udp_send_buff(&ctx->poll, s, addr, buffer, sz, raw);
+    check_wb_high(ctx, s);
+}
+
+//返回-2表示socket已经关闭
+static int
+send_socket_data(xnet_context_t *ctx, xnet_socket_t *s) {
+    int sock_id = s->id;
+    short what = s->close_what;
+    int64_t wb_size = s->wb_size;
+    if (xnet_send_data(&ctx->poll, s) == -2) {
+        ctx->error_func(ctx, sock_id, what);
+        return -2;
+    }
+    if (s->wb_size < wb_size)
+        s->last_write = ctx->nowtime;
+    check_wb_low(ctx, s);
+    return 0;
+}
+
 static void
 send_cmd(xnet_context_t *ctx, xnet_cmdreq_t *req, int type, int len) {
     SOCKET_TYPE fd = ctx->poll.send_fd;
@@ -159,7 +355,7 @@ cmd_send_tcp_pkg(xnet_context_t *ctx, xnet_cmdreq_sendtcp_t *req) {
         free(req->data);
         return;
     }
-    append_send_buff(&ctx->poll, s, req->data, req->size, true);
+    push_send_buff(ctx, s, req->data, req->size, true);
 }
 
 static void
@@ -174,7 +370,7 @@ cmd_broad_tcp_pkg(xnet_context_t *ctx, xnet_cmdreq_broadtcp_t *req) {
             continue;
 
         mf_add_ref(new_buffer);
-        append_send_buff(&ctx->poll, s, new_buffer, req->size, false);
+        push_send_buff(ctx, s, new_buffer, req->size, false);
     }
     free(req->ids);
     free(req->data);
@@ -187,7 +383,7 @@ cmd_send_udp_pkg(xnet_context_t *ctx, xnet_cmdreq_sendupd_t *req) {
         free(req->data);
         return;
     }
-    append_udp_send_buff(&ctx->poll, s, &s->addr_info, req->data, req->size, true);
+    push_udp_send_buff(ctx, s, &s->addr_info, req->data, req->size, true);
 }
 
 static void
@@ -197,7 +393,7 @@ cmd_sendto_udp_pkg(xnet_context_t *ctx, xnet_cmdreq_sendtoupd_t *req) {
         free(req->data);
         return;
     }
-    append_udp_send_buff(&ctx->poll, s, &req->addr, req->data, req->size, true);
+    push_udp_send_buff(ctx, s, &req->addr, req->data, req->size, true);
 }
 
 static void
@@ -307,6 +503,15 @@ xnet_create_context() {
     ctx->connect_func = NULL;
     ctx->timeout_func = NULL;
     ctx->command_func = NULL;
+    ctx->drain_func = NULL;
+    ctx->read_budget = 0;
+    ctx->read_msg_budget = 0;
+    ctx->loop_round = 0;
+    ctx->drain_ids = NULL;
+    ctx->drain_n = ctx->drain_cap = 0;
+    ctx->due_ids = NULL;
+    ctx->due_cap = 0;
+    ctx->poll.wheel_time = ctx->nowtime;
     return ctx;
 FAILED:
     free(ctx);
@@ -317,6 +522,10 @@ void
 xnet_destroy_context(xnet_context_t *ctx) {
     xnet_poll_deinit(&ctx->poll);
     xnet_timeheap_release(&ctx->th);
+    if (ctx->drain_ids)
+        free(ctx->drain_ids);
+    if (ctx->due_ids)
+        free(ctx->due_ids);
     free(ctx);
 }
 
@@ -401,11 +610,22 @@ xnet_register_command(xnet_context_t *ctx, xnet_command_func_t command_func) {
     ctx->command_func = command_func;
 }
 
+void
+xnet_register_drain(xnet_context_t *ctx, xnet_drain_func_t drain_func) {
+    ctx->drain_func = drain_func;
+}
+
 int
 xnet_add_timer(xnet_context_t *ctx, int id, int timeout) {
     if (timeout < 0) return -1;
+    return xnet_add_timer_us(ctx, id, (int64_t)timeout * 1000);
+}
+
+int
+xnet_add_timer_us(xnet_context_t *ctx, int id, int64_t timeout_us) {
+    if (timeout_us < 0) return -1;
     assert(ctx->timeout_func);
-    uint64_t expire = ctx->nowtime + (uint64_t)timeout;
+    uint64_t expire = ctx->nowtime_us + (uint64_t)timeout_us;
     xnet_timeheap_push(&ctx->th, &(xnet_timeinfo_t){id, expire});
     return 0;
 }
@@ -433,6 +653,22 @@ xnet_tcp_connect(xnet_context_t *ctx, const char *host, int port) {
     return rc;
 }
 
+int
+xnet_tcp_connect_id(xnet_context_t *ctx, const char *host, int port) {
+    int sock;
+    xnet_socket_t *s;
+    int rc = xnet_connect_tcp_socket(&ctx->poll, host, port, &sock);
+    if (rc == -1)
+        return -1;
+    if (rc == 1) {
+        //立即连接成功时也等到可写事件再回调，保证调用者先拿到id
+        s = xnet_get_socket(ctx, sock);
+        s->type = SOCKET_TYPE_CONNECTING;
+        xnet_enable_write(&ctx->poll, s, true);
+    }
+    return sock;
+}
+
 char *
 xnet_send_buffer_malloc(size_t size) {
     return mf_malloc(size);
@@ -456,7 +692,7 @@ xnet_tcp_send_buffer_ref(xnet_context_t *ctx, int sock_id, const char *buffer, i
         memcpy(send_buffer, buffer, sz);
     }
     mf_add_ref(send_buffer);
-    append_send_buff(&ctx->poll, s, send_buffer, sz, false);
+    push_send_buff(ctx, s, send_buffer, sz, false);
 }
 
 void
@@ -471,7 +707,102 @@ xnet_tcp_send_buffer(xnet_context_t *ctx, int sock_id, const char *buffer, int s
         send_buffer = (char*)malloc(sz);
         memcpy(send_buffer, buffer, sz);
     }
-    append_send_buff(&ctx->poll, s, send_buffer, sz, true);
+    push_send_buff(ctx, s, send_buffer, sz, true);
+}
+
+int
+xnet_tcp_send_file(xnet_context_t *ctx, int sock_id, int fd, int64_t offset, int64_t sz) {
+    xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+    if (s == NULL || s->type == SOCKET_TYPE_INVALID || s->closing || s->protocol != SOCKET_PROTOCOL_TCP
+        || offset < 0 || sz <= 0) {
+        close_send_file(fd);
+        return -1;
+    }
+    push_send_file(ctx, s, fd, offset, sz);
+    return 0;
+}
+
+int
+xnet_http_respond(xnet_context_t *ctx, int sock_id, int code, const char *fields, int fields_sz,
+    const char *body, int sz, bool raw) {
+    xnet_string_t head;
+    xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+    if (s == NULL || s->type == SOCKET_TYPE_INVALID || s->closing) {
+        if (raw) free((char*)body);
+        return -1;
+    }
+    //响应头一个写队列节点，body单独一个节点，cork模式下用writev一起发送
+    xnet_string_init(&head);
+    xnet_pack_http_head(code, fields, fields_sz > 0 ? fields_sz : 0, body ? sz : -1, &head);
+    push_send_buff(ctx, s, head.str, xnet_string_get_size(&head), true);
+    //发送之后不再使用s，按id重新获取
+    s = xnet_get_socket(ctx, sock_id);
+    if (s->closing) {
+        //响应头已经超过写队列硬上限，连接将被关闭，body不会再进入写队列
+        if (raw) free((char*)body);
+        return -1;
+    }
+    if (body && sz > 0)
+        xnet_tcp_send_buffer(ctx, sock_id, body, sz, raw);
+    else if (raw)
+        free((char*)body);
+    s = xnet_get_socket(ctx, sock_id);
+    return s->closing ? -1 : 0;
+}
+
+int
+xnet_websocket_send(xnet_context_t *ctx, int sock_id, int opcode, const char *data, int sz, bool ref) {
+    char *send_buffer;
+    int n;
+    xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+    if (s == NULL || s->type == SOCKET_TYPE_INVALID || s->closing || sz < 0)
+        return -1;
+    if (ref && sz > 0) {
+        //帧头单独一个节点，payload只增加引用计数
+        send_buffer = (char*)malloc(XNET_WS_HEADER_MAX);
+        n = xnet_pack_websocket_header(opcode, true, sz, NULL, send_buffer);
+        push_send_buff(ctx, s, send_buffer, n, true);
+        xnet_tcp_send_buffer_ref(ctx, sock_id, data, sz, true);
+        return 0;
+    }
+    //帧头和payload合并成一个节点
+    send_buffer = (char*)malloc(XNET_WS_HEADER_MAX + sz);
+    n = xnet_pack_websocket_header(opcode, true, sz, NULL, send_buffer);
+    if (sz > 0) memcpy(send_buffer + n, data, sz);
+    push_send_buff(ctx, s, send_buffer, n + sz, true);
+    return 0;
+}
+
+int
+xnet_http_write_chunk(xnet_context_t *ctx, int sock_id, const char *data, int sz) {
+    char *send_buffer;
+    int n;
+    xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+    if (s == NULL || s->type == SOCKET_TYPE_INVALID || s->closing)
+        return -1;
+    //长度为0的chunk是结束标记，只能由xnet_http_end发送
+    if (sz <= 0)
+        return 0;
+    //chunk头、数据、结尾的CRLF合并成一个写队列节点
+    send_buffer = (char*)malloc(sz + 12);
+    n = sprintf(send_buffer, "%x\r\n", sz);
+    memcpy(send_buffer + n, data, sz);
+    memcpy(send_buffer + n + sz, "\r\n", 2);
+    push_send_buff(ctx, s, send_buffer, n + sz + 2, true);
+    //超过写队列硬上限时连接将被关闭，通知调用者停止输出；发送之后按id重新获取socket
+    s = xnet_get_socket(ctx, sock_id);
+    return s->closing ? -1 : 0;
+}
+
+int
+xnet_http_end(xnet_context_t *ctx, int sock_id) {
+    static const char end_chunk[] = "0\r\n\r\n";
+    xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+    if (s == NULL || s->type == SOCKET_TYPE_INVALID || s->closing)
+        return -1;
+    xnet_tcp_send_buffer(ctx, sock_id, end_chunk, sizeof(end_chunk)-1, false);
+    s = xnet_get_socket(ctx, sock_id);
+    return s->closing ? -1 : 0;
 }
 
 void
@@ -520,7 +851,7 @@ xnet_udp_sendto(xnet_context_t *ctx, int sock_id, xnet_addr_t *recv_addr, const
         send_buffer = (char*)malloc(sz);
         memcpy(send_buffer, buffer, sz);
     }
-    append_udp_send_buff(&ctx->poll, s, recv_addr, send_buffer, sz, true);
+    push_udp_send_buff(ctx, s, recv_addr, send_buffer, sz, true);
 }
 
 void
@@ -537,7 +868,7 @@ xnet_udp_sendto_ref(xnet_context_t *ctx, int sock_id, xnet_addr_t *recv_addr, co
         memcpy(send_buffer, buffer, sz);
     }
     mf_add_ref(send_buffer);
-    append_udp_send_buff(&ctx->poll, s, recv_addr, send_buffer, sz, false);
+    push_udp_send_buff(ctx, s, recv_addr, send_buffer, sz, false);
 }
 
 void
@@ -559,15 +890,140 @@ xnet_exit(xnet_context_t *ctx) {
     ctx->to_quit = true;
 }
 
+void
+xnet_set_cork(xnet_context_t *ctx, bool enable) {
+    xnet_poll_set_cork(&ctx->poll, enable);
+}
+
+//立即发送socket写队列中的数据，不等待本轮循环结束
+int
+xnet_flush(xnet_context_t *ctx, int sock_id) {
+    int64_t wb_size;
+    xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+    if (s == NULL || s->type == SOCKET_TYPE_INVALID || s->protocol != SOCKET_PROTOCOL_TCP)
+        return -1;
+    //正在关闭的socket由循环统一处理关闭回调
+    if (s->closing || wb_list_empty(s))
+        return 0;
+    s->dirty = false;
+    wb_size = s->wb_size;
+    xnet_send_data(&ctx->poll, s);
+    if (s->wb_size < wb_size)
+        s->last_write = ctx->nowtime;
+    check_wb_low(ctx, s);
+    return 0;
+}
+
+int
+xnet_set_conn_timeout(xnet_context_t *ctx, int sock_id, int read_timeout, int write_timeout, int life_timeout) {
+    xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+    if (s == NULL || s->type == SOCKET_TYPE_INVALID)
+        return -1;
+    if (read_timeout < 0 || write_timeout < 0 || life_timeout < 0)
+        return -1;
+
+    s->read_timeout = read_timeout;
+    s->write_timeout = write_timeout;
+    s->life_timeout = life_timeout;
+    s->last_read = s->last_write = s->start_time = ctx->nowtime;
+
+    //监听socket只保存配置，由accept的socket继承
+    if (s->type == SOCKET_TYPE_LISTENING)
+        return 0;
+    if (!read_timeout && !write_timeout && !life_timeout) {
+        xnet_wheel_unlink(&ctx->poll, s);
+        return 0;
+    }
+    check_conn_timeout(ctx, s);
+    return 0;
+}
+
+static void
+inherit_conn_timeout(xnet_context_t *ctx, int listen_id, int sock_id) {
+    xnet_socket_t *ls = xnet_get_socket(ctx, listen_id);
+    if (ls->read_timeout || ls->write_timeout || ls->life_timeout)
+        xnet_set_conn_timeout(ctx, sock_id, ls->read_timeout, ls->write_timeout, ls->life_timeout);
+}
+
+void
+xnet_set_read_budget(xnet_context_t *ctx, int bytes, int msgs) {
+    ctx->read_budget = bytes > 0 ? bytes : 0;
+    ctx->read_msg_budget = msgs > 0 ? msgs : 0;
+}
+
+int
+xnet_set_watermark(xnet_context_t *ctx, int sock_id, int64_t low, int64_t high, int64_t hard) {
+    xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+    if (s == NULL || s->type == SOCKET_TYPE_INVALID)
+        return -1;
+    if (low < 0 || high < 0 || hard < 0 || (high > 0 && low > high))
+        return -1;
+    s->wb_low = low;
+    s->wb_high = high;
+    s->wb_hard = hard;
+    if (s->wb_blocked && (high == 0 || s->wb_size <= low))
+        wb_leave_high(ctx, s);
+    return 0;
+}
+
+int
+xnet_set_read_link(xnet_context_t *ctx, int sock_id, int link_id) {
+    xnet_socket_t *link = NULL, *old;
+    xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+    if (s == NULL || s->type == SOCKET_TYPE_INVALID)
+        return -1;
+    if (link_id != -1) {
+        //只能关联其他存活的tcp连接，超出slot_size的id会被取模到别的socket上
+        if (link_id < 0 || link_id >= ctx->poll.slot_size || link_id == sock_id)
+            return -1;
+        link = xnet_get_socket(ctx, link_id);
+        if (link->type == SOCKET_TYPE_INVALID || link->type == SOCKET_TYPE_LISTENING ||
+            link->protocol != SOCKET_PROTOCOL_TCP || link->closing)
+            return -1;
+    }
+
+    //已经处于高水位时，把暂停读取转移到新的socket上
+    if (s->wb_blocked && (old = xnet_get_read_link(&ctx->poll, s)))
+        xnet_enable_read(&ctx->poll, old, true);
+    s->read_link = link_id;
+    if (link) {
+        s->read_link_gen = link->gen;
+        if (s->wb_blocked)
+            xnet_enable_read(&ctx->poll, link, false);
+    }
+    return 0;
+}
+
+static void
+flush_dirty_sockets(xnet_context_t *ctx) {
+    xnet_poll_t *poll = &ctx->poll;
+    xnet_socket_t *s;
+    int i;
+
+    //回调中可能继续追加dirty socket，所以每次都重新读取dirty_n
+    for (i=0; i<poll->dirty_n; i++) {
+        s = xnet_get_socket(ctx, poll->dirty_ids[i]);
+        if (!s->dirty) continue;
+        s->dirty = false;
+        if (s->type == SOCKET_TYPE_INVALID) continue;
+        send_socket_data(ctx, s);
+    }
+    poll->dirty_n = 0;
+}
+
 static void
 deal_with_connected(xnet_context_t *ctx, xnet_socket_t *s) {
     int err;
     socklen_t len = sizeof(err);
     int code = get_sockopt(s->fd, SOL_SOCKET, SO_ERROR, &err, &len);  
+    int sock_id = s->id;
     if (code < 0 || err) {
         err = code < 0 ? get_last_error() : err;
-        ctx->connect_func(ctx, s->id, err);
-        xnet_poll_closefd(&ctx->poll, s);
+        ctx->connect_func(ctx, sock_id, err);
+        //回调中可能新建socket导致slots扩容
+        s = xnet_get_socket(ctx, sock_id);
+        if (s->type != SOCKET_TYPE_INVALID)
+            xnet_poll_closefd(&ctx->poll, s);
         return;
     }
 
@@ -579,16 +1035,38 @@ deal_with_connected(xnet_context_t *ctx, xnet_socket_t *s) {
 static int
 deal_with_tcp_message(xnet_context_t *ctx, xnet_socket_t *s) {
     char *buffer;
-    int n;
+    int n, sz;
+    int sock_id = s->id;
+    int bytes = 0, msgs = 0;
+    bool budget = ctx->read_budget > 0 || ctx->read_msg_budget > 0;
+
+    for (;;) {
+        sz = s->read_size;
+        n = xnet_recv_data(&ctx->poll, s, &buffer);
+        if (n > 0) {
+            s->last_read = ctx->nowtime;
+            if (ctx->recv_func(ctx, sock_id, buffer, n, &s->addr_info) == 0)
+                free(buffer);
+            buffer = NULL;
+            s = xnet_get_socket(ctx, sock_id);
+        } else if (n < 0) {
+            xnet_poll_closefd(&ctx->poll, s);
+            return -1;
+        } else {
+            break;
+        }
 
-    n = xnet_recv_data(&ctx->poll, s, &buffer);
-    if (n > 0) {
-        if (ctx->recv_func(ctx, s->id, buffer, n, &s->addr_info) == 0)
-            free(buffer);
-        buffer = NULL;
-    } else if (n < 0) {
-        xnet_poll_closefd(&ctx->poll, s);
-        return -1;
+        //未设置预算时保持每次可读事件只recv一次
+        if (!budget || n < sz) break;
+        //回调中可能关闭socket或者暂停读取
+        if (s->type == SOCKET_TYPE_INVALID || !s->reading) break;
+
+        //预算用完时停止，poll是水平触发的，还有数据时下一轮会再次通知
+        bytes += n;
+        msgs++;
+        if ((ctx->read_budget > 0 && bytes >= ctx->read_budget) ||
+            (ctx->read_msg_budget > 0 && msgs >= ctx->read_msg_budget))
+            break;
     }
     return 0;
 }
@@ -616,6 +1094,29 @@ deal_with_message(xnet_context_t *ctx, xnet_socket_t *s) {
         return deal_with_udp_message(ctx, s);
 }
 
+//通知水位变化，和上次通知的状态相同(同一轮中进入又离开高水位)时不回调
+static void
+deal_with_drain_sockets(xnet_context_t *ctx) {
+    int i, sock_id, n = ctx->drain_n;
+    xnet_socket_t *s;
+
+    for (i=0; i<n; i++) {
+        sock_id = ctx->drain_ids[i];
+        s = xnet_get_socket(ctx, sock_id);
+        if (!s->drain_pending) continue;
+        s->drain_pending = false;
+        if (s->type == SOCKET_TYPE_INVALID || s->closing || s->drain_blocked == s->wb_blocked)
+            continue;
+        s->drain_blocked = s->wb_blocked;
+        ctx->drain_func(ctx, sock_id, !s->drain_blocked);
+    }
+
+    //保留回调中新加入的socket
+    ctx->drain_n -= n;
+    if (ctx->drain_n > 0)
+        memmove(ctx->drain_ids, ctx->drain_ids + n, sizeof(int) * ctx->drain_n);
+}
+
 void
 xnet_dispatch_loop(xnet_context_t *ctx) {
     int ret, i;
@@ -627,6 +1128,7 @@ xnet_dispatch_loop(xnet_context_t *ctx) {
     int timeout = -1;
 
     while (!ctx->to_quit) {
+        ctx->loop_round++;
         while (has_cmd(ctx)) {
             ret = ctrl_cmd(ctx);
             if (ret == 0) {
@@ -639,15 +1141,34 @@ xnet_dispatch_loop(xnet_context_t *ctx) {
         //处理定时事件
         update_time_cache(ctx);
         deal_with_timeout_event(ctx);
+        deal_with_conn_timeout(ctx);
 
         if (xnet_timeheap_top(&ctx->th, &ti)) {
-            assert(ti.expire > ctx->nowtime);
-            timeout = (int)(ti.expire - ctx->nowtime);
+            //poll只支持毫秒，剩余时间向上取整，避免不足1毫秒时空转(粗粒度时钟下会持续数毫秒)
+            if (ti.expire > ctx->nowtime_us)
+                timeout = (int)((ti.expire - ctx->nowtime_us + 999) / 1000);
+            else
+                timeout = 0;
         } else {
             if (ctx->to_quit) timeout = 0;
             else timeout = -1;
         }
 
+        //时间轮不为空时最多等到下一格
+        if (poll->wheel_n > 0) {
+            if (poll->wheel_time + XNET_WHEEL_TICK > ctx->nowtime)
+                ret = (int)(poll->wheel_time + XNET_WHEEL_TICK - ctx->nowtime);
+            else
+                ret = 0;
+            if (timeout < 0 || ret < timeout) timeout = ret;
+        }
+
+        //cork模式下，本轮产生的发送在进入等待前统一flush
+        if (poll->dirty_n > 0)
+            flush_dirty_sockets(ctx);
+        //flush产生的水位通知不阻塞等待
+        if (ctx->drain_n > 0) timeout = 0;
+
         ret = xnet_poll_wait(poll, timeout);
 
         if (ret < 0) {
@@ -658,26 +1179,30 @@ xnet_dispatch_loop(xnet_context_t *ctx) {
 
         //对触发的事件进行处理
         for (i=0; i<poll_event->n; i++) {
-            s = poll_event->s[i];
-            if (!s) continue;
+            if (poll_event->id[i] < 0) continue;
+            s = xnet_get_socket(ctx, poll_event->id[i]);
 
             if (s->type == SOCKET_TYPE_LISTENING) {
+                //accept可能导致slots扩容，之后不能再使用s
+                int listen_id = s->id;
                 int sock_id = xnet_accept_tcp_socket(poll, s);
                 if (sock_id != -1) {
-                    ctx->listen_func(ctx, s->id, sock_id);
+                    inherit_conn_timeout(ctx, listen_id, sock_id);
+                    ctx->listen_func(ctx, listen_id, sock_id);
                 } else {
-                    xnet_error(ctx, "accept tcp socket have error:%d", s->id);
+                    xnet_error(ctx, "accept tcp socket have error:%d", listen_id);
                 }
             } else if(s->type == SOCKET_TYPE_CONNECTING) {
                 deal_with_connected(ctx, s);
             } else {
+                int sock_id = s->id;
                 if (poll_event->read[i]) {
                     //输入缓存区有可读数据；处于监听状态，有连接到达；出错
                     //xnet_error(ctx, "read event[%d]", s->id);
-                    int sock_id = s->id;
                     deal_with_message(ctx, s);
+                    s = xnet_get_socket(ctx, sock_id);
                     if (s->type == SOCKET_TYPE_INVALID) {
-                        ctx->error_func(ctx, sock_id, 0);
+                        ctx->error_func(ctx, sock_id, XNET_ERROR_CLOSE);
                         continue;
                     }
                 }
@@ -686,31 +1211,39 @@ xnet_dispatch_loop(xnet_context_t *ctx) {
                     //输出缓冲区可写；连接成功
                     //发送缓冲列表内的数据
                     //xnet_error(ctx, "write event[%d]", s->id);
-                    int sock_id = s->id;
-                    xnet_send_data(&ctx->poll, s);
-                    if (s->type == SOCKET_TYPE_INVALID) {
-                        ctx->error_func(ctx, sock_id, 0);
+                    if (send_socket_data(ctx, s) == -2)
                         continue;
-                    }
+                    s = xnet_get_socket(ctx, sock_id);
                 }
 
                 if (poll_event->error[i]) {
                     //异常；带外数据
                     //xnet_error(ctx, "poll event error:%d", s->id);
-                    ctx->error_func(ctx, s->id, 1);
-                    xnet_poll_closefd(&ctx->poll, s);
+                    ctx->error_func(ctx, sock_id, XNET_ERROR_POLL);
+                    s = xnet_get_socket(ctx, sock_id);
+                    if (s->type != SOCKET_TYPE_INVALID)
+                        xnet_poll_closefd(&ctx->poll, s);
+                    continue;
                 }
 #ifndef _WIN32
                 if (poll_event->eof[i]) {
                     //epoll特有的标记
                     //xnet_error(ctx, "poll event eof:%d", s->id);
-                    ctx->error_func(ctx, s->id, 2);
-                    xnet_poll_closefd(&ctx->poll, s);
+                    ctx->error_func(ctx, sock_id, XNET_ERROR_EOF);
+                    s = xnet_get_socket(ctx, sock_id);
+                    if (s->type != SOCKET_TYPE_INVALID)
+                        xnet_poll_closefd(&ctx->poll, s);
                 }
 #endif
             }
         }
+
+        if (ctx->drain_n > 0)
+            deal_with_drain_sockets(ctx);
     }
+
+    if (poll->dirty_n > 0)
+        flush_dirty_sockets(ctx);
 }
 
 
@@ -24,6 +24,7 @@ void xnet_register_connecter(xnet_context_t *ctx, xnet_connect_func_t connect_fu
 	xnet_error_func_t error_func, xnet_recv_func_t recv_func);
 void xnet_register_timeout(xnet_context_t *ctx, xnet_timeout_func_t timeout_func);
 void xnet_register_command(xnet_context_t *ctx, xnet_command_func_t command_func);
+void xnet_register_drain(xnet_context_t *ctx, xnet_drain_func_t drain_func);
 void xnet_register_event(xnet_context_t *ctx, xnet_listen_func_t listen_func, \
     xnet_error_func_t error_func, xnet_recv_func_t recv_func,                 \
     xnet_connect_func_t connect_func, xnet_timeout_func_t timeout_func,       \
@@ -44,12 +45,21 @@ void xnet_send_buffer_free(char *ptr);
 xnet_socket_t *xnet_get_socket(xnet_context_t *ctx, int sock_id);
 
 int xnet_tcp_connect(xnet_context_t *ctx, const char *host, int port);
+//返回socket id，-1表示失败；connect_func总是在之后的循环中回调，回调前可以先设置socket
+int xnet_tcp_connect_id(xnet_context_t *ctx, const char *host, int port);
 int xnet_tcp_listen(xnet_context_t *ctx, const char *host, int port, int backlog);
 void xnet_tcp_send_buffer(xnet_context_t *ctx, int sock_id, const char *buffer, int sz, bool raw);
 
 //'buffer' must be asigned by xnet_send_buffer_malloc
 void xnet_tcp_send_buffer_ref(xnet_context_t *ctx, int sock_id, const char *buffer, int sz, bool raw);
 
+/*
+ * 发送文件fd从offset开始的sz字节，linux下用sendfile由内核直接拷贝，不经过用户态内存。
+ * 和其他发送一样按顺序进入写队列，fd由xnet接管，发送完或者socket关闭时关闭，失败时立即关闭。
+ * 长度计入写队列的low/high水位，不计入hard；发送中文件被截断时关闭socket。
+ */
+int xnet_tcp_send_file(xnet_context_t *ctx, int sock_id, int fd, int64_t offset, int64_t sz);
+
 int xnet_udp_listen(xnet_context_t *ctx, const char *host, int port);
 
 void xnet_udp_sendto(xnet_context_t *ctx, int sock_id, xnet_addr_t *recv_addr, const char *buffer, int sz, bool raw);
@@ -62,8 +72,66 @@ void xnet_udp_send_buffer(xnet_context_t *ctx, int sock_id, const char *buffer,
 //'buffer' must be asigned by xnet_send_buffer_malloc
 void xnet_udp_send_buffer_ref(xnet_context_t *ctx, int sock_id, const char *buffer, int sz, bool raw);
 
+/*
+ * http chunked响应：先发送带Transfer-Encoding: chunked的响应头(xnet_pack_http)，
+ * 之后每段数据编码成一个chunk直接放入写队列，最后xnet_http_end发送结束标记。
+ * 配合xnet_set_watermark/drain回调可以流式输出大响应，不需要先在内存中拼好。
+ * 返回-1表示socket已经关闭或者超过写队列硬上限将被关闭，应停止输出。
+ */
+int xnet_http_write_chunk(xnet_context_t *ctx, int sock_id, const char *data, int sz);
+int xnet_http_end(xnet_context_t *ctx, int sock_id);
+/*
+ * 发送一帧websocket消息(服务端，不加掩码)。ref为true时data必须由xnet_send_buffer_malloc分配，
+ * 帧头单独入队，payload只增加引用计数不复制，同一份数据可以发给多个连接，全部发送完后释放
+ */
+int xnet_websocket_send(xnet_context_t *ctx, int sock_id, int opcode, const char *data, int sz, bool ref);
+/*
+ * 发送http响应：响应头由xnet_pack_http_head构造，body作为单独的写队列节点，raw为true时
+ * 接管body的内存(malloc分配)不复制。fields格式同xnet_pack_http_head，body为NULL时不添加content-length
+ * 返回-1表示socket已经关闭或者超过写队列硬上限将被关闭，raw的body此时也已释放
+ */
+int xnet_http_respond(xnet_context_t *ctx, int sock_id, int code, const char *fields, int fields_sz,
+    const char *body, int sz, bool raw);
+
 void xnet_close_socket(xnet_context_t *ctx, int sock_id);
+
+/*
+ * 每个tcp socket每轮循环的读取预算（字节数、recv次数，0表示不限制），都为0时每次可读事件只recv一次。
+ * 预算用完的socket由水平触发的poll在下一轮循环再次通知，定时器和其他socket不会被饿死。
+ */
+void xnet_set_read_budget(xnet_context_t *ctx, int bytes, int msgs);
+
+/*
+ * cork模式：本轮循环中的tcp发送只进入写队列，在循环结束时每个socket合并成一次writev发送。
+ * xnet_flush可以在cork模式下立即发送某个socket的数据。
+ */
+void xnet_set_cork(xnet_context_t *ctx, bool enable);
+int xnet_flush(xnet_context_t *ctx, int sock_id);
+
+/*
+ * 写队列水位(字节)，为0表示不限制：
+ * 超过high时回调drain_func(writable=false)，并暂停read_link指定socket的读取；
+ * 回落到low以下时回调drain_func(writable=true)，并恢复read_link的读取；
+ * drain_func不在发送函数中调用，由循环在本轮事件处理完后回调，同一轮中进入又回落的不通知；
+ * 超过hard时丢弃写队列并关闭socket，error_func的what为XNET_ERROR_WB_OVERFLOW。
+ * read_link只能是其他存活的tcp连接，-1表示取消；任一端关闭后关联失效，不会影响复用同一id的新socket。
+ */
+int xnet_set_watermark(xnet_context_t *ctx, int sock_id, int64_t low, int64_t high, int64_t hard);
+int xnet_set_read_link(xnet_context_t *ctx, int sock_id, int link_id);
+
+/*
+ * 连接超时(毫秒，0表示不检查)，到期时回调error_func后关闭socket，what分别为：
+ * XNET_ERROR_READ_TIMEOUT：超过read_timeout没有收到数据
+ * XNET_ERROR_WRITE_TIMEOUT：写队列不为空，超过write_timeout没有发送进展
+ * XNET_ERROR_LIFE_TIMEOUT：从设置时起超过life_timeout
+ * 设置在监听socket上时，accept的socket会继承这些配置。
+ */
+int xnet_set_conn_timeout(xnet_context_t *ctx, int sock_id, int read_timeout, int write_timeout, int life_timeout);
+
+//timeout单位为毫秒，基于单调时钟
 int xnet_add_timer(xnet_context_t *ctx, int id, int timeout);
+//timeout单位为微秒
+int xnet_add_timer_us(xnet_context_t *ctx, int id, int64_t timeout_us);
 void xnet_exit(xnet_context_t *ctx);
 /*---------Main Thread Method End---------*/
 
@@ -0,0 +1,567 @@
+#include "xnet_hpack.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define HPACK_STATIC_COUNT 61
+#define HPACK_ENTRY_OVERHEAD 32
+//单个字符串的长度上限，防止恶意的长度前缀
+#define HPACK_STRING_MAX (1024*1024)
+
+typedef struct {
+	const char *name;
+	uint32_t name_len;
+	const char *value;
+	uint32_t value_len;
+} hpack_static_t;
+
+static const hpack_static_t g_static_table[HPACK_STATIC_COUNT] = {
+	{":authority", 10, "", 0},
+	{":method", 7, "GET", 3},
+	{":method", 7, "POST", 4},
+	{":path", 5, "/", 1},
+	{":path", 5, "/index.html", 11},
+	{":scheme", 7, "http", 4},
+	{":scheme", 7, "https", 5},
+	{":status", 7, "200", 3},
+	{":status", 7, "204", 3},
+	{":status", 7, "206", 3},
+	{":status", 7, "304", 3},
+	{":status", 7, "400", 3},
+	{":status", 7, "404", 3},
+	{":status", 7, "500", 3},
+	{"accept-charset", 14, "", 0},
+	{"accept-encoding", 15, "gzip, deflate", 13},
+	{"accept-language", 15, "", 0},
+	{"accept-ranges", 13, "", 0},
+	{"accept", 6, "", 0},
+	{"access-control-allow-origin", 27, "", 0},
+	{"age", 3, "", 0},
+	{"allow", 5, "", 0},
+	{"authorization", 13, "", 0},
+	{"cache-control", 13, "", 0},
+	{"content-disposition", 19, "", 0},
+	{"content-encoding", 16, "", 0},
+	{"content-language", 16, "", 0},
+	{"content-length", 14, "", 0},
+	{"content-location", 16, "", 0},
+	{"content-range", 13, "", 0},
+	{"content-type", 12, "", 0},
+	{"cookie", 6, "", 0},
+	{"date", 4, "", 0},
+	{"etag", 4, "", 0},
+	{"expect", 6, "", 0},
+	{"expires", 7, "", 0},
+	{"from", 4, "", 0},
+	{"host", 4, "", 0},
+	{"if-match", 8, "", 0},
+	{"if-modified-since", 17, "", 0},
+	{"if-none-match", 13, "", 0},
+	{"if-range", 8, "", 0},
+	{"if-unmodified-since", 19, "", 0},
+	{"last-modified", 13, "", 0},
+	{"link", 4, "", 0},
+	{"location", 8, "", 0},
+	{"max-forwards", 12, "", 0},
+	{"proxy-authenticate", 18, "", 0},
+	{"proxy-authorization", 19, "", 0},
+	{"range", 5, "", 0},
+	{"referer", 7, "", 0},
+	{"refresh", 7, "", 0},
+	{"retry-after", 11, "", 0},
+	{"server", 6, "", 0},
+	{"set-cookie", 10, "", 0},
+	{"strict-transport-security", 25, "", 0},
+	{"transfer-encoding", 17, "", 0},
+	{"user-agent", 10, "", 0},
+	{"vary", 4, "", 0},
+	{"via", 3, "", 0},
+	{"www-authenticate", 16, "", 0},
+};
+
+//RFC 7541附录B，下标为符号，256为EOS
+static const uint32_t g_huff_code[257] = {
+	0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+	0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+	0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+	0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+	0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+	0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+	0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+	0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+	0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+	0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+	0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+	0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+	0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+	0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+	0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+	0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+	0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+	0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+	0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+	0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+	0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+	0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+	0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+	0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+	0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+	0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+	0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+	0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+	0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+	0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+	0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+	0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+	0x3fffffff,
+};
+
+static const uint8_t g_huff_len[257] = {
+	13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+	28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+	6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+	5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+	13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+	15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+	6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+	20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+	24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+	22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+	21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+	26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+	19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+	20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+	26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+	30,
+};
+
+//解码用：前8位查表得到(长度<<8)|符号，更长的编码按长度比较左对齐的上界
+
+static const uint16_t g_huff_fast[256] = {
+	0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0531, 0x0531, 0x0531, 0x0531,
+	0x0531, 0x0531, 0x0531, 0x0531, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532,
+	0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0563, 0x0563, 0x0563, 0x0563,
+	0x0563, 0x0563, 0x0563, 0x0563, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565,
+	0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x056f, 0x056f, 0x056f, 0x056f,
+	0x056f, 0x056f, 0x056f, 0x056f, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573,
+	0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0620, 0x0620, 0x0620, 0x0620,
+	0x0625, 0x0625, 0x0625, 0x0625, 0x062d, 0x062d, 0x062d, 0x062d, 0x062e, 0x062e, 0x062e, 0x062e,
+	0x062f, 0x062f, 0x062f, 0x062f, 0x0633, 0x0633, 0x0633, 0x0633, 0x0634, 0x0634, 0x0634, 0x0634,
+	0x0635, 0x0635, 0x0635, 0x0635, 0x0636, 0x0636, 0x0636, 0x0636, 0x0637, 0x0637, 0x0637, 0x0637,
+	0x0638, 0x0638, 0x0638, 0x0638, 0x0639, 0x0639, 0x0639, 0x0639, 0x063d, 0x063d, 0x063d, 0x063d,
+	0x0641, 0x0641, 0x0641, 0x0641, 0x065f, 0x065f, 0x065f, 0x065f, 0x0662, 0x0662, 0x0662, 0x0662,
+	0x0664, 0x0664, 0x0664, 0x0664, 0x0666, 0x0666, 0x0666, 0x0666, 0x0667, 0x0667, 0x0667, 0x0667,
+	0x0668, 0x0668, 0x0668, 0x0668, 0x066c, 0x066c, 0x066c, 0x066c, 0x066d, 0x066d, 0x066d, 0x066d,
+	0x066e, 0x066e, 0x066e, 0x066e, 0x0670, 0x0670, 0x0670, 0x0670, 0x0672, 0x0672, 0x0672, 0x0672,
+	0x0675, 0x0675, 0x0675, 0x0675, 0x073a, 0x073a, 0x0742, 0x0742, 0x0743, 0x0743, 0x0744, 0x0744,
+	0x0745, 0x0745, 0x0746, 0x0746, 0x0747, 0x0747, 0x0748, 0x0748, 0x0749, 0x0749, 0x074a, 0x074a,
+	0x074b, 0x074b, 0x074c, 0x074c, 0x074d, 0x074d, 0x074e, 0x074e, 0x074f, 0x074f, 0x0750, 0x0750,
+	0x0751, 0x0751, 0x0752, 0x0752, 0x0753, 0x0753, 0x0754, 0x0754, 0x0755, 0x0755, 0x0756, 0x0756,
+	0x0757, 0x0757, 0x0759, 0x0759, 0x076a, 0x076a, 0x076b, 0x076b, 0x0771, 0x0771, 0x0776, 0x0776,
+	0x0777, 0x0777, 0x0778, 0x0778, 0x0779, 0x0779, 0x077a, 0x077a, 0x0826, 0x082a, 0x082c, 0x083b,
+	0x0858, 0x085a, 0x0000, 0x0000,
+};
+
+static const uint64_t g_huff_limit[31] = {
+	0x0ull, 0x0ull, 0x0ull, 0x0ull,
+	0x0ull, 0x50000000ull, 0xb8000000ull, 0xf8000000ull,
+	0xfe000000ull, 0xfe000000ull, 0xff400000ull, 0xffa00000ull,
+	0xffc00000ull, 0xfff00000ull, 0xfff80000ull, 0xfffe0000ull,
+	0xfffe0000ull, 0xfffe0000ull, 0xfffe0000ull, 0xfffe6000ull,
+	0xfffee000ull, 0xffff4800ull, 0xffffb000ull, 0xffffea00ull,
+	0xfffff600ull, 0xfffff800ull, 0xfffffbc0ull, 0xfffffe20ull,
+	0xfffffff0ull, 0xfffffff0ull, 0x100000000ull,
+};
+
+static const uint32_t g_huff_first[31] = {
+	0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x14, 0x5c,
+	0xf8, 0x0, 0x3f8, 0x7fa, 0xffa, 0x1ff8, 0x3ffc, 0x7ffc,
+	0x0, 0x0, 0x0, 0x7fff0, 0xfffe6, 0x1fffdc, 0x3fffd2, 0x7fffd8,
+	0xffffea, 0x1ffffec, 0x3ffffe0, 0x7ffffde, 0xfffffe2, 0x0, 0x3ffffffc,
+};
+
+static const uint16_t g_huff_offset[31] = {
+	0, 0, 0, 0, 0, 0, 10, 36, 68, 0, 74, 79, 82, 84, 90, 92,
+	0, 0, 0, 95, 98, 106, 119, 145, 174, 186, 190, 205, 224, 0, 253,
+};
+
+static const uint16_t g_huff_sym[257] = {
+	48, 49, 50, 97, 99, 101, 105, 111, 115, 116, 32, 37, 45, 46, 47, 51,
+	52, 53, 54, 55, 56, 57, 61, 65, 95, 98, 100, 102, 103, 104, 108, 109,
+	110, 112, 114, 117, 58, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76,
+	77, 78, 79, 80, 81, 82, 83, 84, 85, 86, 87, 89, 106, 107, 113, 118,
+	119, 120, 121, 122, 38, 42, 44, 59, 88, 90, 33, 34, 40, 41, 63, 39,
+	43, 124, 35, 62, 0, 36, 64, 91, 93, 126, 94, 125, 60, 96, 123, 92,
+	195, 208, 128, 130, 131, 162, 184, 194, 224, 226, 153, 161, 167, 172, 176, 177,
+	179, 209, 216, 217, 227, 229, 230, 129, 132, 133, 134, 136, 146, 154, 156, 160,
+	163, 164, 169, 170, 173, 178, 181, 185, 186, 187, 189, 190, 196, 198, 228, 232,
+	233, 1, 135, 137, 138, 139, 140, 141, 143, 147, 149, 150, 151, 152, 155, 157,
+	158, 165, 166, 168, 174, 175, 180, 182, 183, 188, 191, 197, 231, 239, 9, 142,
+	144, 145, 148, 159, 171, 206, 215, 225, 236, 237, 199, 207, 234, 235, 192, 193,
+	200, 201, 202, 205, 210, 213, 218, 219, 238, 240, 242, 243, 255, 203, 204, 211,
+	212, 214, 221, 222, 223, 241, 244, 245, 246, 247, 248, 250, 251, 252, 253, 254,
+	2, 3, 4, 5, 6, 7, 8, 11, 12, 14, 15, 16, 17, 18, 19, 20,
+	21, 23, 24, 25, 26, 27, 28, 29, 30, 31, 127, 220, 249, 10, 13, 22,
+	256,
+};
+
+/*huffman*/
+uint32_t
+xnet_huffman_encoded_len(const char *s, uint32_t sz) {
+	uint64_t bits = 0;
+	uint32_t i;
+	for (i=0; i<sz; i++)
+		bits += g_huff_len[(uint8_t)s[i]];
+	return (uint32_t)((bits + 7) / 8);
+}
+
+void
+xnet_huffman_encode(const char *s, uint32_t sz, xnet_string_t *out) {
+	uint64_t acc = 0;
+	uint32_t bits = 0, i, n = 0;
+	char buf[64];
+	uint8_t c;
+
+	for (i=0; i<sz; i++) {
+		c = (uint8_t)s[i];
+		acc = (acc << g_huff_len[c]) | g_huff_code[c];
+		bits += g_huff_len[c];
+		while (bits >= 8) {
+			bits -= 8;
+			buf[n++] = (char)(acc >> bits);
+		}
+		if (n > sizeof(buf) - 8) {
+			xnet_string_append_buff(out, buf, n);
+			n = 0;
+		}
+	}
+	//用EOS的前缀(全1)填充
+	if (bits > 0)
+		buf[n++] = (char)((acc << (8 - bits)) | (0xFF >> bits));
+	if (n > 0)
+		xnet_string_append_buff(out, buf, n);
+}
+
+int
+xnet_huffman_decode(const char *s, uint32_t sz, xnet_string_t *out) {
+	const uint8_t *p = (const uint8_t *)s;
+	uint64_t acc = 0;
+	uint32_t bits = 0, i = 0, win, len, sym, l, n = 0;
+	uint16_t e;
+	char buf[64];
+
+	for (;;) {
+		while (bits <= 56 && i < sz) {
+			acc = (acc << 8) | p[i++];
+			bits += 8;
+		}
+		if (bits == 0) break;
+		//剩余的位左对齐到32位，不足的用1补齐，和EOS的填充一致
+		if (bits >= 32)
+			win = (uint32_t)(acc >> (bits - 32));
+		else
+			win = (uint32_t)(acc << (32 - bits)) | (uint32_t)((1ull << (32 - bits)) - 1);
+		e = g_huff_fast[win >> 24];
+		if (e) {
+			len = e >> 8;
+			sym = e & 0xFF;
+		} else {
+			for (l=9; l<30 && win >= g_huff_limit[l]; l++);
+			len = l;
+			sym = g_huff_sym[g_huff_offset[l] + (win >> (32 - l)) - g_huff_first[l]];
+		}
+		if (len > bits) {
+			//剩下的是填充：少于8位并且全是1
+			if (bits >= 8 || (acc & ((1u << bits) - 1)) != ((1u << bits) - 1)) return -1;
+			break;
+		}
+		if (sym == 256) return -1;
+		bits -= len;
+		buf[n++] = (char)sym;
+		if (n == sizeof(buf)) {
+			xnet_string_append_buff(out, buf, n);
+			n = 0;
+		}
+	}
+	if (n > 0)
+		xnet_string_append_buff(out, buf, n);
+	return 0;
+}
+
+/*动态表*/
+void
+xnet_hpack_init(xnet_hpack_t *hp, uint32_t limit) {
+	memset(hp, 0, sizeof(*hp));
+	hp->limit = limit;
+	hp->max_size = limit;
+}
+
+void
+xnet_hpack_clear(xnet_hpack_t *hp) {
+	uint32_t i;
+	for (i=0; i<hp->count; i++)
+		free(hp->entries[(hp->head + hp->capacity - i) % hp->capacity].name);
+	free(hp->entries);
+	memset(hp, 0, sizeof(*hp));
+}
+
+static void
+evict_entries(xnet_hpack_t *hp, uint32_t max) {
+	xnet_hpack_entry_t *e;
+	while (hp->count > 0 && hp->size > max) {
+		e = &hp->entries[(hp->head + hp->capacity - hp->count + 1) % hp->capacity];
+		hp->size -= HPACK_ENTRY_OVERHEAD + e->name_len + e->value_len;
+		free(e->name);
+		hp->count--;
+	}
+}
+
+static void
+set_max_size(xnet_hpack_t *hp, uint32_t size) {
+	hp->max_size = size;
+	evict_entries(hp, size);
+}
+
+void
+xnet_hpack_set_limit(xnet_hpack_t *hp, uint32_t limit) {
+	if (limit > XNET_HPACK_DEFAULT_SIZE) limit = XNET_HPACK_DEFAULT_SIZE;
+	hp->limit = limit;
+	if (limit != hp->max_size) {
+		set_max_size(hp, limit);
+		hp->update = true;
+	}
+}
+
+//i从0开始，0为最新加入的
+static xnet_hpack_entry_t *
+get_dynamic(xnet_hpack_t *hp, uint32_t i) {
+	if (i >= hp->count) return NULL;
+	return &hp->entries[(hp->head + hp->capacity - i) % hp->capacity];
+}
+
+static void
+add_entry(xnet_hpack_t *hp, const char *name, uint32_t name_len, const char *value, uint32_t value_len) {
+	uint32_t need = HPACK_ENTRY_OVERHEAD + name_len + value_len;
+	xnet_hpack_entry_t *entries, *e;
+	char *mem;
+	uint32_t i;
+
+	if (need > hp->max_size) {
+		evict_entries(hp, 0);
+		return;
+	}
+	//name可能引用将要淘汰的项，先复制
+	mem = (char *)malloc(name_len + value_len + 1);
+	memcpy(mem, name, name_len);
+	memcpy(mem + name_len, value, value_len);
+	evict_entries(hp, hp->max_size - need);
+
+	if (hp->count == hp->capacity) {
+		entries = (xnet_hpack_entry_t *)malloc(sizeof(xnet_hpack_entry_t) * (hp->capacity ? hp->capacity * 2 : 16));
+		for (i=0; i<hp->count; i++)
+			entries[i] = *get_dynamic(hp, hp->count - 1 - i);
+		free(hp->entries);
+		hp->entries = entries;
+		hp->capacity = hp->capacity ? hp->capacity * 2 : 16;
+		hp->head = hp->count ? hp->count - 1 : hp->capacity - 1;
+	}
+	hp->head = (hp->head + 1) % hp->capacity;
+	e = &hp->entries[hp->head];
+	e->name = mem;
+	e->name_len = name_len;
+	e->value = mem + name_len;
+	e->value_len = value_len;
+	hp->count++;
+	hp->size += need;
+}
+
+/*解码*/
+static int
+decode_int(const uint8_t **pp, const uint8_t *end, int prefix, uint32_t *v) {
+	const uint8_t *p = *pp;
+	uint32_t mask = (1u << prefix) - 1;
+	uint64_t x;
+	int m = 0;
+
+	if (p >= end) return -1;
+	x = *p++ & mask;
+	if (x == mask) {
+		do {
+			if (p >= end || m > 28) return -1;
+			x += (uint64_t)(*p & 0x7f) << m;
+			m += 7;
+		} while (*p++ & 0x80);
+		if (x > 0x7FFFFFFF) return -1;
+	}
+	*v = (uint32_t)x;
+	*pp = p;
+	return 0;
+}
+
+//字符串不是huffman编码时直接指向块，否则解码到scratch，off为在scratch中的位置
+static int
+decode_string(const uint8_t **pp, const uint8_t *end, xnet_string_t *scratch, const char **s, uint32_t *len, int32_t *off) {
+	bool huff;
+	uint32_t n, old;
+
+	if (*pp >= end) return -1;
+	huff = (**pp & 0x80) != 0;
+	if (decode_int(pp, end, 7, &n) != 0 || n > (uint32_t)(end - *pp) || n > HPACK_STRING_MAX) return -1;
+	if (!huff) {
+		*s = (const char *)*pp;
+		*len = n;
+		*off = -1;
+	} else {
+		old = xnet_string_get_size(scratch);
+		if (xnet_huffman_decode((const char *)*pp, n, scratch) != 0) return -1;
+		*len = xnet_string_get_size(scratch) - old;
+		*off = (int32_t)old;
+	}
+	*pp += n;
+	return 0;
+}
+
+static int
+get_field(xnet_hpack_t *hp, uint32_t index, const char **name, uint32_t *name_len, const char **value, uint32_t *value_len) {
+	const hpack_static_t *st;
+	xnet_hpack_entry_t *e;
+	if (index == 0) return -1;
+	if (index <= HPACK_STATIC_COUNT) {
+		st = &g_static_table[index - 1];
+		*name = st->name;
+		*name_len = st->name_len;
+		*value = st->value;
+		*value_len = st->value_len;
+		return 0;
+	}
+	e = get_dynamic(hp, index - HPACK_STATIC_COUNT - 1);
+	if (e == NULL) return -1;
+	*name = e->name;
+	*name_len = e->name_len;
+	*value = e->value;
+	*value_len = e->value_len;
+	return 0;
+}
+
+int
+xnet_hpack_decode(xnet_hpack_t *hp, const char *block, uint32_t sz, xnet_string_t *scratch, xnet_hpack_field_cb cb, void *ud) {
+	const uint8_t *p = (const uint8_t *)block;
+	const uint8_t *end = p + sz;
+	const char *name, *value, *unused;
+	uint32_t index, name_len, value_len, unused_len;
+	int32_t name_off, value_off;
+	bool fields = false;
+	uint8_t b;
+	int prefix;
+
+	while (p < end) {
+		b = *p;
+		if (b & 0x80) {
+			if (decode_int(&p, end, 7, &index) != 0 ||
+				get_field(hp, index, &name, &name_len, &value, &value_len) != 0) return -1;
+			if (cb(ud, name, name_len, value, value_len) != 0) return -1;
+			fields = true;
+			continue;
+		}
+		if ((b & 0xE0) == 0x20) {
+			//大小更新只能在块的开头
+			if (fields || decode_int(&p, end, 5, &index) != 0 || index > hp->limit) return -1;
+			set_max_size(hp, index);
+			continue;
+		}
+
+		prefix = (b & 0x40) ? 6 : 4;
+		if (decode_int(&p, end, prefix, &index) != 0) return -1;
+		scratch->size = 0;
+		name_off = -1;
+		if (index) {
+			if (get_field(hp, index, &name, &name_len, &unused, &unused_len) != 0) return -1;
+		} else if (decode_string(&p, end, scratch, &name, &name_len, &name_off) != 0) {
+			return -1;
+		}
+		if (decode_string(&p, end, scratch, &value, &value_len, &value_off) != 0) return -1;
+		//scratch可能重新分配过，最后再取地址
+		if (name_off >= 0) name = xnet_string_get_str(scratch) + name_off;
+		if (value_off >= 0) value = xnet_string_get_str(scratch) + value_off;
+		if (cb(ud, name, name_len, value, value_len) != 0) return -1;
+		if (prefix == 6)
+			add_entry(hp, name, name_len, value, value_len);
+		fields = true;
+	}
+	return 0;
+}
+
+/*编码*/
+static void
+encode_int(xnet_string_t *out, uint8_t first, int prefix, uint32_t v) {
+	uint32_t mask = (1u << prefix) - 1;
+	char buf[8];
+	int n = 0;
+
+	if (v < mask) {
+		buf[n++] = (char)(first | v);
+	} else {
+		buf[n++] = (char)(first | mask);
+		v -= mask;
+		while (v >= 128) {
+			buf[n++] = (char)((v & 0x7f) | 0x80);
+			v >>= 7;
+		}
+		buf[n++] = (char)v;
+	}
+	xnet_string_append_buff(out, buf, n);
+}
+
+static void
+encode_string(xnet_string_t *out, const char *s, uint32_t len) {
+	uint32_t hlen = xnet_huffman_encoded_len(s, len);
+	if (hlen < len) {
+		encode_int(out, 0x80, 7, hlen);
+		xnet_huffman_encode(s, len, out);
+	} else {
+		encode_int(out, 0, 7, len);
+		xnet_string_append_buff(out, s, len);
+	}
+}
+
+void
+xnet_hpack_encode(xnet_hpack_t *hp, const char *name, uint32_t name_len, const char *value, uint32_t value_len, int mode, xnet_string_t *out) {
+	const hpack_static_t *st;
+	xnet_hpack_entry_t *e;
+	uint32_t i, name_index = 0;
+
+	if (hp->update) {
+		encode_int(out, 0x20, 5, hp->max_size);
+		hp->update = false;
+	}
+	for (i=0; i<HPACK_STATIC_COUNT; i++) {
+		st = &g_static_table[i];
+		if (st->name_len != name_len || memcmp(st->name, name, name_len) != 0) continue;
+		if (st->value_len == value_len && memcmp(st->value, value, value_len) == 0) {
+			encode_int(out, 0x80, 7, i + 1);
+			return;
+		}
+		if (name_index == 0) name_index = i + 1;
+	}
+	if (mode == XNET_HPACK_INDEX) {
+		for (i=0; i<hp->count; i++) {
+			e = get_dynamic(hp, i);
+			if (e->name_len != name_len || memcmp(e->name, name, name_len) != 0) continue;
+			if (e->value_len == value_len && memcmp(e->value, value, value_len) == 0) {
+				encode_int(out, 0x80, 7, HPACK_STATIC_COUNT + 1 + i);
+				return;
+			}
+			if (name_index == 0) name_index = HPACK_STATIC_COUNT + 1 + i;
+		}
+	}
+
+	if (mode == XNET_HPACK_INDEX)
+		encode_int(out, 0x40, 6, name_index);
+	else
+		encode_int(out, mode == XNET_HPACK_NEVER_INDEX ? 0x10 : 0x00, 4, name_index);
+	if (name_index == 0)
+		encode_string(out, name, name_len);
+	encode_string(out, value, value_len);
+	if (mode == XNET_HPACK_INDEX)
+		add_entry(hp, name, name_len, value, value_len);
+}
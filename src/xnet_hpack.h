@@ -0,0 +1,63 @@
+#ifndef _XNET_HPACK_H_
+#define _XNET_HPACK_H_
+#include <stdint.h>
+#include <stdbool.h>
+#include "xnet_string.h"
+
+/*
+ * HPACK(RFC 7541)：http2的header压缩，静态表+动态表+huffman编码。
+ * 编码和解码各用一个xnet_hpack_t，分别对应连接的两个方向，动态表的状态必须和对端一致，
+ * 所以每个header块都要完整解码，即使请求会被拒绝。
+ */
+#define XNET_HPACK_DEFAULT_SIZE 4096
+
+//编码方式：加入动态表，不加入(每次变化的值，例如content-length)，永不加入(敏感的值，代理也不能加入)
+#define XNET_HPACK_INDEX 0
+#define XNET_HPACK_NO_INDEX 1
+#define XNET_HPACK_NEVER_INDEX 2
+
+typedef struct {
+	char *name;//name和value在一次分配中
+	char *value;
+	uint32_t name_len;
+	uint32_t value_len;
+} xnet_hpack_entry_t;
+
+/*
+ * 动态表是环形数组，head为最新加入的位置，size按RFC计算(每项32+名字+值的长度)。
+ * max_size为当前上限，解码时不能超过limit(本端SETTINGS_HEADER_TABLE_SIZE)；
+ * 编码时对端修改了上限，下一个header块开头要先发送大小更新(update为true)
+ */
+typedef struct {
+	xnet_hpack_entry_t *entries;
+	uint32_t capacity;
+	uint32_t count;
+	uint32_t head;
+	uint32_t size;
+	uint32_t max_size;
+	uint32_t limit;
+	bool update;
+} xnet_hpack_t;
+
+void xnet_hpack_init(xnet_hpack_t *hp, uint32_t limit);
+void xnet_hpack_clear(xnet_hpack_t *hp);
+//编码端收到对端的SETTINGS_HEADER_TABLE_SIZE，动态表最多用到4096
+void xnet_hpack_set_limit(xnet_hpack_t *hp, uint32_t limit);
+
+/*
+ * 解码一个完整的header块，每个header回调一次，name和value只在回调期间有效；
+ * 回调返回非0时停止解码(动态表会和对端不一致，连接不能再用)。
+ * scratch用来存放huffman解码的结果，可以复用。成功返回0，格式错误返回-1
+ */
+typedef int (*xnet_hpack_field_cb)(void *ud, const char *name, uint32_t name_len, const char *value, uint32_t value_len);
+int xnet_hpack_decode(xnet_hpack_t *hp, const char *block, uint32_t sz, xnet_string_t *scratch, xnet_hpack_field_cb cb, void *ud);
+
+//编码一个header追加到out，name必须是小写；优先用表中的索引，字符串在huffman更短时使用huffman
+void xnet_hpack_encode(xnet_hpack_t *hp, const char *name, uint32_t name_len, const char *value, uint32_t value_len, int mode, xnet_string_t *out);
+
+//huffman编码和解码，解码时填充不是EOS的前缀或者出现EOS时返回-1
+void xnet_huffman_encode(const char *s, uint32_t sz, xnet_string_t *out);
+uint32_t xnet_huffman_encoded_len(const char *s, uint32_t sz);
+int xnet_huffman_decode(const char *s, uint32_t sz, xnet_string_t *out);
+
+#endif //_XNET_HPACK_H_
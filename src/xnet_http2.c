@@ -0,0 +1,818 @@
+#include "xnet_http2.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+
+#define H2_PREFACE 0
+#define H2_SETTINGS 1//preface之后第一帧必须是SETTINGS
+#define H2_FRAMES 2
+
+#define H2_WINDOW_MAX 0x7FFFFFFF
+#define H2_VERSION "HTTP/2.0"
+
+struct xnet_http2_stream {
+	struct xnet_http2_stream *next;
+	uint32_t id;
+	bool headers_done;
+	bool remote_closed;//收到END_STREAM
+	bool local_closed;//发送了END_STREAM
+	bool responded;
+	bool refused;
+	bool bad;//header不合法，header块解码完后重置
+	int64_t send_window;
+	int64_t recv_window;
+	xnet_string_t fields;//解码后的header，按[长度][名字][长度][值]存放
+	xnet_string_t *body;
+	xnet_string_t data;//等待流控窗口的响应body
+	uint32_t data_off;
+};
+
+static inline uint32_t
+read_be24(const char *p) {
+	return ((uint32_t)(uint8_t)p[0] << 16) | ((uint32_t)(uint8_t)p[1] << 8) | (uint8_t)p[2];
+}
+
+static inline uint32_t
+read_be32(const char *p) {
+	return ((uint32_t)(uint8_t)p[0] << 24) | ((uint32_t)(uint8_t)p[1] << 16) |
+		((uint32_t)(uint8_t)p[2] << 8) | (uint8_t)p[3];
+}
+
+static inline void
+write_be32(char *p, uint32_t v) {
+	p[0] = (char)(v >> 24);
+	p[1] = (char)(v >> 16);
+	p[2] = (char)(v >> 8);
+	p[3] = (char)v;
+}
+
+void
+xnet_pack_http2_frame(uint8_t type, uint8_t flags, uint32_t stream_id, const char *payload, uint32_t len, xnet_string_t *out) {
+	char header[XNET_H2_FRAME_HEADER];
+	header[0] = (char)(len >> 16);
+	header[1] = (char)(len >> 8);
+	header[2] = (char)len;
+	header[3] = (char)type;
+	header[4] = (char)flags;
+	write_be32(header + 5, stream_id & H2_WINDOW_MAX);
+	xnet_string_append_buff(out, header, XNET_H2_FRAME_HEADER);
+	if (len)
+		xnet_string_append_buff(out, payload, len);
+}
+
+static void
+h2_flush(xnet_http2_t *h2) {
+	xnet_socket_t *s;
+	if (h2->ctx == NULL || xnet_string_get_size(&h2->out) == 0) return;
+	//socket已经关闭时send_buffer不会接管内存
+	s = xnet_get_socket(h2->ctx, h2->sock_id);
+	if (s == NULL || s->type == SOCKET_TYPE_INVALID || s->closing) {
+		h2->out.size = 0;
+		return;
+	}
+	xnet_tcp_send_buffer(h2->ctx, h2->sock_id, h2->out.str, xnet_string_get_size(&h2->out), true);
+	xnet_string_init(&h2->out);
+}
+
+static void
+send_rst(xnet_http2_t *h2, uint32_t stream_id, uint32_t code) {
+	char payload[4];
+	write_be32(payload, code);
+	xnet_pack_http2_frame(XNET_H2_RST_STREAM, 0, stream_id, payload, 4, &h2->out);
+}
+
+static void
+send_goaway(xnet_http2_t *h2, uint32_t code) {
+	char payload[8];
+	write_be32(payload, h2->last_stream_id);
+	write_be32(payload + 4, code);
+	xnet_pack_http2_frame(XNET_H2_GOAWAY, 0, 0, payload, 8, &h2->out);
+}
+
+static void
+send_window_update(xnet_http2_t *h2, uint32_t stream_id, uint32_t inc) {
+	char payload[4];
+	write_be32(payload, inc);
+	xnet_pack_http2_frame(XNET_H2_WINDOW_UPDATE, 0, stream_id, payload, 4, &h2->out);
+}
+
+static void
+h2_init(xnet_http2_t *h2, xnet_context_t *ctx, int sock_id) {
+	char settings[12];
+	h2->ctx = ctx;
+	h2->sock_id = sock_id;
+	h2->inited = true;
+	h2->state = H2_PREFACE;
+	h2->peer_max_frame = XNET_H2_MAX_FRAME;
+	h2->peer_window = XNET_H2_WINDOW;
+	h2->send_window = XNET_H2_WINDOW;
+	h2->recv_window = XNET_H2_WINDOW;
+	xnet_hpack_init(&h2->decoder, XNET_HPACK_DEFAULT_SIZE);
+	xnet_hpack_init(&h2->encoder, XNET_HPACK_DEFAULT_SIZE);
+
+	//服务端的preface就是SETTINGS，不需要等待
+	settings[0] = 0;
+	settings[1] = XNET_H2_SETTINGS_MAX_CONCURRENT_STREAMS;
+	write_be32(settings + 2, XNET_H2_MAX_STREAMS);
+	settings[6] = 0;
+	settings[7] = XNET_H2_SETTINGS_MAX_HEADER_LIST_SIZE;
+	write_be32(settings + 8, XNET_HTTP_MAX_HEADER);
+	xnet_pack_http2_frame(XNET_H2_SETTINGS, 0, 0, settings, sizeof(settings), &h2->out);
+}
+
+/*流*/
+static xnet_http2_stream_t *
+find_stream(xnet_http2_t *h2, uint32_t id) {
+	xnet_http2_stream_t *s;
+	for (s=h2->streams; s; s=s->next) {
+		if (s->id == id) return s;
+	}
+	return NULL;
+}
+
+static xnet_http2_stream_t *
+new_stream(xnet_http2_t *h2, uint32_t id) {
+	xnet_http2_stream_t *s = (xnet_http2_stream_t *)calloc(1, sizeof(xnet_http2_stream_t));
+	s->id = id;
+	s->send_window = h2->peer_window;
+	s->recv_window = XNET_H2_WINDOW;
+	s->next = h2->streams;
+	h2->streams = s;
+	h2->stream_count++;
+	if (id > h2->last_stream_id)
+		h2->last_stream_id = id;
+	return s;
+}
+
+static void
+free_stream(xnet_http2_stream_t *s) {
+	xnet_string_clear(&s->fields);
+	xnet_string_clear(&s->data);
+	if (s->body)
+		xnet_string_destroy(s->body);
+	free(s);
+}
+
+static void
+remove_stream(xnet_http2_t *h2, xnet_http2_stream_t *s) {
+	xnet_http2_stream_t **link = &h2->streams;
+	while (*link != s)
+		link = &(*link)->next;
+	*link = s->next;
+	h2->stream_count--;
+	free_stream(s);
+}
+
+static void
+reset_stream(xnet_http2_t *h2, xnet_http2_stream_t *s, uint32_t code) {
+	send_rst(h2, s->id, code);
+	remove_stream(h2, s);
+}
+
+//发送窗口允许的数据，返回是否发送完
+static bool
+flush_stream(xnet_http2_t *h2, xnet_http2_stream_t *s) {
+	uint32_t left = xnet_string_get_size(&s->data) - s->data_off;
+	uint32_t n;
+	int64_t win;
+
+	while (left > 0) {
+		win = h2->send_window < s->send_window ? h2->send_window : s->send_window;
+		if (win <= 0) return false;
+		n = left;
+		if (n > win) n = (uint32_t)win;
+		if (n > h2->peer_max_frame) n = h2->peer_max_frame;
+		xnet_pack_http2_frame(XNET_H2_DATA, n == left ? XNET_H2_FLAG_END_STREAM : 0, s->id,
+			xnet_string_get_str(&s->data) + s->data_off, n, &h2->out);
+		s->data_off += n;
+		left -= n;
+		h2->send_window -= n;
+		s->send_window -= n;
+	}
+	s->local_closed = true;
+	return true;
+}
+
+//窗口变大后继续发送所有等待的流
+static void
+flush_streams(xnet_http2_t *h2) {
+	xnet_http2_stream_t *s = h2->streams, *next;
+	while (s && h2->send_window > 0) {
+		next = s->next;
+		if (s->responded && !s->local_closed && flush_stream(h2, s) && s->remote_closed)
+			remove_stream(h2, s);
+		s = next;
+	}
+}
+
+/*请求*/
+static int
+field_callback(void *ud, const char *name, uint32_t name_len, const char *value, uint32_t value_len) {
+	xnet_http2_stream_t *s = (xnet_http2_stream_t *)ud;
+	uint32_t i;
+	//trailer和被拒绝的流只需要保持动态表同步
+	if (s->headers_done || s->refused || s->bad) return 0;
+	if (xnet_string_get_size(&s->fields) + name_len + value_len > XNET_HTTP_MAX_HEADER) {
+		s->bad = true;
+		return 0;
+	}
+	//名字必须是小写
+	for (i=0; i<name_len; i++) {
+		if (name[i] >= 'A' && name[i] <= 'Z') {
+			s->bad = true;
+			return 0;
+		}
+	}
+	xnet_string_append_buff(&s->fields, (const char *)&name_len, sizeof(name_len));
+	xnet_string_append_buff(&s->fields, name, name_len);
+	xnet_string_append_buff(&s->fields, (const char *)&value_len, sizeof(value_len));
+	xnet_string_append_buff(&s->fields, value, value_len);
+	return 0;
+}
+
+//header转移到h2->fields，请求中的view引用它，回调后释放；缺少伪header时返回-1
+static int
+build_request(xnet_http2_t *h2, xnet_http2_stream_t *s) {
+	xnet_httprequest_t *req = &h2->req;
+	const char *p, *end, *name, *value;
+	uint32_t name_len, value_len;
+	bool regular = false;
+
+	xnet_string_clear(&h2->fields);
+	h2->fields = s->fields;
+	xnet_string_init(&s->fields);
+	p = xnet_string_get_str(&h2->fields);
+	end = p + xnet_string_get_size(&h2->fields);
+	while (p < end) {
+		memcpy(&name_len, p, sizeof(name_len));
+		name = p + sizeof(name_len);
+		p = name + name_len;
+		memcpy(&value_len, p, sizeof(value_len));
+		value = p + sizeof(value_len);
+		p = value + value_len;
+
+		if (name_len == 0 || name[0] != ':') {
+			regular = true;
+			xnet_add_http_header_view(req, name, name_len, value, value_len);
+			continue;
+		}
+		//伪header必须在前面
+		if (regular) return -1;
+		if (name_len == 7 && memcmp(name, ":method", 7) == 0)
+			xnet_string_view(&req->method, value, value_len);
+		else if (name_len == 5 && memcmp(name, ":path", 5) == 0)
+			xnet_string_view(&req->url, value, value_len);
+		else if (name_len == 10 && memcmp(name, ":authority", 10) == 0)
+			xnet_add_http_header_view(req, "host", 4, value, value_len);
+		else if (name_len != 7 || memcmp(name, ":scheme", 7) != 0)
+			return -1;
+	}
+	if (xnet_string_get_size(&req->method) == 0 || xnet_string_get_size(&req->url) == 0)
+		return -1;
+	xnet_string_view(&req->version, H2_VERSION, sizeof(H2_VERSION) - 1);
+	req->body = s->body;
+	s->body = NULL;
+	req->content_length = req->body ? xnet_string_get_size(req->body) : 0;
+	req->body_len = req->content_length;
+	req->keep_alive = true;
+	req->code = 200;
+	return 0;
+}
+
+static void
+deliver_request(xnet_unpacker_t *up, xnet_http2_t *h2, xnet_http2_stream_t *s) {
+	if (s->bad || build_request(h2, s) != 0) {
+		xnet_clear_http2(h2);
+		reset_stream(h2, s, XNET_H2_PROTOCOL_ERROR);
+		return;
+	}
+	h2->stream_id = s->id;
+	up->full = true;
+}
+
+//body超过限制，先回复413再重置，客户端不用继续发送
+static void
+reject_body(xnet_http2_t *h2, xnet_http2_stream_t *s) {
+	//已经回复过的流不能再发HEADERS，响应发完了用NO_ERROR，否则CANCEL
+	if (s->responded) {
+		reset_stream(h2, s, s->local_closed ? XNET_H2_NO_ERROR : XNET_H2_CANCEL);
+		return;
+	}
+	h2->scratch.size = 0;
+	xnet_hpack_encode(&h2->encoder, ":status", 7, "413", 3, XNET_HPACK_INDEX, &h2->scratch);
+	xnet_hpack_encode(&h2->encoder, "content-length", 14, "0", 1, XNET_HPACK_NO_INDEX, &h2->scratch);
+	xnet_pack_http2_frame(XNET_H2_HEADERS, XNET_H2_FLAG_END_HEADERS | XNET_H2_FLAG_END_STREAM, s->id,
+		xnet_string_get_str(&h2->scratch), xnet_string_get_size(&h2->scratch), &h2->out);
+	reset_stream(h2, s, XNET_H2_NO_ERROR);
+}
+
+static int
+header_block_done(xnet_unpacker_t *up, xnet_http2_t *h2, uint32_t stream_id, uint8_t flags, const char *block, uint32_t sz) {
+	xnet_http2_stream_t *s = find_stream(h2, stream_id);
+	bool trailer = s->headers_done;
+
+	if (xnet_hpack_decode(&h2->decoder, block, sz, &h2->scratch, field_callback, s) != 0)
+		return XNET_H2_COMPRESSION_ERROR;
+	if (s->refused) {
+		reset_stream(h2, s, XNET_H2_REFUSED_STREAM);
+		return 0;
+	}
+	//trailer必须结束流
+	if (trailer && !(flags & XNET_H2_FLAG_END_STREAM)) {
+		reset_stream(h2, s, XNET_H2_PROTOCOL_ERROR);
+		return 0;
+	}
+	s->headers_done = true;
+	if (flags & XNET_H2_FLAG_END_STREAM) {
+		s->remote_closed = true;
+		deliver_request(up, h2, s);
+	} else if (s->bad) {
+		reset_stream(h2, s, XNET_H2_PROTOCOL_ERROR);
+	}
+	return 0;
+}
+
+//去掉padding，返回-1表示长度不对
+static int
+strip_padding(uint8_t flags, const char **p, uint32_t *len) {
+	uint8_t pad;
+	if (!(flags & XNET_H2_FLAG_PADDED)) return 0;
+	if (*len < 1) return -1;
+	pad = (uint8_t)(*p)[0];
+	(*p)++;
+	(*len)--;
+	if (pad > *len) return -1;
+	*len -= pad;
+	return 0;
+}
+
+static int
+on_headers(xnet_unpacker_t *up, xnet_http2_t *h2, uint32_t id, uint8_t flags, const char *p, uint32_t len) {
+	xnet_http2_stream_t *s;
+
+	if (id == 0 || strip_padding(flags, &p, &len) != 0) return XNET_H2_PROTOCOL_ERROR;
+	if (flags & XNET_H2_FLAG_PRIORITY) {
+		if (len < 5) return XNET_H2_PROTOCOL_ERROR;
+		p += 5;
+		len -= 5;
+	}
+	s = find_stream(h2, id);
+	if (s == NULL) {
+		//新的流id必须是奇数并且递增
+		if (!(id & 1) || id <= h2->last_stream_id) return XNET_H2_PROTOCOL_ERROR;
+		s = new_stream(h2, id);
+		if (h2->stream_count > XNET_H2_MAX_STREAMS) s->refused = true;
+	} else if (s->remote_closed) {
+		return XNET_H2_STREAM_CLOSED;
+	}
+
+	if (flags & XNET_H2_FLAG_END_HEADERS)
+		return header_block_done(up, h2, id, flags, p, len);
+	h2->hblock.size = 0;
+	xnet_string_append_buff(&h2->hblock, p, len);
+	h2->hblock_stream = id;
+	h2->hblock_flags = flags;
+	return 0;
+}
+
+static int
+on_continuation(xnet_unpacker_t *up, xnet_http2_t *h2, uint32_t id, uint8_t flags, const char *p, uint32_t len) {
+	if (h2->hblock_stream == 0 || id != h2->hblock_stream) return XNET_H2_PROTOCOL_ERROR;
+	if (xnet_string_get_size(&h2->hblock) + len > XNET_HTTP_MAX_HEADER) return XNET_H2_ENHANCE_YOUR_CALM;
+	xnet_string_append_buff(&h2->hblock, p, len);
+	if (!(flags & XNET_H2_FLAG_END_HEADERS)) return 0;
+	h2->hblock_stream = 0;
+	return header_block_done(up, h2, id, h2->hblock_flags, xnet_string_get_str(&h2->hblock), xnet_string_get_size(&h2->hblock));
+}
+
+static int
+on_data(xnet_unpacker_t *up, xnet_http2_t *h2, uint32_t id, uint8_t flags, const char *p, uint32_t len) {
+	xnet_http2_stream_t *s;
+	uint32_t flow = len;
+
+	if (id == 0) return XNET_H2_PROTOCOL_ERROR;
+	if (id > h2->last_stream_id) return XNET_H2_PROTOCOL_ERROR;
+	if (strip_padding(flags, &p, &len) != 0) return XNET_H2_PROTOCOL_ERROR;
+	//padding也计入流控
+	h2->recv_window -= flow;
+	if (h2->recv_window < 0) return XNET_H2_FLOW_CONTROL_ERROR;
+	if (h2->recv_window <= XNET_H2_WINDOW / 2) {
+		send_window_update(h2, 0, (uint32_t)(XNET_H2_WINDOW - h2->recv_window));
+		h2->recv_window = XNET_H2_WINDOW;
+	}
+
+	s = find_stream(h2, id);
+	if (s == NULL || !s->headers_done || s->remote_closed) {
+		send_rst(h2, id, XNET_H2_STREAM_CLOSED);
+		return 0;
+	}
+	s->recv_window -= flow;
+	if (s->recv_window < 0) {
+		reset_stream(h2, s, XNET_H2_FLOW_CONTROL_ERROR);
+		return 0;
+	}
+	if (len > 0) {
+		if (s->body == NULL) s->body = xnet_string_create();
+		if (up->limit && xnet_string_get_size(s->body) + len > up->limit) {
+			reject_body(h2, s);
+			return 0;
+		}
+		xnet_string_append_buff(s->body, p, len);
+	}
+	if (flags & XNET_H2_FLAG_END_STREAM) {
+		s->remote_closed = true;
+		deliver_request(up, h2, s);
+	} else if (s->recv_window <= XNET_H2_WINDOW / 2) {
+		send_window_update(h2, id, (uint32_t)(XNET_H2_WINDOW - s->recv_window));
+		s->recv_window = XNET_H2_WINDOW;
+	}
+	return 0;
+}
+
+static int
+apply_settings(xnet_http2_t *h2, const char *p, uint32_t len) {
+	xnet_http2_stream_t *s;
+	uint16_t id;
+	uint32_t v, i;
+	int64_t delta;
+
+	for (i=0; i+6<=len; i+=6) {
+		id = (uint16_t)(((uint8_t)p[i] << 8) | (uint8_t)p[i+1]);
+		v = read_be32(p + i + 2);
+		switch (id) {
+			case XNET_H2_SETTINGS_HEADER_TABLE_SIZE:
+				xnet_hpack_set_limit(&h2->encoder, v);
+			break;
+			case XNET_H2_SETTINGS_ENABLE_PUSH:
+				if (v > 1) return XNET_H2_PROTOCOL_ERROR;
+			break;
+			case XNET_H2_SETTINGS_INITIAL_WINDOW_SIZE:
+				if (v > H2_WINDOW_MAX) return XNET_H2_FLOW_CONTROL_ERROR;
+				//已经打开的流按差值调整
+				delta = (int64_t)v - h2->peer_window;
+				for (s=h2->streams; s; s=s->next) {
+					s->send_window += delta;
+					if (s->send_window > H2_WINDOW_MAX) return XNET_H2_FLOW_CONTROL_ERROR;
+				}
+				h2->peer_window = v;
+			break;
+			case XNET_H2_SETTINGS_MAX_FRAME_SIZE:
+				if (v < XNET_H2_MAX_FRAME || v > 0xFFFFFF) return XNET_H2_PROTOCOL_ERROR;
+				h2->peer_max_frame = v;
+			break;
+		}
+	}
+	return 0;
+}
+
+static int
+on_settings(xnet_http2_t *h2, uint32_t id, uint8_t flags, const char *p, uint32_t len) {
+	int err;
+	if (id != 0) return XNET_H2_PROTOCOL_ERROR;
+	if (flags & XNET_H2_FLAG_ACK)
+		return len == 0 ? 0 : XNET_H2_FRAME_SIZE_ERROR;
+	if (len % 6 != 0) return XNET_H2_FRAME_SIZE_ERROR;
+	if ((err = apply_settings(h2, p, len)) != 0) return err;
+	xnet_pack_http2_frame(XNET_H2_SETTINGS, XNET_H2_FLAG_ACK, 0, NULL, 0, &h2->out);
+	flush_streams(h2);
+	return 0;
+}
+
+static int
+on_window_update(xnet_http2_t *h2, uint32_t id, const char *p, uint32_t len) {
+	xnet_http2_stream_t *s;
+	uint32_t inc;
+
+	if (len != 4) return XNET_H2_FRAME_SIZE_ERROR;
+	inc = read_be32(p) & H2_WINDOW_MAX;
+	if (id == 0) {
+		if (inc == 0) return XNET_H2_PROTOCOL_ERROR;
+		h2->send_window += inc;
+		if (h2->send_window > H2_WINDOW_MAX) return XNET_H2_FLOW_CONTROL_ERROR;
+		flush_streams(h2);
+		return 0;
+	}
+	if (id > h2->last_stream_id) return XNET_H2_PROTOCOL_ERROR;
+	//已经关闭的流忽略
+	if ((s = find_stream(h2, id)) == NULL) return 0;
+	if (inc == 0) {
+		reset_stream(h2, s, XNET_H2_PROTOCOL_ERROR);
+		return 0;
+	}
+	s->send_window += inc;
+	if (s->send_window > H2_WINDOW_MAX) {
+		reset_stream(h2, s, XNET_H2_FLOW_CONTROL_ERROR);
+		return 0;
+	}
+	if (s->responded && !s->local_closed && flush_stream(h2, s) && s->remote_closed)
+		remove_stream(h2, s);
+	return 0;
+}
+
+//处理一个完整的帧，返回连接错误的错误码
+static int
+process_frame(xnet_unpacker_t *up, xnet_http2_t *h2, const char *frame, uint32_t sz) {
+	uint32_t len = sz - XNET_H2_FRAME_HEADER;
+	uint8_t type = (uint8_t)frame[3];
+	uint8_t flags = (uint8_t)frame[4];
+	uint32_t id = read_be32(frame + 5) & H2_WINDOW_MAX;
+	const char *p = frame + XNET_H2_FRAME_HEADER;
+	xnet_http2_stream_t *s;
+
+	if (h2->state == H2_SETTINGS) {
+		if (type != XNET_H2_SETTINGS || (flags & XNET_H2_FLAG_ACK)) return XNET_H2_PROTOCOL_ERROR;
+		h2->state = H2_FRAMES;
+	}
+	//header块没有结束时只能是同一个流的CONTINUATION
+	if (h2->hblock_stream && type != XNET_H2_CONTINUATION) return XNET_H2_PROTOCOL_ERROR;
+
+	switch (type) {
+		case XNET_H2_DATA:
+			return on_data(up, h2, id, flags, p, len);
+		case XNET_H2_HEADERS:
+			return on_headers(up, h2, id, flags, p, len);
+		case XNET_H2_CONTINUATION:
+			return on_continuation(up, h2, id, flags, p, len);
+		case XNET_H2_PRIORITY:
+			if (id == 0) return XNET_H2_PROTOCOL_ERROR;
+			return len == 5 ? 0 : XNET_H2_FRAME_SIZE_ERROR;
+		case XNET_H2_RST_STREAM:
+			if (id == 0 || id > h2->last_stream_id) return XNET_H2_PROTOCOL_ERROR;
+			if (len != 4) return XNET_H2_FRAME_SIZE_ERROR;
+			if ((s = find_stream(h2, id)) != NULL) remove_stream(h2, s);
+			return 0;
+		case XNET_H2_SETTINGS:
+			return on_settings(h2, id, flags, p, len);
+		case XNET_H2_PUSH_PROMISE:
+			return XNET_H2_PROTOCOL_ERROR;
+		case XNET_H2_PING:
+			if (id != 0) return XNET_H2_PROTOCOL_ERROR;
+			if (len != 8) return XNET_H2_FRAME_SIZE_ERROR;
+			if (!(flags & XNET_H2_FLAG_ACK))
+				xnet_pack_http2_frame(XNET_H2_PING, XNET_H2_FLAG_ACK, 0, p, 8, &h2->out);
+			return 0;
+		case XNET_H2_GOAWAY:
+			if (id != 0) return XNET_H2_PROTOCOL_ERROR;
+			return len >= 8 ? 0 : XNET_H2_FRAME_SIZE_ERROR;
+		case XNET_H2_WINDOW_UPDATE:
+			return on_window_update(h2, id, p, len);
+	}
+	//未知类型忽略
+	return 0;
+}
+
+//当前需要的完整长度：preface，帧头，或者帧头+负载
+static uint32_t
+unit_size(xnet_http2_t *h2, const char *p, uint32_t sz) {
+	if (h2->state == H2_PREFACE) return XNET_H2_PREFACE_LEN;
+	if (sz < XNET_H2_FRAME_HEADER) return XNET_H2_FRAME_HEADER;
+	return XNET_H2_FRAME_HEADER + read_be24(p);
+}
+
+static int
+process_unit(xnet_unpacker_t *up, xnet_http2_t *h2, const char *p, uint32_t sz) {
+	if (h2->state == H2_PREFACE) {
+		if (memcmp(p, XNET_H2_PREFACE, XNET_H2_PREFACE_LEN) != 0) return XNET_H2_PROTOCOL_ERROR;
+		h2->state = H2_SETTINGS;
+		return 0;
+	}
+	return process_frame(up, h2, p, sz);
+}
+
+//连接错误：发送GOAWAY后关闭，写队列中的数据发送完才真正关闭
+static uint32_t
+h2_fail(xnet_http2_t *h2, int err) {
+	send_goaway(h2, (uint32_t)err);
+	h2_flush(h2);
+	if (h2->ctx)
+		xnet_close_socket(h2->ctx, h2->sock_id);
+	return 0;
+}
+
+uint32_t
+xnet_unpack_http2(xnet_unpacker_t *up, const char *buffer, uint32_t sz) {
+	xnet_http2_t *h2 = (xnet_http2_t *)up->arg;
+	uint32_t off = 0, need, n;
+	int err;
+
+	if (!h2->inited)
+		h2_init(h2, (xnet_context_t *)up->user_ptr, (int)(long)up->user_arg);
+
+	//先补齐上次不完整的帧
+	if (xnet_string_get_size(&h2->pending)) {
+		for (;;) {
+			need = unit_size(h2, xnet_string_get_str(&h2->pending), xnet_string_get_size(&h2->pending));
+			if (need > XNET_H2_FRAME_HEADER + XNET_H2_MAX_FRAME) return h2_fail(h2, XNET_H2_FRAME_SIZE_ERROR);
+			if (xnet_string_get_size(&h2->pending) >= need) break;
+			if (off == sz) return sz;
+			n = need - xnet_string_get_size(&h2->pending);
+			if (n > sz - off) n = sz - off;
+			xnet_string_append_buff(&h2->pending, buffer + off, n);
+			off += n;
+		}
+		err = process_unit(up, h2, xnet_string_get_str(&h2->pending), need);
+		h2->pending.size = 0;
+		if (err) return h2_fail(h2, err);
+		h2_flush(h2);
+		return off;
+	}
+
+	while (off < sz) {
+		need = unit_size(h2, buffer + off, sz - off);
+		if (need > XNET_H2_FRAME_HEADER + XNET_H2_MAX_FRAME) return h2_fail(h2, XNET_H2_FRAME_SIZE_ERROR);
+		if (sz - off < need) {
+			xnet_string_append_buff(&h2->pending, buffer + off, sz - off);
+			off = sz;
+			break;
+		}
+		if ((err = process_unit(up, h2, buffer + off, need)) != 0) return h2_fail(h2, err);
+		off += need;
+		//一次回调一个请求
+		if (up->full) break;
+	}
+	h2_flush(h2);
+	return off;
+}
+
+void
+xnet_clear_http2(void *arg) {
+	xnet_http2_t *h2 = (xnet_http2_t *)arg;
+	xnet_clear_http_slice(&h2->req);
+	xnet_string_clear(&h2->fields);
+	h2->stream_id = 0;
+}
+
+void
+xnet_free_http2(void *arg) {
+	xnet_http2_t *h2 = (xnet_http2_t *)arg;
+	xnet_http2_stream_t *s, *next;
+
+	for (s=h2->streams; s; s=next) {
+		next = s->next;
+		free_stream(s);
+	}
+	xnet_clear_http(&h2->req);
+	xnet_string_clear(&h2->fields);
+	xnet_hpack_clear(&h2->decoder);
+	xnet_hpack_clear(&h2->encoder);
+	xnet_string_clear(&h2->pending);
+	xnet_string_clear(&h2->hblock);
+	xnet_string_clear(&h2->scratch);
+	xnet_string_clear(&h2->out);
+	memset(h2, 0, sizeof(*h2));
+}
+
+/*响应*/
+static bool
+hop_by_hop(const char *name, uint32_t len) {
+	static const char *hop[] = {"connection", "keep-alive", "proxy-connection", "transfer-encoding", "upgrade", NULL};
+	int i;
+	for (i=0; hop[i]; i++) {
+		if (strlen(hop[i]) == len && memcmp(hop[i], name, len) == 0) return true;
+	}
+	return false;
+}
+
+//编码"Key: value\r\n"格式的header，返回是否有content-length
+static bool
+encode_fields(xnet_http2_t *h2, const char *fields, uint32_t fields_sz, xnet_string_t *block) {
+	const char *p = fields, *end = fields + fields_sz, *colon, *value, *eol;
+	char name[256];
+	uint32_t name_len, i;
+	bool has_length = false;
+
+	while (p < end) {
+		eol = memchr(p, '\n', end - p);
+		if (eol == NULL) eol = end;
+		colon = memchr(p, ':', eol - p);
+		if (colon == NULL || colon == p || colon - p >= (long)sizeof(name)) {
+			p = eol + 1;
+			continue;
+		}
+		name_len = (uint32_t)(colon - p);
+		for (i=0; i<name_len; i++)
+			name[i] = (p[i] >= 'A' && p[i] <= 'Z') ? (char)(p[i] | 0x20) : p[i];
+		for (value=colon+1; value < eol && (*value == ' ' || *value == '\t'); value++);
+		p = eol + 1;
+		if (eol > value && eol[-1] == '\r') eol--;
+		if (hop_by_hop(name, name_len)) continue;
+		if (name_len == 14 && memcmp(name, "content-length", 14) == 0) has_length = true;
+		//每次变化的值不加入动态表
+		xnet_hpack_encode(&h2->encoder, name, name_len, value, (uint32_t)(eol - value),
+			(has_length && name_len == 14) || (name_len == 4 && memcmp(name, "date", 4) == 0) ?
+			XNET_HPACK_NO_INDEX : XNET_HPACK_INDEX, block);
+	}
+	return has_length;
+}
+
+int
+xnet_http2_respond(xnet_http2_t *h2, uint32_t stream_id, int code, const char *fields, uint32_t fields_sz,
+	const char *body, uint32_t body_sz) {
+	xnet_http2_stream_t *s = find_stream(h2, stream_id);
+	xnet_string_t *block = &h2->scratch;
+	char buf[16];
+	uint32_t off, n, total;
+	uint8_t type, flags;
+	int len;
+
+	if (s == NULL || s->responded || !s->headers_done) return -1;
+	s->responded = true;
+	block->size = 0;
+	len = snprintf(buf, sizeof(buf), "%d", code);
+	xnet_hpack_encode(&h2->encoder, ":status", 7, buf, (uint32_t)len, XNET_HPACK_INDEX, block);
+	if (!(fields && encode_fields(h2, fields, fields_sz, block)) && code != 204 && code != 304) {
+		len = snprintf(buf, sizeof(buf), "%u", body_sz);
+		xnet_hpack_encode(&h2->encoder, "content-length", 14, buf, (uint32_t)len, XNET_HPACK_NO_INDEX, block);
+	}
+
+	//header块超过对端的帧大小时分成CONTINUATION
+	total = xnet_string_get_size(block);
+	off = 0;
+	do {
+		n = total - off;
+		if (n > h2->peer_max_frame) n = h2->peer_max_frame;
+		type = off == 0 ? XNET_H2_HEADERS : XNET_H2_CONTINUATION;
+		flags = (off + n == total) ? XNET_H2_FLAG_END_HEADERS : 0;
+		if (off == 0 && body_sz == 0) flags |= XNET_H2_FLAG_END_STREAM;
+		xnet_pack_http2_frame(type, flags, stream_id, xnet_string_get_str(block) + off, n, &h2->out);
+		off += n;
+	} while (off < total);
+
+	if (body_sz == 0) {
+		s->local_closed = true;
+	} else {
+		xnet_string_set(&s->data, body, body_sz);
+		flush_stream(h2, s);
+	}
+	if (s->local_closed && s->remote_closed)
+		remove_stream(h2, s);
+	h2_flush(h2);
+	return 0;
+}
+
+/*h2c升级*/
+static int
+base64url_value(char c) {
+	if (c >= 'A' && c <= 'Z') return c - 'A';
+	if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+	if (c >= '0' && c <= '9') return c - '0' + 52;
+	if (c == '-' || c == '+') return 62;
+	if (c == '_' || c == '/') return 63;
+	return -1;
+}
+
+//HTTP2-Settings是base64url编码的SETTINGS负载，不带填充
+static int
+base64url_decode(const char *s, uint32_t sz, char *out, uint32_t out_sz) {
+	uint32_t i, n = 0, acc = 0, bits = 0;
+	int v;
+	for (i=0; i<sz && s[i] != '='; i++) {
+		if ((v = base64url_value(s[i])) < 0) return -1;
+		acc = (acc << 6) | (uint32_t)v;
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			if (n == out_sz) return -1;
+			out[n++] = (char)(acc >> bits);
+		}
+	}
+	return (int)n;
+}
+
+static bool
+has_token(xnet_string_t *value, const char *token) {
+	const char *p = xnet_string_get_str(value);
+	uint32_t sz = xnet_string_get_size(value), len = (uint32_t)strlen(token), i;
+	for (i=0; i+len<=sz; i++) {
+		if (strncasecmp(p + i, token, len) == 0 && (i == 0 || p[i-1] == ' ' || p[i-1] == ',') &&
+			(i + len == sz || p[i+len] == ' ' || p[i+len] == ','))
+			return true;
+	}
+	return false;
+}
+
+int
+xnet_http2_upgrade(xnet_http2_t *h2, xnet_context_t *ctx, int sock_id, xnet_httprequest_t *req) {
+	static const char rsp[] = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+	xnet_httpheader_t *upgrade = xnet_get_http_header(req, XNET_HTTP_H_UPGRADE);
+	xnet_httpheader_t *settings = xnet_get_http_header(req, XNET_HTTP_H_HTTP2_SETTINGS);
+	xnet_http2_stream_t *s;
+	char payload[256];
+	int len;
+
+	if (upgrade == NULL || settings == NULL || !has_token(&upgrade->value, "h2c")) return -1;
+	len = base64url_decode(xnet_string_get_str(&settings->value), xnet_string_get_size(&settings->value), payload, sizeof(payload));
+	if (len < 0 || len % 6 != 0) return -1;
+
+	//SETTINGS先放在out中，设置合法后跟在101之后发送
+	h2_init(h2, ctx, sock_id);
+	if (apply_settings(h2, payload, (uint32_t)len) != 0) return -1;
+	xnet_tcp_send_buffer(ctx, sock_id, rsp, sizeof(rsp) - 1, false);
+	//升级的请求是流1，已经收完
+	s = new_stream(h2, 1);
+	s->headers_done = true;
+	s->remote_closed = true;
+	h2_flush(h2);
+	return 0;
+}
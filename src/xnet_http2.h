@@ -0,0 +1,121 @@
+#ifndef _XNET_HTTP2_H_
+#define _XNET_HTTP2_H_
+#include "xnet.h"
+#include "xnet_packer.h"
+#include "xnet_hpack.h"
+
+/*
+ * http2明文(h2c)服务端，作为解包器使用：连接开头是preface(prior knowledge)，
+ * 或者先用http/1.1请求升级(xnet_http2_upgrade)。一个连接上的多个流交错到达，
+ * 每个流的请求(header和body)收完后回调一次，之后用xnet_http2_respond在同一个流上回复，
+ * 不需要按请求的顺序回复。SETTINGS、PING、WINDOW_UPDATE等控制帧由解包器自己处理。
+ * 发送使用up->user_ptr(context)和up->user_arg(sock_id)，user_ptr为NULL时输出留在out中(用于测试)。
+ * 协议错误时发送GOAWAY，关闭连接并返回解包失败。
+ */
+#define XNET_H2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define XNET_H2_PREFACE_LEN 24
+#define XNET_H2_FRAME_HEADER 9
+
+//帧类型
+#define XNET_H2_DATA 0x0
+#define XNET_H2_HEADERS 0x1
+#define XNET_H2_PRIORITY 0x2
+#define XNET_H2_RST_STREAM 0x3
+#define XNET_H2_SETTINGS 0x4
+#define XNET_H2_PUSH_PROMISE 0x5
+#define XNET_H2_PING 0x6
+#define XNET_H2_GOAWAY 0x7
+#define XNET_H2_WINDOW_UPDATE 0x8
+#define XNET_H2_CONTINUATION 0x9
+
+#define XNET_H2_FLAG_END_STREAM 0x1
+#define XNET_H2_FLAG_ACK 0x1
+#define XNET_H2_FLAG_END_HEADERS 0x4
+#define XNET_H2_FLAG_PADDED 0x8
+#define XNET_H2_FLAG_PRIORITY 0x20
+
+#define XNET_H2_SETTINGS_HEADER_TABLE_SIZE 0x1
+#define XNET_H2_SETTINGS_ENABLE_PUSH 0x2
+#define XNET_H2_SETTINGS_MAX_CONCURRENT_STREAMS 0x3
+#define XNET_H2_SETTINGS_INITIAL_WINDOW_SIZE 0x4
+#define XNET_H2_SETTINGS_MAX_FRAME_SIZE 0x5
+#define XNET_H2_SETTINGS_MAX_HEADER_LIST_SIZE 0x6
+
+//错误码
+#define XNET_H2_NO_ERROR 0x0
+#define XNET_H2_PROTOCOL_ERROR 0x1
+#define XNET_H2_INTERNAL_ERROR 0x2
+#define XNET_H2_FLOW_CONTROL_ERROR 0x3
+#define XNET_H2_STREAM_CLOSED 0x5
+#define XNET_H2_FRAME_SIZE_ERROR 0x6
+#define XNET_H2_REFUSED_STREAM 0x7
+#define XNET_H2_CANCEL 0x8
+#define XNET_H2_COMPRESSION_ERROR 0x9
+#define XNET_H2_ENHANCE_YOUR_CALM 0xb
+
+//本端的设置：同时打开的流、接收窗口(流和连接相同)、帧大小都使用默认值
+#define XNET_H2_MAX_STREAMS 100
+#define XNET_H2_WINDOW 65535
+#define XNET_H2_MAX_FRAME 16384
+
+typedef struct xnet_http2_stream xnet_http2_stream_t;
+
+/*
+ * 回调时req为完整的请求，stream_id为它的流：method、url来自:method、:path，
+ * :authority作为host header，version为"HTTP/2.0"，字段都是view，只在回调期间有效。
+ * up->limit限制每个请求的body大小(0表示不限制)，超过时回复413并重置这个流。
+ */
+typedef struct {
+	xnet_httprequest_t req;
+	uint32_t stream_id;
+	//以下为连接状态
+	xnet_context_t *ctx;
+	int sock_id;
+	bool inited;
+	uint8_t state;
+	uint32_t last_stream_id;
+	uint32_t stream_count;
+	xnet_http2_stream_t *streams;
+	uint32_t peer_max_frame;
+	uint32_t peer_window;//对端的SETTINGS_INITIAL_WINDOW_SIZE
+	int64_t send_window;//连接的发送窗口
+	int64_t recv_window;
+	xnet_hpack_t decoder;
+	xnet_hpack_t encoder;
+	xnet_string_t pending;//跨越多次接收的帧
+	xnet_string_t hblock;//没有END_HEADERS时拼接CONTINUATION
+	uint32_t hblock_stream;
+	uint8_t hblock_flags;
+	xnet_string_t scratch;
+	xnet_string_t fields;//回调中的请求引用的header
+	xnet_string_t out;
+} xnet_http2_t;
+
+/*
+ * up = xnet_unpacker_new(sizeof(xnet_http2_t), cb, xnet_unpack_http2, xnet_clear_http2, limit);
+ * up->fm = xnet_free_http2;
+ * up->user_ptr = ctx; up->user_arg = (void*)(long)sock_id;
+ */
+uint32_t xnet_unpack_http2(xnet_unpacker_t *up, const char *buffer, uint32_t sz);
+void xnet_clear_http2(void *arg);
+void xnet_free_http2(void *arg);
+
+/*
+ * 在stream_id上回复，fields为"Key: value\r\n"格式的header(名字转为小写，去掉Connection等逐跳header)，
+ * 没有content-length时按body添加。body超过流控窗口的部分复制后等待WINDOW_UPDATE。
+ * 可以在回调之后任何时候调用，流不存在(已经回复或者被重置)返回-1
+ */
+int xnet_http2_respond(xnet_http2_t *h2, uint32_t stream_id, int code, const char *fields, uint32_t fields_sz,
+	const char *body, uint32_t body_sz);
+
+/*
+ * 处理Upgrade: h2c请求：检查Upgrade和HTTP2-Settings，回复101并发送SETTINGS，
+ * 这个请求成为流1，之后用xnet_http2_respond(h2, 1, ...)回复。
+ * h2是新建的http2解包器的arg，调用者随后用它替换http解包器。不是合法的升级请求返回-1
+ */
+int xnet_http2_upgrade(xnet_http2_t *h2, xnet_context_t *ctx, int sock_id, xnet_httprequest_t *req);
+
+//封装一个帧，用于测试和客户端
+void xnet_pack_http2_frame(uint8_t type, uint8_t flags, uint32_t stream_id, const char *payload, uint32_t len, xnet_string_t *out);
+
+#endif //_XNET_HTTP2_H_
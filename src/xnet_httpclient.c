@@ -0,0 +1,453 @@
+#include "xnet_httpclient.h"
+#include <assert.h>
+#include <stddef.h>
+
+typedef struct http_call {
+	int id;
+	void *ud;
+	bool head;//HEAD请求的响应没有body
+	bool retry;//安全的方法，连接被服务端关闭时可以重发
+	char *data;//序列化后的请求，收到响应前保留，连接被服务端关闭时可以重发
+	int sz;
+	struct http_call *next;
+} http_call_t;
+
+typedef struct {
+	http_call_t *head;
+	http_call_t *tail;
+	int n;
+} call_queue_t;
+
+struct http_pool;
+
+typedef struct http_conn {
+	int sock_id;
+	bool connected;
+	bool closing;//收到了不保持连接的响应，不再发送新的请求
+	bool dead;//已经从连接池移除，等error回调再释放
+	bool served;//收到过响应，之后被服务端关闭可以认为是keep-alive超时
+	xnet_unpacker_t *up;
+	call_queue_t inflight;//已发送，等待响应
+	struct http_pool *pool;
+	struct http_conn *next;
+} http_conn_t;
+
+typedef struct http_pool {
+	char host[256];
+	int port;
+	int nconn;
+	int nconnecting;
+	http_conn_t *conns;
+	call_queue_t waiting;//还没有分配到连接
+	xnet_httpclient_t *cli;
+	struct http_pool *next;
+} http_pool_t;
+
+struct xnet_httpclient {
+	xnet_context_t *ctx;
+	xnet_httpclient_cb_t cb;
+	int max_conn;
+	int max_pipeline;
+	int next_id;
+	http_pool_t *pools;
+	call_queue_t failed;//下一轮循环再回调失败，保证调用者先拿到id
+	bool timer;
+};
+
+static void conn_response(xnet_unpacker_t *up, void *arg);
+
+static void
+queue_push(call_queue_t *q, http_call_t *call) {
+	call->next = NULL;
+	if (q->tail) q->tail->next = call;
+	else q->head = call;
+	q->tail = call;
+	q->n++;
+}
+
+static http_call_t *
+queue_pop(call_queue_t *q) {
+	http_call_t *call = q->head;
+	if (!call) return NULL;
+	q->head = call->next;
+	if (!q->head) q->tail = NULL;
+	q->n--;
+	call->next = NULL;
+	return call;
+}
+
+//把from整个插到to的前面，保持请求顺序
+static void
+queue_prepend(call_queue_t *to, call_queue_t *from) {
+	if (!from->head) return;
+	from->tail->next = to->head;
+	if (!to->tail) to->tail = from->tail;
+	to->head = from->head;
+	to->n += from->n;
+	from->head = from->tail = NULL;
+	from->n = 0;
+}
+
+//把from整个接到to的后面
+static void
+queue_append(call_queue_t *to, call_queue_t *from) {
+	if (!from->head) return;
+	if (to->tail) to->tail->next = from->head;
+	else to->head = from->head;
+	to->tail = from->tail;
+	to->n += from->n;
+	from->head = from->tail = NULL;
+	from->n = 0;
+}
+
+static void
+call_free(http_call_t *call) {
+	free(call->data);
+	free(call);
+}
+
+static void
+fail_queue(xnet_httpclient_t *cli, call_queue_t *q) {
+	http_call_t *call;
+	while ((call = queue_pop(q)) != NULL) {
+		cli->cb(cli, call->id, NULL, call->ud);
+		call_free(call);
+	}
+}
+
+//在xnet_httpclient_request中发现的失败，等到定时器回调时再通知
+static void
+fail_later(xnet_httpclient_t *cli, call_queue_t *q) {
+	if (!q->head) return;
+	queue_append(&cli->failed, q);
+	if (!cli->timer) {
+		cli->timer = true;
+		xnet_add_timer(cli->ctx, XNET_HTTPCLIENT_TIMER, 0);
+	}
+}
+
+//服务端关闭了连接，只重发安全的方法，其余的请求可能已经被执行过，按失败回调
+static void
+retry_inflight(xnet_httpclient_t *cli, http_pool_t *pool, http_conn_t *conn) {
+	call_queue_t retry = {NULL, NULL, 0};
+	call_queue_t fail = {NULL, NULL, 0};
+	http_call_t *call;
+	while ((call = queue_pop(&conn->inflight)) != NULL)
+		queue_push(call->retry ? &retry : &fail, call);
+	queue_prepend(&pool->waiting, &retry);
+	fail_queue(cli, &fail);
+}
+
+static http_conn_t *
+get_conn(xnet_context_t *ctx, int sock_id) {
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	xnet_unpacker_t *up;
+	if (!s || !s->unpacker) return NULL;
+	up = (xnet_unpacker_t *)s->unpacker;
+	if (up->cb != conn_response) return NULL;
+	return (http_conn_t *)up->user_ptr;
+}
+
+//每个响应结束后重置，并根据下一个请求是否是HEAD决定响应有没有body
+static void
+conn_clear(void *arg) {
+	xnet_unpacker_t *up = (xnet_unpacker_t *)((char *)arg - offsetof(xnet_unpacker_t, arg));
+	http_conn_t *conn = (http_conn_t *)up->user_ptr;
+	xnet_httpresponse_t *rsp = (xnet_httpresponse_t *)arg;
+	xnet_clear_http_rsp_slice(arg);
+	rsp->skip_body = conn->inflight.head && conn->inflight.head->head;
+}
+
+static void
+conn_response(xnet_unpacker_t *up, void *arg) {
+	http_conn_t *conn = (http_conn_t *)up->user_ptr;
+	xnet_httpclient_t *cli = conn->pool->cli;
+	xnet_httpresponse_t *rsp = (xnet_httpresponse_t *)arg;
+	http_call_t *call = queue_pop(&conn->inflight);
+
+	//没有对应请求的响应，当作格式错误
+	if (!call) {
+		conn->closing = true;
+		up->close = true;
+		return;
+	}
+	conn->served = true;
+	if (!rsp->keep_alive) {
+		//后面的请求不会再有响应，停止解析
+		conn->closing = true;
+		up->close = true;
+	}
+	cli->cb(cli, call->id, rsp, call->ud);
+	call_free(call);
+}
+
+static void
+conn_send(http_conn_t *conn, http_call_t *call) {
+	xnet_httpclient_t *cli = conn->pool->cli;
+	if (conn->inflight.n == 0)
+		((xnet_httpresponse_t *)conn->up->arg)->skip_body = call->head;
+	queue_push(&conn->inflight, call);
+	xnet_tcp_send_buffer(cli->ctx, conn->sock_id, call->data, call->sz, false);
+}
+
+static void
+conn_unlink(http_conn_t *conn) {
+	http_pool_t *pool = conn->pool;
+	http_conn_t **pp;
+	for (pp=&pool->conns; *pp; pp=&(*pp)->next) {
+		if (*pp == conn) {
+			*pp = conn->next;
+			break;
+		}
+	}
+	pool->nconn--;
+	if (!conn->connected) pool->nconnecting--;
+}
+
+//释放已经从连接池中移除的连接，socket需要已经关闭或者正在关闭
+static void
+conn_free(xnet_context_t *ctx, http_conn_t *conn) {
+	xnet_socket_t *s = xnet_get_socket(ctx, conn->sock_id);
+	if (s && s->unpacker == conn->up) s->unpacker = NULL;
+	xnet_unpacker_free(conn->up);
+	free(conn);
+}
+
+//主动关闭连接，只在recv回调中调用，xnet之后总会回调error_func，在那里释放
+static void
+conn_close(xnet_httpclient_t *cli, http_conn_t *conn) {
+	xnet_close_socket(cli->ctx, conn->sock_id);
+	conn->dead = true;//之后不能再访问pool，client可能已经销毁
+}
+
+static int
+conn_open(xnet_httpclient_t *cli, http_pool_t *pool) {
+	xnet_socket_t *s;
+	http_conn_t *conn;
+	int sock_id = xnet_tcp_connect_id(cli->ctx, pool->host, pool->port);
+	if (sock_id == -1) return -1;
+
+	conn = calloc(1, sizeof(*conn));
+	assert(conn);
+	conn->sock_id = sock_id;
+	conn->pool = pool;
+	conn->up = xnet_unpacker_new(sizeof(xnet_httpresponse_t), conn_response, xnet_unpack_http_rsp, conn_clear, 0);
+	conn->up->fm = xnet_free_http_rsp;
+	conn->up->user_ptr = conn;
+	s = xnet_get_socket(cli->ctx, sock_id);
+	s->unpacker = conn->up;
+	conn->next = pool->conns;
+	pool->conns = conn;
+	pool->nconn++;
+	pool->nconnecting++;
+	return 0;
+}
+
+static void
+pool_dispatch(xnet_httpclient_t *cli, http_pool_t *pool) {
+	http_conn_t *conn, *best;
+
+	while (pool->waiting.n > 0) {
+		//优先发给空闲的连接
+		best = NULL;
+		for (conn=pool->conns; conn; conn=conn->next) {
+			if (!conn->connected || conn->closing || conn->inflight.n >= cli->max_pipeline)
+				continue;
+			if (!best || conn->inflight.n < best->inflight.n)
+				best = conn;
+		}
+		if (best && (best->inflight.n == 0 || pool->nconn >= cli->max_conn)) {
+			conn_send(best, queue_pop(&pool->waiting));
+			continue;
+		}
+		//正在建立的连接不够处理等待的请求时再新建
+		if (pool->nconn < cli->max_conn && pool->nconnecting * cli->max_pipeline < pool->waiting.n) {
+			if (conn_open(cli, pool) == 0) continue;
+			if (pool->nconn == 0) fail_later(cli, &pool->waiting);
+		}
+		if (best) {
+			conn_send(best, queue_pop(&pool->waiting));
+			continue;
+		}
+		break;
+	}
+}
+
+static http_pool_t *
+get_pool(xnet_httpclient_t *cli, const char *host, int port) {
+	http_pool_t *pool;
+	for (pool=cli->pools; pool; pool=pool->next) {
+		if (pool->port == port && strcmp(pool->host, host) == 0)
+			return pool;
+	}
+	if (strlen(host) >= sizeof(pool->host)) return NULL;
+	pool = calloc(1, sizeof(*pool));
+	assert(pool);
+	strcpy(pool->host, host);
+	pool->port = port;
+	pool->cli = cli;
+	pool->next = cli->pools;
+	cli->pools = pool;
+	return pool;
+}
+
+xnet_httpclient_t *
+xnet_httpclient_create(xnet_context_t *ctx, xnet_httpclient_cb_t cb, int max_conn, int max_pipeline) {
+	xnet_httpclient_t *cli = calloc(1, sizeof(*cli));
+	assert(cli);
+	cli->ctx = ctx;
+	cli->cb = cb;
+	cli->max_conn = max_conn > 0 ? max_conn : 1;
+	cli->max_pipeline = max_pipeline > 0 ? max_pipeline : 1;
+	return cli;
+}
+
+void
+xnet_httpclient_destroy(xnet_httpclient_t *cli) {
+	http_pool_t *pool;
+	http_conn_t *conn;
+
+	while ((pool = cli->pools) != NULL) {
+		cli->pools = pool->next;
+		while ((conn = pool->conns) != NULL) {
+			pool->conns = conn->next;
+			fail_queue(cli, &conn->inflight);
+			xnet_close_socket(cli->ctx, conn->sock_id);
+			conn_free(cli->ctx, conn);
+		}
+		fail_queue(cli, &pool->waiting);
+		free(pool);
+	}
+	fail_queue(cli, &cli->failed);
+	free(cli);
+}
+
+int
+xnet_httpclient_request(xnet_httpclient_t *cli, const char *host, int port, const char *method,
+	const char *url, const char *headers, const char *body, int body_sz, void *ud) {
+	http_pool_t *pool;
+	http_call_t *call;
+	xnet_string_t out;
+	char line[320];
+
+	pool = get_pool(cli, host, port);
+	if (!pool) return -1;
+	if (!body) body_sz = 0;
+
+	xnet_string_init(&out);
+	xnet_string_append_buff(&out, method, strlen(method));
+	xnet_string_append_cs(&out, " ");
+	xnet_string_append_buff(&out, url, strlen(url));
+	xnet_string_append_cs(&out, " HTTP/1.1\r\n");
+	if (port == 80)
+		snprintf(line, sizeof(line), "Host: %s\r\n", host);
+	else
+		snprintf(line, sizeof(line), "Host: %s:%d\r\n", host, port);
+	xnet_string_append_cs(&out, line);
+	if (headers) xnet_string_append_buff(&out, headers, strlen(headers));
+	if (body_sz > 0 || strcmp(method, "POST") == 0 || strcmp(method, "PUT") == 0) {
+		snprintf(line, sizeof(line), "Content-Length: %d\r\n", body_sz);
+		xnet_string_append_cs(&out, line);
+	}
+	xnet_string_append_cs(&out, "\r\n");
+	if (body_sz > 0) xnet_string_append_buff(&out, body, body_sz);
+
+	call = calloc(1, sizeof(*call));
+	assert(call);
+	call->id = ++cli->next_id;
+	if (cli->next_id == 0x7FFFFFFF) cli->next_id = 0;
+	call->ud = ud;
+	call->head = strcmp(method, "HEAD") == 0;
+	call->retry = call->head || strcmp(method, "GET") == 0 ||
+		strcmp(method, "OPTIONS") == 0 || strcmp(method, "TRACE") == 0;
+	call->sz = (int)xnet_string_get_size(&out);
+	call->data = out.str;//接管内存
+
+	queue_push(&pool->waiting, call);
+	pool_dispatch(cli, pool);
+	return call->id;
+}
+
+int
+xnet_httpclient_connected(xnet_context_t *ctx, int sock_id, int error) {
+	http_conn_t *conn = get_conn(ctx, sock_id);
+	http_pool_t *pool;
+	xnet_httpclient_t *cli;
+	if (!conn) return -1;
+
+	pool = conn->pool;
+	cli = pool->cli;
+	if (error) {
+		//连接失败后socket由xnet关闭
+		conn_unlink(conn);
+		conn_free(ctx, conn);
+		if (pool->nconn == 0)
+			fail_queue(cli, &pool->waiting);
+		else
+			pool_dispatch(cli, pool);
+		return 0;
+	}
+	conn->connected = true;
+	pool->nconnecting--;
+	pool_dispatch(cli, pool);
+	return 0;
+}
+
+int
+xnet_httpclient_error(xnet_context_t *ctx, int sock_id, short what) {
+	http_conn_t *conn = get_conn(ctx, sock_id);
+	http_pool_t *pool;
+	xnet_httpclient_t *cli;
+	if (!conn) return -1;
+	if (conn->dead) {
+		conn_free(ctx, conn);
+		return 0;
+	}
+
+	pool = conn->pool;
+	cli = pool->cli;
+	//body到连接关闭为止的响应在这里结束
+	xnet_http_rsp_eof(conn->up);
+	conn_unlink(conn);
+	//服务端关闭了复用的连接，剩下的请求换连接重发
+	if (conn->closing || conn->served)
+		retry_inflight(cli, pool, conn);
+	else
+		fail_queue(cli, &conn->inflight);
+	conn_free(ctx, conn);
+	pool_dispatch(cli, pool);
+	return 0;
+}
+
+int
+xnet_httpclient_recv(xnet_context_t *ctx, int sock_id, const char *buffer, int sz) {
+	http_conn_t *conn = get_conn(ctx, sock_id);
+	http_pool_t *pool;
+	xnet_httpclient_t *cli;
+	if (!conn) return -1;
+	if (conn->dead) return 0;
+
+	pool = conn->pool;
+	cli = pool->cli;
+	if (xnet_unpacker_recv(conn->up, buffer, sz) != 0) {
+		//响应格式错误，连接上的请求都无法继续
+		conn_unlink(conn);
+		fail_queue(cli, &conn->inflight);
+		conn_close(cli, conn);
+	} else if (conn->closing) {
+		//服务端要关闭连接，还没有响应的请求重新排队
+		conn_unlink(conn);
+		retry_inflight(cli, pool, conn);
+		conn_close(cli, conn);
+	}
+	pool_dispatch(cli, pool);
+	return 0;
+}
+
+int
+xnet_httpclient_timeout(xnet_httpclient_t *cli, int id) {
+	if (id != XNET_HTTPCLIENT_TIMER) return -1;
+	cli->timer = false;
+	fail_queue(cli, &cli->failed);
+	return 0;
+}
@@ -0,0 +1,43 @@
+#ifndef _XNET_HTTPCLIENT_H_
+#define _XNET_HTTPCLIENT_H_
+#include "xnet.h"
+#include "xnet_packer.h"
+
+/*
+ * 非阻塞http客户端：每个host:port一个连接池，连接保持keep-alive，
+ * 每个连接上最多同时发送max_pipeline个请求(pipelining)，响应按请求顺序回调。
+ * client的socket也走context的回调，需要在connect_func/error_func/recv_func中
+ * 先调用对应的xnet_httpclient_xxx，返回0表示socket属于client，已经处理。
+ */
+typedef struct xnet_httpclient xnet_httpclient_t;
+
+/*
+ * 请求完成回调，rsp为NULL表示失败(连接失败、连接断开、响应格式错误)，
+ * rsp只在回调期间有效；回调中可以发起新的请求，但不能销毁client。
+ * 回调总是发生在xnet_httpclient_request返回之后。
+ * 已经发出的请求遇到连接断开时，只有GET/HEAD/OPTIONS/TRACE会换连接重发，其余的按失败回调。
+ */
+typedef void (*xnet_httpclient_cb_t)(xnet_httpclient_t *cli, int req_id, xnet_httpresponse_t *rsp, void *ud);
+
+xnet_httpclient_t *xnet_httpclient_create(xnet_context_t *ctx, xnet_httpclient_cb_t cb, int max_conn, int max_pipeline);
+//未完成的请求以rsp为NULL回调
+void xnet_httpclient_destroy(xnet_httpclient_t *cli);
+
+/*
+ * headers为"Key: value\r\n"格式的额外header，可以为NULL，Host和Content-Length会自动添加
+ * 返回请求id，-1表示失败
+ */
+int xnet_httpclient_request(xnet_httpclient_t *cli, const char *host, int port, const char *method,
+	const char *url, const char *headers, const char *body, int body_sz, void *ud);
+
+/*
+ * client用id为XNET_HTTPCLIENT_TIMER的定时器延迟回调，需要在timeout_func中先调用
+ * xnet_httpclient_timeout，返回0表示定时器属于client；自己的定时器不要使用这个id
+ */
+#define XNET_HTTPCLIENT_TIMER (-0x48545450)
+int xnet_httpclient_timeout(xnet_httpclient_t *cli, int id);
+int xnet_httpclient_connected(xnet_context_t *ctx, int sock_id, int error);
+int xnet_httpclient_error(xnet_context_t *ctx, int sock_id, short what);
+int xnet_httpclient_recv(xnet_context_t *ctx, int sock_id, const char *buffer, int sz);
+
+#endif //_XNET_HTTPCLIENT_H_
@@ -60,16 +60,21 @@ listen_func(xnet_context_t *ctx, int sock_id, int acc_sock_id) {
 			return;
 		}
 	}
+	sniff_accept(ctx, L, sock_id, acc_sock_id);
+	proxyproto_accept(ctx, L, sock_id, acc_sock_id);
 }
 
 static void
 error_func(xnet_context_t *ctx, int sock_id, short what) {
 	lua_State *L = ctx->user_ptr;
+	if (xnet_httpclient_error(ctx, sock_id, what) == 0) return;
 	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
 	if (s->unpacker) {
 		xnet_unpacker_free(s->unpacker);
 		s->unpacker = NULL;
 	}
+	sniff_close(L, sock_id);
+	proxyproto_close(L, sock_id);
 
 	int ftype = lua_getfield(L, LUA_REGISTRYINDEX, "reg_funcs");
 	if (ftype != LUA_TTABLE) {
@@ -89,10 +94,15 @@ error_func(xnet_context_t *ctx, int sock_id, short what) {
 
 static int
 recv_func(xnet_context_t *ctx, int sock_id, char *buffer, int size, xnet_addr_t *addr_info) {
+	if (xnet_httpclient_recv(ctx, sock_id, buffer, size) == 0) return 0;
 	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
-	if (s->unpacker != NULL) {
-		if (xnet_unpacker_recv(s->unpacker, buffer, size) != 0) {
+	xnet_unpacker_t *up = s->unpacker;
+	if (up != NULL) {
+		//回调中替换或移除的解包器由xnet_unpacker_recv释放
+		if (xnet_unpacker_recv(up, buffer, size) != 0) {
+			//解包失败后剩余数据无法再正确解析，回调中已经放入写队列的响应发送完后关闭
 			xnet_error(ctx, "unpacker recv error");
+			xnet_close_socket(ctx, sock_id);
 		}
 		return 0;
 	}
@@ -122,6 +132,8 @@ recv_func(xnet_context_t *ctx, int sock_id, char *buffer, int size, xnet_addr_t
 static void
 timeout_func(xnet_context_t *ctx, int id) {
 	lua_State *L = ctx->user_ptr;
+	//http客户端的定时器不通知lua
+	if (http_client_timeout(L, id) == 0) return;
     int ftype = lua_getfield(L, LUA_REGISTRYINDEX, "reg_funcs");
     if (ftype != LUA_TTABLE) {
     	xnet_error(ctx, "reg_funcs is not a table %d", ftype);
@@ -161,6 +173,8 @@ command_func(xnet_context_t *ctx, xnet_context_t *source, int command, void *dat
 static void
 connect_func(struct xnet_context_t *ctx, int sock_id, int error) {
 	lua_State *L = ctx->user_ptr;
+	//http客户端的连接不通知lua
+	if (xnet_httpclient_connected(ctx, sock_id, error) == 0) return;
 	int ftype = lua_getfield(L, LUA_REGISTRYINDEX, "reg_funcs");
 	if (ftype != LUA_TTABLE) {
 		xnet_error(ctx, "reg_funcs is not a table %d", ftype);
@@ -176,10 +190,29 @@ connect_func(struct xnet_context_t *ctx, int sock_id, int error) {
 	}
 }
 
+static void
+drain_func(struct xnet_context_t *ctx, int sock_id, bool writable) {
+	lua_State *L = ctx->user_ptr;
+	int ftype = lua_getfield(L, LUA_REGISTRYINDEX, "reg_funcs");
+	if (ftype != LUA_TTABLE) {
+		xnet_error(ctx, "reg_funcs is not a table %d", ftype);
+		return;
+	}
+	if (lua_getfield(L, -1, "drain") == LUA_TFUNCTION) {
+		lua_pushinteger(L, sock_id);
+		lua_pushboolean(L, writable);
+		if (lua_pcall(L, 2, 0, 0) != LUA_OK) {
+			xnet_error(ctx, "call drain error:%s", lua_tostring(L, -1));
+			return;
+		}
+	}
+}
+
 static void
 bind_event(xnet_context_t *ctx) {
 	xnet_register_event(ctx, listen_func, error_func, recv_func,            \
     					connect_func, timeout_func, command_func);
+	xnet_register_drain(ctx, drain_func);
 }
 
 static void
@@ -270,6 +303,7 @@ main(int argc, char **argv) {
 
 	call_lua_stop(L, ctx);
 
+	xnet_release_lua(L);
 	lua_close(L);
 	xnet_destroy_context(ctx);
 	xnet_deinit();
@@ -0,0 +1,305 @@
+#include "xnet_memcache.h"
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+
+#define MC_STORAGE_BYTES_TOKEN 4
+
+bool
+xnet_mc_slice_equal(const xnet_mc_slice_t *s, const char *cs) {
+	uint32_t len = strlen(cs);
+	return s->len == len && memcmp(s->str, cs, len) == 0;
+}
+
+static int
+mc_parse_uint(const xnet_mc_slice_t *s, uint64_t max, uint64_t *v) {
+	uint64_t n = 0;
+	uint32_t i;
+	if (s->len == 0) return -1;
+	for (i=0; i<s->len; i++) {
+		if (s->str[i] < '0' || s->str[i] > '9' || n > (max - (s->str[i] - '0')) / 10) return -1;
+		n = n * 10 + (s->str[i] - '0');
+	}
+	*v = n;
+	return 0;
+}
+
+static int
+mc_parse_int(const xnet_mc_slice_t *s, int64_t *v) {
+	xnet_mc_slice_t t = *s;
+	uint64_t n;
+	bool neg = (t.len > 0 && t.str[0] == '-');
+	if (neg) {
+		t.str++;
+		t.len--;
+	}
+	if (mc_parse_uint(&t, INT64_MAX, &n) != 0) return -1;
+	*v = neg ? -(int64_t)n : (int64_t)n;
+	return 0;
+}
+
+static void
+mc_add_token(xnet_memcache_t *mc, const char *str, uint32_t len) {
+	if (mc->ntokens == mc->token_cap) {
+		mc->token_cap = mc->token_cap ? mc->token_cap * 2 : 16;
+		mc->tokens = realloc(mc->tokens, mc->token_cap * sizeof(xnet_mc_slice_t));
+		assert(mc->tokens);
+	}
+	mc->tokens[mc->ntokens].str = str;
+	mc->tokens[mc->ntokens].len = len;
+	mc->ntokens++;
+}
+
+static bool
+mc_is_storage(const xnet_mc_slice_t *cmd) {
+	return xnet_mc_slice_equal(cmd, "set") || xnet_mc_slice_equal(cmd, "add") ||
+		xnet_mc_slice_equal(cmd, "replace") || xnet_mc_slice_equal(cmd, "append") ||
+		xnet_mc_slice_equal(cmd, "prepend") || xnet_mc_slice_equal(cmd, "cas");
+}
+
+//按空格切分命令行(连续的空格当作一个)，存储命令返回数据块的长度，其他返回0，格式错误返回-1
+static int64_t
+mc_parse_line(xnet_memcache_t *mc, const char *line, uint32_t line_len) {
+	const char *p = line, *end = line + line_len - 1, *s;
+	uint64_t v;
+	uint32_t args;
+
+	if (end > line && end[-1] == '\r') end--;
+	mc->ntokens = 0;
+	while (p < end) {
+		s = memchr(p, ' ', end - p);
+		if (s == NULL) s = end;
+		if (s > p) mc_add_token(mc, p, (uint32_t)(s - p));
+		p = s + 1;
+	}
+	if (mc->ntokens == 0) return -1;
+	mc->noreply = xnet_mc_slice_equal(&mc->tokens[mc->ntokens-1], "noreply");
+	mc->storage = mc_is_storage(&mc->tokens[0]);
+	if (!mc->storage) return 0;
+
+	//<cmd> <key> <flags> <exptime> <bytes> [<cas>] [noreply]
+	args = xnet_mc_slice_equal(&mc->tokens[0], "cas") ? 6 : 5;
+	if (mc->ntokens != args + (mc->noreply ? 1 : 0)) return -1;
+	if (mc_parse_uint(&mc->tokens[2], UINT32_MAX, &v) != 0) return -1;
+	mc->flags = (uint32_t)v;
+	if (mc_parse_int(&mc->tokens[3], &mc->exptime) != 0) return -1;
+	if (args == 6 && mc_parse_uint(&mc->tokens[5], UINT64_MAX, &mc->cas) != 0) return -1;
+	if (mc_parse_uint(&mc->tokens[MC_STORAGE_BYTES_TOKEN], UINT32_MAX - 2, &v) != 0) return -1;
+	return (int64_t)v;
+}
+
+static int
+mc_parse_header(xnet_memcache_t *mc, const uint8_t *p) {
+	xnet_mc_header_t *h = &mc->header;
+	int i;
+
+	h->magic = p[0];
+	h->opcode = p[1];
+	h->key_len = (uint16_t)(p[2] << 8 | p[3]);
+	h->extras_len = p[4];
+	h->data_type = p[5];
+	h->status = (uint16_t)(p[6] << 8 | p[7]);
+	h->body_len = (uint32_t)p[8] << 24 | (uint32_t)p[9] << 16 | (uint32_t)p[10] << 8 | p[11];
+	memcpy(&h->opaque, p + 12, 4);
+	h->cas = 0;
+	for (i=0; i<8; i++)
+		h->cas = h->cas << 8 | p[16+i];
+	if (h->magic != XNET_MC_MAGIC_REQUEST && h->magic != XNET_MC_MAGIC_RESPONSE) return -1;
+	if ((uint64_t)h->extras_len + h->key_len > h->body_len) return -1;
+	if (h->body_len > UINT32_MAX - XNET_MC_HEADER_SIZE) return -1;
+	return 0;
+}
+
+/*
+ * 解析base开头的一个消息，返回消息长度，0表示数据不够，-1表示格式错误或者超出限制。
+ * 知道消息长度之后不再重复查找，消息完整时再按最终的base计算各个slice
+ */
+static int64_t
+mc_parse(xnet_unpacker_t *up, xnet_memcache_t *mc, const char *base, uint32_t size) {
+	const char *eol;
+	const char *body;
+	int64_t bytes;
+	bool parsed = false;
+
+	if (mc->need == 0) {
+		mc->binary = ((uint8_t)base[0] & 0x80) != 0;
+		if (mc->binary) {
+			if (size < XNET_MC_HEADER_SIZE) return 0;
+			if (mc_parse_header(mc, (const uint8_t *)base) != 0) return -1;
+			mc->need = XNET_MC_HEADER_SIZE + mc->header.body_len;
+		} else {
+			eol = memchr(base + mc->scanned, '\n', size - mc->scanned);
+			if (eol == NULL) {
+				mc->scanned = size;
+				return (up->limit != 0 && size > up->limit) ? -1 : 0;
+			}
+			mc->line_len = (uint32_t)(eol - base) + 1;
+			bytes = mc_parse_line(mc, base, mc->line_len);
+			if (bytes < 0 || (uint64_t)mc->line_len + bytes + 2 > UINT32_MAX) return -1;
+			mc->need = mc->line_len + (mc->storage ? (uint32_t)bytes + 2 : 0);
+		}
+		if (up->limit != 0 && mc->need > up->limit) return -1;
+		parsed = true;
+	}
+	if (size < mc->need) return 0;
+
+	if (mc->binary) {
+		body = base + XNET_MC_HEADER_SIZE;
+		mc->extras.str = body;
+		mc->extras.len = mc->header.extras_len;
+		mc->key.str = body + mc->header.extras_len;
+		mc->key.len = mc->header.key_len;
+		mc->data.str = mc->key.str + mc->header.key_len;
+		mc->data.len = mc->header.body_len - mc->header.extras_len - mc->header.key_len;
+		return mc->need;
+	}
+	//跨越多次接收的消息，token重新指向拼接后的缓存
+	if (!parsed) mc_parse_line(mc, base, mc->line_len);
+	if (mc->storage) {
+		mc->data.str = base + mc->line_len;
+		mc->data.len = mc->need - mc->line_len - 2;
+		if (base[mc->need-2] != '\r' || base[mc->need-1] != '\n') return -1;
+	}
+	return mc->need;
+}
+
+uint32_t
+xnet_unpack_memcache(xnet_unpacker_t *up, const char *buffer, uint32_t sz) {
+	xnet_memcache_t *mc = (xnet_memcache_t *)up->arg;
+	uint32_t old = xnet_string_get_size(&mc->pending);
+	int64_t ret;
+
+	if (old == 0) {
+		ret = mc_parse(up, mc, buffer, sz);
+		if (ret < 0) return 0;
+		if (ret > 0) {
+			up->full = true;
+			return (uint32_t)ret;
+		}
+		xnet_string_append_buff(&mc->pending, buffer, sz);
+		return sz;
+	}
+
+	//后面的消息也会被复制进来，完成后只消耗属于本消息的部分
+	xnet_string_append_buff(&mc->pending, buffer, sz);
+	ret = mc_parse(up, mc, mc->pending.str, xnet_string_get_size(&mc->pending));
+	if (ret < 0) return 0;
+	if (ret == 0) return sz;
+	up->full = true;
+	return (uint32_t)ret - old;
+}
+
+//回调后重置，保留token数组和拼接缓存的内存
+void
+xnet_clear_memcache(void *arg) {
+	xnet_memcache_t *mc = (xnet_memcache_t *)arg;
+	mc->binary = false;
+	mc->ntokens = 0;
+	mc->storage = false;
+	mc->noreply = false;
+	mc->flags = 0;
+	mc->exptime = 0;
+	mc->cas = 0;
+	memset(&mc->header, 0, sizeof(mc->header));
+	memset(&mc->extras, 0, sizeof(mc->extras));
+	memset(&mc->key, 0, sizeof(mc->key));
+	memset(&mc->data, 0, sizeof(mc->data));
+	mc->line_len = 0;
+	mc->scanned = 0;
+	mc->need = 0;
+	mc->pending.size = 0;
+}
+
+void
+xnet_free_memcache(void *arg) {
+	xnet_memcache_t *mc = (xnet_memcache_t *)arg;
+	if (mc->tokens) free(mc->tokens);
+	xnet_string_clear(&mc->pending);
+	memset(mc, 0, sizeof(*mc));
+}
+
+/*文本协议封包*/
+void
+xnet_pack_mc_get(const char *cmd, int nkeys, const char **keys, const uint32_t *keys_sz, xnet_string_t *out) {
+	int i;
+	xnet_string_append_buff(out, cmd, strlen(cmd));
+	for (i=0; i<nkeys; i++) {
+		xnet_string_add(out, ' ');
+		xnet_string_append_buff(out, keys[i], keys_sz ? keys_sz[i] : strlen(keys[i]));
+	}
+	xnet_string_append_buff(out, "\r\n", 2);
+}
+
+void
+xnet_pack_mc_store(const char *cmd, const char *key, uint32_t key_sz, uint32_t flags, int64_t exptime,
+	const char *data, uint32_t sz, uint64_t cas, bool noreply, xnet_string_t *out) {
+	char line[96];
+	int n;
+	xnet_string_append_buff(out, cmd, strlen(cmd));
+	xnet_string_add(out, ' ');
+	xnet_string_append_buff(out, key, key_sz);
+	if (strcmp(cmd, "cas") == 0)
+		n = snprintf(line, sizeof(line), " %u %lld %u %llu", flags, (long long)exptime, sz, (unsigned long long)cas);
+	else
+		n = snprintf(line, sizeof(line), " %u %lld %u", flags, (long long)exptime, sz);
+	xnet_string_append_buff(out, line, n);
+	if (noreply) xnet_string_append_buff(out, " noreply", 8);
+	xnet_string_append_buff(out, "\r\n", 2);
+	xnet_string_append_buff(out, data, sz);
+	xnet_string_append_buff(out, "\r\n", 2);
+}
+
+void
+xnet_pack_mc_value(const char *key, uint32_t key_sz, uint32_t flags, const char *data, uint32_t sz,
+	bool with_cas, uint64_t cas, xnet_string_t *out) {
+	char line[64];
+	int n;
+	xnet_string_append_buff(out, "VALUE ", 6);
+	xnet_string_append_buff(out, key, key_sz);
+	if (with_cas)
+		n = snprintf(line, sizeof(line), " %u %u %llu\r\n", flags, sz, (unsigned long long)cas);
+	else
+		n = snprintf(line, sizeof(line), " %u %u\r\n", flags, sz);
+	xnet_string_append_buff(out, line, n);
+	xnet_string_append_buff(out, data, sz);
+	xnet_string_append_buff(out, "\r\n", 2);
+}
+
+/*二进制协议封包*/
+void
+xnet_pack_mc_header(const xnet_mc_header_t *h, char *out) {
+	uint8_t *p = (uint8_t *)out;
+	int i;
+	p[0] = h->magic;
+	p[1] = h->opcode;
+	p[2] = (uint8_t)(h->key_len >> 8);
+	p[3] = (uint8_t)h->key_len;
+	p[4] = h->extras_len;
+	p[5] = h->data_type;
+	p[6] = (uint8_t)(h->status >> 8);
+	p[7] = (uint8_t)h->status;
+	p[8] = (uint8_t)(h->body_len >> 24);
+	p[9] = (uint8_t)(h->body_len >> 16);
+	p[10] = (uint8_t)(h->body_len >> 8);
+	p[11] = (uint8_t)h->body_len;
+	//opaque原样返回，不转换字节序
+	memcpy(p + 12, &h->opaque, 4);
+	for (i=0; i<8; i++)
+		p[16+i] = (uint8_t)(h->cas >> (56 - i*8));
+}
+
+void
+xnet_pack_mc_binary(const xnet_mc_header_t *header, const char *extras, uint8_t extras_len,
+	const char *key, uint16_t key_len, const char *value, uint32_t value_len, xnet_string_t *out) {
+	xnet_mc_header_t h = *header;
+	char buf[XNET_MC_HEADER_SIZE];
+	h.extras_len = extras_len;
+	h.key_len = key_len;
+	h.body_len = (uint32_t)extras_len + key_len + value_len;
+	xnet_pack_mc_header(&h, buf);
+	xnet_string_append_buff(out, buf, XNET_MC_HEADER_SIZE);
+	xnet_string_append_buff(out, extras, extras_len);
+	xnet_string_append_buff(out, key, key_len);
+	xnet_string_append_buff(out, value, value_len);
+}
@@ -0,0 +1,84 @@
+#ifndef _XNET_MEMCACHE_H_
+#define _XNET_MEMCACHE_H_
+#include "xnet_packer.h"
+
+/*memcached文本协议和二进制协议的解包和封包，第一个字节为0x80/0x81时按二进制协议解析*/
+#define XNET_MC_MAGIC_REQUEST 0x80
+#define XNET_MC_MAGIC_RESPONSE 0x81
+#define XNET_MC_HEADER_SIZE 24
+
+typedef struct {
+	const char *str;
+	uint32_t len;
+} xnet_mc_slice_t;
+
+//二进制协议的24字节头部，status在请求中为vbucket id
+typedef struct {
+	uint8_t magic;
+	uint8_t opcode;
+	uint16_t key_len;
+	uint8_t extras_len;
+	uint8_t data_type;
+	uint16_t status;
+	uint32_t body_len;
+	uint32_t opaque;
+	uint64_t cas;
+} xnet_mc_header_t;
+
+/*
+ * 文本协议：tokens[0]为命令，其后为参数(get/gets的多个key)，行尾的noreply会设置noreply；
+ * set/add/replace/append/prepend/cas会解析flags、exptime、cas，data为数据块(不包括\r\n)。
+ * 二进制协议：header为头部，extras、key、data依次为body中的三部分。
+ * 一次接收中完整的消息直接引用接收缓存，否则拼接到pending中，所有slice只在回调期间有效。
+ * up->limit限制单个消息的字节数(0表示不限制)
+ */
+typedef struct {
+	bool binary;
+	//文本协议
+	xnet_mc_slice_t *tokens;
+	uint32_t ntokens;
+	bool storage;
+	bool noreply;
+	uint32_t flags;
+	int64_t exptime;
+	uint64_t cas;
+	//二进制协议
+	xnet_mc_header_t header;
+	xnet_mc_slice_t extras;
+	xnet_mc_slice_t key;
+	//数据块或者二进制协议的value
+	xnet_mc_slice_t data;
+	//以下为解析状态
+	uint32_t token_cap;
+	uint32_t line_len;
+	uint32_t scanned;
+	uint32_t need;//0:还不知道整个消息的长度
+	xnet_string_t pending;
+} xnet_memcache_t;
+
+/*
+ * up = xnet_unpacker_new(sizeof(xnet_memcache_t), cb, xnet_unpack_memcache, xnet_clear_memcache, limit);
+ * up->fm = xnet_free_memcache;
+ */
+uint32_t xnet_unpack_memcache(xnet_unpacker_t *up, const char *buffer, uint32_t sz);
+void xnet_clear_memcache(void *arg);
+void xnet_free_memcache(void *arg);
+//token和字符串比较
+bool xnet_mc_slice_equal(const xnet_mc_slice_t *s, const char *cs);
+
+/*文本协议封包，追加到out*/
+//get/gets请求
+void xnet_pack_mc_get(const char *cmd, int nkeys, const char **keys, const uint32_t *keys_sz, xnet_string_t *out);
+//存储请求，cmd为"cas"时带上cas
+void xnet_pack_mc_store(const char *cmd, const char *key, uint32_t key_sz, uint32_t flags, int64_t exptime,
+	const char *data, uint32_t sz, uint64_t cas, bool noreply, xnet_string_t *out);
+//get的回复中的一项，with_cas为true时(gets)带上cas，最后由调用者追加"END\r\n"
+void xnet_pack_mc_value(const char *key, uint32_t key_sz, uint32_t flags, const char *data, uint32_t sz,
+	bool with_cas, uint64_t cas, xnet_string_t *out);
+
+/*二进制协议封包，header中的长度字段由extras、key、value的长度填写*/
+void xnet_pack_mc_header(const xnet_mc_header_t *header, char *out);
+void xnet_pack_mc_binary(const xnet_mc_header_t *header, const char *extras, uint8_t extras_len,
+	const char *key, uint16_t key_len, const char *value, uint32_t value_len, xnet_string_t *out);
+
+#endif //_XNET_MEMCACHE_H_
@@ -1,8 +1,10 @@
 #include "xnet_packer.h"
+#include "xnet_util.h"
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <stdio.h>
+#include <time.h>
 
 xnet_unpacker_t *
 xnet_unpacker_new(uint32_t arg_sz, unpack_callback_t cb, unpack_method_t um,
@@ -20,8 +22,16 @@ xnet_unpacker_new(uint32_t arg_sz, unpack_callback_t cb, unpack_method_t um,
 
 void
 xnet_unpacker_free(xnet_unpacker_t *up) {
-	up->cm(up->arg);
-	free(up);
+	xnet_unpacker_t *next;
+	while (up) {
+		next = up->next;
+		if (up->fm)
+			up->fm(up->arg);
+		else
+			up->cm(up->arg);
+		free(up);
+		up = next;
+	}
 }
 
 //return 0:success
@@ -29,15 +39,29 @@ xnet_unpacker_free(xnet_unpacker_t *up) {
 int
 xnet_unpacker_recv(xnet_unpacker_t *up, const char *buffer, uint32_t sz) {
 	uint32_t ret;
+	int result = 0;
+	bool busy = up->busy;//回调中嵌套接收时，由最外层处理移除
+	xnet_unpacker_t *next;
 
+	up->busy = true;
 	ret = up->um(up, buffer, sz);
 	while (ret != 0) {
 		if (up->full) {
 			up->cb(up, up->arg);
 			up->cm(up->arg);
 			up->full = false;
+			if (up->fail) {
+				result = -1;
+				break;
+			}
 			if (up->close) {
 				up->close = false;
+				sz = 0;
+				break;
+			}
+			if (up->removed) {
+				buffer += ret;
+				sz -= ret;
 				break;
 			}
 		}
@@ -47,69 +71,608 @@ xnet_unpacker_recv(xnet_unpacker_t *up, const char *buffer, uint32_t sz) {
 		if (sz == 0) break;
 		ret = up->um(up, buffer, sz);
 	}
-	if (up->full) {
-		up->cb(up, up->arg);
+	if (ret == 0) {
+		if (up->full) {
+			up->cb(up, up->arg);
+			up->full = false;
+			up->close = false;
+		}
 		up->cm(up->arg);
-		up->full = false;
-		return (ret == 0) ? -1 : 0;
+		result = -1;
 	}
+	up->fail = false;
+	up->busy = busy;
+	if (up->removed && !busy) {
+		//已经从流水线中摘下，剩余的数据交给原来的下一级
+		next = up->next;
+		up->next = NULL;
+		xnet_unpacker_free(up);
+		if (result == 0 && sz > 0 && next)
+			result = xnet_unpacker_recv(next, buffer, sz);
+	}
+	return result;
+}
 
-	if (ret == 0) {
-		up->cm(up->arg);
+int
+xnet_unpacker_emit(xnet_unpacker_t *up, const char *data, uint32_t sz) {
+	if (up->next == NULL || sz == 0) return 0;
+	if (xnet_unpacker_recv(up->next, data, sz) != 0) {
+		up->fail = true;
 		return -1;
 	}
 	return 0;
 }
 
+void
+xnet_unpacker_insert(xnet_unpacker_t **head, xnet_unpacker_t *prev, xnet_unpacker_t *up) {
+	xnet_unpacker_t **link = prev ? &prev->next : head;
+	up->next = *link;
+	*link = up;
+}
+
+void
+xnet_unpacker_remove(xnet_unpacker_t **head, xnet_unpacker_t *up) {
+	xnet_unpacker_t **link = head;
+	while (*link && *link != up)
+		link = &(*link)->next;
+	if (*link == NULL || up->removed) return;
+	//保留up->next，延迟释放时剩余的数据还要交给它
+	*link = up->next;
+	up->removed = true;
+	if (!up->busy) {
+		up->next = NULL;
+		xnet_unpacker_free(up);
+	}
+}
+
+void
+xnet_unpacker_replace(xnet_unpacker_t **head, xnet_unpacker_t *old, xnet_unpacker_t *up) {
+	xnet_unpacker_insert(head, old, up);
+	xnet_unpacker_remove(head, old);
+}
+
 #define HTTP_VERSION "HTTP/1.1"
-#define HEADER_TOKEN_FILTER "()<>@,;:\\\"/[]?={} \t\n\r"
+//请求和响应以相同的字段开头，共用头部和body的解析
+#define HTTP_MSG(p) ((xnet_httpmessage_t *)(p))
+#define HTTP_VERSION_PREFIX "HTTP/1."
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(XNET_HTTP_NO_SIMD)
+#define XNET_HTTP_SIMD
+#endif
+
+/*
+ * 各个状态下需要停下来处理的字符：
+ * url遇到' '，header key遇到"()<>@,;:\\\"/[]?={} \t\n\r"，header value遇到'\r'
+ */
+#define TOKEN_STOP_URL 1
+#define TOKEN_STOP_KEY 2
+#define TOKEN_STOP_VALUE 4
+
+static const uint8_t g_token_stop_map[256] = {
+	['\t'] = TOKEN_STOP_KEY, ['\n'] = TOKEN_STOP_KEY,
+	['\r'] = TOKEN_STOP_KEY | TOKEN_STOP_VALUE,
+	[' '] = TOKEN_STOP_URL | TOKEN_STOP_KEY,
+	['('] = TOKEN_STOP_KEY, [')'] = TOKEN_STOP_KEY, ['<'] = TOKEN_STOP_KEY,
+	['>'] = TOKEN_STOP_KEY, ['@'] = TOKEN_STOP_KEY, [','] = TOKEN_STOP_KEY,
+	[';'] = TOKEN_STOP_KEY, [':'] = TOKEN_STOP_KEY, ['\\'] = TOKEN_STOP_KEY,
+	['"'] = TOKEN_STOP_KEY, ['/'] = TOKEN_STOP_KEY, ['['] = TOKEN_STOP_KEY,
+	[']'] = TOKEN_STOP_KEY, ['?'] = TOKEN_STOP_KEY, ['='] = TOKEN_STOP_KEY,
+	['{'] = TOKEN_STOP_KEY, ['}'] = TOKEN_STOP_KEY,
+};
+
+/*
+ * 向量化扫描用的区间表(闭区间对，最多8对，需可读16字节)，只需覆盖停止字符，
+ * 多覆盖的字符(控制字符、非ascii)由g_token_stop_map再判断一次。
+ */
+#define URL_RANGES_SIZE 2
+#define KEY_RANGES_SIZE 16
+#define VALUE_RANGES_SIZE 2
+static const char g_url_ranges[16] __attribute__((aligned(16))) = "  ";
+static const char g_key_ranges[16] __attribute__((aligned(16))) =
+	"\x00 \"\"(),,//:@[]{}";
+static const char g_value_ranges[16] __attribute__((aligned(16))) = "\r\r";
+
+typedef const char *(*find_ranges_func_t)(const char *p, const char *end, const char *ranges, int ranges_sz);
+
+static const char *
+find_ranges_scalar(const char *p, const char *end, const char *ranges, int ranges_sz) {
+	return p;
+}
+
+#ifdef XNET_HTTP_SIMD
+#include <immintrin.h>
+
+__attribute__((target("sse4.2")))
+static const char *
+find_ranges_sse42(const char *p, const char *end, const char *ranges, int ranges_sz) {
+	__m128i r = _mm_load_si128((const __m128i *)ranges);
+	__m128i b;
+	int idx;
+
+	while (end - p >= 16) {
+		b = _mm_loadu_si128((const __m128i *)p);
+		idx = _mm_cmpestri(r, ranges_sz, b, 16,
+			_SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+		if (idx != 16) return p + idx;
+		p += 16;
+	}
+	return p;
+}
+
+__attribute__((target("avx2")))
+static const char *
+find_ranges_avx2(const char *p, const char *end, const char *ranges, int ranges_sz) {
+	__m256i lo[2], span[2];
+	__m256i b, d, m;
+	uint32_t mask;
+	int i, n = ranges_sz / 2;
+
+	//区间多时每个区间都要比较一次，不如pcmpestri
+	if (n > 2)
+		return find_ranges_sse42(p, end, ranges, ranges_sz);
+
+	//x in [lo, hi] 等价于 (uint8_t)(x - lo) <= hi - lo
+	for (i=0; i<n; i++) {
+		lo[i] = _mm256_set1_epi8(ranges[i*2]);
+		span[i] = _mm256_set1_epi8((char)(ranges[i*2+1] - ranges[i*2]));
+	}
+	while (end - p >= 32) {
+		b = _mm256_loadu_si256((const __m256i *)p);
+		m = _mm256_setzero_si256();
+		for (i=0; i<n; i++) {
+			d = _mm256_sub_epi8(b, lo[i]);
+			m = _mm256_or_si256(m, _mm256_cmpeq_epi8(_mm256_min_epu8(d, span[i]), d));
+		}
+		mask = (uint32_t)_mm256_movemask_epi8(m);
+		if (mask) return p + __builtin_ctz(mask);
+		p += 32;
+	}
+	return find_ranges_sse42(p, end, ranges, ranges_sz);
+}
+#endif
+
+static find_ranges_func_t g_find_ranges = NULL;
+
+int
+xnet_http_set_simd(int level) {
+#ifdef XNET_HTTP_SIMD
+	__builtin_cpu_init();
+	if (level >= XNET_SIMD_AVX2 && __builtin_cpu_supports("avx2")) {
+		g_find_ranges = find_ranges_avx2;
+		return XNET_SIMD_AVX2;
+	}
+	if (level >= XNET_SIMD_SSE42 && __builtin_cpu_supports("sse4.2")) {
+		g_find_ranges = find_ranges_sse42;
+		return XNET_SIMD_SSE42;
+	}
+#endif
+	g_find_ranges = find_ranges_scalar;
+	return XNET_SIMD_NONE;
+}
+
+//返回第一个stop字符的位置，找不到返回end
+static inline const char *
+scan_token(const char *p, const char *end, const char *ranges, int ranges_sz, uint8_t stop) {
+	for (;;) {
+		p = g_find_ranges(p, end, ranges, ranges_sz);
+		if (p == end || (g_token_stop_map[(uint8_t)*p] & stop)) return p;
+		p++;
+	}
+}
 
+//支持HTTP/1.0和HTTP/1.1
 static inline bool
-check_in(const char *s, char c) {
-	while(*s) {
-		if (*s == c) return true;
-		s++;
+version_char_ok(uint32_t i, char c) {
+	if (i < sizeof(HTTP_VERSION_PREFIX)-1) return c == HTTP_VERSION_PREFIX[i];
+	if (i == sizeof(HTTP_VERSION_PREFIX)-1) return c == '0' || c == '1';
+	return false;
+}
+
+//value是否包含token(逗号分隔，不区分大小写)
+static bool
+has_token(xnet_string_t *value, const char *token) {
+	const char *p = xnet_string_get_str(value);
+	const char *end = p + xnet_string_get_size(value);
+	const char *q;
+	uint32_t len = strlen(token);
+
+	while (p < end) {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) p++;
+		for (q=p; q<end && *q != ','; q++);
+		while (q > p && (q[-1] == ' ' || q[-1] == '\t')) q--;
+		if ((uint32_t)(q - p) == len && strncasecmp(p, token, len) == 0) return true;
+		while (p < end && *p != ',') p++;
 	}
 	return false;
 }
 
+typedef struct {
+	const char *name;
+	uint8_t len;
+	uint8_t id;
+} known_header_t;
+
+//已知header的完美哈希表，位置由长度和首、中、尾字符决定，生成时保证没有冲突
+#define KNOWN_HEADER_SLOTS 128
+#define KNOWN_HEADER_MAX_LEN 24
+static const known_header_t g_known_headers[KNOWN_HEADER_SLOTS] = {
+	[2] = {"location", 8, XNET_HTTP_H_LOCATION},
+	[8] = {"user-agent", 10, XNET_HTTP_H_USER_AGENT},
+	[11] = {"etag", 4, XNET_HTTP_H_ETAG},
+	[12] = {"range", 5, XNET_HTTP_H_RANGE},
+	[14] = {"if-modified-since", 17, XNET_HTTP_H_IF_MODIFIED_SINCE},
+	[15] = {"if-none-match", 13, XNET_HTTP_H_IF_NONE_MATCH},
+	[20] = {"http2-settings", 14, XNET_HTTP_H_HTTP2_SETTINGS},
+	[23] = {"transfer-encoding", 17, XNET_HTTP_H_TRANSFER_ENCODING},
+	[27] = {"host", 4, XNET_HTTP_H_HOST},
+	[36] = {"forwarded", 9, XNET_HTTP_H_FORWARDED},
+	[38] = {"accept-encoding", 15, XNET_HTTP_H_ACCEPT_ENCODING},
+	[39] = {"accept-language", 15, XNET_HTTP_H_ACCEPT_LANGUAGE},
+	[42] = {"content-length", 14, XNET_HTTP_H_CONTENT_LENGTH},
+	[44] = {"referer", 7, XNET_HTTP_H_REFERER},
+	[47] = {"set-cookie", 10, XNET_HTTP_H_SET_COOKIE},
+	[56] = {"expect", 6, XNET_HTTP_H_EXPECT},
+	[57] = {"keep-alive", 10, XNET_HTTP_H_KEEP_ALIVE},
+	[58] = {"te", 2, XNET_HTTP_H_TE},
+	[61] = {"authorization", 13, XNET_HTTP_H_AUTHORIZATION},
+	[63] = {"vary", 4, XNET_HTTP_H_VARY},
+	[64] = {"pragma", 6, XNET_HTTP_H_PRAGMA},
+	[68] = {"accept", 6, XNET_HTTP_H_ACCEPT},
+	[70] = {"sec-websocket-protocol", 22, XNET_HTTP_H_SEC_WEBSOCKET_PROTOCOL},
+	[74] = {"origin", 6, XNET_HTTP_H_ORIGIN},
+	[81] = {"sec-websocket-version", 21, XNET_HTTP_H_SEC_WEBSOCKET_VERSION},
+	[82] = {"x-real-ip", 9, XNET_HTTP_H_X_REAL_IP},
+	[87] = {"cookie", 6, XNET_HTTP_H_COOKIE},
+	[89] = {"server", 6, XNET_HTTP_H_SERVER},
+	[97] = {"content-encoding", 16, XNET_HTTP_H_CONTENT_ENCODING},
+	[98] = {"sec-websocket-accept", 20, XNET_HTTP_H_SEC_WEBSOCKET_ACCEPT},
+	[100] = {"last-modified", 13, XNET_HTTP_H_LAST_MODIFIED},
+	[102] = {"content-type", 12, XNET_HTTP_H_CONTENT_TYPE},
+	[105] = {"upgrade", 7, XNET_HTTP_H_UPGRADE},
+	[107] = {"cache-control", 13, XNET_HTTP_H_CACHE_CONTROL},
+	[108] = {"sec-websocket-extensions", 24, XNET_HTTP_H_SEC_WEBSOCKET_EXTENSIONS},
+	[110] = {"connection", 10, XNET_HTTP_H_CONNECTION},
+	[111] = {"x-forwarded-for", 15, XNET_HTTP_H_X_FORWARDED_FOR},
+	[114] = {"sec-websocket-key", 17, XNET_HTTP_H_SEC_WEBSOCKET_KEY},
+	[120] = {"proxy-connection", 16, XNET_HTTP_H_PROXY_CONNECTION},
+	[123] = {"date", 4, XNET_HTTP_H_DATE},
+};
+
 static int
-push_key_char(xnet_httprequest_t *req, char c) {
+known_header_id(const char *key, uint32_t len) {
+	const known_header_t *k;
+	uint32_t h;
+	if (len == 0 || len > KNOWN_HEADER_MAX_LEN) return XNET_HTTP_H_UNKNOWN;
+	h = len + (key[0] | 0x20) * 29 + (key[len-1] | 0x20) * 3 + (key[len/2] | 0x20);
+	k = &g_known_headers[h & (KNOWN_HEADER_SLOTS-1)];
+	if (k->len == len && strncasecmp(key, k->name, len) == 0) return k->id;
+	return XNET_HTTP_H_UNKNOWN;
+}
+
+//不区分大小写的FNV-1a
+static uint32_t
+header_hash(const char *key, uint32_t len) {
+	uint32_t h = 2166136261u;
+	uint32_t i;
+	unsigned char c;
+	for (i=0; i<len; i++) {
+		c = (unsigned char)key[i];
+		if (c >= 'A' && c <= 'Z') c |= 0x20;
+		h = (h ^ c) * 16777619u;
+	}
+	return h;
+}
+
+static void
+reset_header_index(xnet_httpmessage_t *msg) {
+	memset(msg->header_known, 0, sizeof(msg->header_known));
+	if (msg->header_hashed) {
+		memset(msg->header_slots, 0, sizeof(msg->header_slots));
+		msg->header_hashed = false;
+	}
+}
+
+//header解析完成后建立索引，key不能再变化
+static void
+index_header(xnet_httpmessage_t *msg, int i) {
+	xnet_httpheader_t *header = &msg->header[i];
+	const char *key = xnet_string_get_str(&header->key);
+	uint32_t len = xnet_string_get_size(&header->key);
+	uint32_t slot;
+
+	header->id = known_header_id(key, len);
+	header->hash = 0;
+	if (i >= XNET_HTTP_INDEX_MAX) return;
+	if (header->id != XNET_HTTP_H_UNKNOWN) {
+		//重复的header保留第一个
+		if (msg->header_known[header->id] == 0)
+			msg->header_known[header->id] = i + 1;
+		return;
+	}
+	header->hash = header_hash(key, len);
+	slot = header->hash & (XNET_HTTP_INDEX_SLOTS-1);
+	while (msg->header_slots[slot])
+		slot = (slot + 1) & (XNET_HTTP_INDEX_SLOTS-1);
+	msg->header_slots[slot] = i + 1;
+	msg->header_hashed = true;
+}
+
+//HTTP/1.1默认保持连接，HTTP/1.0需要显式的Connection: keep-alive
+static void
+check_keep_alive(xnet_httpmessage_t *msg) {
+	xnet_httpheader_t *conn = xnet_get_http_header(msg, XNET_HTTP_H_CONNECTION);
+	msg->keep_alive = xnet_string_compare_cs(&msg->version, HTTP_VERSION) == 0;
+	if (conn) {
+		if (has_token(&conn->value, "close"))
+			msg->keep_alive = false;
+		else if (has_token(&conn->value, "keep-alive"))
+			msg->keep_alive = true;
+	}
+}
+
+static int
+ensure_header(xnet_httpmessage_t *msg) {
 	int new_capacity;
-	xnet_httpheader_t *header;
 
-	if (req->header_count >= req->header_capacity) {
-		new_capacity = req->header_capacity ? req->header_capacity*2 : 32;
-		req->header = realloc(req->header, new_capacity*sizeof(*req->header));
-		assert(req->header);
-		memset(req->header + req->header_capacity, 0,
-			sizeof(*req->header)*(new_capacity - req->header_capacity));
-		req->header_capacity = new_capacity;
-	}
-	header = &req->header[req->header_count];
-	if (xnet_string_get_size(&header->key) >= 1024) return -1;
-	xnet_string_add(&header->key, c);
+	if (msg->header_count >= msg->header_capacity) {
+		new_capacity = msg->header_capacity ? msg->header_capacity*2 : 32;
+		msg->header = realloc(msg->header, new_capacity*sizeof(*msg->header));
+		assert(msg->header);
+		memset(msg->header + msg->header_capacity, 0,
+			sizeof(*msg->header)*(new_capacity - msg->header_capacity));
+		msg->header_capacity = new_capacity;
+	}
+	return 0;
+}
+
+static int
+push_key(xnet_httprequest_t *req, const char *key, uint32_t sz) {
+	xnet_httpheader_t *header = &req->header[req->header_count];
+	if (xnet_string_get_size(&header->key) + sz > 1024) return -1;
+	xnet_string_append_buff(&header->key, key, sz);
 	return 0;
 }
 
 static int
-push_value_char(xnet_httprequest_t *req, char c) {
+push_value(xnet_httprequest_t *req, const char *value, uint32_t sz) {
 	xnet_httpheader_t *header = &req->header[req->header_count];
-	if (xnet_string_get_size(&header->value) >= 4096) return -1;
-	xnet_string_add(&header->value, c);
+	if (xnet_string_get_size(&header->value) + sz > 4096) return -1;
+	xnet_string_append_buff(&header->value, value, sz);
 	return 0;
 }
 
+//Content-Length只允许数字，返回-1表示格式错误或者超出范围
+static int64_t
+parse_content_length(xnet_string_t *value) {
+	const char *p = xnet_string_get_str(value);
+	const char *end = p + xnet_string_get_size(value);
+	int64_t n = 0;
+
+	while (p < end && (*p == ' ' || *p == '\t')) p++;
+	while (end > p && (end[-1] == ' ' || end[-1] == '\t')) end--;
+	if (p == end || end - p > 10) return -1;
+	for (; p<end; p++) {
+		if (*p < '0' || *p > '9') return -1;
+		n = n * 10 + (*p - '0');
+	}
+	if (n > UINT32_MAX) return -1;
+	return n;
+}
+
+//根据Content-Length或者chunked确定body的长度，进入对应的状态
+static int
+http_body_length(xnet_unpacker_t *up, xnet_httpmessage_t *msg) {
+	xnet_httpheader_t *length_header, *te_header;
+	int64_t length;
+
+	msg->content_length = 0;
+	length_header = xnet_get_http_header(msg, XNET_HTTP_H_CONTENT_LENGTH);
+	te_header = xnet_get_http_header(msg, XNET_HTTP_H_TRANSFER_ENCODING);
+	if (te_header) {
+		//同时出现Content-Length时无法确定body边界，拒绝
+		if (length_header) {
+			msg->code = 400;
+			return -1;
+		}
+		if (xnet_string_casecompare_cs(&te_header->value, "chunked") != 0) {
+			msg->code = 501;
+			return -1;
+		}
+		msg->chunked = true;
+		msg->state = HTTP_STATE_CHUNK;
+		msg->subState = 0;
+		msg->chunk_left = 0;
+		if (up->sm) up->sm(up, up->arg, NULL, 0);
+		return 0;
+	}
+	if (length_header) {
+		length = parse_content_length(&length_header->value);
+		if (length < 0) {
+			msg->code = 400;
+			return -1;
+		}
+		msg->content_length = (uint32_t)length;
+	}
+	//流式body不缓存，不受limit限制
+	if (!up->sm && up->limit != 0 && msg->content_length > up->limit) {
+		msg->code = 413;
+		return -1;
+	}
+	msg->state = msg->content_length > 0 ? HTTP_STATE_BODY : HTTP_STATE_DONE;
+	msg->subState = 0;
+	if (up->sm) up->sm(up, up->arg, NULL, 0);
+	return 0;
+}
+
+//请求头接收完成，所有方法都根据Content-Length或者chunked判断是否有body
+static int
+http_header_done(xnet_unpacker_t *up, xnet_httprequest_t *req) {
+	check_keep_alive(HTTP_MSG(req));
+	return http_body_length(up, HTTP_MSG(req));
+}
+
+//处理body数据，返回消耗的长度；view为true时完整的body直接引用buffer
+static uint32_t
+http_body(xnet_unpacker_t *up, xnet_httpmessage_t *msg, const char *buffer, uint32_t sz, bool view) {
+	uint32_t n = msg->content_length - msg->body_len;
+	if (n > sz) n = sz;
+
+	if (up->sm) {
+		up->sm(up, up->arg, buffer, n);
+	} else if (!msg->body && view && n == msg->content_length) {
+		msg->body = xnet_string_create();
+		xnet_string_view(msg->body, buffer, n);
+	} else {
+		if (!msg->body) msg->body = xnet_string_create();
+		xnet_string_append_buff(msg->body, buffer, n);
+	}
+	msg->body_len += n;
+	if (msg->body_len == msg->content_length)
+		msg->state = HTTP_STATE_DONE;
+	return n;
+}
+
+static inline int
+hex_value(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+enum chunk_state_e {
+	CHUNK_SIZE_FIRST = 0,
+	CHUNK_SIZE,
+	CHUNK_EXT,
+	CHUNK_SIZE_LF,
+	CHUNK_DATA,
+	CHUNK_DATA_CR,
+	CHUNK_DATA_LF,
+	CHUNK_TRAILER,
+	CHUNK_TRAILER_LINE,
+	CHUNK_TRAILER_LF,
+	CHUNK_END_LF
+};
+
+/*
+ * 增量解码chunked body，状态保存在req->subState和req->chunk_left中
+ * return >=0:消耗的长度 -1:错误
+ */
+static int
+http_chunked(xnet_unpacker_t *up, xnet_httpmessage_t *msg, const char *buffer, uint32_t sz) {
+	const char *q = buffer;
+	const char *eq = buffer + sz;
+	const char *p;
+	uint32_t n;
+	int v;
+
+	while (q < eq && msg->state == HTTP_STATE_CHUNK) {
+		switch (msg->subState) {
+			case CHUNK_SIZE_FIRST:
+			case CHUNK_SIZE:
+				v = hex_value(*q);
+				if (v >= 0) {
+					if (msg->chunk_left > 0x0FFFFFFF) {
+						msg->code = 413;
+						return -1;
+					}
+					msg->chunk_left = (msg->chunk_left << 4) | v;
+					msg->subState = CHUNK_SIZE;
+				} else if (msg->subState == CHUNK_SIZE_FIRST) {
+					msg->code = 400;
+					return -1;
+				} else if (*q == ';' || *q == ' ' || *q == '\t') {
+					msg->subState = CHUNK_EXT;
+				} else if (*q == '\r') {
+					msg->subState = CHUNK_SIZE_LF;
+				} else {
+					msg->code = 400;
+					return -1;
+				}
+				q++;
+			break;
+			case CHUNK_EXT://忽略chunk扩展
+				p = memchr(q, '\r', eq - q);
+				if (!p) return (int)(eq - buffer);
+				q = p + 1;
+				msg->subState = CHUNK_SIZE_LF;
+			break;
+			case CHUNK_SIZE_LF:
+				if (*q++ != '\n') {
+					msg->code = 400;
+					return -1;
+				}
+				if (msg->chunk_left == 0) {
+					msg->subState = CHUNK_TRAILER;
+					break;
+				}
+				if (!up->sm && up->limit != 0 && msg->body_len + (uint64_t)msg->chunk_left > up->limit) {
+					msg->code = 413;
+					return -1;
+				}
+				msg->subState = CHUNK_DATA;
+			break;
+			case CHUNK_DATA:
+				n = msg->chunk_left;
+				if (n > (uint32_t)(eq - q)) n = (uint32_t)(eq - q);
+				if (up->sm) {
+					up->sm(up, up->arg, q, n);
+				} else {
+					if (!msg->body) msg->body = xnet_string_create();
+					xnet_string_append_buff(msg->body, q, n);
+				}
+				msg->body_len += n;
+				msg->chunk_left -= n;
+				q += n;
+				if (msg->chunk_left == 0) msg->subState = CHUNK_DATA_CR;
+			break;
+			case CHUNK_DATA_CR:
+			case CHUNK_DATA_LF:
+				if (*q++ != (msg->subState == CHUNK_DATA_CR ? '\r' : '\n')) {
+					msg->code = 400;
+					return -1;
+				}
+				msg->subState = (msg->subState == CHUNK_DATA_CR) ? CHUNK_DATA_LF : CHUNK_SIZE_FIRST;
+			break;
+			case CHUNK_TRAILER://忽略trailer，空行表示结束
+				msg->subState = (*q++ == '\r') ? CHUNK_END_LF : CHUNK_TRAILER_LINE;
+			break;
+			case CHUNK_TRAILER_LINE:
+				p = memchr(q, '\r', eq - q);
+				if (!p) return (int)(eq - buffer);
+				q = p + 1;
+				msg->subState = CHUNK_TRAILER_LF;
+			break;
+			case CHUNK_TRAILER_LF:
+			case CHUNK_END_LF:
+				if (*q++ != '\n') {
+					msg->code = 400;
+					return -1;
+				}
+				if (msg->subState == CHUNK_TRAILER_LF) {
+					msg->subState = CHUNK_TRAILER;
+				} else {
+					msg->state = HTTP_STATE_DONE;
+					msg->subState = 0;
+				}
+			break;
+		}
+	}
+	return (int)(q - buffer);
+}
+
 static int
-parse_request(xnet_httprequest_t *req, const char *buffer, uint32_t sz, uint32_t body_limit) {
+parse_request(xnet_unpacker_t *up, xnet_httprequest_t *req, const char *buffer, uint32_t sz) {
 	uint16_t state = req->state;
 	uint16_t subState = req->subState;
 	const char *q = buffer;
 	const char *eq = q + sz;
-	xnet_httpheader_t *length_header;
+	const char *p;
 	uint32_t version_sz;
+	int ret;
 
 	if (q == eq) return 0;
+	if (!g_find_ranges) xnet_http_set_simd(XNET_SIMD_AVX2);
 
 	while (q < eq) {
 		switch (state) {
@@ -151,10 +714,14 @@ parse_request(xnet_httprequest_t *req, const char *buffer, uint32_t sz, uint32_t
 						return -1;
 					}
 				} else if (subState == 1) {
-					if (*q != ' ') {
-						xnet_string_add(&req->url, *q);
-						q++;
-					} else {
+					p = scan_token(q, eq, g_url_ranges, URL_RANGES_SIZE, TOKEN_STOP_URL);
+					if (xnet_string_get_size(&req->url) + (uint32_t)(p - q) >= 1024) {
+						req->code = 414;
+						return -1;
+					}
+					xnet_string_append_buff(&req->url, q, (uint32_t)(p - q));
+					q = p;
+					if (q < eq) {
 						q++;
 						state = HTTP_STATE_VERSION;
 						subState = 0;
@@ -171,7 +738,7 @@ parse_request(xnet_httprequest_t *req, const char *buffer, uint32_t sz, uint32_t
 					return -1;
 				}
 				if (subState == 0) {
-					if (version_sz < sizeof(HTTP_VERSION) && *q == HTTP_VERSION[version_sz]) {
+					if (version_char_ok(version_sz, *q)) {
 						xnet_string_add(&req->version, *q);
 						q++;
 					} else {
@@ -206,16 +773,18 @@ parse_request(xnet_httprequest_t *req, const char *buffer, uint32_t sz, uint32_t
 						q++;
 						subState = 3;
 					} else {
+						ensure_header(HTTP_MSG(req));
 						subState = 1;
 					}
 				} else if (subState == 1) {
-					if (!check_in(HEADER_TOKEN_FILTER, *q)) {
-						if (push_key_char(req, *q) != 0) {
-							req->code = 413;
-							return -1;
-						}
-						q++;
-					} else if (*q == ':') {
+					p = scan_token(q, eq, g_key_ranges, KEY_RANGES_SIZE, TOKEN_STOP_KEY);
+					if (push_key(req, q, (uint32_t)(p - q)) != 0) {
+						req->code = 413;
+						return -1;
+					}
+					q = p;
+					if (q == eq) break;
+					if (*q == ':' && xnet_string_get_size(&req->header[req->header_count].key) > 0) {
 						subState = 2;
 						q++;
 					} else {
@@ -252,21 +821,22 @@ parse_request(xnet_httprequest_t *req, const char *buffer, uint32_t sz, uint32_t
 						q++;
 						state = HTTP_STATE_HEADER_KEY;
 						subState = 0;
+						index_header(HTTP_MSG(req), req->header_count);
 						req->header_count++;
 					} else {
 						req->code = 400;
 						return -1;
 					}
 				} else if (subState == 2) {
-					if (*q == '\r') {
+					p = scan_token(q, eq, g_value_ranges, VALUE_RANGES_SIZE, TOKEN_STOP_VALUE);
+					if (push_value(req, q, (uint32_t)(p - q)) != 0) {
+						req->code = 413;
+						return -1;
+					}
+					q = p;
+					if (q < eq) {
 						subState = 1;
 						q++;
-					} else {
-						if (push_value_char(req, *q) != 0){
-							req->code = 413;
-							return -1;
-						}
-						q++;
 					}
 				} else {
 					req->code = 400;
@@ -276,37 +846,22 @@ parse_request(xnet_httprequest_t *req, const char *buffer, uint32_t sz, uint32_t
 			case HTTP_STATE_HEADER_DONE:
 				q++;// '\n'
 				//recv header done.
-				length_header = xnet_get_http_header_value(req, "content-length");
-				if (length_header) {
-					req->content_length = (uint32_t)xnet_string_toint(&length_header->value);
-					if (body_limit != 0 && req->content_length > 0 &&
-						(req->content_length + req->recv_len + (uint32_t)(eq - q)) > body_limit) {
-						req->code = 413;
-						return -1;
-					}
-				}
-				if (xnet_string_compare_cs(&req->method, "POST") == 0) {
-					state = HTTP_STATE_BODY;
-					subState = 0;
-				} else {
-					state = HTTP_STATE_DONE;
-					subState = 0;
-					goto _out;
-				}
+				if (http_header_done(up, req) != 0) return -1;
+				state = req->state;
+				subState = 0;
+				if (state == HTTP_STATE_DONE) goto _out;
+			break;
+			case HTTP_STATE_CHUNK:
+				ret = http_chunked(up, HTTP_MSG(req), q, (uint32_t)(eq - q));
+				if (ret < 0) return -1;
+				q += ret;
+				state = req->state;
+				subState = req->subState;
+				if (state == HTTP_STATE_DONE) goto _out;
 			break;
 			case HTTP_STATE_BODY:
-				if (req->content_length == 0) {
-					req->code = 400;
-					return -1;
-				}
-				if (!req->body) req->body = xnet_string_create();
-				xnet_string_add(req->body, *q);
-				q++;
-				if (xnet_string_get_size(req->body) > body_limit) {
-					req->code = 413;
-					return -1;
-				}
-				if (xnet_string_get_size(req->body) == req->content_length) {
+				q += http_body(up, HTTP_MSG(req), q, (uint32_t)(eq - q), false);
+				if (req->state == HTTP_STATE_DONE) {
 					state = HTTP_STATE_DONE;
 					subState = 0;
 					goto _out;
@@ -329,16 +884,18 @@ xnet_unpack_http(xnet_unpacker_t *up, const char *buffer, uint32_t sz) {
 	xnet_httprequest_t *req = (xnet_httprequest_t *)up->arg;
 	int ret;
 
-	ret = parse_request(req, buffer, sz, up->limit);
+	ret = parse_request(up, req, buffer, sz);
 	if (ret == -1) {
-		//bad request
+		//bad request，剩余数据的边界已不可信，不能继续当作下一个请求解析
 		if (req->code == 0) req->code = 400;
+		req->keep_alive = false;
 		up->full = true;
+		up->close = true;
 		return 0;
 	}
 	if (req->state == HTTP_STATE_DONE) {
 		up->full = true;
-		up->close = true;
+		up->close = !req->keep_alive;
 		req->code = 200;
 	}
 	req->recv_len += ret;
@@ -355,8 +912,10 @@ xnet_clear_http(void *arg) {
 	xnet_string_clear(&req->method);
 	xnet_string_clear(&req->url);
 	xnet_string_clear(&req->version);
+	xnet_string_clear(&req->raw);
 	if (req->header) {
-		for (i=0; i<req->header_count; i++) {
+		//解析出错时正在解析的header还没有计入header_count
+		for (i=0; i<req->header_capacity; i++) {
 			xnet_string_clear(&req->header[i].key);
 			xnet_string_clear(&req->header[i].value);
 		}
@@ -365,113 +924,609 @@ xnet_clear_http(void *arg) {
 	memset(req, 0, sizeof(*req));
 }
 
-xnet_httpheader_t *
-xnet_get_http_header_value(void *req_or_rsp, const char *key) {
-	xnet_httprequest_t *req = (xnet_httprequest_t *)req_or_rsp;
-	xnet_httpheader_t *header = req->header;
+static void
+rebase_view(xnet_string_t *s, const char *base, uint32_t len, char *to) {
+	if (s->capacity == 0 && s->str >= base && s->str < base + len)
+		s->str = to + (s->str - base);
+}
+
+//把引用接收缓存的头部复制到raw中，并修正version和header的view，其余字段由调用者修正
+static void
+pin_header_slice(xnet_httpmessage_t *msg, const char *base, uint32_t len) {
 	int i;
-	if (!header || req->header_count == 0) return NULL;
+	xnet_string_append_buff(&msg->raw, base, len);
+	rebase_view(&msg->version, base, len, msg->raw.str);
+	for (i=0; i<msg->header_count; i++) {
+		rebase_view(&msg->header[i].key, base, len, msg->raw.str);
+		rebase_view(&msg->header[i].value, base, len, msg->raw.str);
+	}
+}
+
+/*
+ * 解析[q, eq)中的header行直到空行，字段都指向data所在的缓存
+ * return >0:头部总长度(从data开始) 0:还需要更多数据 -1:错误
+ */
+static int
+parse_header_lines(xnet_httpmessage_t *msg, const char *data, const char *q, const char *eq) {
+	const char *p;
+	xnet_httpheader_t *header;
+
+	//头部不完整时会从头重新解析
+	msg->header_count = 0;
+	reset_header_index(msg);
+	for (;;) {
+		if (q == eq) return 0;
+		if (*q == '\r') {
+			if (q + 1 == eq) return 0;
+			if (q[1] != '\n') {
+				msg->code = 400;
+				return -1;
+			}
+			return (int)(q + 2 - data);
+		}
+		if (msg->header_count >= 128) {
+			msg->code = 413;
+			return -1;
+		}
+
+		/*^[()<>@,;:\\"/\[\]?={} \t]:[ \t] */
+		p = scan_token(q, eq, g_key_ranges, KEY_RANGES_SIZE, TOKEN_STOP_KEY);
+		if (p - q > 1024) {
+			msg->code = 413;
+			return -1;
+		}
+		if (p == eq) return 0;
+		if (*p != ':' || p == q) {
+			msg->code = 400;
+			return -1;
+		}
+		ensure_header(msg);
+		header = &msg->header[msg->header_count];
+		xnet_string_view(&header->key, q, (uint32_t)(p - q));
+		q = p + 1;
+		if (q == eq) return 0;
+		if (*q != ' ' && *q != '\t') {
+			msg->code = 400;
+			return -1;
+		}
+		q++;
+
+		/* ^[\r] \r\n*/
+		p = scan_token(q, eq, g_value_ranges, VALUE_RANGES_SIZE, TOKEN_STOP_VALUE);
+		if (p - q > 4096) {
+			msg->code = 413;
+			return -1;
+		}
+		if (p == eq || p + 1 == eq) return 0;
+		if (p[1] != '\n') {
+			msg->code = 400;
+			return -1;
+		}
+		xnet_string_view(&header->value, q, (uint32_t)(p - q));
+		q = p + 2;
+		index_header(msg, msg->header_count);
+		msg->header_count++;
+	}
+}
+
+/*
+ * 在连续内存中解析完整的请求头，字段都指向data
+ * return >0:请求头长度 0:还需要更多数据 -1:错误
+ */
+static int
+parse_header_slice(xnet_httprequest_t *req, const char *data, uint32_t len) {
+	const char *q = data;
+	const char *eq = data + len;
+	const char *p;
+	uint32_t n, i;
+
+	if (!g_find_ranges) xnet_http_set_simd(XNET_SIMD_AVX2);
+
+	/*[a-zA-Z]+ ' '*/
+	for (p=q; p<eq && ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z')); p++);
+	if (p - q > 32) {
+		req->code = 413;
+		return -1;
+	}
+	if (p == eq) return 0;
+	if (*p != ' ' || p == q) {
+		req->code = 400;
+		return -1;
+	}
+	xnet_string_view(&req->method, q, (uint32_t)(p - q));
+	q = p + 1;
+
+	/*/[^ ]+ ' '*/
+	if (q == eq) return 0;
+	if (*q != '/') {
+		req->code = 400;
+		return -1;
+	}
+	p = scan_token(q, eq, g_url_ranges, URL_RANGES_SIZE, TOKEN_STOP_URL);
+	if (p - q >= 1024) {
+		req->code = 414;
+		return -1;
+	}
+	if (p == eq) return 0;
+	xnet_string_view(&req->url, q, (uint32_t)(p - q));
+	q = p + 1;
+
+	/*'HTTP/1.1' \r\n*/
+	n = (uint32_t)(eq - q);
+	for (i=0; i<n && i<sizeof(HTTP_VERSION)-1; i++) {
+		if (!version_char_ok(i, q[i])) {
+			req->code = 505;
+			return -1;
+		}
+	}
+	if (n > sizeof(HTTP_VERSION)-1 && q[sizeof(HTTP_VERSION)-1] != '\r') {
+		req->code = 505;
+		return -1;
+	}
+	if (n < sizeof(HTTP_VERSION)+1) return 0;
+	if (q[sizeof(HTTP_VERSION)] != '\n') {
+		req->code = 400;
+		return -1;
+	}
+	xnet_string_view(&req->version, q, sizeof(HTTP_VERSION)-1);
+	q += sizeof(HTTP_VERSION)+1;
+
+	return parse_header_lines(HTTP_MSG(req), data, q, eq);
+}
+
+uint32_t
+xnet_unpack_http_slice(xnet_unpacker_t *up, const char *buffer, uint32_t sz) {
+	xnet_httprequest_t *req = (xnet_httprequest_t *)up->arg;
+	const char *q = buffer;
+	const char *eq = buffer + sz;
+	uint32_t old, header_len = 0;
+	int ret;
+
+	if (sz == 0) return 0;
+
+	if (req->state < HTTP_STATE_BODY) {
+		old = xnet_string_get_size(&req->raw);
+		if (old == 0) {
+			ret = parse_header_slice(req, buffer, sz);
+		} else {
+			//请求头跨越了多次接收，拼接后从头解析
+			xnet_string_append_buff(&req->raw, buffer, sz);
+			ret = parse_header_slice(req, req->raw.str, old + sz);
+		}
+		if (ret < 0) goto _bad;
+		if (ret == 0) {
+			if (old + sz > XNET_HTTP_MAX_HEADER) {
+				req->code = 413;
+				goto _bad;
+			}
+			if (old == 0) xnet_string_append_buff(&req->raw, buffer, sz);
+			req->recv_len += sz;
+			return sz;
+		}
+		//raw中多出来的是body，交给下面处理
+		if (old > 0) req->raw.size = ret;
+		else header_len = (uint32_t)ret;
+		q = buffer + (ret - old);
+		if (http_header_done(up, req) != 0) goto _bad;
+	}
+
+	if (req->state == HTTP_STATE_BODY && q < eq)
+		q += http_body(up, HTTP_MSG(req), q, (uint32_t)(eq - q), true);
+	if (req->state == HTTP_STATE_CHUNK && q < eq) {
+		ret = http_chunked(up, HTTP_MSG(req), q, (uint32_t)(eq - q));
+		if (ret < 0) goto _bad;
+		q += ret;
+	}
+
+	if (req->state == HTTP_STATE_DONE) {
+		up->full = true;
+		up->close = !req->keep_alive;
+		req->code = 200;
+	} else if (header_len > 0) {
+		//body还没收完，请求头不能再引用本次的接收缓存
+		pin_header_slice(HTTP_MSG(req), buffer, header_len);
+		rebase_view(&req->method, buffer, header_len, req->raw.str);
+		rebase_view(&req->url, buffer, header_len, req->raw.str);
+	}
+	req->recv_len += (uint32_t)(q - buffer);
+	return (uint32_t)(q - buffer);
+_bad:
+	if (req->code == 0) req->code = 400;
+	req->keep_alive = false;
+	up->full = true;
+	up->close = true;
+	return 0;
+}
+
+xnet_unpacker_t *
+xnet_unpacker_new_http(unpack_callback_t cb, uint32_t limit) {
+	xnet_unpacker_t *up;
+	up = xnet_unpacker_new(sizeof(xnet_httprequest_t), cb, xnet_unpack_http_slice, xnet_clear_http_slice, limit);
+	up->fm = xnet_clear_http;
+	return up;
+}
+
+void
+xnet_clear_http_slice(void *arg) {
+	int i;
+	xnet_httprequest_t *req = (xnet_httprequest_t *)arg;
+	if (req->body) {
+		xnet_string_destroy(req->body);
+		req->body = NULL;
+	}
+	//回调中可能复制过view，需要释放
+	xnet_string_clear(&req->method);
+	xnet_string_clear(&req->url);
+	xnet_string_clear(&req->version);
 	for (i=0; i<req->header_count; i++) {
-		if (xnet_string_casecompare_cs(&header[i].key, key) == 0) {
-			return &header[i];
+		xnet_string_clear(&req->header[i].key);
+		xnet_string_clear(&req->header[i].value);
+	}
+	req->header_count = 0;
+	reset_header_index(HTTP_MSG(req));
+	req->raw.size = 0;
+	req->state = req->subState = 0;
+	req->content_length = 0;
+	req->body_len = 0;
+	req->chunk_left = 0;
+	req->chunked = false;
+	req->recv_len = 0;
+	req->code = 0;
+	req->keep_alive = false;
+}
+
+/*
+ * 在连续内存中解析完整的响应头：HTTP/1.x SP 3DIGIT [SP reason] CRLF
+ * return >0:响应头长度 0:还需要更多数据 -1:错误
+ */
+static int
+parse_status_slice(xnet_httpresponse_t *rsp, const char *data, uint32_t len) {
+	const char *q = data;
+	const char *eq = data + len;
+	const char *p;
+	uint32_t i;
+	int code = 0;
+
+	if (!g_find_ranges) xnet_http_set_simd(XNET_SIMD_AVX2);
+
+	for (i=0; q+i<eq && i<sizeof(HTTP_VERSION)-1; i++) {
+		if (!version_char_ok(i, q[i])) return -1;
+	}
+	if (i < sizeof(HTTP_VERSION)-1) return 0;
+	xnet_string_view(&rsp->version, q, sizeof(HTTP_VERSION)-1);
+	q += sizeof(HTTP_VERSION)-1;
+
+	if (q == eq) return 0;
+	if (*q++ != ' ') return -1;
+	for (i=0; i<3; i++) {
+		if (q == eq) return 0;
+		if (*q < '0' || *q > '9') return -1;
+		code = code * 10 + (*q++ - '0');
+	}
+	if (code < 100) return -1;
+
+	//reason可以为空，有的服务器会省略前面的空格
+	if (q == eq) return 0;
+	if (*q == ' ') q++;
+	p = memchr(q, '\r', eq - q);
+	if (!p) return (eq - q > 1024) ? -1 : 0;
+	if (p + 1 == eq) return 0;
+	if (p[1] != '\n') return -1;
+	xnet_string_view(&rsp->reason, q, (uint32_t)(p - q));
+	rsp->code = code;
+	return parse_header_lines(HTTP_MSG(rsp), data, p + 2, eq);
+}
+
+static int
+http_rsp_header_done(xnet_unpacker_t *up, xnet_httpresponse_t *rsp) {
+	check_keep_alive(HTTP_MSG(rsp));
+	//101之后连接不再是http，不能复用
+	if (rsp->code == 101) rsp->keep_alive = false;
+	if (rsp->skip_body || rsp->code == 101 || rsp->code == 204 || rsp->code == 304) {
+		rsp->state = HTTP_STATE_DONE;
+		return 0;
+	}
+	if (!xnet_get_http_header(rsp, XNET_HTTP_H_CONTENT_LENGTH) &&
+		!xnet_get_http_header(rsp, XNET_HTTP_H_TRANSFER_ENCODING)) {
+		//没有长度信息，body到连接关闭为止
+		rsp->until_close = true;
+		rsp->keep_alive = false;
+		rsp->state = HTTP_STATE_BODY;
+		if (up->sm) up->sm(up, up->arg, NULL, 0);
+		return 0;
+	}
+	return http_body_length(up, HTTP_MSG(rsp));
+}
+
+uint32_t
+xnet_unpack_http_rsp(xnet_unpacker_t *up, const char *buffer, uint32_t sz) {
+	xnet_httpresponse_t *rsp = (xnet_httpresponse_t *)up->arg;
+	const char *q = buffer;
+	const char *eq = buffer + sz;
+	uint32_t old, header_len = 0, n;
+	int ret;
+
+	if (sz == 0) return 0;
+
+	if (rsp->state < HTTP_STATE_BODY) {
+		old = xnet_string_get_size(&rsp->raw);
+		if (old == 0) {
+			ret = parse_status_slice(rsp, buffer, sz);
+		} else {
+			xnet_string_append_buff(&rsp->raw, buffer, sz);
+			ret = parse_status_slice(rsp, rsp->raw.str, old + sz);
+		}
+		if (ret < 0) return 0;
+		if (ret == 0) {
+			if (old + sz > XNET_HTTP_MAX_HEADER) return 0;
+			if (old == 0) xnet_string_append_buff(&rsp->raw, buffer, sz);
+			rsp->recv_len += sz;
+			return sz;
+		}
+		if (old > 0) rsp->raw.size = ret;
+		else header_len = (uint32_t)ret;
+		q = buffer + (ret - old);
+		//跳过1xx的中间响应(100 Continue等)
+		if (rsp->code < 200 && rsp->code != 101) {
+			rsp->raw.size = 0;
+			rsp->header_count = 0;
+			rsp->code = 0;
+			return (uint32_t)(q - buffer);
+		}
+		if (http_rsp_header_done(up, rsp) != 0) return 0;
+	}
+
+	if (rsp->state == HTTP_STATE_BODY && q < eq) {
+		if (rsp->until_close) {
+			n = (uint32_t)(eq - q);
+			if (!up->sm && up->limit != 0 && (uint64_t)rsp->body_len + n > up->limit) return 0;
+			if (up->sm) {
+				up->sm(up, up->arg, q, n);
+			} else {
+				if (!rsp->body) rsp->body = xnet_string_create();
+				xnet_string_append_buff(rsp->body, q, n);
+			}
+			rsp->body_len += n;
+			q = eq;
+		} else {
+			q += http_body(up, HTTP_MSG(rsp), q, (uint32_t)(eq - q), true);
 		}
 	}
+	if (rsp->state == HTTP_STATE_CHUNK && q < eq) {
+		ret = http_chunked(up, HTTP_MSG(rsp), q, (uint32_t)(eq - q));
+		if (ret < 0) return 0;
+		q += ret;
+	}
+
+	if (rsp->state == HTTP_STATE_DONE) {
+		up->full = true;
+	} else if (header_len > 0) {
+		pin_header_slice(HTTP_MSG(rsp), buffer, header_len);
+		rebase_view(&rsp->reason, buffer, header_len, rsp->raw.str);
+	}
+	rsp->recv_len += (uint32_t)(q - buffer);
+	return (uint32_t)(q - buffer);
+}
+
+int
+xnet_http_rsp_eof(xnet_unpacker_t *up) {
+	xnet_httpresponse_t *rsp = (xnet_httpresponse_t *)up->arg;
+	if (rsp->state != HTTP_STATE_BODY || !rsp->until_close) return -1;
+	rsp->state = HTTP_STATE_DONE;
+	up->cb(up, up->arg);
+	up->cm(up->arg);
+	return 0;
+}
+
+void
+xnet_free_http_rsp(void *arg) {
+	xnet_clear_http_rsp((xnet_httpresponse_t *)arg);
+}
+
+void
+xnet_clear_http_rsp_slice(void *arg) {
+	int i;
+	xnet_httpresponse_t *rsp = (xnet_httpresponse_t *)arg;
+	if (rsp->body) {
+		xnet_string_destroy(rsp->body);
+		rsp->body = NULL;
+	}
+	xnet_string_clear(&rsp->version);
+	xnet_string_clear(&rsp->reason);
+	for (i=0; i<rsp->header_count; i++) {
+		xnet_string_clear(&rsp->header[i].key);
+		xnet_string_clear(&rsp->header[i].value);
+	}
+	rsp->header_count = 0;
+	reset_header_index(HTTP_MSG(rsp));
+	rsp->raw.size = 0;
+	rsp->state = rsp->subState = 0;
+	rsp->code = 0;
+	rsp->keep_alive = false;
+	rsp->chunked = false;
+	rsp->until_close = false;
+	rsp->content_length = 0;
+	rsp->body_len = 0;
+	rsp->chunk_left = 0;
+	rsp->recv_len = 0;
+	rsp->skip_body = false;
+}
+
+//超出索引范围的header只在手动添加大量header时出现，顺序比较
+static xnet_httpheader_t *
+find_unindexed(xnet_httpmessage_t *msg, const char *key) {
+	int i;
+	for (i=XNET_HTTP_INDEX_MAX; i<msg->header_count; i++) {
+		if (xnet_string_casecompare_cs(&msg->header[i].key, key) == 0)
+			return &msg->header[i];
+	}
 	return NULL;
 }
 
-static const char *
-get_http_status_msg(int state) {
-	switch (state) {
-		case 100:
-			return "Continue";
-		case 101:
-			return "Switching Protocols";
-		case 200:
-			return "OK";
-		case 201:
-			return "Created";
-		case 202:
-			return "Accepted";
-		case 203:
-			return "Non-Authoritative Information";
-		case 204:
-			return "No Content";
-		case 205:
-			return "Reset Content";
-		case 206:
-			return "Partial Content";
-		case 300:
-			return "Multiple Choices";
-		case 301:
-			return "Moved Permanently";
-		case 302:
-			return "Found";
-		case 303:
-			return "See Other";
-		case 304:
-			return "Not Modified";
-		case 305:
-			return "Use Proxy";
-		case 307:
-			return "Temporary Redirect";
-		case 400:
-			return "Bad Request";
-		case 401:
-			return "Unauthorized";
-		case 402:
-			return "Payment Required";
-		case 403:
-			return "Forbidden";
-		case 404:
-			return "Not Found";
-		case 405:
-			return "Method Not Allowed";
-		case 406:
-			return "Not Acceptable";
-		case 407:
-			return "Proxy Authentication Required";
-		case 408:
-			return "Request Time-out";
-		case 409:
-			return "Conflict";
-		case 410:
-			return "Gone";
-		case 411:
-			return "Length Required";
-		case 412:
-			return "Precondition Failed";
-		case 413:
-			return "Request Entity Too Large";
-		case 414:
-			return "Request-URI Too Large";
-		case 415:
-			return "Unsupported Media Type";
-		case 416:
-			return "Requested range not satisfiable";
-		case 417:
-			return "Expectation Failed";
-		case 500:
-			return "Internal Server Error";
-		case 501:
-			return "Not Implemented";
-		case 502:
-			return "Bad Gateway";
-		case 503:
-			return "Service Unavailable";
-		case 504:
-			return "Gateway Time-out";
-		case 505:
-			return "HTTP Version not supported";
-	};
-	return "";
+xnet_httpheader_t *
+xnet_get_http_header(void *req_or_rsp, int id) {
+	xnet_httpmessage_t *msg = HTTP_MSG(req_or_rsp);
+	int i;
+	if (id <= XNET_HTTP_H_UNKNOWN || id >= XNET_HTTP_H_MAX) return NULL;
+	if (msg->header_known[id])
+		return &msg->header[msg->header_known[id] - 1];
+	for (i=XNET_HTTP_INDEX_MAX; i<msg->header_count; i++) {
+		if (msg->header[i].id == id)
+			return &msg->header[i];
+	}
+	return NULL;
+}
+
+xnet_httpheader_t *
+xnet_get_http_header_value(void *req_or_rsp, const char *key) {
+	xnet_httpmessage_t *msg = HTTP_MSG(req_or_rsp);
+	xnet_httpheader_t *header;
+	uint32_t len = (uint32_t)strlen(key);
+	uint32_t hash, slot;
+	int id;
+
+	if (msg->header_count == 0) return NULL;
+	id = known_header_id(key, len);
+	if (id != XNET_HTTP_H_UNKNOWN)
+		return xnet_get_http_header(msg, id);
+	if (msg->header_hashed) {
+		hash = header_hash(key, len);
+		slot = hash & (XNET_HTTP_INDEX_SLOTS-1);
+		while (msg->header_slots[slot]) {
+			header = &msg->header[msg->header_slots[slot] - 1];
+			if (header->hash == hash && xnet_string_casecompare_cs(&header->key, key) == 0)
+				return header;
+			slot = (slot + 1) & (XNET_HTTP_INDEX_SLOTS-1);
+		}
+	}
+	return find_unindexed(msg, key);
+}
+
+void
+xnet_add_http_header_view(void *req_or_rsp, const char *key, uint32_t key_sz, const char *value, uint32_t value_sz) {
+	xnet_httpmessage_t *msg = HTTP_MSG(req_or_rsp);
+	ensure_header(msg);
+	xnet_string_view(&msg->header[msg->header_count].key, key, key_sz);
+	xnet_string_view(&msg->header[msg->header_count].value, value, value_sz);
+	index_header(msg, msg->header_count);
+	msg->header_count++;
+}
+
+//完整的状态行预先拼好，按状态码直接取
+typedef struct {
+	const char *line;
+	uint32_t len;
+} http_status_line_t;
+
+#define STATUS_LINE(code, msg) [code] = {"HTTP/1.1 " #code " " msg "\r\n", sizeof("HTTP/1.1 " #code " " msg "\r\n")-1}
+#define HTTP_STATUS_MAX 600
+
+static const http_status_line_t g_status_lines[HTTP_STATUS_MAX] = {
+	STATUS_LINE(100, "Continue"),
+	STATUS_LINE(101, "Switching Protocols"),
+	STATUS_LINE(200, "OK"),
+	STATUS_LINE(201, "Created"),
+	STATUS_LINE(202, "Accepted"),
+	STATUS_LINE(203, "Non-Authoritative Information"),
+	STATUS_LINE(204, "No Content"),
+	STATUS_LINE(205, "Reset Content"),
+	STATUS_LINE(206, "Partial Content"),
+	STATUS_LINE(300, "Multiple Choices"),
+	STATUS_LINE(301, "Moved Permanently"),
+	STATUS_LINE(302, "Found"),
+	STATUS_LINE(303, "See Other"),
+	STATUS_LINE(304, "Not Modified"),
+	STATUS_LINE(305, "Use Proxy"),
+	STATUS_LINE(307, "Temporary Redirect"),
+	STATUS_LINE(400, "Bad Request"),
+	STATUS_LINE(401, "Unauthorized"),
+	STATUS_LINE(402, "Payment Required"),
+	STATUS_LINE(403, "Forbidden"),
+	STATUS_LINE(404, "Not Found"),
+	STATUS_LINE(405, "Method Not Allowed"),
+	STATUS_LINE(406, "Not Acceptable"),
+	STATUS_LINE(407, "Proxy Authentication Required"),
+	STATUS_LINE(408, "Request Time-out"),
+	STATUS_LINE(409, "Conflict"),
+	STATUS_LINE(410, "Gone"),
+	STATUS_LINE(411, "Length Required"),
+	STATUS_LINE(412, "Precondition Failed"),
+	STATUS_LINE(413, "Request Entity Too Large"),
+	STATUS_LINE(414, "Request-URI Too Large"),
+	STATUS_LINE(415, "Unsupported Media Type"),
+	STATUS_LINE(416, "Requested range not satisfiable"),
+	STATUS_LINE(417, "Expectation Failed"),
+	STATUS_LINE(500, "Internal Server Error"),
+	STATUS_LINE(501, "Not Implemented"),
+	STATUS_LINE(502, "Bad Gateway"),
+	STATUS_LINE(503, "Service Unavailable"),
+	STATUS_LINE(504, "Gateway Time-out"),
+	STATUS_LINE(505, "HTTP Version not supported"),
 };
 
+//Date每秒只格式化一次，每个线程(context)一份缓存
+static __thread time_t g_date_time;
+static __thread uint32_t g_date_len;
+static __thread char g_date_line[64];
+
+static void
+append_status_line(int code, xnet_string_t *out) {
+	char line[32];
+	int n;
+	if (code > 0 && code < HTTP_STATUS_MAX && g_status_lines[code].line) {
+		xnet_string_append_buff(out, g_status_lines[code].line, g_status_lines[code].len);
+		return;
+	}
+	n = snprintf(line, sizeof(line), "HTTP/1.1 %d \r\n", code);
+	xnet_string_append_buff(out, line, n);
+}
+
+static void
+append_date(xnet_string_t *out) {
+	static const char *wday[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+	static const char *mon[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+		"Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+	time_t now = time(NULL);
+	struct tm tm;
+
+	//转换失败时继续使用上一次的Date
+	if (now != g_date_time && util_gmtime(&now, &tm)) {
+		g_date_len = sprintf(g_date_line, "Date: %s, %02d %s %d %02d:%02d:%02d GMT\r\n", wday[tm.tm_wday],
+			tm.tm_mday, mon[tm.tm_mon], tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+		g_date_time = now;
+	}
+	xnet_string_append_buff(out, g_date_line, g_date_len);
+}
+
+static void
+append_content_length(uint64_t len, xnet_string_t *out) {
+	static const char key[] = "content-length: ";
+	char num[20];
+	int n = sizeof(num);
+	do {
+		num[--n] = '0' + len % 10;
+		len /= 10;
+	} while (len > 0);
+	xnet_string_append_buff(out, key, sizeof(key)-1);
+	xnet_string_append_buff(out, num + n, sizeof(num) - n);
+	xnet_string_append_buff(out, "\r\n", 2);
+}
+
+void
+xnet_pack_http_head(int code, const char *fields, uint32_t fields_sz, int64_t body_len, xnet_string_t *out) {
+	append_status_line(code, out);
+	append_date(out);
+	if (fields_sz > 0)
+		xnet_string_append_buff(out, fields, fields_sz);
+	if (body_len >= 0)
+		append_content_length((uint64_t)body_len, out);
+	xnet_string_append_buff(out, "\r\n", 2);
+}
+
 int
 xnet_pack_http(xnet_httpresponse_t *rsp, xnet_string_t *out) {
 	int i;
-	char pack_str[128] = {};
-	sprintf(pack_str, "HTTP/1.1 %d %s\r\n", rsp->code, get_http_status_msg(rsp->code));
-	xnet_string_append_cs(out, pack_str);
+	append_status_line(rsp->code, out);
 
 	if (rsp->header) {
 		for (i=0; i<rsp->header_count; i++) {
@@ -481,14 +1536,14 @@ xnet_pack_http(xnet_httpresponse_t *rsp, xnet_string_t *out) {
 			xnet_string_append_cs(out, "\r\n");
 		}
 	}
-	if (rsp->body && xnet_string_get_size(rsp->body) > 0) {
-		//if 'transfer-encoding' is set, don't need append 'content-length'
-		if (xnet_get_http_header_value(rsp, "transfer-encoding")) {
-			xnet_string_append_cs(out, "\r\n");
-		} else {
-			sprintf(pack_str, "content-length: %d\r\n\r\n", xnet_string_get_size(rsp->body));
-			xnet_string_append_cs(out, pack_str);
-		}
+	if (xnet_get_http_header(rsp, XNET_HTTP_H_TRANSFER_ENCODING)) {
+		//chunked：body作为第一个chunk，后续的chunk和结束标记由调用者继续输出
+		xnet_string_append_cs(out, "\r\n");
+		if (rsp->body && xnet_string_get_size(rsp->body) > 0)
+			xnet_pack_http_chunk(xnet_string_get_str(rsp->body), xnet_string_get_size(rsp->body), out);
+	} else if (rsp->body && xnet_string_get_size(rsp->body) > 0) {
+		append_content_length(xnet_string_get_size(rsp->body), out);
+		xnet_string_append_buff(out, "\r\n", 2);
 		xnet_string_append(out, rsp->body);
 	} else {
 		xnet_string_append_cs(out, "\r\n");
@@ -496,6 +1551,22 @@ xnet_pack_http(xnet_httpresponse_t *rsp, xnet_string_t *out) {
 	return 0;
 }
 
+void
+xnet_pack_http_chunk(const char *data, uint32_t sz, xnet_string_t *out) {
+	char size_str[16];
+	//长度为0的chunk表示结束，这里忽略
+	if (sz == 0) return;
+	sprintf(size_str, "%x\r\n", sz);
+	xnet_string_append_cs(out, size_str);
+	xnet_string_append_buff(out, data, sz);
+	xnet_string_append_cs(out, "\r\n");
+}
+
+void
+xnet_pack_http_end(xnet_string_t *out) {
+	xnet_string_append_cs(out, "0\r\n\r\n");
+}
+
 inline void
 xnet_set_http_rsp_code(xnet_httpresponse_t *rsp, int code) {
 	rsp->code = code;
@@ -504,7 +1575,7 @@ xnet_set_http_rsp_code(xnet_httpresponse_t *rsp, int code) {
 void
 xnet_add_http_rsp_header(xnet_httpresponse_t *rsp, const char *key, const char *value) {
 	uint32_t new_capacity;
-	if (rsp->header_capacity >= rsp->header_count) {
+	if (rsp->header_count >= rsp->header_capacity) {
 		new_capacity = rsp->header_capacity ? rsp->header_capacity*2 : 32;
 		rsp->header = realloc(rsp->header, sizeof(*rsp->header)*new_capacity);
 		assert(rsp->header);
@@ -514,6 +1585,7 @@ xnet_add_http_rsp_header(xnet_httpresponse_t *rsp, const char *key, const char *
 	}
 	xnet_string_set_cs(&rsp->header[rsp->header_count].key, key);
 	xnet_string_set_cs(&rsp->header[rsp->header_count].value, value);
+	index_header(HTTP_MSG(rsp), rsp->header_count);
 	rsp->header_count ++;
 }
 
@@ -552,8 +1624,11 @@ xnet_raw_set_http_rsp_byte_body(xnet_httpresponse_t *rsp, char *body, uint32_t s
 void
 xnet_clear_http_rsp(xnet_httpresponse_t *rsp) {
 	int i;
+	xnet_string_clear(&rsp->version);
+	xnet_string_clear(&rsp->reason);
+	xnet_string_clear(&rsp->raw);
 	if (rsp->header) {
-		for (i=0; i<rsp->header_count; i++) {
+		for (i=0; i<rsp->header_capacity; i++) {
 			xnet_string_clear(&rsp->header[i].key);
 			xnet_string_clear(&rsp->header[i].value);
 		}
@@ -590,6 +1665,21 @@ xnet_unpack_sizebuffer(xnet_unpacker_t *up, const char *buffer, uint32_t sz) {
 	uint32_t body_size;
 	xnet_sizebuffer_t *sb = (xnet_sizebuffer_t *)up->arg;
 
+	//完整的一帧都在本次接收中，直接引用
+	if (sb->recv_len == 0 && sz >= BUFFER_HEADER_SIZE) {
+		body_size = read_size((unsigned char*)buffer);
+		if (body_size <= sz - BUFFER_HEADER_SIZE) {
+			if (body_size == 0 || (up->limit != 0 && body_size > up->limit))
+				return 0;
+			sb->buffer_size = body_size;
+			sb->recv_len = body_size + BUFFER_HEADER_SIZE;
+			sb->recv_buffer = (char*)buffer + BUFFER_HEADER_SIZE;
+			sb->view = true;
+			up->full = true;
+			return sb->recv_len;
+		}
+	}
+
 	if (sb->recv_len < BUFFER_HEADER_SIZE) {
 		if (sb->recv_len + sz < BUFFER_HEADER_SIZE) {
 			memcpy(sb->header+sb->recv_len, buffer, sz);
@@ -633,7 +1723,7 @@ void
 xnet_clear_sizebuffer(void *arg) {
 	xnet_sizebuffer_t *sb = (xnet_sizebuffer_t *)arg;
 
-	if (sb->recv_buffer) {
+	if (sb->recv_buffer && !sb->view) {
 		free(sb->recv_buffer);
 		sb->recv_buffer = NULL;
 	}
@@ -652,32 +1742,212 @@ xnet_pack_sizebuff(const char *buffer, uint32_t sz, xnet_string_t *out) {
 }
 
 uint32_t
-xnet_unpack_line(xnet_unpacker_t *up, const char *buffer, uint32_t sz) {
-	xnet_linebuffer_t *lb = (xnet_linebuffer_t *)up->arg;
-	const char *q = buffer;
-	const char *eq = q + sz;
-	char *str;
+xnet_pack_sizebuff_begin(xnet_string_t *out) {
+	uint32_t start = xnet_string_get_size(out);
+	char header[BUFFER_HEADER_SIZE] = {0};
+	xnet_string_append_buff(out, header, BUFFER_HEADER_SIZE);
+	return start;
+}
+
+void
+xnet_pack_sizebuff_end(xnet_string_t *out, uint32_t start) {
+	char *str = xnet_string_get_str(out);
+	write_size(xnet_string_get_size(out) - start - BUFFER_HEADER_SIZE, str + start);
+}
 
-	while (q < eq && *q != '\n') {
-		if (up->limit != 0 && xnet_string_get_size(&lb->line_str) > up->limit) {
-			return 0;
+//解析帧头，返回1表示得到整帧长度，0表示帧头不完整，-1表示出错
+static int
+decode_lengthfield(const xnet_lengthfield_conf_t *conf, const uint8_t *p, uint32_t sz, uint64_t *frame_len) {
+	uint64_t len = 0;
+	uint32_t head, i;
+	int64_t total;
+
+	if (sz <= conf->offset) return 0;
+	p += conf->offset;
+	sz -= conf->offset;
+	if (conf->width == 0) {
+		for (i=0; ; i++) {
+			if (i == 10) return -1;
+			if (i == sz) return 0;
+			len |= (uint64_t)(p[i] & 0x7F) << (7 * i);
+			if (!(p[i] & 0x80)) break;
 		}
-		xnet_string_add(&lb->line_str, *q);
-		q++;
+		head = conf->offset + i + 1;
+	} else {
+		if (sz < conf->width) return 0;
+		for (i=0; i<conf->width; i++) {
+			if (conf->big_endian)
+				len = len << 8 | p[i];
+			else
+				len |= (uint64_t)p[i] << (8 * i);
+		}
+		head = conf->offset + conf->width;
 	}
-	if (*q == '\n') {
-		q++;
+	if (len > UINT32_MAX) return -1;
+	total = (int64_t)head + (int64_t)len + conf->adjust;
+	if (total < head || total < conf->strip || total > UINT32_MAX) return -1;
+	*frame_len = (uint64_t)total;
+	return 1;
+}
+
+uint32_t
+xnet_unpack_lengthfield(xnet_unpacker_t *up, const char *buffer, uint32_t sz) {
+	xnet_lengthfield_t *lf = (xnet_lengthfield_t *)up->arg;
+	uint32_t used = 0, n, head_min;
+	uint64_t frame_len;
+	int r;
+
+	//完整的一帧都在本次接收中，直接引用
+	if (xnet_string_get_size(&lf->buffer) == 0) {
+		r = decode_lengthfield(&lf->conf, (const uint8_t *)buffer, sz, &frame_len);
+		if (r < 0 || (r > 0 && up->limit != 0 && frame_len > up->limit)) return 0;
+		if (r > 0 && frame_len <= sz) {
+			lf->frame_len = (uint32_t)frame_len;
+			lf->data = buffer + lf->conf.strip;
+			lf->size = lf->frame_len - lf->conf.strip;
+			lf->view = true;
+			up->full = true;
+			return lf->frame_len;
+		}
+	}
+
+	//帧头按需要的字节数复制，不会多读到下一帧
+	head_min = lf->conf.offset + (lf->conf.width ? lf->conf.width : 1);
+	while (lf->frame_len == 0) {
+		n = xnet_string_get_size(&lf->buffer);
+		n = (n < head_min) ? head_min - n : 1;
+		if (n > sz - used) n = sz - used;
+		if (n == 0) return used;
+		xnet_string_append_buff(&lf->buffer, buffer + used, n);
+		used += n;
+		r = decode_lengthfield(&lf->conf, (const uint8_t *)lf->buffer.str, xnet_string_get_size(&lf->buffer), &frame_len);
+		if (r < 0 || (r > 0 && up->limit != 0 && frame_len > up->limit)) return 0;
+		if (r > 0) lf->frame_len = (uint32_t)frame_len;
+	}
+
+	n = lf->frame_len - xnet_string_get_size(&lf->buffer);
+	if (n > sz - used) n = sz - used;
+	xnet_string_append_buff(&lf->buffer, buffer + used, n);
+	used += n;
+	if (xnet_string_get_size(&lf->buffer) == lf->frame_len) {
+		lf->data = lf->buffer.str + lf->conf.strip;
+		lf->size = lf->frame_len - lf->conf.strip;
+		lf->view = false;
 		up->full = true;
-		lb->sep = false;
-		if (xnet_string_get_size(&lb->line_str) > 0) {
-			str = xnet_string_get_str(&lb->line_str);
-			if (str[xnet_string_get_size(&lb->line_str)-1] == '\r') {
-				lb->line_str.size --;
-				lb->sep = true;
-			}
+	}
+	return used;
+}
+
+//保留配置和拼接缓存
+void
+xnet_clear_lengthfield(void *arg) {
+	xnet_lengthfield_t *lf = (xnet_lengthfield_t *)arg;
+	lf->data = NULL;
+	lf->size = 0;
+	lf->view = false;
+	lf->frame_len = 0;
+	lf->buffer.size = 0;
+}
+
+void
+xnet_free_lengthfield(void *arg) {
+	xnet_lengthfield_t *lf = (xnet_lengthfield_t *)arg;
+	xnet_string_clear(&lf->buffer);
+	xnet_clear_lengthfield(lf);
+}
+
+int
+xnet_pack_lengthfield_header(const xnet_lengthfield_conf_t *conf, uint64_t body_sz, char *out) {
+	uint8_t *p = (uint8_t *)out;
+	int64_t len;
+	int i, n;
+
+	//长度值 = 长度字段之后的字节数 - adjust
+	len = (int64_t)body_sz - conf->adjust;
+	if (conf->width == 0) {
+		if (len < 0) return -1;
+		for (n=0; len >= 0x80; n++) {
+			p[n] = (uint8_t)(len | 0x80);
+			len >>= 7;
 		}
+		p[n++] = (uint8_t)len;
+		return n;
 	}
-	return (uint32_t)(q - buffer);
+	if (len < 0 || (conf->width < 8 && (uint64_t)len >> (conf->width * 8)))
+		return -1;
+	for (i=0; i<conf->width; i++) {
+		if (conf->big_endian)
+			p[i] = (uint8_t)(len >> (8 * (conf->width - 1 - i)));
+		else
+			p[i] = (uint8_t)(len >> (8 * i));
+	}
+	return conf->width;
+}
+
+int
+xnet_pack_lengthfield(const xnet_lengthfield_conf_t *conf, const char *head, const char *body, uint32_t sz, xnet_string_t *out) {
+	char field[10];
+	char zero[256] = {0};
+	int n = xnet_pack_lengthfield_header(conf, sz, field);
+	if (n < 0) return -1;
+	xnet_string_append_buff(out, head ? head : zero, conf->offset);
+	xnet_string_append_buff(out, field, n);
+	xnet_string_append_buff(out, body, sz);
+	return 0;
+}
+
+//分隔符的最后一个字节在buffer[i]，检查前面的字节(可能有一部分在上次接收的line_str中)
+static bool
+line_delim_match(xnet_linebuffer_t *lb, const char *buffer, uint32_t i) {
+	uint32_t n = lb->delim_len - 1;
+	uint32_t in_buffer = (i < n) ? i : n;
+	uint32_t in_line = n - in_buffer;
+
+	if (in_line > xnet_string_get_size(&lb->line_str)) return false;
+	if (memcmp(buffer + i - in_buffer, lb->delim + n - in_buffer, in_buffer) != 0) return false;
+	return in_line == 0 || memcmp(lb->line_str.str + lb->line_str.size - in_line, lb->delim, in_line) == 0;
+}
+
+uint32_t
+xnet_unpack_line(xnet_unpacker_t *up, const char *buffer, uint32_t sz) {
+	xnet_linebuffer_t *lb = (xnet_linebuffer_t *)up->arg;
+	xnet_string_t *line = &lb->line_str;
+	char last = lb->delim_len ? lb->delim[lb->delim_len-1] : '\n';
+	uint32_t i = 0, used, cut;
+	const char *p;
+
+	//memchr找分隔符的最后一个字节，多字节分隔符再比较前面的字节
+	for (;;) {
+		p = memchr(buffer + i, last, sz - i);
+		if (p == NULL) {
+			if (up->limit != 0 && xnet_string_get_size(line) + sz > up->limit)
+				return 0;
+			xnet_string_append_buff(line, buffer, sz);
+			return sz;
+		}
+		i = (uint32_t)(p - buffer);
+		if (lb->delim_len <= 1 || line_delim_match(lb, buffer, i))
+			break;
+		i++;
+	}
+
+	used = i + 1;
+	if (xnet_string_get_size(line) == 0) {
+		xnet_string_view(line, buffer, used);
+	} else {
+		xnet_string_append_buff(line, buffer, used);
+	}
+	cut = lb->delim_len ? lb->delim_len : 1;
+	lb->sep = false;
+	if (lb->delim_len == 0 && line->size > 1 && line->str[line->size-2] == '\r') {
+		cut++;
+		lb->sep = true;
+	}
+	line->size -= cut;
+	if (up->limit != 0 && line->size > up->limit)
+		return 0;
+	up->full = true;
+	return used;
 }
 
 void
@@ -685,3 +1955,11 @@ xnet_clear_line(void *arg) {
 	xnet_linebuffer_t *lb = (xnet_linebuffer_t *)arg;
 	xnet_string_clear(&lb->line_str);
 }
+
+int
+xnet_set_line_delim(xnet_linebuffer_t *lb, const char *delim, uint32_t sz) {
+	if (sz > XNET_LINE_DELIM_MAX) return -1;
+	memcpy(lb->delim, delim, sz);
+	lb->delim_len = (uint8_t)sz;
+	return 0;
+}
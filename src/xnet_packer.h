@@ -10,14 +10,22 @@ typedef struct xnet_unpacker xnet_unpacker_t;
 typedef void (*unpack_callback_t)(xnet_unpacker_t *up, void *arg);
 typedef uint32_t (*unpack_method_t)(xnet_unpacker_t *up, const char *buffer, uint32_t sz);
 typedef void (*clear_method_t)(void *arg);
+typedef void (*unpack_stream_t)(xnet_unpacker_t *up, void *arg, const char *data, uint32_t sz);
 
 struct xnet_unpacker {
 	unpack_callback_t cb;
 	unpack_method_t um;
 	clear_method_t cm;
+	clear_method_t fm;//释放解包器时调用，为空时使用cm
+	unpack_stream_t sm;//流式接收，目前只有http的body支持
 	uint32_t limit;//包大小限制,为0表示没有限制,实际限制范围取决于解包方法
 	bool full;//收完一个整包，需设置此标记为true，在进行回调后，会调用cm方法清理用户缓存
 	bool close;//用于在成功进行一次回调后终止剩余数据的解包
+	//流水线：next为下一级，cb中用xnet_unpacker_emit把本级的输出交给它
+	xnet_unpacker_t *next;
+	bool busy;//正在解包，期间的移除延迟到解包返回时
+	bool removed;
+	bool fail;//下一级解包失败
 	//保留给用户
 	void *user_ptr;
 	void *user_arg;
@@ -25,9 +33,24 @@ struct xnet_unpacker {
 };
 
 xnet_unpacker_t *xnet_unpacker_new(uint32_t arg_sz, unpack_callback_t cb, unpack_method_t um, clear_method_t cm, uint32_t limit);
+//释放时连同后面的各级一起释放
 void xnet_unpacker_free(xnet_unpacker_t * up);
 int xnet_unpacker_recv(xnet_unpacker_t *up, const char *buffer, uint32_t sz);
 
+/*
+ * 解包流水线：各级按next串起来，socket的unpacker指向第一级，例如PROXY头->http、
+ * lengthfield->RESP。中间级的cb调用xnet_unpacker_emit把输出(通常是指向接收缓存的view)
+ * 直接交给下一级解包，不复制；下一级失败时本级的recv也返回失败。
+ * head为第一级指针的地址(通常是&s->unpacker)，以下操作可以在任意一级的回调中调用：
+ * insert把up插入到prev之后(prev为NULL时成为第一级)；remove移除并释放up，
+ * up正在解包时延迟到它的recv返回时释放，本次接收中剩余的数据交给原来的下一级；
+ * replace用up替换old(例如http升级为websocket)，old剩余的数据交给up。
+ */
+int xnet_unpacker_emit(xnet_unpacker_t *up, const char *data, uint32_t sz);
+void xnet_unpacker_insert(xnet_unpacker_t **head, xnet_unpacker_t *prev, xnet_unpacker_t *up);
+void xnet_unpacker_remove(xnet_unpacker_t **head, xnet_unpacker_t *up);
+void xnet_unpacker_replace(xnet_unpacker_t **head, xnet_unpacker_t *old, xnet_unpacker_t *up);
+
 /*http 封包解包*/
 enum http_state_e {
 	HTTP_STATE_METHOD = 0,
@@ -37,35 +60,118 @@ enum http_state_e {
 	HTTP_STATE_HEADER_VALUE,
 	HTTP_STATE_HEADER_DONE,
 	HTTP_STATE_BODY,
+	HTTP_STATE_CHUNK,//Transfer-Encoding: chunked
 	HTTP_STATE_DONE
 };
+
+//解析时能识别的header，用xnet_get_http_header按id直接取
+enum xnet_http_header_e {
+	XNET_HTTP_H_UNKNOWN = 0,
+	XNET_HTTP_H_HOST,
+	XNET_HTTP_H_CONNECTION,
+	XNET_HTTP_H_CONTENT_LENGTH,
+	XNET_HTTP_H_CONTENT_TYPE,
+	XNET_HTTP_H_TRANSFER_ENCODING,
+	XNET_HTTP_H_ACCEPT,
+	XNET_HTTP_H_ACCEPT_ENCODING,
+	XNET_HTTP_H_ACCEPT_LANGUAGE,
+	XNET_HTTP_H_USER_AGENT,
+	XNET_HTTP_H_COOKIE,
+	XNET_HTTP_H_UPGRADE,
+	XNET_HTTP_H_EXPECT,
+	XNET_HTTP_H_AUTHORIZATION,
+	XNET_HTTP_H_REFERER,
+	XNET_HTTP_H_ORIGIN,
+	XNET_HTTP_H_CACHE_CONTROL,
+	XNET_HTTP_H_IF_NONE_MATCH,
+	XNET_HTTP_H_IF_MODIFIED_SINCE,
+	XNET_HTTP_H_RANGE,
+	XNET_HTTP_H_DATE,
+	XNET_HTTP_H_SERVER,
+	XNET_HTTP_H_LOCATION,
+	XNET_HTTP_H_SET_COOKIE,
+	XNET_HTTP_H_CONTENT_ENCODING,
+	XNET_HTTP_H_KEEP_ALIVE,
+	XNET_HTTP_H_SEC_WEBSOCKET_KEY,
+	XNET_HTTP_H_SEC_WEBSOCKET_VERSION,
+	XNET_HTTP_H_SEC_WEBSOCKET_ACCEPT,
+	XNET_HTTP_H_SEC_WEBSOCKET_PROTOCOL,
+	XNET_HTTP_H_SEC_WEBSOCKET_EXTENSIONS,
+	XNET_HTTP_H_X_FORWARDED_FOR,
+	XNET_HTTP_H_X_REAL_IP,
+	XNET_HTTP_H_HTTP2_SETTINGS,
+	XNET_HTTP_H_LAST_MODIFIED,
+	XNET_HTTP_H_ETAG,
+	XNET_HTTP_H_VARY,
+	XNET_HTTP_H_TE,
+	XNET_HTTP_H_PRAGMA,
+	XNET_HTTP_H_PROXY_CONNECTION,
+	XNET_HTTP_H_FORWARDED,
+	XNET_HTTP_H_MAX
+};
+
 typedef struct {
 	xnet_string_t key;
 	xnet_string_t value;
+	uint8_t id;//enum xnet_http_header_e
+	uint32_t hash;//未知header名字的哈希(不区分大小写)
 } xnet_httpheader_t;
 
+/*
+ * header_known按id记录已知header的位置，header_slots是未知header的开放寻址表，
+ * 都保存下标+1，0表示没有；只索引前XNET_HTTP_INDEX_MAX个header
+ */
+#define XNET_HTTP_INDEX_MAX 128
+#define XNET_HTTP_INDEX_SLOTS 256
 #define HTTP_CMMOND_HEAD \
 xnet_httpheader_t *header; \
 uint16_t header_count; \
-uint16_t header_capacity;
+uint16_t header_capacity; \
+bool header_hashed; \
+uint8_t header_known[XNET_HTTP_H_MAX]; \
+uint8_t header_slots[XNET_HTTP_INDEX_SLOTS];
+
+/*
+ * 请求和响应解析共用的字段：
+ * keep_alive 处理完后是否保持连接
+ * until_close 响应没有长度信息，body到连接关闭为止
+ * body_len 已接收的body长度，chunk_left 当前chunk剩余长度
+ * raw 跨越多次接收的头部
+ */
+#define HTTP_CMMOND_PARSE \
+uint16_t state; \
+uint16_t subState; \
+int code; \
+bool keep_alive; \
+bool chunked; \
+bool until_close; \
+xnet_string_t version; \
+xnet_string_t *body; \
+uint32_t content_length; \
+uint32_t body_len; \
+uint32_t chunk_left; \
+uint32_t recv_len; \
+xnet_string_t raw;
 
 typedef struct {
 	HTTP_CMMOND_HEAD
-	uint16_t state;
-	uint16_t subState;
+	HTTP_CMMOND_PARSE
+} xnet_httpmessage_t;
+
+//code为解析结果，200表示成功；keep_alive为true时同一次接收中后续的请求会继续解析(pipelining)
+typedef struct {
+	HTTP_CMMOND_HEAD
+	HTTP_CMMOND_PARSE
 	xnet_string_t method;
 	xnet_string_t url;
-	xnet_string_t version;
-	xnet_string_t *body;
-	uint32_t content_length;
-	uint32_t recv_len;
-	int code;
 } xnet_httprequest_t;
 
+//封包时只使用header、code和body；解包时code为状态码
 typedef struct {
 	HTTP_CMMOND_HEAD
-	int code;
-	xnet_string_t *body;
+	HTTP_CMMOND_PARSE
+	xnet_string_t reason;
+	bool skip_body;//对应的请求是HEAD，响应没有body，需要在解析前设置
 } xnet_httpresponse_t;
 
 /**
@@ -73,11 +179,65 @@ typedef struct {
  * return values:
  * >0:recv len
  * 0:error
+ * 所有方法都根据Content-Length接收body，up->limit限制body大小(0表示不限制)。
+ * 流式body：设置up->sm后body不再缓存到req->body中，请求头解析完成时先调用一次
+ * sm(data=NULL, sz=0)，之后每收到一段body调用一次sm，body收完后照常调用cb。
+ * 流式模式下内存占用与body大小无关，up->limit不再限制body。
+ * Transfer-Encoding: chunked的body会被解码，同样支持流式接收，trailer会被忽略。
  */
 uint32_t xnet_unpack_http(xnet_unpacker_t *up, const char *buffer, uint32_t sz);
+
+/*
+ * http解析时批量查找分隔符使用的指令集，默认按cpu支持自动选择，
+ * 编译时定义XNET_HTTP_NO_SIMD则只使用标量代码。返回实际生效的级别。
+ */
+#define XNET_SIMD_NONE 0
+#define XNET_SIMD_SSE42 1
+#define XNET_SIMD_AVX2 2
+int xnet_http_set_simd(int level);
 void xnet_clear_http(void *arg);
+
+/*
+ * slice模式：method/url/version/header都是指向接收缓存的view，不再逐个分配内存，
+ * 请求头跨越多次接收时才复制到req->raw中。view只在回调期间有效，需要保留的话自行复制。
+ * 每个请求结束后用xnet_clear_http_slice重置(保留header数组和raw的内存)，
+ * 解包器释放时用xnet_clear_http完整释放，xnet_unpacker_new_http会设置好这两个方法：
+ * up = xnet_unpacker_new_http(cb, limit);
+ */
+#define XNET_HTTP_MAX_HEADER (64*1024)
+xnet_unpacker_t *xnet_unpacker_new_http(unpack_callback_t cb, uint32_t limit);
+uint32_t xnet_unpack_http_slice(xnet_unpacker_t *up, const char *buffer, uint32_t sz);
+void xnet_clear_http_slice(void *arg);
+//按名字查找header，不区分大小写，不随header数量变慢
 xnet_httpheader_t *xnet_get_http_header_value(void *req_or_rsp, const char *key);
+//按已知header的id查找
+xnet_httpheader_t *xnet_get_http_header(void *req_or_rsp, int id);
+//追加一个view形式的header并建立索引，用于不是从http/1.x文本解析出的请求(例如http2)
+void xnet_add_http_header_view(void *req_or_rsp, const char *key, uint32_t key_sz, const char *value, uint32_t value_sz);
+
+/*
+ * http响应解包：状态行、header、Content-Length/chunked/到连接关闭为止的body，
+ * 字段是view，规则同slice模式，1xx的中间响应会被跳过。出错时不回调，直接返回失败。
+ * up = xnet_unpacker_new(sizeof(xnet_httpresponse_t), cb, xnet_unpack_http_rsp, xnet_clear_http_rsp_slice, limit);
+ * up->fm = xnet_free_http_rsp;
+ * 连接关闭时调用xnet_http_rsp_eof，body到连接关闭为止的响应会在此时回调，返回-1表示没有这样的响应。
+ */
+uint32_t xnet_unpack_http_rsp(xnet_unpacker_t *up, const char *buffer, uint32_t sz);
+void xnet_clear_http_rsp_slice(void *arg);
+void xnet_free_http_rsp(void *arg);
+int xnet_http_rsp_eof(xnet_unpacker_t *up);
+/*
+ * 设置了Transfer-Encoding: chunked时，body作为第一个chunk输出，之后用xnet_pack_http_chunk
+ * (或者xnet_http_write_chunk直接发送)继续输出，最后以xnet_pack_http_end(xnet_http_end)结束
+ */
 int xnet_pack_http(xnet_httpresponse_t *rsp, xnet_string_t *out);
+void xnet_pack_http_chunk(const char *data, uint32_t sz, xnet_string_t *out);
+/*
+ * 快速构造响应头：状态行查表，Date每秒格式化一次，一次写入out，body由调用者单独发送(不复制)。
+ * fields为"Key: value\r\n"格式的header，可以为NULL；body_len>=0时添加content-length
+ */
+void xnet_pack_http_head(int code, const char *fields, uint32_t fields_sz, int64_t body_len, xnet_string_t *out);
+void xnet_pack_http_end(xnet_string_t *out);
 void xnet_set_http_rsp_code(xnet_httpresponse_t *rsp, int code);
 void xnet_add_http_rsp_header(xnet_httpresponse_t *rsp, const char *key, const char *value);
 void xnet_set_http_rsp_body(xnet_httpresponse_t *rsp, const char *body);
@@ -86,26 +246,87 @@ void xnet_set_http_rsp_byte_body(xnet_httpresponse_t *rsp, const char *body, uin
 void xnet_raw_set_http_rsp_byte_body(xnet_httpresponse_t *rsp, char *body, uint32_t sz);
 void xnet_clear_http_rsp(xnet_httpresponse_t *rsp);
 
-/*4字节长度+实际数据*/
+/*
+ * 4字节长度+实际数据
+ * 一次接收中包含完整的一帧时recv_buffer直接指向接收缓存(view为true)，不复制，
+ * 跨越多次接收的帧才分配内存拼接；recv_buffer只在回调期间有效，不能修改
+ */
 #define BUFFER_HEADER_SIZE sizeof(uint32_t)
 typedef struct {
 	uint32_t buffer_size;
 	uint32_t recv_len;
 	char *recv_buffer;
+	bool view;
 	char header[BUFFER_HEADER_SIZE];
 } xnet_sizebuffer_t;
 
 uint32_t xnet_unpack_sizebuffer(xnet_unpacker_t *up, const char *buffer, uint32_t sz);
 void xnet_clear_sizebuffer(void *arg);
 int xnet_pack_sizebuff(const char *buffer, uint32_t sz, xnet_string_t *out);
+/*
+ * 预留长度字段的封包：begin在out末尾预留4字节并返回帧的起始位置，之后把数据直接追加到out，
+ * end在预留位置写入长度。多帧可以连续写入同一个out，不需要先生成数据再复制
+ */
+uint32_t xnet_pack_sizebuff_begin(xnet_string_t *out);
+void xnet_pack_sizebuff_end(xnet_string_t *out, uint32_t start);
 
-/*以'\n'或者'\r\n'结尾的行*/
+/*
+ * 通用长度字段分帧：帧 = [offset字节][长度字段][数据]，
+ * 整帧长度 = offset + 长度字段宽度 + 长度值 + adjust(长度值包含帧头时为负数)，
+ * 回调时data跳过帧开头的strip字节。width为1/2/4/8，0表示protobuf varint(最多10字节)。
+ * 例如sizebuffer为{0, 4, false, 0, 4}，2字节大端且长度包含自身为{0, 2, true, -2, 2}
+ */
+typedef struct {
+	uint8_t offset;
+	uint8_t width;
+	bool big_endian;
+	int32_t adjust;
+	uint32_t strip;
+} xnet_lengthfield_conf_t;
+
+/*
+ * 和sizebuffer一样，完整的一帧在一次接收中时data直接指向接收缓存(view为true)，
+ * 否则拼接到buffer中；data只在回调期间有效
+ */
+typedef struct {
+	xnet_lengthfield_conf_t conf;//创建后设置
+	const char *data;
+	uint32_t size;
+	bool view;
+	uint32_t frame_len;//0:帧头还没有接收完
+	xnet_string_t buffer;
+} xnet_lengthfield_t;
+
+/*
+ * up = xnet_unpacker_new(sizeof(xnet_lengthfield_t), cb, xnet_unpack_lengthfield, xnet_clear_lengthfield, limit);
+ * up->fm = xnet_free_lengthfield;
+ * ((xnet_lengthfield_t *)up->arg)->conf = conf;
+ * limit限制整帧长度，长度字段不合法(整帧小于帧头或者strip)时出错
+ */
+uint32_t xnet_unpack_lengthfield(xnet_unpacker_t *up, const char *buffer, uint32_t sz);
+void xnet_clear_lengthfield(void *arg);
+void xnet_free_lengthfield(void *arg);
+//只写长度字段，body_sz为长度字段之后的字节数，返回写入的字节数(最多10)，长度无法表示时返回-1
+int xnet_pack_lengthfield_header(const xnet_lengthfield_conf_t *conf, uint64_t body_sz, char *out);
+//向out追加完整的一帧，head为长度字段前的offset字节(为NULL时填0)
+int xnet_pack_lengthfield(const xnet_lengthfield_conf_t *conf, const char *head, const char *body, uint32_t sz, xnet_string_t *out);
+
+/*
+ * 默认以'\n'或者'\r\n'结尾的行，xnet_set_line_delim可以指定其他分隔符(如"\0"、只认"\r\n"、多字节)，
+ * 回调时line_str不包含分隔符。一次接收中完整的行直接引用接收缓存(view)，跨越接收的行才复制拼接，
+ * line_str只在回调期间有效
+ */
+#define XNET_LINE_DELIM_MAX 8
 typedef struct {
 	xnet_string_t line_str;
-	bool sep;//true:'\r\n' false:'\n'
+	bool sep;//默认分隔符时 true:'\r\n' false:'\n'
+	uint8_t delim_len;//0:默认分隔符
+	char delim[XNET_LINE_DELIM_MAX];
 } xnet_linebuffer_t;
 
 uint32_t xnet_unpack_line(xnet_unpacker_t *up, const char *buffer, uint32_t sz);
 void xnet_clear_line(void *arg);
+//sz为0时恢复默认分隔符，超过XNET_LINE_DELIM_MAX返回-1
+int xnet_set_line_delim(xnet_linebuffer_t *lb, const char *delim, uint32_t sz);
 
 #endif //_UNPACKER_H_
\ No newline at end of file
@@ -0,0 +1,260 @@
+#include "xnet_proxyproto.h"
+#include <string.h>
+#include <stdio.h>
+
+#define PROXY_V1_PREFIX "PROXY "
+#define PROXY_V1_PREFIX_LEN 6
+#define PROXY_FAM_UNSPEC 0
+#define PROXY_FAM_INET 1
+#define PROXY_FAM_INET6 2
+#define PROXY_FAM_UNIX 3
+
+static const uint32_t g_v2_addr_len[] = {0, 12, 36, 216};
+
+static inline uint16_t
+read_be16(const char *p) {
+	return (uint16_t)(((uint8_t)p[0] << 8) | (uint8_t)p[1]);
+}
+
+//返回头部长度，0表示还不完整，-1表示不是PROXY头
+static int
+proxy_header_len(const char *p, uint32_t sz, uint32_t limit) {
+	const char *lf;
+	uint32_t n, len;
+
+	if (p[0] == 'P') {
+		n = sz < PROXY_V1_PREFIX_LEN ? sz : PROXY_V1_PREFIX_LEN;
+		if (memcmp(p, PROXY_V1_PREFIX, n) != 0) return -1;
+		n = sz < XNET_PROXY_V1_MAX ? sz : XNET_PROXY_V1_MAX;
+		lf = memchr(p, '\n', n);
+		if (lf == NULL) return (sz < XNET_PROXY_V1_MAX) ? 0 : -1;
+		if (lf == p || lf[-1] != '\r') return -1;
+		return (int)(lf - p + 1);
+	}
+
+	n = sz < XNET_PROXY_V2_SIG_LEN ? sz : XNET_PROXY_V2_SIG_LEN;
+	if (memcmp(p, XNET_PROXY_V2_SIG, n) != 0) return -1;
+	if (sz < XNET_PROXY_V2_HEADER) return 0;
+	len = XNET_PROXY_V2_HEADER + read_be16(p + 14);
+	if (limit != 0 && len > limit) return -1;
+	return (sz < len) ? 0 : (int)len;
+}
+
+//十进制端口，转为网络字节序
+static int
+proxy_parse_port(const char *s, uint16_t *port) {
+	uint32_t v = 0;
+	if (*s == 0) return -1;
+	for (; *s; s++) {
+		if (*s < '0' || *s > '9') return -1;
+		v = v * 10 + (*s - '0');
+		if (v > 65535) return -1;
+	}
+	*port = htons((uint16_t)v);
+	return 0;
+}
+
+//PROXY TCP4|TCP6 src dst sport dport\r\n，或者PROXY UNKNOWN...\r\n
+static int
+proxy_parse_v1(xnet_proxyproto_t *pp, const char *p, uint32_t len) {
+	char line[XNET_PROXY_V1_MAX + 1];
+	char *field[4];
+	char *s;
+	int af, i;
+
+	//去掉前缀和\r\n，按单个空格切分
+	len -= PROXY_V1_PREFIX_LEN + 2;
+	memcpy(line, p + PROXY_V1_PREFIX_LEN, len);
+	line[len] = 0;
+	pp->version = 1;
+	pp->command = XNET_PROXY_PROXY;
+	if (strncmp(line, "UNKNOWN", 7) == 0)
+		return 0;
+	if (strncmp(line, "TCP4 ", 5) == 0)
+		af = AF_INET;
+	else if (strncmp(line, "TCP6 ", 5) == 0)
+		af = AF_INET6;
+	else
+		return -1;
+
+	//源地址 目的地址 源端口 目的端口
+	s = line + 5;
+	for (i=0; i<4; i++) {
+		field[i] = s;
+		if (i == 3) break;
+		s = strchr(s, ' ');
+		if (s == NULL) return -1;
+		*s++ = 0;
+	}
+	if (strchr(field[3], ' ')) return -1;
+	if (inet_pton(af, field[0], pp->src.addr) != 1 || inet_pton(af, field[1], pp->dst.addr) != 1)
+		return -1;
+	if (proxy_parse_port(field[2], &pp->src.port) != 0 || proxy_parse_port(field[3], &pp->dst.port) != 0)
+		return -1;
+	pp->src.type = pp->dst.type = (af == AF_INET) ? SOCKET_ADDR_TYPE_IPV4 : SOCKET_ADDR_TYPE_IPV6;
+	pp->has_addr = true;
+	return 0;
+}
+
+static int
+proxy_parse_v2(xnet_proxyproto_t *pp, const char *p, uint32_t len) {
+	uint8_t ver_cmd = (uint8_t)p[12];
+	uint8_t fam = (uint8_t)p[13] >> 4;
+	uint32_t addr_len, ip_len, off;
+	const char *a = p + XNET_PROXY_V2_HEADER;
+
+	if ((ver_cmd >> 4) != 2 || (ver_cmd & 0xF) > XNET_PROXY_PROXY || fam > PROXY_FAM_UNIX)
+		return -1;
+	pp->version = 2;
+	pp->command = ver_cmd & 0xF;
+	addr_len = g_v2_addr_len[fam];
+	if (len - XNET_PROXY_V2_HEADER < addr_len) return -1;
+	pp->tlv = a + addr_len;
+	pp->tlv_size = len - XNET_PROXY_V2_HEADER - addr_len;
+
+	//先检查所有TLV的长度，遍历时不用再检查
+	for (off=0; off<pp->tlv_size; off+=3+read_be16(pp->tlv + off + 1)) {
+		if (pp->tlv_size - off < 3 || pp->tlv_size - off - 3 < read_be16(pp->tlv + off + 1))
+			return -1;
+	}
+
+	//LOCAL时忽略地址
+	if (pp->command != XNET_PROXY_PROXY || (fam != PROXY_FAM_INET && fam != PROXY_FAM_INET6))
+		return 0;
+	ip_len = (fam == PROXY_FAM_INET) ? 4 : 16;
+	pp->src.type = pp->dst.type = (fam == PROXY_FAM_INET) ? SOCKET_ADDR_TYPE_IPV4 : SOCKET_ADDR_TYPE_IPV6;
+	memcpy(pp->src.addr, a, ip_len);
+	memcpy(pp->dst.addr, a + ip_len, ip_len);
+	//端口已经是网络字节序
+	memcpy(&pp->src.port, a + 2 * ip_len, 2);
+	memcpy(&pp->dst.port, a + 2 * ip_len + 2, 2);
+	pp->has_addr = true;
+	return 0;
+}
+
+uint32_t
+xnet_unpack_proxyproto(xnet_unpacker_t *up, const char *buffer, uint32_t sz) {
+	xnet_proxyproto_t *pp = (xnet_proxyproto_t *)up->arg;
+	uint32_t old = xnet_string_get_size(&pp->pending);
+	const char *p = buffer;
+	uint32_t n = sz;
+	int len, ret;
+
+	if (old) {
+		xnet_string_append_buff(&pp->pending, buffer, sz);
+		p = xnet_string_get_str(&pp->pending);
+		n = xnet_string_get_size(&pp->pending);
+	}
+	len = proxy_header_len(p, n, up->limit);
+	if (len < 0) return 0;
+	if (len == 0) {
+		//不完整时收到的都是头部，长度有上限
+		if (old == 0) xnet_string_append_buff(&pp->pending, buffer, sz);
+		return sz;
+	}
+
+	ret = (p[0] == 'P') ? proxy_parse_v1(pp, p, len) : proxy_parse_v2(pp, p, len);
+	if (ret != 0) return 0;
+	pp->header_len = len;
+	up->full = true;
+	//只消耗头部，之后的数据留给下一级
+	return len - old;
+}
+
+void
+xnet_clear_proxyproto(void *arg) {
+	xnet_proxyproto_t *pp = (xnet_proxyproto_t *)arg;
+	xnet_string_t pending = pp->pending;
+	memset(pp, 0, sizeof(*pp));
+	pending.size = 0;
+	pp->pending = pending;
+}
+
+void
+xnet_free_proxyproto(void *arg) {
+	xnet_proxyproto_t *pp = (xnet_proxyproto_t *)arg;
+	xnet_string_clear(&pp->pending);
+	memset(pp, 0, sizeof(*pp));
+}
+
+int
+xnet_proxyproto_next_tlv(const xnet_proxyproto_t *pp, uint32_t *offset, uint8_t *type, const char **value, uint16_t *len) {
+	const char *t;
+	if (*offset >= pp->tlv_size) return -1;
+	t = pp->tlv + *offset;
+	*type = (uint8_t)t[0];
+	*len = read_be16(t + 1);
+	*value = t + 3;
+	*offset += 3 + *len;
+	return 0;
+}
+
+const char *
+xnet_proxyproto_find_tlv(const xnet_proxyproto_t *pp, uint8_t type, uint16_t *len) {
+	uint32_t offset = 0;
+	uint8_t t;
+	const char *value;
+	while (xnet_proxyproto_next_tlv(pp, &offset, &t, &value, len) == 0) {
+		if (t == type) return value;
+	}
+	return NULL;
+}
+
+/*封包*/
+void
+xnet_pack_proxyproto_v1(const xnet_addr_t *src, const xnet_addr_t *dst, xnet_string_t *out) {
+	char s[64], d[64], line[XNET_PROXY_V1_MAX + 1];
+	int af, n;
+
+	if (src == NULL || dst == NULL) {
+		xnet_string_append_buff(out, "PROXY UNKNOWN\r\n", 15);
+		return;
+	}
+	af = (src->type == SOCKET_ADDR_TYPE_IPV4) ? AF_INET : AF_INET6;
+	inet_ntop(af, src->addr, s, sizeof(s));
+	inet_ntop(af, dst->addr, d, sizeof(d));
+	n = snprintf(line, sizeof(line), "PROXY %s %s %s %u %u\r\n", af == AF_INET ? "TCP4" : "TCP6",
+		s, d, ntohs(src->port), ntohs(dst->port));
+	xnet_string_append_buff(out, line, n);
+}
+
+void
+xnet_pack_proxyproto_v2(const xnet_addr_t *src, const xnet_addr_t *dst, const char *tlv, uint16_t tlv_size, xnet_string_t *out) {
+	char header[XNET_PROXY_V2_HEADER];
+	uint32_t ip_len = 0;
+	uint16_t len;
+
+	memcpy(header, XNET_PROXY_V2_SIG, XNET_PROXY_V2_SIG_LEN);
+	if (src == NULL || dst == NULL) {
+		header[12] = 0x20 | XNET_PROXY_LOCAL;
+		header[13] = PROXY_FAM_UNSPEC << 4;
+	} else {
+		ip_len = (src->type == SOCKET_ADDR_TYPE_IPV4) ? 4 : 16;
+		header[12] = 0x20 | XNET_PROXY_PROXY;
+		//TCP
+		header[13] = (char)(((ip_len == 4 ? PROXY_FAM_INET : PROXY_FAM_INET6) << 4) | 1);
+	}
+	len = (uint16_t)(g_v2_addr_len[ip_len == 0 ? 0 : (ip_len == 4 ? 1 : 2)] + tlv_size);
+	header[14] = (char)(len >> 8);
+	header[15] = (char)len;
+	xnet_string_append_buff(out, header, XNET_PROXY_V2_HEADER);
+	if (ip_len) {
+		xnet_string_append_buff(out, (const char *)src->addr, ip_len);
+		xnet_string_append_buff(out, (const char *)dst->addr, ip_len);
+		xnet_string_append_buff(out, (const char *)&src->port, 2);
+		xnet_string_append_buff(out, (const char *)&dst->port, 2);
+	}
+	if (tlv_size)
+		xnet_string_append_buff(out, tlv, tlv_size);
+}
+
+void
+xnet_pack_proxyproto_tlv(uint8_t type, const char *value, uint16_t len, xnet_string_t *out) {
+	char t[3];
+	t[0] = (char)type;
+	t[1] = (char)(len >> 8);
+	t[2] = (char)len;
+	xnet_string_append_buff(out, t, 3);
+	if (len)
+		xnet_string_append_buff(out, value, len);
+}
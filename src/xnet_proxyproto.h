@@ -0,0 +1,73 @@
+#ifndef _XNET_PROXYPROTO_H_
+#define _XNET_PROXYPROTO_H_
+#include "xnet_packer.h"
+#include "xnet_socket.h"
+
+/*
+ * PROXY protocol(haproxy) v1文本和v2二进制头部解析，放在流水线的第一级，
+ * 解析出负载均衡之前的客户端地址。连接开头必须是PROXY头，否则解包失败。
+ */
+#define XNET_PROXY_V1_MAX 107
+#define XNET_PROXY_V2_SIG "\r\n\r\n\0\r\nQUIT\n"
+#define XNET_PROXY_V2_SIG_LEN 12
+#define XNET_PROXY_V2_HEADER 16
+
+//v2的command，LOCAL为负载均衡自己的连接(健康检查)，没有地址
+#define XNET_PROXY_LOCAL 0
+#define XNET_PROXY_PROXY 1
+
+//v2常用的TLV类型
+#define XNET_PP2_TYPE_ALPN 0x01
+#define XNET_PP2_TYPE_AUTHORITY 0x02
+#define XNET_PP2_TYPE_CRC32C 0x03
+#define XNET_PP2_TYPE_NOOP 0x04
+#define XNET_PP2_TYPE_UNIQUE_ID 0x05
+#define XNET_PP2_TYPE_SSL 0x20
+#define XNET_PP2_TYPE_NETNS 0x30
+
+/*
+ * 回调时version为1或2，has_addr为true时src/dst为代理前的地址(格式同socket的addr_info，端口为网络字节序)，
+ * UNKNOWN、LOCAL、unix socket等没有可用地址时为false，应保留原来的地址。
+ * tlv/tlv_size为v2地址之后的TLV区域，解析时已检查过每一项的长度，
+ * 用xnet_proxyproto_next_tlv遍历，不分配内存；只在回调期间有效。
+ * 头部在一次接收中完整时直接引用接收缓存，否则拼接到pending。
+ * 回调中移除本级(xnet_unpacker_remove)，之后的数据交给下一级。
+ */
+typedef struct {
+	uint8_t version;
+	uint8_t command;
+	bool has_addr;
+	xnet_addr_t src;
+	xnet_addr_t dst;
+	const char *tlv;
+	uint32_t tlv_size;
+	uint32_t header_len;
+	//以下为解析状态
+	xnet_string_t pending;
+} xnet_proxyproto_t;
+
+/*
+ * up = xnet_unpacker_new(sizeof(xnet_proxyproto_t), cb, xnet_unpack_proxyproto, xnet_clear_proxyproto, limit);
+ * up->fm = xnet_free_proxyproto;
+ * limit限制v2头部的长度(0表示不限制，最大为16+65535)
+ */
+uint32_t xnet_unpack_proxyproto(xnet_unpacker_t *up, const char *buffer, uint32_t sz);
+void xnet_clear_proxyproto(void *arg);
+void xnet_free_proxyproto(void *arg);
+
+/*
+ * 从*offset(初始为0)开始取下一个TLV，返回0表示成功并更新*offset，-1表示没有了；
+ * xnet_proxyproto_find_tlv返回第一个类型为type的值，没有时返回NULL
+ */
+int xnet_proxyproto_next_tlv(const xnet_proxyproto_t *pp, uint32_t *offset, uint8_t *type, const char **value, uint16_t *len);
+const char *xnet_proxyproto_find_tlv(const xnet_proxyproto_t *pp, uint8_t type, uint16_t *len);
+
+/*
+ * 封包，用于测试或者作为代理转发时添加头部：src/dst为NULL时v1为UNKNOWN，v2为LOCAL；
+ * tlv为已经编码好的TLV，可以为NULL，只用于v2
+ */
+void xnet_pack_proxyproto_v1(const xnet_addr_t *src, const xnet_addr_t *dst, xnet_string_t *out);
+void xnet_pack_proxyproto_v2(const xnet_addr_t *src, const xnet_addr_t *dst, const char *tlv, uint16_t tlv_size, xnet_string_t *out);
+void xnet_pack_proxyproto_tlv(uint8_t type, const char *value, uint16_t len, xnet_string_t *out);
+
+#endif //_XNET_PROXYPROTO_H_
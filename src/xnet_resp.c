@@ -0,0 +1,210 @@
+#include "xnet_resp.h"
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+
+//p到'\r'之间的十进制整数
+static int
+resp_parse_int(const char *p, const char *end, int64_t *v) {
+	bool neg = false;
+	uint64_t n = 0;
+
+	if (p < end && *p == '-') {
+		neg = true;
+		p++;
+	}
+	if (p == end) return -1;
+	for (; p<end; p++) {
+		if (*p < '0' || *p > '9' || n > (uint64_t)INT64_MAX / 10) return -1;
+		n = n * 10 + (*p - '0');
+	}
+	if (n > (uint64_t)INT64_MAX) return -1;
+	*v = neg ? -(int64_t)n : (int64_t)n;
+	return 0;
+}
+
+static xnet_resp_elem_t *
+resp_new_elem(xnet_resp_t *r) {
+	if (r->elem_count == r->elem_cap) {
+		r->elem_cap = r->elem_cap ? r->elem_cap * 2 : 16;
+		r->elems = realloc(r->elems, r->elem_cap * sizeof(xnet_resp_elem_t));
+		assert(r->elems);
+	}
+	return &r->elems[r->elem_count];
+}
+
+/*
+ * 从r->pos开始继续解析base中的消息，每次解析一个完整的元素(bulk包括数据)，
+ * 返回1表示消息完整，0表示数据不够，-1表示格式错误或者超出限制
+ */
+static int
+resp_parse(xnet_resp_t *r, const char *base, uint32_t size, uint32_t limit) {
+	const char *p, *eol;
+	xnet_resp_elem_t *e;
+	uint32_t line_len, elem_len;
+	int64_t n;
+
+	for (;;) {
+		p = base + r->pos;
+		eol = memchr(p, '\n', size - r->pos);
+		if (eol == NULL) {
+			if (limit != 0 && size > limit) return -1;
+			return 0;
+		}
+		line_len = (uint32_t)(eol - p) + 1;
+		if (line_len < 3 || eol[-1] != '\r') return -1;
+		elem_len = line_len;
+
+		e = resp_new_elem(r);
+		memset(e, 0, sizeof(*e));
+		e->type = p[0];
+		switch (e->type) {
+		case XNET_RESP_STRING:
+		case XNET_RESP_ERROR:
+			e->offset = r->pos + 1;
+			e->len = line_len - 3;
+			break;
+		case XNET_RESP_INTEGER:
+			if (resp_parse_int(p + 1, eol - 1, &e->integer) != 0) return -1;
+			break;
+		case XNET_RESP_BULK:
+			if (resp_parse_int(p + 1, eol - 1, &n) != 0 || n < -1 || n > UINT32_MAX) return -1;
+			if (n == -1) {
+				e->nil = true;
+				break;
+			}
+			if ((uint64_t)r->pos + line_len + n + 2 > (limit ? limit : UINT32_MAX)) return -1;
+			elem_len += (uint32_t)n + 2;
+			//数据不完整时下次从这个元素重新开始
+			if (elem_len > size - r->pos) return 0;
+			if (p[elem_len-2] != '\r' || p[elem_len-1] != '\n') return -1;
+			e->offset = r->pos + line_len;
+			e->len = (uint32_t)n;
+			break;
+		case XNET_RESP_ARRAY:
+			if (resp_parse_int(p + 1, eol - 1, &n) != 0 || n < -1 || n > INT32_MAX) return -1;
+			if (n == -1)
+				e->nil = true;
+			else
+				e->count = (uint32_t)n;
+			break;
+		default:
+			return -1;
+		}
+		r->pos += elem_len;
+		r->elem_count++;
+		if (limit != 0 && r->pos > limit) return -1;
+
+		//父数组剩余元素减1，非空数组入栈，解析完的数组出栈
+		if (r->depth > 0) r->stack[r->depth-1]--;
+		if (e->type == XNET_RESP_ARRAY && e->count > 0) {
+			if (r->depth == XNET_RESP_MAX_DEPTH) return -1;
+			r->stack[r->depth++] = e->count;
+		}
+		while (r->depth > 0 && r->stack[r->depth-1] == 0)
+			r->depth--;
+		if (r->depth == 0) return 1;
+	}
+}
+
+static void
+resp_finish(xnet_unpacker_t *up, xnet_resp_t *r, const char *base) {
+	uint32_t i;
+	xnet_resp_elem_t *e;
+	for (i=0; i<r->elem_count; i++) {
+		e = &r->elems[i];
+		if (e->type == XNET_RESP_STRING || e->type == XNET_RESP_ERROR || (e->type == XNET_RESP_BULK && !e->nil))
+			e->str = base + e->offset;
+	}
+	up->full = true;
+}
+
+uint32_t
+xnet_unpack_resp(xnet_unpacker_t *up, const char *buffer, uint32_t sz) {
+	xnet_resp_t *r = (xnet_resp_t *)up->arg;
+	uint32_t old = xnet_string_get_size(&r->pending);
+	int ret;
+
+	//消息从buffer开头开始，完整时直接引用
+	if (old == 0) {
+		ret = resp_parse(r, buffer, sz, up->limit);
+		if (ret < 0) return 0;
+		if (ret > 0) {
+			resp_finish(up, r, buffer);
+			return r->pos;
+		}
+		xnet_string_append_buff(&r->pending, buffer, sz);
+		return sz;
+	}
+
+	//后面的消息也会被复制进来，完成后只消耗属于本消息的部分
+	xnet_string_append_buff(&r->pending, buffer, sz);
+	ret = resp_parse(r, r->pending.str, xnet_string_get_size(&r->pending), up->limit);
+	if (ret < 0) return 0;
+	if (ret == 0) return sz;
+	resp_finish(up, r, r->pending.str);
+	return r->pos - old;
+}
+
+//回调后重置，保留元素数组和拼接缓存的内存
+void
+xnet_clear_resp(void *arg) {
+	xnet_resp_t *r = (xnet_resp_t *)arg;
+	r->elem_count = 0;
+	r->pos = 0;
+	r->depth = 0;
+	r->pending.size = 0;
+}
+
+void
+xnet_free_resp(void *arg) {
+	xnet_resp_t *r = (xnet_resp_t *)arg;
+	if (r->elems) free(r->elems);
+	xnet_string_clear(&r->pending);
+	memset(r, 0, sizeof(*r));
+}
+
+/*封包*/
+static void
+resp_pack_line(char type, int64_t v, xnet_string_t *out) {
+	char line[32];
+	int n = snprintf(line, sizeof(line), "%c%lld\r\n", type, (long long)v);
+	xnet_string_append_buff(out, line, n);
+}
+
+void
+xnet_pack_resp_command(int argc, const char **argv, const uint32_t *argv_sz, xnet_string_t *out) {
+	int i;
+	resp_pack_line(XNET_RESP_ARRAY, argc, out);
+	for (i=0; i<argc; i++)
+		xnet_pack_resp_bulk(argv[i], argv_sz ? argv_sz[i] : strlen(argv[i]), out);
+}
+
+void
+xnet_pack_resp_array(int64_t count, xnet_string_t *out) {
+	resp_pack_line(XNET_RESP_ARRAY, count < 0 ? -1 : count, out);
+}
+
+void
+xnet_pack_resp_bulk(const char *data, uint32_t sz, xnet_string_t *out) {
+	if (data == NULL) {
+		xnet_string_append_buff(out, "$-1\r\n", 5);
+		return;
+	}
+	resp_pack_line(XNET_RESP_BULK, sz, out);
+	xnet_string_append_buff(out, data, sz);
+	xnet_string_append_buff(out, "\r\n", 2);
+}
+
+void
+xnet_pack_resp_simple(char type, const char *str, uint32_t sz, xnet_string_t *out) {
+	xnet_string_add(out, type);
+	xnet_string_append_buff(out, str, sz);
+	xnet_string_append_buff(out, "\r\n", 2);
+}
+
+void
+xnet_pack_resp_integer(int64_t v, xnet_string_t *out) {
+	resp_pack_line(XNET_RESP_INTEGER, v, out);
+}
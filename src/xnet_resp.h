@@ -0,0 +1,62 @@
+#ifndef _XNET_RESP_H_
+#define _XNET_RESP_H_
+#include "xnet_packer.h"
+
+/*redis RESP2协议的解包和封包，命令和回复格式相同*/
+#define XNET_RESP_STRING '+'
+#define XNET_RESP_ERROR '-'
+#define XNET_RESP_INTEGER ':'
+#define XNET_RESP_BULK '$'
+#define XNET_RESP_ARRAY '*'
+
+#define XNET_RESP_MAX_DEPTH 32
+
+/*
+ * 元素按前序排列，elems[0]为整个消息，array后面紧跟它的count个子元素(子数组展开在内)。
+ * str指向接收缓存或者内部的拼接缓存，只在回调期间有效
+ */
+typedef struct {
+	char type;
+	bool nil;//$-1或者*-1
+	uint32_t count;//array的元素个数
+	uint32_t len;
+	uint32_t offset;//内部使用：str相对消息开头的位置
+	int64_t integer;
+	const char *str;
+} xnet_resp_elem_t;
+
+/*
+ * 一次接收中的完整消息直接引用接收缓存，跨越多次接收的消息复制到pending中继续解析，
+ * 已经解析的元素不会重新解析。元素数组在消息之间复用，pipelining时不会为每个元素分配内存。
+ * up->limit限制单个消息的字节数(0表示不限制)
+ */
+typedef struct {
+	xnet_resp_elem_t *elems;
+	uint32_t elem_count;
+	//以下为解析状态
+	uint32_t elem_cap;
+	uint32_t pos;//当前消息已经解析的字节数
+	uint32_t depth;
+	uint32_t stack[XNET_RESP_MAX_DEPTH];//每层数组还没有解析的元素个数
+	xnet_string_t pending;
+} xnet_resp_t;
+
+/*
+ * up = xnet_unpacker_new(sizeof(xnet_resp_t), cb, xnet_unpack_resp, xnet_clear_resp, limit);
+ * up->fm = xnet_free_resp;
+ */
+uint32_t xnet_unpack_resp(xnet_unpacker_t *up, const char *buffer, uint32_t sz);
+void xnet_clear_resp(void *arg);
+void xnet_free_resp(void *arg);
+
+//封包，追加到out；多个元素依次追加即可组成数组
+void xnet_pack_resp_command(int argc, const char **argv, const uint32_t *argv_sz, xnet_string_t *out);
+//count为-1时为nil数组
+void xnet_pack_resp_array(int64_t count, xnet_string_t *out);
+//data为NULL时为nil
+void xnet_pack_resp_bulk(const char *data, uint32_t sz, xnet_string_t *out);
+//type为XNET_RESP_STRING或XNET_RESP_ERROR，str中不能有\r\n
+void xnet_pack_resp_simple(char type, const char *str, uint32_t sz, xnet_string_t *out);
+void xnet_pack_resp_integer(int64_t v, xnet_string_t *out);
+
+#endif //_XNET_RESP_H_
@@ -0,0 +1,270 @@
+#include "xnet_router.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ROUTE_STATIC 0
+#define ROUTE_PARAM 1
+#define ROUTE_WILD 2
+#define ROUTE_METHOD_MAX 16
+
+typedef struct route_node {
+	char *prefix;//静态节点为压缩后的公共前缀，参数和通配符节点为参数名
+	uint32_t len;
+	uint8_t type;
+	uint16_t nchild;
+	char *indices;//静态子节点前缀的第一个字节，和children一一对应
+	struct route_node **children;
+	struct route_node *param;
+	struct route_node *wild;
+	void *handler;
+} route_node_t;
+
+typedef struct {
+	char method[ROUTE_METHOD_MAX];
+	uint32_t method_sz;
+	route_node_t *root;
+} route_tree_t;
+
+struct xnet_router {
+	route_tree_t *trees;
+	uint32_t ntree;
+};
+
+static route_node_t *
+new_node(uint8_t type, const char *prefix, uint32_t len) {
+	route_node_t *n = (route_node_t *)calloc(1, sizeof(route_node_t));
+	n->type = type;
+	n->prefix = (char *)malloc(len + 1);
+	memcpy(n->prefix, prefix, len);
+	n->prefix[len] = 0;
+	n->len = len;
+	return n;
+}
+
+static void
+free_node(route_node_t *n) {
+	uint16_t i;
+	if (n == NULL) return;
+	for (i=0; i<n->nchild; i++)
+		free_node(n->children[i]);
+	free_node(n->param);
+	free_node(n->wild);
+	free(n->children);
+	free(n->indices);
+	free(n->prefix);
+	free(n);
+}
+
+static void
+add_child(route_node_t *n, route_node_t *c) {
+	n->children = (route_node_t **)realloc(n->children, sizeof(route_node_t *) * (n->nchild + 1));
+	n->indices = (char *)realloc(n->indices, n->nchild + 1);
+	n->children[n->nchild] = c;
+	n->indices[n->nchild] = c->prefix[0];
+	n->nchild++;
+}
+
+//把n的子节点c在前缀的第i个字节处拆成两段，返回前一段
+static route_node_t *
+split_child(route_node_t *n, uint16_t idx, uint32_t i) {
+	route_node_t *c = n->children[idx];
+	route_node_t *mid = new_node(ROUTE_STATIC, c->prefix, i);
+	char *rest = (char *)malloc(c->len - i + 1);
+
+	memcpy(rest, c->prefix + i, c->len - i + 1);
+	free(c->prefix);
+	c->prefix = rest;
+	c->len -= i;
+	add_child(mid, c);
+	n->children[idx] = mid;
+	return mid;
+}
+
+//从n之后插入静态路径s，返回s结束处的节点
+static route_node_t *
+insert_static(route_node_t *n, const char *s, uint32_t len) {
+	route_node_t *c;
+	const char *p;
+	uint32_t i;
+
+	while (len > 0) {
+		p = n->nchild ? memchr(n->indices, s[0], n->nchild) : NULL;
+		if (p == NULL) {
+			c = new_node(ROUTE_STATIC, s, len);
+			add_child(n, c);
+			return c;
+		}
+		c = n->children[p - n->indices];
+		for (i=1; i<c->len && i<len && c->prefix[i] == s[i]; i++);
+		if (i < c->len)
+			c = split_child(n, (uint16_t)(p - n->indices), i);
+		n = c;
+		s += i;
+		len -= i;
+	}
+	return n;
+}
+
+//参数和通配符节点，已经存在时名字必须相同
+static route_node_t *
+insert_param(route_node_t **slot, uint8_t type, const char *name, uint32_t len) {
+	if (*slot == NULL)
+		*slot = new_node(type, name, len);
+	else if ((*slot)->len != len || memcmp((*slot)->prefix, name, len) != 0)
+		return NULL;
+	return *slot;
+}
+
+//检查路径，返回参数的个数，-1表示不合法
+static int
+check_path(const char *path) {
+	const char *s;
+	int count = 0;
+
+	if (path[0] != '/') return -1;
+	for (s=path; *s; s++) {
+		if (*s != ':' && *s != '*') continue;
+		//参数必须是完整的路径段，名字不能为空
+		if (s[-1] != '/' || s[1] == 0 || s[1] == '/') return -1;
+		if (*s == '*' && strchr(s, '/') != NULL) return -1;
+		if (++count > XNET_ROUTE_MAX_PARAMS) return -1;
+		while (s[1] && s[1] != '/') {
+			if (s[1] == ':' || s[1] == '*') return -1;
+			s++;
+		}
+	}
+	return count;
+}
+
+static route_tree_t *
+find_tree(const xnet_router_t *r, const char *method, uint32_t method_sz) {
+	uint32_t i;
+	for (i=0; i<r->ntree; i++) {
+		if (r->trees[i].method_sz == method_sz && memcmp(r->trees[i].method, method, method_sz) == 0)
+			return &r->trees[i];
+	}
+	return NULL;
+}
+
+static void *
+match_node(const route_node_t *n, const char *path, uint32_t len, xnet_route_match_t *m) {
+	const route_node_t *c;
+	const char *p;
+	xnet_route_param_t *param;
+	uint32_t seg;
+	void *h;
+
+	if (len == 0 && n->handler) return n->handler;
+	if (len > 0 && n->nchild) {
+		p = memchr(n->indices, path[0], n->nchild);
+		if (p) {
+			c = n->children[p - n->indices];
+			if (c->len <= len && memcmp(c->prefix, path, c->len) == 0) {
+				h = match_node(c, path + c->len, len - c->len, m);
+				if (h) return h;
+			}
+		}
+	}
+	//静态路径没有匹配，回溯到参数
+	if (n->param && len > 0 && path[0] != '/') {
+		p = memchr(path, '/', len);
+		seg = p ? (uint32_t)(p - path) : len;
+		param = &m->params[m->param_count++];
+		param->key = n->param->prefix;
+		param->key_sz = n->param->len;
+		param->value = path;
+		param->value_sz = seg;
+		h = match_node(n->param, path + seg, len - seg, m);
+		if (h) return h;
+		m->param_count--;
+	}
+	if (n->wild) {
+		param = &m->params[m->param_count++];
+		param->key = n->wild->prefix;
+		param->key_sz = n->wild->len;
+		param->value = path;
+		param->value_sz = len;
+		return n->wild->handler;
+	}
+	return NULL;
+}
+
+xnet_router_t *
+xnet_router_create() {
+	return (xnet_router_t *)calloc(1, sizeof(xnet_router_t));
+}
+
+void
+xnet_router_destroy(xnet_router_t *r) {
+	uint32_t i;
+	for (i=0; i<r->ntree; i++)
+		free_node(r->trees[i].root);
+	free(r->trees);
+	free(r);
+}
+
+int
+xnet_router_add(xnet_router_t *r, const char *method, const char *path, void *handler, void **old) {
+	route_tree_t *t;
+	route_node_t *n;
+	const char *s, *e;
+	uint32_t method_sz = (uint32_t)strlen(method);
+
+	if (handler == NULL || method_sz == 0 || method_sz >= ROUTE_METHOD_MAX || check_path(path) < 0)
+		return -1;
+	t = find_tree(r, method, method_sz);
+	if (t == NULL) {
+		r->trees = (route_tree_t *)realloc(r->trees, sizeof(route_tree_t) * (r->ntree + 1));
+		t = &r->trees[r->ntree++];
+		memcpy(t->method, method, method_sz);
+		t->method_sz = method_sz;
+		t->root = new_node(ROUTE_STATIC, "", 0);
+	}
+
+	//参数名冲突时已经插入的节点没有handler，不影响匹配
+	n = t->root;
+	s = path;
+	while (*s) {
+		for (e=s; *e && *e != ':' && *e != '*'; e++);
+		if (e > s)
+			n = insert_static(n, s, (uint32_t)(e - s));
+		if (*e == 0) break;
+		for (s=e+1; *s && *s != '/'; s++);
+		n = insert_param(*e == ':' ? &n->param : &n->wild, *e == ':' ? ROUTE_PARAM : ROUTE_WILD, e + 1, (uint32_t)(s - e - 1));
+		if (n == NULL) return -1;
+	}
+	if (old) *old = n->handler;
+	n->handler = handler;
+	return 0;
+}
+
+void *
+xnet_router_match(const xnet_router_t *r, const char *method, uint32_t method_sz,
+	const char *path, uint32_t path_sz, xnet_route_match_t *m) {
+	const route_tree_t *t;
+	const char *q = memchr(path, '?', path_sz);
+	void *h = NULL;
+
+	if (q) path_sz = (uint32_t)(q - path);
+	m->param_count = 0;
+	t = find_tree(r, method, method_sz);
+	if (t) h = match_node(t->root, path, path_sz, m);
+	if (h == NULL && (t = find_tree(r, "*", 1)) != NULL) {
+		m->param_count = 0;
+		h = match_node(t->root, path, path_sz, m);
+	}
+	return h;
+}
+
+const char *
+xnet_route_param(const xnet_route_match_t *m, const char *key, uint32_t *sz) {
+	uint32_t len = (uint32_t)strlen(key);
+	int i;
+	for (i=0; i<m->param_count; i++) {
+		if (m->params[i].key_sz == len && memcmp(m->params[i].key, key, len) == 0) {
+			*sz = m->params[i].value_sz;
+			return m->params[i].value;
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,50 @@
+#ifndef _XNET_ROUTER_H_
+#define _XNET_ROUTER_H_
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * http路由：每个method一棵压缩前缀树(radix tree)，路径中可以有参数和通配符，
+ * 参数如/users/:id/posts中的:id，匹配一个非空的路径段(到下一个/为止)；
+ * 通配符如 *file，匹配剩下的所有内容(可以为空)，只能是最后一段。
+ * 同一位置优先匹配静态路径，其次参数，最后通配符，失败时回溯。
+ * method为"*"的路由匹配所有method，在对应method的路由之后查找。
+ * 匹配时不分配内存，参数的值直接指向传入的路径。不是线程安全的。
+ */
+#define XNET_ROUTE_MAX_PARAMS 8
+
+typedef struct xnet_router xnet_router_t;
+
+typedef struct {
+	const char *key;//参数名，在路由销毁前有效
+	uint32_t key_sz;
+	const char *value;//指向匹配的路径
+	uint32_t value_sz;
+} xnet_route_param_t;
+
+typedef struct {
+	int param_count;
+	xnet_route_param_t params[XNET_ROUTE_MAX_PARAMS];
+} xnet_route_match_t;
+
+xnet_router_t *xnet_router_create();
+void xnet_router_destroy(xnet_router_t *r);
+
+/*
+ * 添加路由，handler不能为NULL；已经存在时替换，old不为NULL时返回原来的handler(新添加的为NULL)。
+ * 路径必须以/开头，参数必须是完整的路径段，同一位置的参数名必须相同，参数不超过XNET_ROUTE_MAX_PARAMS个。
+ * 成功返回0，-1表示路径不合法或者和已有的路由冲突
+ */
+int xnet_router_add(xnet_router_t *r, const char *method, const char *path, void *handler, void **old);
+
+/*
+ * 查找路由，path可以带查询参数(?之后的部分忽略)，路径不做解码。
+ * 返回handler并填写m，没有匹配的路由时返回NULL
+ */
+void *xnet_router_match(const xnet_router_t *r, const char *method, uint32_t method_sz,
+	const char *path, uint32_t path_sz, xnet_route_match_t *m);
+
+//按名字取参数的值，没有时返回NULL
+const char *xnet_route_param(const xnet_route_match_t *m, const char *key, uint32_t *sz);
+
+#endif //_XNET_ROUTER_H_
@@ -0,0 +1,120 @@
+#include "xnet_sniff.h"
+#include <string.h>
+
+static const char *g_http_methods[] = {
+	"GET ", "POST ", "PUT ", "HEAD ", "DELETE ", "OPTIONS ", "PATCH ", "CONNECT ", "TRACE ", NULL
+};
+
+int
+xnet_sniff_add(xnet_sniff_table_t *t, int proto, const char *magic, uint8_t len, uint8_t offset) {
+	xnet_sniff_sig_t *sig;
+
+	if (t->count >= XNET_SNIFF_MAX || len == 0 || len > XNET_SNIFF_MAGIC_MAX || proto < 0)
+		return -1;
+	sig = &t->sigs[t->count++];
+	memcpy(sig->magic, magic, len);
+	sig->len = len;
+	sig->offset = offset;
+	sig->proto = proto;
+	return 0;
+}
+
+int
+xnet_sniff_add_builtin(xnet_sniff_table_t *t, int builtin, int proto) {
+	int i;
+
+	switch (builtin) {
+		case XNET_SNIFF_HTTP:
+			for (i=0; g_http_methods[i]; i++) {
+				if (xnet_sniff_add(t, proto, g_http_methods[i], strlen(g_http_methods[i]), 0) != 0)
+					return -1;
+			}
+			return 0;
+		case XNET_SNIFF_TLS:
+			//handshake记录，版本号高字节为3
+			return xnet_sniff_add(t, proto, "\x16\x03", 2, 0);
+		case XNET_SNIFF_PROXY:
+			if (xnet_sniff_add(t, proto, "PROXY ", 6, 0) != 0)
+				return -1;
+			return xnet_sniff_add(t, proto, "\r\n\r\n\0\r\nQUIT\n", 12, 0);
+		case XNET_SNIFF_HTTP2:
+			//preface的前16字节，和http/1.x的方法不冲突
+			return xnet_sniff_add(t, proto, "PRI * HTTP/2.0\r\n", 16, 0);
+	}
+	return -1;
+}
+
+int
+xnet_sniff_match(const xnet_sniff_table_t *t, const char *data, uint32_t sz) {
+	const xnet_sniff_sig_t *sig;
+	uint32_t n;
+	int i;
+
+	for (i=0; i<t->count; i++) {
+		sig = &t->sigs[i];
+		//优先级更高的签名还不能排除时等待
+		if (sz <= sig->offset)
+			return XNET_SNIFF_AGAIN;
+		n = sz - sig->offset;
+		if (n > sig->len) n = sig->len;
+		if (memcmp(data + sig->offset, sig->magic, n) != 0)
+			continue;
+		return (n == sig->len) ? sig->proto : XNET_SNIFF_AGAIN;
+	}
+	return XNET_SNIFF_NONE;
+}
+
+uint32_t
+xnet_unpack_sniff(xnet_unpacker_t *up, const char *buffer, uint32_t sz) {
+	xnet_sniff_t *sn = (xnet_sniff_t *)up->arg;
+	xnet_string_t *pending = &sn->pending;
+
+	//还在等待时数据不会超过最长的offset+len，拼接的代价很小
+	if (xnet_string_get_size(pending) == 0) {
+		sn->proto = xnet_sniff_match(sn->table, buffer, sz);
+		if (sn->proto == XNET_SNIFF_AGAIN) {
+			xnet_string_append_buff(pending, buffer, sz);
+			return sz;
+		}
+		sn->data = buffer;
+		sn->size = sz;
+	} else {
+		xnet_string_append_buff(pending, buffer, sz);
+		sn->proto = xnet_sniff_match(sn->table, xnet_string_get_str(pending), xnet_string_get_size(pending));
+		if (sn->proto == XNET_SNIFF_AGAIN)
+			return sz;
+		sn->data = xnet_string_get_str(pending);
+		sn->size = xnet_string_get_size(pending);
+	}
+	up->full = true;
+	return sz;
+}
+
+void
+xnet_clear_sniff(void *arg) {
+	xnet_sniff_t *sn = (xnet_sniff_t *)arg;
+	sn->data = NULL;
+	sn->size = 0;
+	sn->pending.size = 0;
+}
+
+void
+xnet_free_sniff(void *arg) {
+	xnet_sniff_t *sn = (xnet_sniff_t *)arg;
+	xnet_string_clear(&sn->pending);
+	sn->data = NULL;
+	sn->size = 0;
+}
+
+int
+xnet_sniff_forward(xnet_unpacker_t **head, xnet_unpacker_t *up, xnet_unpacker_t *next) {
+	xnet_sniff_t *sn = (xnet_sniff_t *)up->arg;
+
+	if (next == NULL) {
+		xnet_unpacker_remove(head, up);
+		return 0;
+	}
+	//替换后up->next为next，回调返回后up被释放
+	xnet_unpacker_replace(head, up, next);
+	return xnet_unpacker_emit(up, sn->data, sn->size);
+}
@@ -0,0 +1,64 @@
+#ifndef _XNET_SNIFF_H_
+#define _XNET_SNIFF_H_
+#include "xnet_packer.h"
+
+/*
+ * 协议探测：新连接的前几个字节和签名表比较，确定协议后换成对应的解包器。
+ * 签名按加入的顺序有优先级，前面的签名还可能匹配时继续等待数据，
+ * 所以结果不受数据怎样分段到达的影响。
+ */
+#define XNET_SNIFF_MAX 32
+#define XNET_SNIFF_MAGIC_MAX 16
+
+//xnet_sniff_match的结果，其余为签名的proto(>=0)
+#define XNET_SNIFF_NONE (-1)//所有签名都不匹配
+#define XNET_SNIFF_AGAIN (-2)//还需要更多数据
+
+//内置签名
+#define XNET_SNIFF_HTTP 1//http/1.x的请求方法
+#define XNET_SNIFF_TLS 2//TLS ClientHello记录头
+#define XNET_SNIFF_PROXY 3//PROXY protocol v1和v2
+#define XNET_SNIFF_HTTP2 4//h2c的connection preface(prior knowledge)
+
+typedef struct {
+	char magic[XNET_SNIFF_MAGIC_MAX];
+	uint8_t len;
+	uint8_t offset;
+	int proto;
+} xnet_sniff_sig_t;
+
+//签名表，通常每个监听端口一个，初始化为0即可
+typedef struct {
+	xnet_sniff_sig_t sigs[XNET_SNIFF_MAX];
+	int count;
+} xnet_sniff_table_t;
+
+//magic出现在连接数据的offset处时为proto，表满或者magic太长返回-1
+int xnet_sniff_add(xnet_sniff_table_t *t, int proto, const char *magic, uint8_t len, uint8_t offset);
+//加入内置签名(XNET_SNIFF_xxx)的所有magic
+int xnet_sniff_add_builtin(xnet_sniff_table_t *t, int builtin, int proto);
+int xnet_sniff_match(const xnet_sniff_table_t *t, const char *data, uint32_t sz);
+
+/*
+ * 探测用的解包器，确定协议(或者都不匹配)时回调一次，proto为结果，
+ * data/size为到目前为止收到的全部数据：一次接收就能确定时直接引用接收缓存，否则为拼接的缓存。
+ * 回调中用xnet_sniff_forward换成对应的解包器，已经收到的数据交给它继续解包。
+ * up = xnet_unpacker_new(sizeof(xnet_sniff_t), cb, xnet_unpack_sniff, xnet_clear_sniff, 0);
+ * up->fm = xnet_free_sniff;
+ * ((xnet_sniff_t *)up->arg)->table = table;
+ */
+typedef struct {
+	const xnet_sniff_table_t *table;//创建后设置，解包器释放前必须有效
+	int proto;
+	const char *data;
+	uint32_t size;
+	xnet_string_t pending;
+} xnet_sniff_t;
+
+uint32_t xnet_unpack_sniff(xnet_unpacker_t *up, const char *buffer, uint32_t sz);
+void xnet_clear_sniff(void *arg);
+void xnet_free_sniff(void *arg);
+//用next替换流水线中的探测解包器up并把收到的数据交给它，next为NULL时只移除；返回next解包的结果
+int xnet_sniff_forward(xnet_unpacker_t **head, xnet_unpacker_t *up, xnet_unpacker_t *next);
+
+#endif //_XNET_SNIFF_H_
@@ -55,9 +55,14 @@ xnet_addr_to_sockaddr(xnet_addr_t *addr, union sockaddr_all *sa) {
 static inline void
 init_socket_slot(xnet_socket_t *s) {
     s->id = s->fd = 0;
+    s->gen = 0;
     s->type = SOCKET_TYPE_INVALID;
+    s->dirty = false;
+    s->drain_pending = false;
+    s->wheel_slot = -1;
     s->wb_list.head = s->wb_list.tail = NULL;
     s->wb_size = 0;
+    s->wb_file_size = 0;
     memset(&s->addr_info, 0, sizeof(s->addr_info));
 }
 
@@ -96,14 +101,28 @@ new_fd(xnet_poll_t *poll, SOCKET_TYPE fd, int id, uint8_t protocol, bool reading
     xnet_socket_t *s = &poll->slots[id];
     s->fd = fd;
     s->id = id;
+    s->gen++;
     s->protocol = protocol;
     s->reading = false;
     s->writing = false;
     s->closing = false;
+    s->dirty = false;
     s->read_size = MIN_READ_SIZE;
 
     assert(s->wb_list.head == NULL && s->wb_list.tail == NULL);
     s->wb_size = 0;
+    s->wb_file_size = 0;
+    s->wb_low = s->wb_high = s->wb_hard = 0;
+    s->wb_blocked = false;
+    s->drain_pending = false;
+    s->drain_blocked = false;
+    s->read_link = -1;
+    s->close_what = 0;
+    s->read_timeout = s->write_timeout = s->life_timeout = 0;
+    s->last_read = s->last_write = s->start_time = 0;
+    s->wheel_slot = -1;
+    s->unpacker = NULL;
+    s->user_ptr = NULL;
     memset(&s->addr_info, 0, sizeof(s->addr_info));
 
     xnet_poll_addfd(poll, fd, id);
@@ -113,7 +132,9 @@ new_fd(xnet_poll_t *poll, SOCKET_TYPE fd, int id, uint8_t protocol, bool reading
 
 static void
 free_wb(xnet_write_buff_t *wb) {
-    if (wb->raw)
+    if (wb->file)
+        poll_close_file(((xnet_file_write_buff_t *)wb)->fd);
+    else if (wb->raw)
         free(wb->buffer);
     else
         mf_free(wb->buffer);
@@ -147,6 +168,27 @@ clear_wb_list(xnet_wb_list_t *wb_list) {
     wb_list->tail = NULL;
 }
 
+void
+mark_dirty_socket(xnet_poll_t *poll, xnet_socket_t *s) {
+    int new_cap;
+    int *ids;
+
+    if (s->dirty) return;
+    if (poll->dirty_n >= poll->dirty_cap) {
+        new_cap = poll->dirty_cap ? poll->dirty_cap * 2 : 32;
+        ids = realloc(poll->dirty_ids, sizeof(int) * new_cap);
+        if (!ids) {
+            //内存不足时退化为直接等待可写事件
+            xnet_enable_write(poll, s, true);
+            return;
+        }
+        poll->dirty_ids = ids;
+        poll->dirty_cap = new_cap;
+    }
+    poll->dirty_ids[poll->dirty_n++] = s->id;
+    s->dirty = true;
+}
+
 int
 xnet_socket_init() {
 #ifdef _WIN32
@@ -174,6 +216,12 @@ xnet_poll_init(xnet_poll_t *poll) {
     int i;
 
     poll->slot_index = 0;
+    poll->cork = false;
+    poll->dirty_ids = NULL;
+    poll->dirty_n = poll->dirty_cap = 0;
+    poll->wheel = NULL;
+    poll->wheel_cur = poll->wheel_n = 0;
+    poll->wheel_time = 0;
 
     poll->slot_size = 32;
     poll->slots = malloc(sizeof(*poll->slots)*poll->slot_size);
@@ -208,7 +256,7 @@ xnet_poll_init(xnet_poll_t *poll) {
         return -1;
     }
 
-    poll_add(poll->epoll_fd, fd[0], NULL);
+    poll_add(poll->epoll_fd, fd[0], -1);
 #endif
 
     return 0;
@@ -245,6 +293,15 @@ xnet_poll_deinit(xnet_poll_t *poll) {
         free(poll->slots);
         poll->slots = NULL;
     }
+    if (poll->dirty_ids) {
+        free(poll->dirty_ids);
+        poll->dirty_ids = NULL;
+    }
+    poll->dirty_n = poll->dirty_cap = 0;
+    if (poll->wheel) {
+        free(poll->wheel);
+        poll->wheel = NULL;
+    }
     return 0;
 }
 
@@ -256,14 +313,14 @@ xnet_poll_addfd(xnet_poll_t *poll, SOCKET_TYPE fd, int id) {
     add_to_socketlist(poll, fd, id);
 #else
     //epoll
-    xnet_socket_t *s = &poll->slots[id];
-    poll_add(poll->epoll_fd, fd, s);
+    poll_add(poll->epoll_fd, fd, id);
 #endif
     return 0;
 }
 
 int
 xnet_poll_closefd(xnet_poll_t *poll, xnet_socket_t *s) {
+    xnet_socket_t *link;
 #ifdef _WIN32
     //select
     FD_CLR(s->fd, &poll->errorfds);
@@ -276,13 +333,18 @@ xnet_poll_closefd(xnet_poll_t *poll, xnet_socket_t *s) {
     poll_del(poll->epoll_fd, s->fd);
 #endif
     closesocket(s->fd);
+    xnet_wheel_unlink(poll, s);
+
+    //写队列阻塞时关闭，恢复被暂停读取的socket
+    if (s->wb_blocked && (link = xnet_get_read_link(poll, s)))
+        xnet_enable_read(poll, link, true);
+    s->read_link = -1;
 
     s->id = s->fd = 0;
     s->writing = false;
     s->reading = false;
     s->type = SOCKET_TYPE_INVALID;
-    s->unpacker = NULL;
-    s->user_ptr = NULL;
+    //unpacker/user_ptr保留到error回调中由用户释放，重新分配时再清空
     clear_wb_list(&s->wb_list);
     return 0;
 }
@@ -328,6 +390,20 @@ xnet_poll_get_socket(xnet_poll_t *poll, int id) {
     return &poll->slots[id % poll->slot_size];
 }
 
+//返回read_link指向的socket，对方已经关闭或者slot被重新分配时清除read_link
+xnet_socket_t *
+xnet_get_read_link(xnet_poll_t *poll, xnet_socket_t *s) {
+    xnet_socket_t *link;
+    if (s->read_link < 0)
+        return NULL;
+    link = &poll->slots[s->read_link];
+    if (link->type == SOCKET_TYPE_INVALID || link->gen != s->read_link_gen || link->closing) {
+        s->read_link = -1;
+        return NULL;
+    }
+    return link;
+}
+
 static SOCKET_TYPE
 do_bind(const char *host, int port, int protocol, int *family) {
     SOCKET_TYPE fd = -1;
@@ -616,7 +692,7 @@ xnet_recv_data(xnet_poll_t *poll, xnet_socket_t *s, char **out_data) {
         return -2;
     }
 
-    if (n == sz) {
+    if (n == sz && sz < MAX_READ_SIZE) {
         s->read_size *= 2;
     } else if(sz > MIN_READ_SIZE && n*2 < sz) {
         s->read_size /= 2;
@@ -655,34 +731,95 @@ xnet_recv_udp_data(xnet_poll_t *poll, xnet_socket_t *s, xnet_addr_t *addr_out) {
     return n;
 }
 
+//发送队首的文件节点，返回0表示已经发送完，否则同send_tcp_data
+static int
+send_file_data(xnet_poll_t *poll, xnet_socket_t *s) {
+    xnet_wb_list_t *wb_list = &s->wb_list;
+    xnet_file_write_buff_t *fwb = (xnet_file_write_buff_t *)wb_list->head;
+    int n, err;
+
+    while (fwb->left > 0) {
+        n = poll_sendfile(s->fd, fwb->fd, &fwb->offset, fwb->left);
+        if (n < 0) {
+            err = get_last_error();
+            if (err == XNET_EINTR) continue;
+            if (XNET_HAVE_WOULDBLOCK(err)) {
+                xnet_enable_write(poll, s, true);
+                return -1;
+            }
+            xnet_enable_write(poll, s, false);
+            return -1;
+        }
+        if (n == 0) {
+            //文件被截断，已经发出的长度对不上，只能关闭连接，由下次可写事件关闭
+            discard_send_buff(poll, s);
+            s->closing = true;
+            xnet_enable_write(poll, s, true);
+            return -1;
+        }
+        s->wb_size -= n;
+        s->wb_file_size -= n;
+        fwb->left -= n;
+    }
+    wb_list->head = fwb->wb.next;
+    free_wb((xnet_write_buff_t *)fwb);
+    if (wb_list->head == NULL)
+        wb_list->tail = NULL;
+    return 0;
+}
+
+//把写队列中的多个buffer合并成一次writev发送
 static int
 send_tcp_data(xnet_poll_t *poll, xnet_socket_t *s) {
     xnet_wb_list_t *wb_list = &s->wb_list;
     xnet_write_buff_t *wb;
-    int n, err;
+    xnet_iovec_t iov[XNET_IOV_MAX];
+    int n, i, err, total, sent;
 
     while (wb_list->head) {
-        wb = wb_list->head;
-        for (;;) {
-            n = send(s->fd, wb->ptr, wb->sz, 0);
-            if (n < 0) {
-                err = get_last_error();
-                if (err == XNET_EINTR) continue;
-                if (XNET_HAVE_WOULDBLOCK(err)) return -1;
-                xnet_enable_write(poll, s, false);
+        if (wb_list->head->file) {
+            n = send_file_data(poll, s);
+            if (n == 0) continue;
+            return n;
+        }
+        total = 0;
+        //文件节点之前的buffer合并发送
+        for (i=0, wb=wb_list->head; wb && !wb->file && i<XNET_IOV_MAX; wb=wb->next, i++) {
+            XNET_IOV_SET(iov[i], wb->ptr, wb->sz);
+            total += wb->sz;
+        }
+
+        n = poll_sendv(s->fd, iov, i, wb != NULL && wb->file);
+        if (n < 0) {
+            err = get_last_error();
+            if (err == XNET_EINTR) continue;
+            if (XNET_HAVE_WOULDBLOCK(err)) {
+                xnet_enable_write(poll, s, true);
                 return -1;
             }
-            s->wb_size -= n;
-            if (n != wb->sz) {
+            xnet_enable_write(poll, s, false);
+            return -1;
+        }
+        s->wb_size -= n;
+        sent = n;
+
+        while (n > 0) {
+            wb = wb_list->head;
+            if (n < wb->sz) {
                 wb->ptr += n;
                 wb->sz -= n;
-                return -1;
+                break;
             }
-            break;
+            n -= wb->sz;
+            wb_list->head = wb->next;
+            free_wb(wb);
         }
 
-        wb_list->head = wb->next;
-        free_wb(wb);
+        if (sent < total) {
+            //内核发送缓冲区已满，等待可写事件
+            xnet_enable_write(poll, s, true);
+            return -1;
+        }
     }
 
     wb_list->tail = NULL;
@@ -753,10 +890,41 @@ append_send_buff(xnet_poll_t *poll, xnet_socket_t *s, const char *buffer, int sz
     wb->sz = sz;
     wb->next = NULL;
     wb->raw = raw;
+    wb->file = false;
     insert_wb_list(&s->wb_list, wb);
     s->wb_size += sz;
 
-    xnet_enable_write(poll, s, true);
+    if (poll->cork)
+        mark_dirty_socket(poll, s);
+    else
+        xnet_enable_write(poll, s, true);
+}
+
+void
+append_send_file(xnet_poll_t *poll, xnet_socket_t *s, int fd, int64_t offset, int64_t sz) {
+    xnet_file_write_buff_t *fwb = (xnet_file_write_buff_t *)malloc(sizeof(xnet_file_write_buff_t));
+    fwb->wb.buffer = fwb->wb.ptr = NULL;
+    fwb->wb.sz = 0;
+    fwb->wb.next = NULL;
+    fwb->wb.raw = false;
+    fwb->wb.file = true;
+    fwb->fd = fd;
+    fwb->offset = offset;
+    fwb->left = sz;
+    insert_wb_list(&s->wb_list, (xnet_write_buff_t *)fwb);
+    s->wb_size += sz;
+    s->wb_file_size += sz;
+
+    if (poll->cork)
+        mark_dirty_socket(poll, s);
+    else
+        xnet_enable_write(poll, s, true);
+}
+
+//没有进入写队列的文件也按平台的方式关闭
+void
+close_send_file(int fd) {
+    poll_close_file(fd);
 }
 
 void
@@ -766,6 +934,7 @@ append_udp_send_buff(xnet_poll_t *poll, xnet_socket_t *s, xnet_addr_t *addr, con
     udp_wb->wb.sz = sz;
     udp_wb->wb.next = NULL;
     udp_wb->wb.raw = raw;
+    udp_wb->wb.file = false;
     memcpy(&udp_wb->udp_addr, addr, sizeof(xnet_addr_t));
     insert_wb_list(&s->wb_list, (xnet_write_buff_t*)udp_wb);
 
@@ -773,6 +942,78 @@ append_udp_send_buff(xnet_poll_t *poll, xnet_socket_t *s, xnet_addr_t *addr, con
     xnet_enable_write(poll, s, true);
 }
 
+//丢弃写队列中未发送的数据
+void
+discard_send_buff(xnet_poll_t *poll, xnet_socket_t *s) {
+    clear_wb_list(&s->wb_list);
+    s->wb_size = 0;
+    s->wb_file_size = 0;
+}
+
+void
+xnet_poll_set_cork(xnet_poll_t *poll, bool enable) {
+    poll->cork = enable;
+}
+
+//把socket挂到deadline(毫秒)所在的槽位，超出时间轮范围的挂在最远的槽位，到时再重新检查
+int
+xnet_wheel_link(xnet_poll_t *poll, xnet_socket_t *s, uint64_t deadline) {
+    int i, slot;
+    uint64_t ticks;
+
+    if (!poll->wheel) {
+        poll->wheel = malloc(sizeof(int) * XNET_WHEEL_SIZE);
+        if (!poll->wheel) return -1;
+        for (i=0; i<XNET_WHEEL_SIZE; i++)
+            poll->wheel[i] = -1;
+    }
+    xnet_wheel_unlink(poll, s);
+
+    if (deadline <= poll->wheel_time + XNET_WHEEL_TICK) {
+        ticks = 1;
+    } else {
+        ticks = (deadline - poll->wheel_time + XNET_WHEEL_TICK - 1) / XNET_WHEEL_TICK;
+        if (ticks >= XNET_WHEEL_SIZE) ticks = XNET_WHEEL_SIZE - 1;
+    }
+    slot = (poll->wheel_cur + (int)ticks) % XNET_WHEEL_SIZE;
+
+    s->wheel_slot = slot;
+    s->wheel_prev = -1;
+    s->wheel_next = poll->wheel[slot];
+    if (s->wheel_next != -1)
+        poll->slots[s->wheel_next].wheel_prev = s->id;
+    poll->wheel[slot] = s->id;
+    poll->wheel_n++;
+    return 0;
+}
+
+void
+xnet_wheel_unlink(xnet_poll_t *poll, xnet_socket_t *s) {
+    if (s->wheel_slot < 0) return;
+    if (s->wheel_prev != -1)
+        poll->slots[s->wheel_prev].wheel_next = s->wheel_next;
+    else
+        poll->wheel[s->wheel_slot] = s->wheel_next;
+    if (s->wheel_next != -1)
+        poll->slots[s->wheel_next].wheel_prev = s->wheel_prev;
+    s->wheel_slot = -1;
+    poll->wheel_n--;
+}
+
+//取出整个槽位的链表，返回链表头的socket id，-1表示为空
+int
+xnet_wheel_detach(xnet_poll_t *poll, int slot) {
+    int id, head;
+    if (!poll->wheel) return -1;
+    head = poll->wheel[slot];
+    poll->wheel[slot] = -1;
+    for (id=head; id!=-1; id=poll->slots[id].wheel_next) {
+        poll->slots[id].wheel_slot = -1;
+        poll->wheel_n--;
+    }
+    return head;
+}
+
 void
 block_recv(SOCKET_TYPE fd, void *buffer, int sz) {
     int err, n;
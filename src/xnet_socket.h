@@ -26,8 +26,14 @@
 #endif
 
 #define MIN_READ_SIZE 512
+#define MAX_READ_SIZE (64*1024)
 #define MAX_CLIENT_NUM 65536
 #define MAX_UDP_PACKAGE 65535
+#define XNET_IOV_MAX 64
+
+//连接超时时间轮：每格100毫秒，512格
+#define XNET_WHEEL_TICK 100
+#define XNET_WHEEL_SIZE 512
 
 //socket type:
 #define SOCKET_TYPE_INVALID 0
@@ -63,6 +69,7 @@ typedef struct write_buffer {
     char *ptr;
     int sz;
     bool raw;
+    bool file;//xnet_file_write_buff_t
 } xnet_write_buff_t;
 
 typedef struct {
@@ -70,6 +77,14 @@ typedef struct {
     xnet_addr_t udp_addr;
 } xnet_udp_wirte_buff_t;
 
+//文件节点：用sendfile发送fd的[offset, offset+left)，发送完或丢弃时关闭fd
+typedef struct {
+    xnet_write_buff_t wb;
+    int fd;
+    int64_t offset;
+    int64_t left;
+} xnet_file_write_buff_t;
+
 typedef struct {
     xnet_write_buff_t *head;
     xnet_write_buff_t *tail;
@@ -80,22 +95,47 @@ typedef struct {
 	int type;
 	int id;
     int read_size;
+    uint32_t gen;//slot每次分配socket时递增，保存的socket id可以用它确认没有被重新分配
     uint8_t protocol;//1tcp 2udp 3udp_v6
     bool reading;
     bool writing;
     bool closing;
+    bool dirty;//已加入poll的待flush列表
 
     xnet_wb_list_t wb_list;
     int64_t wb_size;
+    int64_t wb_file_size;//wb_size中文件节点的部分，数据不在内存中，不计入wb_hard
+    //写队列水位，为0表示不限制
+    int64_t wb_low;
+    int64_t wb_high;
+    int64_t wb_hard;//超过此值直接关闭socket
+    bool wb_blocked;//写队列超过高水位，还未回落到低水位
+    bool drain_pending;//已加入context的待通知水位列表
+    bool drain_blocked;//最后一次通知drain_func的状态
+    int read_link;//超过高水位时暂停读取的socket，-1表示没有
+    uint32_t read_link_gen;//设置read_link时对方的gen
+    short close_what;//延迟关闭时回调error_func的what
     xnet_addr_t addr_info;
 
+    //连接超时(毫秒)，为0表示不检查，到期时间由时间轮惰性检查
+    uint32_t read_timeout;//超过此时间没有收到数据
+    uint32_t write_timeout;//写队列不为空，超过此时间没有发送进展
+    uint32_t life_timeout;//连接总时长
+    uint64_t last_read;
+    uint64_t last_write;
+    uint64_t start_time;
+    int wheel_slot;//-1表示不在时间轮中
+    int wheel_prev;
+    int wheel_next;
+
     //保留给用户
     void *unpacker;
     void *user_ptr;
 } xnet_socket_t;
 
+//回调中新建socket可能导致slots扩容，事件中只记录socket id(-1表示管道)
 typedef struct {
-    xnet_socket_t *s[POLL_EVENT_MAX];
+    int id[POLL_EVENT_MAX];
     bool read[POLL_EVENT_MAX];
     bool write[POLL_EVENT_MAX];
     bool error[POLL_EVENT_MAX];
@@ -129,6 +169,18 @@ typedef struct {
     int slot_index;
     xnet_poll_event_t poll_event;
 
+    //cork模式下，发送数据只标记socket，在每轮循环结束时统一flush
+    bool cork;
+    int *dirty_ids;
+    int dirty_n;
+    int dirty_cap;
+
+    //连接超时时间轮，每个槽位是以socket id串起来的双向链表
+    int *wheel;
+    int wheel_cur;
+    int wheel_n;
+    uint64_t wheel_time;
+
     //其他线程的操作通过管道发送异步进行
 	SOCKET_TYPE recv_fd;
 	SOCKET_TYPE send_fd;
@@ -147,6 +199,7 @@ int xnet_poll_addfd(xnet_poll_t *poll, SOCKET_TYPE fd, int id);
 int xnet_poll_closefd(xnet_poll_t *poll, xnet_socket_t *s);
 int xnet_poll_wait(xnet_poll_t *poll, int timeout);//进行io等待，触发后返回触发的socket列表，保存在poll->event中
 xnet_socket_t *xnet_poll_get_socket(xnet_poll_t *poll, int id);
+xnet_socket_t *xnet_get_read_link(xnet_poll_t *poll, xnet_socket_t *s);
 
 int xnet_enable_read(xnet_poll_t *poll, xnet_socket_t *s, bool enable);
 int xnet_enable_write(xnet_poll_t *poll, xnet_socket_t *s, bool enable);
@@ -154,6 +207,10 @@ int xnet_enable_write(xnet_poll_t *poll, xnet_socket_t *s, bool enable);
 int xnet_recv_data(xnet_poll_t *poll, xnet_socket_t *s, char **out_data);
 int xnet_recv_udp_data(xnet_poll_t *poll, xnet_socket_t *s, xnet_addr_t *addr_out);
 int xnet_send_data(xnet_poll_t *poll, xnet_socket_t *s);
+void xnet_poll_set_cork(xnet_poll_t *poll, bool enable);
+int xnet_wheel_link(xnet_poll_t *poll, xnet_socket_t *s, uint64_t deadline);
+void xnet_wheel_unlink(xnet_poll_t *poll, xnet_socket_t *s);
+int xnet_wheel_detach(xnet_poll_t *poll, int slot);
 
 int xnet_listen_tcp_socket(xnet_poll_t *poll, const char *host, int port, int backlog);
 int xnet_accept_tcp_socket(xnet_poll_t *poll, xnet_socket_t *listen_s);
@@ -171,7 +228,11 @@ bool wb_list_empty(xnet_socket_t *s);
 void set_nonblocking(SOCKET_TYPE fd);
 void set_keepalive(SOCKET_TYPE fd);
 void append_send_buff(xnet_poll_t *poll, xnet_socket_t *s, const char *buffer, int sz, bool raw);
+void append_send_file(xnet_poll_t *poll, xnet_socket_t *s, int fd, int64_t offset, int64_t sz);
+void close_send_file(int fd);
 void append_udp_send_buff(xnet_poll_t *poll, xnet_socket_t *s, xnet_addr_t *addr, const char *buffer, int sz, bool raw);
+void discard_send_buff(xnet_poll_t *poll, xnet_socket_t *s);
+void mark_dirty_socket(xnet_poll_t *poll, xnet_socket_t *s);
 void block_recv(SOCKET_TYPE fd, void *buffer, int sz);
 void block_send(SOCKET_TYPE fd, void *buffer, int sz);
 int get_sockopt(SOCKET_TYPE fd, int level, int optname, int *optval, socklen_t *optlen);
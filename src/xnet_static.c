@@ -0,0 +1,747 @@
+#include "xnet_static.h"
+#include "xnet_util.h"
+#include "malloc_ref.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+#ifndef S_ISREG
+#define S_ISREG(m) (((m) & S_IFMT) == S_IFREG)
+#define S_ISDIR(m) (((m) & S_IFMT) == S_IFDIR)
+#endif
+
+#define STATIC_PATH_MAX 1024
+//同一份缓存同时在很多写队列中时引用计数会溢出，这时复制一份
+#define STATIC_REF_MAX ((REF_INT)~0 - 1)
+
+typedef struct static_entry {
+	struct static_entry *hnext;
+	struct static_entry *prev;//LRU，最近使用的在前
+	struct static_entry *next;
+	uint32_t hash;
+	uint32_t key_len;
+	bool exists;
+	bool dir;
+	int64_t size;
+	int64_t mtime;
+	uint64_t check_time;
+	char *data;//缓存的内容，引用计数，缓存自己持有一个
+	char etag[48];
+	char last_modified[32];
+	char key[0];//相对根目录的路径
+} static_entry_t;
+
+struct xnet_static {
+	char *root;
+	char *index;
+	int64_t cache_size;
+	uint32_t max_file;
+	uint32_t max_entries;
+	uint32_t check_interval;
+	bool gzip;
+
+	static_entry_t **buckets;
+	uint32_t mask;
+	static_entry_t lru;//哨兵
+	xnet_static_stat_t stat;
+};
+
+typedef struct {
+	const char *ext;
+	const char *type;
+} static_mime_t;
+
+static const static_mime_t g_mime[] = {
+	{"html", "text/html; charset=utf-8"},
+	{"htm", "text/html; charset=utf-8"},
+	{"css", "text/css; charset=utf-8"},
+	{"js", "application/javascript; charset=utf-8"},
+	{"mjs", "application/javascript; charset=utf-8"},
+	{"json", "application/json"},
+	{"txt", "text/plain; charset=utf-8"},
+	{"xml", "text/xml; charset=utf-8"},
+	{"svg", "image/svg+xml"},
+	{"png", "image/png"},
+	{"jpg", "image/jpeg"},
+	{"jpeg", "image/jpeg"},
+	{"gif", "image/gif"},
+	{"ico", "image/x-icon"},
+	{"webp", "image/webp"},
+	{"wasm", "application/wasm"},
+	{"woff", "font/woff"},
+	{"woff2", "font/woff2"},
+	{"ttf", "font/ttf"},
+	{"pdf", "application/pdf"},
+	{"mp3", "audio/mpeg"},
+	{"mp4", "video/mp4"},
+	{"webm", "video/webm"},
+	{"zip", "application/zip"},
+	{"gz", "application/gzip"},
+	{NULL, NULL}
+};
+
+static const char *
+mime_type(const char *key, uint32_t len) {
+	const char *ext = NULL;
+	uint32_t i, n;
+	for (i=len; i>0; i--) {
+		if (key[i-1] == '/') break;
+		if (key[i-1] == '.') {
+			ext = key + i;
+			break;
+		}
+	}
+	if (ext) {
+		n = len - (uint32_t)(ext - key);
+		for (i=0; g_mime[i].ext; i++) {
+			if (strlen(g_mime[i].ext) == n && util_strncasecmp(g_mime[i].ext, ext, n) == 0)
+				return g_mime[i].type;
+		}
+	}
+	return "application/octet-stream";
+}
+
+static uint32_t
+hash_key(const char *key, uint32_t len) {
+	uint32_t h = 2166136261u;
+	uint32_t i;
+	for (i=0; i<len; i++) {
+		h ^= (uint8_t)key[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/*日期*/
+static const char *g_wday[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char *g_mon[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+	"Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+static void
+http_date(int64_t t, char out[32]) {
+	time_t tt = (time_t)(t > 0 ? t : 0);
+	struct tm tm;
+	//超出范围的时间按1970-01-01输出，不使用未初始化的tm
+	if (util_gmtime(&tt, &tm) == NULL) {
+		tt = 0;
+		util_gmtime(&tt, &tm);
+	}
+	sprintf(out, "%s, %02d %s %d %02d:%02d:%02d GMT", g_wday[tm.tm_wday], tm.tm_mday,
+		g_mon[tm.tm_mon], tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
+
+//公历日期到1970-01-01的天数
+static int64_t
+days_from_civil(int64_t y, int m, int d) {
+	int64_t era, yoe, doy, doe;
+	y -= m <= 2;
+	era = (y >= 0 ? y : y - 399) / 400;
+	yoe = y - era * 400;
+	doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+//只解析IMF-fixdate(Sun, 06 Nov 1994 08:49:37 GMT)，失败返回-1
+static int64_t
+parse_http_date(const char *s, uint32_t sz) {
+	char buf[64], wday[4], mon[4];
+	int d, y, hh, mm, ss, m;
+	if (sz >= sizeof(buf)) return -1;
+	memcpy(buf, s, sz);
+	buf[sz] = 0;
+	if (sscanf(buf, "%3s, %2d %3s %4d %2d:%2d:%2d GMT", wday, &d, mon, &y, &hh, &mm, &ss) != 7)
+		return -1;
+	for (m=0; m<12; m++) {
+		if (strcmp(mon, g_mon[m]) == 0) break;
+	}
+	if (m == 12 || d < 1 || d > 31 || hh > 23 || mm > 59 || ss > 60)
+		return -1;
+	return days_from_civil(y, m + 1, d) * 86400 + hh * 3600 + mm * 60 + ss;
+}
+
+/*缓存*/
+static void
+drop_data(xnet_static_t *st, static_entry_t *e) {
+	if (e->data) {
+		st->stat.cache_bytes -= e->size;
+		mf_free(e->data);
+		e->data = NULL;
+	}
+}
+
+static void
+lru_unlink(static_entry_t *e) {
+	e->prev->next = e->next;
+	e->next->prev = e->prev;
+}
+
+static void
+lru_push_front(xnet_static_t *st, static_entry_t *e) {
+	e->prev = &st->lru;
+	e->next = st->lru.next;
+	st->lru.next->prev = e;
+	st->lru.next = e;
+}
+
+static void
+remove_entry(xnet_static_t *st, static_entry_t *e) {
+	static_entry_t **pp = &st->buckets[e->hash & st->mask];
+	while (*pp != e)
+		pp = &(*pp)->hnext;
+	*pp = e->hnext;
+	lru_unlink(e);
+	drop_data(st, e);
+	st->stat.entries--;
+	free(e);
+}
+
+//从最久没有使用的开始淘汰，keep和比它更新的不淘汰
+static void
+evict(xnet_static_t *st, static_entry_t *keep) {
+	static_entry_t *e;
+	while (st->stat.entries > st->max_entries || st->stat.cache_bytes > st->cache_size) {
+		e = st->lru.prev;
+		if (e == &st->lru || e == keep) break;
+		remove_entry(st, e);
+	}
+}
+
+static void
+full_path(xnet_static_t *st, static_entry_t *e, char *out) {
+	snprintf(out, STATIC_PATH_MAX * 2, "%s/%.*s", st->root, (int)e->key_len, e->key);
+}
+
+//sb为NULL表示文件不存在，元数据变化时丢弃缓存的内容
+static void
+set_meta(xnet_static_t *st, static_entry_t *e, struct stat *sb) {
+	bool dir = sb && S_ISDIR(sb->st_mode);
+	bool exists = sb && (dir || S_ISREG(sb->st_mode));
+	int64_t size = exists ? (int64_t)sb->st_size : 0;
+	int64_t mtime = exists ? (int64_t)sb->st_mtime : 0;
+
+	if (exists == e->exists && dir == e->dir && size == e->size && mtime == e->mtime)
+		return;
+	drop_data(st, e);
+	e->exists = exists;
+	e->dir = dir;
+	e->size = size;
+	e->mtime = mtime;
+	snprintf(e->etag, sizeof(e->etag), "\"%llx-%llx\"", (unsigned long long)mtime, (unsigned long long)size);
+	http_date(mtime, e->last_modified);
+}
+
+static void
+check_entry(xnet_static_t *st, static_entry_t *e, uint64_t now) {
+	char path[STATIC_PATH_MAX * 2];
+	struct stat sb;
+	full_path(st, e, path);
+	st->stat.stat++;
+	set_meta(st, e, stat(path, &sb) == 0 ? &sb : NULL);
+	e->check_time = now;
+}
+
+static static_entry_t *
+get_entry(xnet_static_t *st, const char *key, uint32_t len, uint64_t now) {
+	uint32_t h = hash_key(key, len);
+	static_entry_t *e;
+
+	for (e=st->buckets[h & st->mask]; e; e=e->hnext) {
+		if (e->hash == h && e->key_len == len && memcmp(e->key, key, len) == 0)
+			break;
+	}
+	if (e) {
+		if (now - e->check_time >= st->check_interval)
+			check_entry(st, e, now);
+		lru_unlink(e);
+		lru_push_front(st, e);
+		return e;
+	}
+
+	e = (static_entry_t *)malloc(sizeof(static_entry_t) + len + 1);
+	memset(e, 0, sizeof(static_entry_t));
+	memcpy(e->key, key, len);
+	e->key[len] = 0;
+	e->key_len = len;
+	e->hash = h;
+	//set_meta按变化判断，先设置成不可能的大小
+	e->size = -1;
+	e->hnext = st->buckets[h & st->mask];
+	st->buckets[h & st->mask] = e;
+	lru_push_front(st, e);
+	st->stat.entries++;
+	check_entry(st, e, now);
+	evict(st, e);
+	return e;
+}
+
+//打开文件并用fstat校正元数据，失败返回-403或-404
+static int
+open_entry(xnet_static_t *st, static_entry_t *e) {
+	char path[STATIC_PATH_MAX * 2];
+	struct stat sb;
+	int fd, err;
+
+	full_path(st, e, path);
+	fd = util_open(path, O_RDONLY | O_BINARY);
+	if (fd < 0) {
+		err = errno;
+		e->check_time = 0;
+		return err == EACCES ? -403 : -404;
+	}
+	if (fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode)) {
+		util_close(fd);
+		e->check_time = 0;
+		return -404;
+	}
+	set_meta(st, e, &sb);
+	return fd;
+}
+
+//小文件读入缓存，成功时关闭fd
+static int
+load_entry(xnet_static_t *st, static_entry_t *e, int fd) {
+	char *buf = (char *)mf_malloc(e->size);
+	int64_t total = 0;
+	int n;
+
+	while (total < e->size) {
+		n = util_read(fd, buf + total, (size_t)(e->size - total));
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) break;
+		total += n;
+	}
+	if (total != e->size) {
+		mf_free(buf);
+		return -1;
+	}
+	util_close(fd);
+	mf_set_ref(buf, 1);
+	e->data = buf;
+	st->stat.cache_bytes += e->size;
+	evict(st, e);
+	return 0;
+}
+
+/*请求解析*/
+
+//解码url中的路径，去掉查询参数，输出不带开头'/'的相对路径；..、反斜杠、\0视为非法
+static int
+normalize_path(const char *url, uint32_t sz, char *out, uint32_t *out_len, bool *slash) {
+	char buf[STATIC_PATH_MAX];
+	uint32_t i, n = 0, len = 0, seg;
+	int hi, lo;
+
+	for (i=0; i<sz && url[i] != '?' && url[i] != '#'; i++) {
+		if (n + 1 >= sizeof(buf)) return -1;
+		if (url[i] == '%') {
+			if (i + 2 >= sz) return -1;
+			hi = url[i+1];
+			lo = url[i+2];
+			hi = (hi >= '0' && hi <= '9') ? hi - '0' : ((hi | 0x20) >= 'a' && (hi | 0x20) <= 'f') ? (hi | 0x20) - 'a' + 10 : -1;
+			lo = (lo >= '0' && lo <= '9') ? lo - '0' : ((lo | 0x20) >= 'a' && (lo | 0x20) <= 'f') ? (lo | 0x20) - 'a' + 10 : -1;
+			if (hi < 0 || lo < 0) return -1;
+			buf[n++] = (char)(hi << 4 | lo);
+			i += 2;
+		} else {
+			buf[n++] = url[i];
+		}
+	}
+	*slash = (n == 0 || buf[n-1] == '/');
+
+	//按'/'切分，跳过空段和.
+	for (i=0; i<n; ) {
+		while (i < n && buf[i] == '/') i++;
+		seg = i;
+		while (i < n && buf[i] != '/') {
+			if (buf[i] == '\\' || buf[i] == 0) return -1;
+			i++;
+		}
+		if (i == seg || (i - seg == 1 && buf[seg] == '.'))
+			continue;
+		if (i - seg == 2 && buf[seg] == '.' && buf[seg+1] == '.')
+			return -1;
+		if (len > 0) out[len++] = '/';
+		memcpy(out + len, buf + seg, i - seg);
+		len += i - seg;
+	}
+	out[len] = 0;
+	*out_len = len;
+	return 0;
+}
+
+static inline bool
+is_space(char c) {
+	return c == ' ' || c == '\t';
+}
+
+//逗号分隔的列表，取下一项并去掉两边的空白，返回false表示没有了
+static bool
+next_item(const char **p, const char *end, const char **item, uint32_t *len) {
+	const char *s = *p, *e;
+	while (s < end && (is_space(*s) || *s == ',')) s++;
+	if (s >= end) return false;
+	e = s;
+	while (e < end && *e != ',') e++;
+	*p = e;
+	while (e > s && is_space(e[-1])) e--;
+	*item = s;
+	*len = (uint32_t)(e - s);
+	return true;
+}
+
+//If-None-Match使用弱比较
+static bool
+etag_match(const char *v, uint32_t sz, const char *etag) {
+	const char *p = v, *end = v + sz, *item;
+	uint32_t len, etag_len = strlen(etag);
+	while (next_item(&p, end, &item, &len)) {
+		if (len == 1 && item[0] == '*') return true;
+		if (len > 2 && item[0] == 'W' && item[1] == '/') {
+			item += 2;
+			len -= 2;
+		}
+		if (len == etag_len && memcmp(item, etag, len) == 0) return true;
+	}
+	return false;
+}
+
+//Accept-Encoding中有gzip并且q不为0
+static bool
+accept_gzip(const char *v, uint32_t sz) {
+	const char *p = v, *end = v + sz, *item, *q;
+	uint32_t len, name_len;
+	while (next_item(&p, end, &item, &len)) {
+		for (name_len=0; name_len<len && item[name_len] != ';' && !is_space(item[name_len]); name_len++);
+		if (name_len != 4 || util_strncasecmp(item, "gzip", 4) != 0)
+			continue;
+		for (q=item+name_len; q+1<item+len; q++) {
+			if ((q[0] == 'q' || q[0] == 'Q') && q[1] == '=') {
+				for (q+=2; q<item+len && (*q == '0' || *q == '.'); q++);
+				return q < item + len && *q >= '1' && *q <= '9';
+			}
+		}
+		return true;
+	}
+	return false;
+}
+
+static bool
+parse_number(const char *s, const char *end, int64_t *out) {
+	int64_t v = 0;
+	if (s >= end || end - s > 18) return false;
+	for (; s<end; s++) {
+		if (*s < '0' || *s > '9') return false;
+		v = v * 10 + (*s - '0');
+	}
+	*out = v;
+	return true;
+}
+
+//只处理单个范围：返回1为[*start, *start+*len)，0表示忽略Range，-1表示不能满足
+static int
+parse_range(const char *v, uint32_t sz, int64_t size, int64_t *start, int64_t *len) {
+	const char *end = v + sz, *dash;
+	int64_t a, b;
+
+	if (sz < 6 || util_strncasecmp(v, "bytes=", 6) != 0) return 0;
+	v += 6;
+	while (v < end && is_space(*v)) v++;
+	while (end > v && is_space(end[-1])) end--;
+	if (memchr(v, ',', end - v)) return 0;
+	dash = memchr(v, '-', end - v);
+	if (dash == NULL) return 0;
+
+	if (dash == v) {
+		//-n：最后n字节
+		if (!parse_number(dash + 1, end, &b)) return 0;
+		if (b == 0 || size == 0) return -1;
+		if (b > size) b = size;
+		*start = size - b;
+		*len = b;
+		return 1;
+	}
+	if (!parse_number(v, dash, &a)) return 0;
+	if (dash + 1 == end) {
+		b = size - 1;
+	} else {
+		if (!parse_number(dash + 1, end, &b) || b < a) return 0;
+		if (b >= size) b = size - 1;
+	}
+	if (a >= size) return -1;
+	*start = a;
+	*len = b - a + 1;
+	return 1;
+}
+
+static const char *
+request_header(xnet_httprequest_t *req, int id, const char *name, uint32_t *sz) {
+	xnet_httpheader_t *h = id ? xnet_get_http_header(req, id) : xnet_get_http_header_value(req, name);
+	if (h == NULL) return NULL;
+	*sz = xnet_string_get_size(&h->value);
+	return xnet_string_get_str(&h->value);
+}
+
+static void
+add_field(xnet_static_reply_t *rp, const char *key, const char *value) {
+	xnet_string_append_buff(&rp->fields, key, strlen(key));
+	xnet_string_append_buff(&rp->fields, ": ", 2);
+	xnet_string_append_buff(&rp->fields, value, strlen(value));
+	xnet_string_append_buff(&rp->fields, "\r\n", 2);
+}
+
+static int
+reply_code(xnet_static_reply_t *rp, int code) {
+	rp->code = code;
+	rp->length = 0;
+	return code;
+}
+
+static int
+reply_entry(xnet_static_t *st, xnet_httprequest_t *req, static_entry_t *e, const char *mime, bool gz,
+	bool head, xnet_static_reply_t *rp) {
+	const char *v;
+	uint32_t sz;
+	int64_t start, len, t, old_size, old_mtime;
+	char range[96];
+	int fd = -1, r, retry;
+
+	for (retry=0; ; retry++) {
+		rp->fields.size = 0;
+		if (gz) add_field(rp, "Content-Encoding", "gzip");
+		if (st->gzip) add_field(rp, "Vary", "Accept-Encoding");
+		add_field(rp, "ETag", e->etag);
+		add_field(rp, "Last-Modified", e->last_modified);
+
+		//条件请求只看缓存的元数据，If-None-Match优先
+		if ((v = request_header(req, XNET_HTTP_H_IF_NONE_MATCH, NULL, &sz)) != NULL) {
+			if (etag_match(v, sz, e->etag)) {
+				rp->code = 304;
+				rp->length = -1;
+				return 304;
+			}
+		} else if ((v = request_header(req, XNET_HTTP_H_IF_MODIFIED_SINCE, NULL, &sz)) != NULL) {
+			t = parse_http_date(v, sz);
+			if (t >= 0 && e->mtime <= t) {
+				rp->code = 304;
+				rp->length = -1;
+				return 304;
+			}
+		}
+		add_field(rp, "Content-Type", mime);
+		add_field(rp, "Accept-Ranges", "bytes");
+
+		rp->code = 200;
+		start = 0;
+		len = e->size;
+		v = head ? NULL : request_header(req, XNET_HTTP_H_RANGE, NULL, &sz);
+		if (v) {
+			//If-Range和当前的ETag或修改时间不一致时返回整个文件
+			const char *ir;
+			uint32_t ir_sz;
+			ir = request_header(req, 0, "If-Range", &ir_sz);
+			if (ir && !(ir_sz == strlen(e->etag) && memcmp(ir, e->etag, ir_sz) == 0)
+				&& !(ir_sz == strlen(e->last_modified) && memcmp(ir, e->last_modified, ir_sz) == 0)) {
+				r = 0;
+			} else {
+				r = parse_range(v, sz, e->size, &start, &len);
+			}
+			if (r < 0) {
+				snprintf(range, sizeof(range), "bytes */%lld", (long long)e->size);
+				add_field(rp, "Content-Range", range);
+				return reply_code(rp, 416);
+			}
+			if (r > 0) {
+				rp->code = 206;
+				snprintf(range, sizeof(range), "bytes %lld-%lld/%lld", (long long)start,
+					(long long)(start + len - 1), (long long)e->size);
+				add_field(rp, "Content-Range", range);
+			}
+		}
+		rp->length = len;
+		rp->size = e->size;
+		rp->offset = start;
+		if (head || len == 0)
+			return rp->code;
+
+		if (e->data) {
+			st->stat.hit++;
+			break;
+		}
+		st->stat.miss++;
+		old_size = e->size;
+		old_mtime = e->mtime;
+		fd = open_entry(st, e);
+		if (fd < 0)
+			return reply_code(rp, -fd);
+		//stat之后文件变了，按新的元数据重新处理
+		if (e->size != old_size || e->mtime != old_mtime) {
+			util_close(fd);
+			fd = -1;
+			if (retry > 0) return reply_code(rp, 404);
+			continue;
+		}
+		if (e->size <= st->max_file && load_entry(st, e, fd) == 0)
+			break;
+		rp->fd = fd;
+		return rp->code;
+	}
+
+	if (mf_get_ref(e->data) >= STATIC_REF_MAX) {
+		rp->data = (char *)mf_malloc(e->size);
+		memcpy(rp->data, e->data, e->size);
+		mf_set_ref(rp->data, 1);
+	} else {
+		rp->data = e->data;
+		mf_add_ref(rp->data);
+	}
+	return rp->code;
+}
+
+xnet_static_t *
+xnet_static_create(const xnet_static_config_t *conf) {
+	xnet_static_t *st;
+	uint32_t n = 16;
+
+	if (conf == NULL || conf->root == NULL) return NULL;
+	st = (xnet_static_t *)malloc(sizeof(xnet_static_t));
+	memset(st, 0, sizeof(xnet_static_t));
+	st->root = strdup(conf->root);
+	st->index = strdup(conf->index ? conf->index : "index.html");
+	st->cache_size = conf->cache_size > 0 ? conf->cache_size : 16*1024*1024;
+	st->max_file = conf->max_file > 0 ? conf->max_file : 64*1024;
+	if (st->max_file > st->cache_size) st->max_file = (uint32_t)st->cache_size;
+	st->max_entries = conf->max_entries > 0 ? conf->max_entries : 1024;
+	//gzip时一次请求用到两个条目
+	if (st->max_entries < 8) st->max_entries = 8;
+	st->check_interval = conf->check_interval > 0 ? conf->check_interval : 1000;
+	st->gzip = conf->gzip;
+
+	while (n < st->max_entries) n <<= 1;
+	st->buckets = (static_entry_t **)calloc(n, sizeof(static_entry_t *));
+	st->mask = n - 1;
+	st->lru.prev = st->lru.next = &st->lru;
+	return st;
+}
+
+void
+xnet_static_destroy(xnet_static_t *st) {
+	while (st->lru.next != &st->lru)
+		remove_entry(st, st->lru.next);
+	free(st->buckets);
+	free(st->root);
+	free(st->index);
+	free(st);
+}
+
+int
+xnet_static_lookup(xnet_static_t *st, xnet_httprequest_t *req, const char *path, uint32_t path_sz, xnet_static_reply_t *rp) {
+	char key[STATIC_PATH_MAX + 8];
+	uint32_t len, index_len;
+	bool slash, head;
+	const char *mime, *v;
+	uint32_t sz;
+	static_entry_t *e, *g;
+	uint64_t now = get_time();
+
+	memset(rp, 0, sizeof(*rp));
+	xnet_string_init(&rp->fields);
+	rp->fd = -1;
+
+	if (xnet_string_compare_cs(&req->method, "GET") == 0) {
+		head = false;
+	} else if (xnet_string_compare_cs(&req->method, "HEAD") == 0) {
+		head = true;
+	} else {
+		add_field(rp, "Allow", "GET, HEAD");
+		return reply_code(rp, 405);
+	}
+	if (path == NULL) {
+		path = xnet_string_get_str(&req->url);
+		path_sz = xnet_string_get_size(&req->url);
+	}
+	if (normalize_path(path, path_sz, key, &len, &slash) != 0)
+		return reply_code(rp, 400);
+	if (slash) {
+		index_len = strlen(st->index);
+		if (len + index_len + 1 >= STATIC_PATH_MAX) return reply_code(rp, 400);
+		if (len > 0) key[len++] = '/';
+		memcpy(key + len, st->index, index_len + 1);
+		len += index_len;
+	}
+
+	e = get_entry(st, key, len, now);
+	if (e->dir) {
+		//目录不以'/'结尾时重定向，相对路径才能正确解析
+		xnet_string_append_buff(&rp->fields, "Location: ", 10);
+		for (sz=0; sz<path_sz && path[sz] != '?' && path[sz] != '#'; sz++);
+		xnet_string_append_buff(&rp->fields, path, sz);
+		xnet_string_append_buff(&rp->fields, "/\r\n", 3);
+		return reply_code(rp, 301);
+	}
+	if (!e->exists)
+		return reply_code(rp, 404);
+
+	mime = mime_type(key, len);
+	if (st->gzip && (v = request_header(req, XNET_HTTP_H_ACCEPT_ENCODING, NULL, &sz)) != NULL && accept_gzip(v, sz)) {
+		memcpy(key + len, ".gz", 4);
+		g = get_entry(st, key, len + 3, now);
+		if (g->exists && !g->dir)
+			return reply_entry(st, req, g, mime, true, head, rp);
+	}
+	return reply_entry(st, req, e, mime, false, head, rp);
+}
+
+void
+xnet_static_reply_clear(xnet_static_reply_t *rp) {
+	xnet_string_clear(&rp->fields);
+	if (rp->data) {
+		mf_free(rp->data);
+		rp->data = NULL;
+	}
+	if (rp->fd >= 0) {
+		util_close(rp->fd);
+		rp->fd = -1;
+	}
+}
+
+int
+xnet_static_serve(xnet_static_t *st, xnet_context_t *ctx, int sock_id, xnet_httprequest_t *req, const char *path, uint32_t path_sz) {
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	xnet_static_reply_t rp;
+	xnet_string_t head;
+	int code;
+
+	if (s == NULL || s->type == SOCKET_TYPE_INVALID || s->closing)
+		return -1;
+	code = xnet_static_lookup(st, req, path, path_sz, &rp);
+	if (!req->keep_alive)
+		xnet_string_append_buff(&rp.fields, "Connection: close\r\n", 19);
+	xnet_string_init(&head);
+	xnet_pack_http_head(code, xnet_string_get_str(&rp.fields), xnet_string_get_size(&rp.fields), rp.length, &head);
+	xnet_tcp_send_buffer(ctx, sock_id, head.str, xnet_string_get_size(&head), true);
+
+	if (rp.data) {
+		//整个文件按引用入队，Range只复制需要的部分
+		if (rp.offset == 0 && rp.length == rp.size)
+			xnet_tcp_send_buffer_ref(ctx, sock_id, rp.data, (int)rp.length, true);
+		else
+			xnet_tcp_send_buffer(ctx, sock_id, rp.data + rp.offset, (int)rp.length, false);
+	} else if (rp.fd >= 0) {
+		xnet_tcp_send_file(ctx, sock_id, rp.fd, rp.offset, rp.length);
+		rp.fd = -1;
+	}
+	xnet_static_reply_clear(&rp);
+	return code;
+}
+
+void
+xnet_static_get_stat(xnet_static_t *st, xnet_static_stat_t *stat) {
+	*stat = st->stat;
+}
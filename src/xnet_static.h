@@ -0,0 +1,65 @@
+#ifndef _XNET_STATIC_H_
+#define _XNET_STATIC_H_
+#include "xnet.h"
+#include "xnet_packer.h"
+
+/*
+ * 静态文件：小文件读入内存按LRU缓存，发送时只增加引用计数不复制；大文件每次打开后用sendfile发送。
+ * 文件的元数据(大小、修改时间、ETag)也缓存，每check_interval毫秒最多stat一次，
+ * 条件请求(If-None-Match/If-Modified-Since)直接由缓存的元数据回答。
+ * 支持单个Range(多个时返回整个文件)，客户端接受gzip时优先发送预压缩的xxx.gz。
+ * 不是线程安全的，每个context使用自己的实例。
+ */
+typedef struct xnet_static xnet_static_t;
+
+typedef struct {
+	const char *root;//根目录
+	const char *index;//目录的默认文件，NULL为index.html
+	int64_t cache_size;//缓存文件内容的总字节数，0为16M
+	uint32_t max_file;//不超过此大小的文件缓存内容，0为64K，更大的用sendfile发送
+	uint32_t max_entries;//元数据条目的上限，包括不存在的文件，0为1024
+	uint32_t check_interval;//缓存多少毫秒后重新stat，0为1000
+	bool gzip;//查找预压缩的.gz文件
+} xnet_static_config_t;
+
+/*
+ * xnet_static_lookup的结果：fields为"Key: value\r\n"格式的header，length为content-length(-1表示没有)。
+ * body为缓存的内容时data不为NULL(引用计数，xnet_static_reply_clear时释放)，否则fd为打开的文件，
+ * 都从offset开始发送length字节；HEAD请求、304等没有body时data为NULL且fd为-1。
+ */
+typedef struct {
+	int code;
+	xnet_string_t fields;
+	int64_t length;
+	int64_t size;//文件大小
+	char *data;
+	int fd;
+	int64_t offset;
+} xnet_static_reply_t;
+
+typedef struct {
+	uint64_t hit;//内容缓存命中
+	uint64_t miss;
+	uint64_t stat;//stat次数
+	int64_t cache_bytes;
+	uint32_t entries;
+} xnet_static_stat_t;
+
+xnet_static_t *xnet_static_create(const xnet_static_config_t *conf);
+void xnet_static_destroy(xnet_static_t *st);
+
+/*
+ * 按请求构造响应，path为NULL时使用请求的url(去掉查询参数并解码)，返回状态码。
+ * 用完后调用xnet_static_reply_clear，会关闭没有发送的fd
+ */
+int xnet_static_lookup(xnet_static_t *st, xnet_httprequest_t *req, const char *path, uint32_t path_sz, xnet_static_reply_t *rp);
+void xnet_static_reply_clear(xnet_static_reply_t *rp);
+
+/*
+ * lookup后发送响应：响应头一个写队列节点，缓存的内容按引用入队，大文件用xnet_tcp_send_file。
+ * 请求不保持连接时添加Connection: close，由调用者关闭连接。返回状态码，-1表示socket已经无效
+ */
+int xnet_static_serve(xnet_static_t *st, xnet_context_t *ctx, int sock_id, xnet_httprequest_t *req, const char *path, uint32_t path_sz);
+void xnet_static_get_stat(xnet_static_t *st, xnet_static_stat_t *stat);
+
+#endif //_XNET_STATIC_H_
@@ -17,9 +17,18 @@ fixsize(uint32_t sz) {
 static void
 reserve(xnet_string_t *s, uint32_t add) {
 	uint32_t new_capacity;
+	char *str;
 	if (s->size + add > s->capacity) {
 		new_capacity = fixsize(s->size + add);
-		s->str = realloc(s->str, new_capacity);
+		if (s->capacity == 0 && s->str) {
+			//view，复制后再修改
+			str = malloc(new_capacity);
+			assert(str);
+			memcpy(str, s->str, s->size);
+			s->str = str;
+		} else {
+			s->str = realloc(s->str, new_capacity);
+		}
 		s->capacity = new_capacity;
 	}
 }
@@ -31,7 +40,7 @@ xnet_string_init(xnet_string_t *s) {
 
 inline void
 xnet_string_clear(xnet_string_t *s) {
-	if (s->str) {
+	if (s->str && s->capacity) {
 		free(s->str);
 		s->str = NULL;
 	}
@@ -56,12 +65,14 @@ xnet_string_create_link() {
 
 void
 xnet_string_destroy(xnet_string_t *s) {
-	if (s->str) free(s->str);
+	if (s->str && s->capacity) free(s->str);
 	free(s);
 }
 
 void
 xnet_string_set(xnet_string_t *s, const char *cs, uint32_t cs_size) {
+	if (s->capacity == 0)
+		s->str = NULL;
 	if (s->capacity < cs_size) {
 		s->str = realloc(s->str, cs_size);
 		s->capacity = cs_size;
@@ -78,9 +89,14 @@ xnet_string_set_cs(xnet_string_t *s, const char *cs) {
 
 void
 xnet_string_raw_set(xnet_string_t *s, char *cs, uint32_t cs_size) {
-	if (s->str)
+	if (s->str && s->capacity)
 		free(s->str);
 
+	//capacity为0会被当作view，空串直接释放
+	if (cs_size == 0) {
+		free(cs);
+		cs = NULL;
+	}
 	s->str = cs;
 	s->capacity = s->size = cs_size;
 }
@@ -90,6 +106,17 @@ xnet_string_raw_set_cs(xnet_string_t *s, char *cs) {
 	xnet_string_raw_set(s, cs, strlen(cs));
 }
 
+//引用cs指向的内存，调用者保证在使用期间有效
+void
+xnet_string_view(xnet_string_t *s, const char *cs, uint32_t cs_size) {
+	if (s->str && s->capacity)
+		free(s->str);
+
+	s->str = (char *)cs;
+	s->size = cs_size;
+	s->capacity = 0;
+}
+
 inline char *
 xnet_string_get_str(xnet_string_t *s) {
 	if (s->size == 0) return "";
@@ -130,22 +157,35 @@ xnet_string_append_cs(xnet_string_t *s, char *cs) {
 	s->size += len;
 }
 
+void
+xnet_string_append_buff(xnet_string_t *s, const char *buff, uint32_t sz) {
+	if (sz == 0) return;
+	reserve(s, sz);
+	memcpy(s->str + s->size, buff, sz);
+	s->size += sz;
+}
+
 void
 xnet_string_add(xnet_string_t *s, char c) {
 	reserve(s, 1);
 	s->str[s->size++] = c;
 }
 
+//按长度比较，不需要在末尾填充'\0'(view也不会被复制)
 int
 xnet_string_compare_cs(xnet_string_t *s, const char *cs) {
-	char *str = xnet_string_get_c_str(s);
-	return strcmp(str, cs);
+	uint32_t len = strlen(cs);
+	int ret = memcmp(xnet_string_get_str(s), cs, s->size < len ? s->size : len);
+	if (ret != 0) return ret;
+	return (s->size > len) - (s->size < len);
 }
 
 int
 xnet_string_casecompare_cs(xnet_string_t *s, const char *cs) {
-	char *str = xnet_string_get_c_str(s);
-	return strcasecmp(str, cs);
+	uint32_t len = strlen(cs);
+	int ret = strncasecmp(xnet_string_get_str(s), cs, s->size < len ? s->size : len);
+	if (ret != 0) return ret;
+	return (s->size > len) - (s->size < len);
 }
 
 int
@@ -5,12 +5,13 @@
 
 /*
  * 注意，这是非‘\0’结尾的字符串
+ * capacity为0而str不为空时表示引用外部内存(view)，不负责释放，修改前会先复制一份
  */
 
 typedef struct {
 	char *str;
 	uint32_t size;
-	uint32_t capacity;
+	uint32_t capacity;//0:未分配或者view
 	char next[0];
 } xnet_string_t;
 
@@ -23,11 +24,13 @@ void xnet_string_set(xnet_string_t *s, const char *cs, uint32_t cs_size);
 void xnet_string_set_cs(xnet_string_t *s, const char *cs);
 void xnet_string_raw_set(xnet_string_t *s, char *cs, uint32_t cs_size);
 void xnet_string_raw_set_cs(xnet_string_t *s, char *cs);
+void xnet_string_view(xnet_string_t *s, const char *cs, uint32_t cs_size);
 char *xnet_string_get_str(xnet_string_t *s);
 char *xnet_string_get_c_str(xnet_string_t *s);
 uint32_t xnet_string_get_size(xnet_string_t *s);
 void xnet_string_append(xnet_string_t *as, xnet_string_t *bs);
 void xnet_string_append_cs(xnet_string_t *s, char *cs);
+void xnet_string_append_buff(xnet_string_t *s, const char *buff, uint32_t sz);
 void xnet_string_add(xnet_string_t *s, char c);
 int xnet_string_compare_cs(xnet_string_t *s, const char *cs);
 int xnet_string_casecompare_cs(xnet_string_t *s, const char *cs);
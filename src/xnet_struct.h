@@ -9,12 +9,23 @@
 
 struct xnet_context_t;
 
+//error_func的what参数
+#define XNET_ERROR_CLOSE 0
+#define XNET_ERROR_POLL 1
+#define XNET_ERROR_EOF 2
+#define XNET_ERROR_WB_OVERFLOW 3//写队列超过硬上限
+#define XNET_ERROR_READ_TIMEOUT 4//读超时
+#define XNET_ERROR_WRITE_TIMEOUT 5//写超时
+#define XNET_ERROR_LIFE_TIMEOUT 6//连接存活时间到期
+
 typedef void (*xnet_connect_func_t)(struct xnet_context_t *ctx, int sock_id, int error);
 typedef void (*xnet_listen_func_t)(struct xnet_context_t *ctx, int sock_id, int acc_sock_id);
 //recv_func返回0表示自动释放，返回其他值表示接管buffer，自行释放
 typedef int (*xnet_recv_func_t)(struct xnet_context_t *ctx, int sock_id, char *buffer, int size, xnet_addr_t *addr_info);
 typedef void (*xnet_error_func_t)(struct xnet_context_t *ctx, int sock_id, short what);
 typedef void (*xnet_timeout_func_t)(struct xnet_context_t *ctx, int id);
+//写队列超过高水位时writable为false，回落到低水位时writable为true
+typedef void (*xnet_drain_func_t)(struct xnet_context_t *ctx, int sock_id, bool writable);
 //返回0表示自动释放，返回其他值表示接管data，自行释放
 typedef int (*xnet_command_func_t)(struct xnet_context_t *ctx, struct xnet_context_t *source, int command, void *data, int sz);
 
@@ -23,7 +34,20 @@ typedef struct xnet_context_t {
 	bool to_quit;
 	xnet_poll_t poll;
 	xnet_timeheap_t th;
-	uint64_t nowtime;
+	uint64_t nowtime;//单调时钟缓存，毫秒
+	uint64_t nowtime_us;//单调时钟缓存，微秒
+
+	//每个socket每轮循环的读取预算，都为0表示每次可读事件只recv一次
+	int read_budget;//字节
+	int read_msg_budget;//recv次数
+	uint32_t loop_round;//循环轮次，每轮poll一次
+	//水位变化待通知drain_func的socket，本轮事件处理完后统一回调
+	int *drain_ids;
+	int drain_n;
+	int drain_cap;
+	//连接超时检查时的临时列表
+	int *due_ids;
+	int due_cap;
 
 	xnet_listen_func_t listen_func;
 	xnet_recv_func_t recv_func;
@@ -31,6 +55,7 @@ typedef struct xnet_context_t {
 	xnet_connect_func_t connect_func;
 	xnet_timeout_func_t timeout_func;
 	xnet_command_func_t command_func;
+	xnet_drain_func_t drain_func;
 
 	void *user_ptr;
 } xnet_context_t;
@@ -6,7 +6,7 @@
 
 typedef struct {
 	int id;
-	uint64_t expire;
+	uint64_t expire;//单调时钟，微秒
 } xnet_timeinfo_t;
 
 typedef struct {
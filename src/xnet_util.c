@@ -33,20 +33,39 @@ util_gettimeofday(struct timeval *tv, struct timezone *tz) {
 #endif
 
 
+#if defined(XNET_COARSE_CLOCK) && defined(CLOCK_MONOTONIC_COARSE)
+	#define XNET_CLOCK_ID CLOCK_MONOTONIC_COARSE
+#else
+	#define XNET_CLOCK_ID CLOCK_MONOTONIC
+#endif
+
+uint64_t
+get_time_us() {
+#ifdef _WIN32
+	static LARGE_INTEGER freq = {0};
+	LARGE_INTEGER counter;
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&counter);
+	return (uint64_t)(counter.QuadPart / freq.QuadPart) * 1000000 +
+		(uint64_t)(counter.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+#else
+	struct timespec ti;
+	clock_gettime(XNET_CLOCK_ID, &ti);
+	return (uint64_t)ti.tv_sec * 1000000 + (uint64_t)ti.tv_nsec / 1000;
+#endif
+}
+
 uint64_t
 get_time() {
-// #ifdef _WIN32
-    struct timeval tv;
-    util_gettimeofday(&tv, NULL);
-    return (uint64_t)(tv.tv_sec) * 1000 + (uint64_t)(tv.tv_usec) / 1000;
-// #else
-//     uint64_t t;
-// 	struct timespec ti;
-// 	clock_gettime(CLOCK_MONOTONIC, &ti);
-// 	t = (uint64_t)ti.tv_sec * 1000;
-// 	t += ti.tv_nsec / 1000000;
-// 	return t;
-// #endif
+	return get_time_us() / 1000;
+}
+
+uint64_t
+get_wall_time() {
+	struct timeval tv;
+	util_gettimeofday(&tv, NULL);
+	return (uint64_t)(tv.tv_sec) * 1000 + (uint64_t)(tv.tv_usec) / 1000;
 }
 
 #ifdef _WIN32
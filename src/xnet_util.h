@@ -6,14 +6,36 @@
 
 #ifdef _WIN32
 	#include <Windows.h>
+	#include <io.h>
 
 	int util_gettimeofday(struct timeval *tv, struct timezone *tz);
+	//文件和字符串相关的平台差异，util_gmtime和gmtime_r一样失败时返回NULL
+	#define util_gmtime(t, tm) (gmtime_s((tm), (t)) == 0 ? (tm) : NULL)
+	#define util_strncasecmp _strnicmp
+	#define util_open _open
+	#define util_read _read
+	#define util_close _close
 #else
 	#include <sys/time.h>
+	#include <unistd.h>
+	#include <fcntl.h>
+	#include <strings.h>
 	#define util_gettimeofday gettimeofday
+	#define util_gmtime gmtime_r
+	#define util_strncasecmp strncasecmp
+	#define util_open open
+	#define util_read read
+	#define util_close close
 #endif
 
+/*
+ * get_time/get_time_us使用单调时钟，用于定时器和计时，不受系统时间调整影响；
+ * 定义XNET_COARSE_CLOCK时使用CLOCK_MONOTONIC_COARSE，精度较低但开销更小。
+ * get_wall_time返回unix时间(毫秒)，用于日志等需要真实时间的地方。
+ */
 uint64_t get_time();
+uint64_t get_time_us();
+uint64_t get_wall_time();
 void timestring(uint64_t time, char *out, int size);
 
 int xnet_vsnprintf(char *buf, size_t buflen, const char *format, va_list ap);
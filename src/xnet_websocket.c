@@ -0,0 +1,552 @@
+#include "xnet_websocket.h"
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+#include <strings.h>
+
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(XNET_HTTP_NO_SIMD)
+#define XNET_WS_SIMD
+#include <immintrin.h>
+#endif
+
+/*sha1 只用于计算握手的accept key*/
+typedef struct {
+	uint32_t h[5];
+	uint64_t len;
+	uint8_t block[64];
+	uint32_t n;
+} sha1_ctx_t;
+
+#define ROL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void
+sha1_block(sha1_ctx_t *c, const uint8_t *p) {
+	uint32_t w[80], a, b, d, e, f, k, t, cc;
+	int i;
+	for (i=0; i<16; i++)
+		w[i] = (uint32_t)p[i*4] << 24 | (uint32_t)p[i*4+1] << 16 | (uint32_t)p[i*4+2] << 8 | p[i*4+3];
+	for (; i<80; i++)
+		w[i] = ROL32(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+	a = c->h[0]; b = c->h[1]; cc = c->h[2]; d = c->h[3]; e = c->h[4];
+	for (i=0; i<80; i++) {
+		if (i < 20) {
+			f = (b & cc) | (~b & d);
+			k = 0x5A827999;
+		} else if (i < 40) {
+			f = b ^ cc ^ d;
+			k = 0x6ED9EBA1;
+		} else if (i < 60) {
+			f = (b & cc) | (b & d) | (cc & d);
+			k = 0x8F1BBCDC;
+		} else {
+			f = b ^ cc ^ d;
+			k = 0xCA62C1D6;
+		}
+		t = ROL32(a, 5) + f + e + k + w[i];
+		e = d; d = cc; cc = ROL32(b, 30); b = a; a = t;
+	}
+	c->h[0] += a; c->h[1] += b; c->h[2] += cc; c->h[3] += d; c->h[4] += e;
+}
+
+static void
+sha1_init(sha1_ctx_t *c) {
+	c->h[0] = 0x67452301;
+	c->h[1] = 0xEFCDAB89;
+	c->h[2] = 0x98BADCFE;
+	c->h[3] = 0x10325476;
+	c->h[4] = 0xC3D2E1F0;
+	c->len = 0;
+	c->n = 0;
+}
+
+static void
+sha1_update(sha1_ctx_t *c, const uint8_t *p, uint32_t sz) {
+	uint32_t n;
+	c->len += sz;
+	while (sz > 0) {
+		n = 64 - c->n;
+		if (n > sz) n = sz;
+		memcpy(c->block + c->n, p, n);
+		c->n += n;
+		p += n;
+		sz -= n;
+		if (c->n == 64) {
+			sha1_block(c, c->block);
+			c->n = 0;
+		}
+	}
+}
+
+static void
+sha1_final(sha1_ctx_t *c, uint8_t out[20]) {
+	uint64_t bits = c->len * 8;
+	uint8_t pad = 0x80, zero = 0, len[8];
+	int i;
+	sha1_update(c, &pad, 1);
+	while (c->n != 56)
+		sha1_update(c, &zero, 1);
+	for (i=0; i<8; i++)
+		len[i] = (uint8_t)(bits >> (56 - i*8));
+	sha1_update(c, len, 8);
+	for (i=0; i<20; i++)
+		out[i] = (uint8_t)(c->h[i/4] >> (24 - (i%4)*8));
+}
+
+static int
+base64_encode(const uint8_t *p, uint32_t sz, char *out) {
+	static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	uint32_t i, v;
+	int n = 0;
+	for (i=0; i+2<sz; i+=3) {
+		v = (uint32_t)p[i] << 16 | (uint32_t)p[i+1] << 8 | p[i+2];
+		out[n++] = table[v >> 18];
+		out[n++] = table[(v >> 12) & 0x3F];
+		out[n++] = table[(v >> 6) & 0x3F];
+		out[n++] = table[v & 0x3F];
+	}
+	if (i < sz) {
+		v = (uint32_t)p[i] << 16;
+		if (i + 1 < sz) v |= (uint32_t)p[i+1] << 8;
+		out[n++] = table[v >> 18];
+		out[n++] = table[(v >> 12) & 0x3F];
+		out[n++] = (i + 1 < sz) ? table[(v >> 6) & 0x3F] : '=';
+		out[n++] = '=';
+	}
+	out[n] = '\0';
+	return n;
+}
+
+int
+xnet_websocket_accept_key(const char *key, uint32_t sz, char *out) {
+	sha1_ctx_t c;
+	uint8_t digest[20];
+	sha1_init(&c);
+	sha1_update(&c, (const uint8_t *)key, sz);
+	sha1_update(&c, (const uint8_t *)WS_GUID, sizeof(WS_GUID)-1);
+	sha1_final(&c, digest);
+	return base64_encode(digest, 20, out);
+}
+
+//逗号分隔的值中是否有token(不区分大小写)
+static bool
+header_has_token(xnet_httpheader_t *header, const char *token) {
+	const char *p, *q, *end;
+	uint32_t len = strlen(token);
+	if (!header) return false;
+	p = xnet_string_get_str(&header->value);
+	end = p + xnet_string_get_size(&header->value);
+	while (p < end) {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) p++;
+		for (q=p; q<end && *q != ','; q++);
+		while (q > p && (q[-1] == ' ' || q[-1] == '\t')) q--;
+		if ((uint32_t)(q - p) == len && strncasecmp(p, token, len) == 0) return true;
+		while (p < end && *p != ',') p++;
+	}
+	return false;
+}
+
+int
+xnet_pack_websocket_handshake(xnet_httprequest_t *req, const char *protocol, xnet_string_t *out) {
+	xnet_httpheader_t *key, *version;
+	char accept[32];
+	char fields[256];
+	int n;
+
+	if (req->code != 200 || xnet_string_compare_cs(&req->method, "GET") != 0) return -1;
+	if (!header_has_token(xnet_get_http_header(req, XNET_HTTP_H_UPGRADE), "websocket") ||
+		!header_has_token(xnet_get_http_header(req, XNET_HTTP_H_CONNECTION), "upgrade"))
+		return -1;
+	version = xnet_get_http_header(req, XNET_HTTP_H_SEC_WEBSOCKET_VERSION);
+	if (!version || xnet_string_compare_cs(&version->value, "13") != 0) return -1;
+	//key是16字节随机数的base64
+	key = xnet_get_http_header(req, XNET_HTTP_H_SEC_WEBSOCKET_KEY);
+	if (!key || xnet_string_get_size(&key->value) != 24) return -1;
+	if (protocol && strlen(protocol) > 128) return -1;
+
+	xnet_websocket_accept_key(xnet_string_get_str(&key->value), 24, accept);
+	n = snprintf(fields, sizeof(fields), "Upgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n", accept);
+	if (protocol)
+		n += snprintf(fields + n, sizeof(fields) - n, "Sec-WebSocket-Protocol: %s\r\n", protocol);
+	xnet_pack_http_head(101, fields, n, -1, out);
+	return 0;
+}
+
+/*掩码：每次处理8/16/32字节，mask先按offset旋转好*/
+typedef void (*mask_func_t)(char *dst, const char *src, uint32_t sz, uint32_t m);
+
+static void
+mask_scalar(char *dst, const char *src, uint32_t sz, uint32_t m) {
+	uint64_t m64 = (uint64_t)m << 32 | m;
+	uint64_t v;
+	uint32_t i;
+	for (i=0; i+8<=sz; i+=8) {
+		memcpy(&v, src + i, 8);
+		v ^= m64;
+		memcpy(dst + i, &v, 8);
+	}
+	for (; i<sz; i++)
+		dst[i] = src[i] ^ ((const char *)&m)[i & 3];
+}
+
+#ifdef XNET_WS_SIMD
+__attribute__((target("sse2")))
+static void
+mask_sse2(char *dst, const char *src, uint32_t sz, uint32_t m) {
+	__m128i vm = _mm_set1_epi32((int)m);
+	uint32_t i;
+	for (i=0; i+16<=sz; i+=16)
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(_mm_loadu_si128((const __m128i *)(src + i)), vm));
+	mask_scalar(dst + i, src + i, sz - i, m);
+}
+
+__attribute__((target("avx2")))
+static void
+mask_avx2(char *dst, const char *src, uint32_t sz, uint32_t m) {
+	__m256i vm = _mm256_set1_epi32((int)m);
+	uint32_t i;
+	for (i=0; i+64<=sz; i+=64) {
+		_mm256_storeu_si256((__m256i *)(dst + i),
+			_mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(src + i)), vm));
+		_mm256_storeu_si256((__m256i *)(dst + i + 32),
+			_mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(src + i + 32)), vm));
+	}
+	for (; i+32<=sz; i+=32)
+		_mm256_storeu_si256((__m256i *)(dst + i),
+			_mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(src + i)), vm));
+	mask_sse2(dst + i, src + i, sz - i, m);
+}
+#endif
+
+static mask_func_t g_mask_func = NULL;
+
+int
+xnet_websocket_set_simd(int level) {
+#ifdef XNET_WS_SIMD
+	__builtin_cpu_init();
+	if (level >= XNET_SIMD_AVX2 && __builtin_cpu_supports("avx2")) {
+		g_mask_func = mask_avx2;
+		return XNET_SIMD_AVX2;
+	}
+	if (level >= XNET_SIMD_SSE42 && __builtin_cpu_supports("sse2")) {
+		g_mask_func = mask_sse2;
+		return XNET_SIMD_SSE42;
+	}
+#endif
+	g_mask_func = mask_scalar;
+	return XNET_SIMD_NONE;
+}
+
+void
+xnet_websocket_mask(char *dst, const char *src, uint32_t sz, const uint8_t *mask, uint32_t offset) {
+	uint8_t r[4];
+	uint32_t m;
+	int i;
+	if (!g_mask_func) xnet_websocket_set_simd(XNET_SIMD_AVX2);
+	for (i=0; i<4; i++)
+		r[i] = mask[(offset + i) & 3];
+	memcpy(&m, r, 4);
+	g_mask_func(dst, src, sz, m);
+}
+
+/*解包*/
+static void
+ws_error(xnet_unpacker_t *up, xnet_websocket_t *ws, uint16_t code) {
+	ws->error = code;
+	ws->opcode = XNET_WS_CLOSE;
+	ws->close_code = code;
+	ws->data = NULL;
+	ws->size = 0;
+	ws->control_ready = true;
+	up->full = true;
+	up->close = true;
+}
+
+//检查是否是合法的UTF-8，拒绝超长编码、代理区和超过U+10FFFF的码点
+static bool
+ws_valid_utf8(const char *str, uint32_t sz) {
+	const uint8_t *p = (const uint8_t *)str;
+	const uint8_t *end = p + sz;
+	uint8_t c, lo, hi;
+	int n;
+	while (p < end) {
+		c = *p++;
+		if (c < 0x80) continue;
+		lo = 0x80; hi = 0xBF;
+		if (c >= 0xC2 && c <= 0xDF) n = 1;
+		else if (c >= 0xE0 && c <= 0xEF) {
+			n = 2;
+			if (c == 0xE0) lo = 0xA0;
+			else if (c == 0xED) hi = 0x9F;
+		} else if (c >= 0xF0 && c <= 0xF4) {
+			n = 3;
+			if (c == 0xF0) lo = 0x90;
+			else if (c == 0xF4) hi = 0x8F;
+		} else
+			return false;
+		if (end - p < n || *p < lo || *p > hi) return false;
+		p++;
+		for (n--; n > 0; n--, p++)
+			if ((*p & 0xC0) != 0x80) return false;
+	}
+	return true;
+}
+
+//收到的close状态码是否可以出现在帧中(RFC 6455 7.4)
+static bool
+ws_valid_close_code(uint16_t code) {
+	if (code >= 1000 && code <= 1011)
+		return code != 1004 && code != 1005 && code != 1006;
+	return code >= 3000 && code <= 4999;
+}
+
+//第二个字节到达后确定帧头长度
+static uint8_t
+ws_header_size(xnet_websocket_t *ws) {
+	uint8_t len = ws->header[1] & 0x7F;
+	uint8_t n = 2;
+	if (len == 126) n += 2;
+	else if (len == 127) n += 8;
+	if (ws->header[1] & 0x80) n += 4;
+	return n;
+}
+
+//帧头接收完成，检查后进入payload，返回-1表示出错
+static int
+ws_frame_begin(xnet_unpacker_t *up, xnet_websocket_t *ws) {
+	uint8_t *h = ws->header;
+	uint8_t opcode = h[0] & 0x0F;
+	uint8_t len = h[1] & 0x7F;
+	bool fin = (h[0] & 0x80) != 0;
+	uint64_t frame_len = len;
+	int i, p = 2;
+
+	ws->masked = (h[1] & 0x80) != 0;
+	//没有协商扩展，rsv必须为0；客户端发来的帧必须有掩码，服务端的帧不能有
+	if ((h[0] & 0x70) || ws->masked == ws->client) {
+		ws_error(up, ws, XNET_WS_CLOSE_PROTOCOL);
+		return -1;
+	}
+	if (len == 126) {
+		frame_len = (uint64_t)h[2] << 8 | h[3];
+		p = 4;
+	} else if (len == 127) {
+		frame_len = 0;
+		for (i=0; i<8; i++)
+			frame_len = frame_len << 8 | h[2+i];
+		p = 10;
+		if (frame_len >> 63) {
+			ws_error(up, ws, XNET_WS_CLOSE_PROTOCOL);
+			return -1;
+		}
+	}
+	if (ws->masked) memcpy(ws->mask, h + p, 4);
+
+	if (opcode & 0x08) {
+		//控制帧不能分片，最长125字节
+		if (opcode > XNET_WS_PONG || !fin || frame_len > XNET_WS_CONTROL_MAX) {
+			ws_error(up, ws, XNET_WS_CLOSE_PROTOCOL);
+			return -1;
+		}
+	} else {
+		if (opcode == XNET_WS_CONTINUATION) {
+			if (!ws->in_message) {
+				ws_error(up, ws, XNET_WS_CLOSE_PROTOCOL);
+				return -1;
+			}
+		} else if (opcode > XNET_WS_BINARY || ws->in_message) {
+			ws_error(up, ws, XNET_WS_CLOSE_PROTOCOL);
+			return -1;
+		} else {
+			ws->in_message = true;
+			ws->message_opcode = opcode;
+			ws->message.size = 0;
+		}
+		if (frame_len > UINT32_MAX - ws->message.size ||
+			(up->limit != 0 && ws->message.size + frame_len > up->limit)) {
+			ws_error(up, ws, XNET_WS_CLOSE_TOO_BIG);
+			return -1;
+		}
+	}
+	ws->frame_opcode = opcode;
+	ws->frame_len = frame_len;
+	ws->frame_recv = 0;
+	return 0;
+}
+
+//一帧结束，返回1表示有消息需要回调
+static int
+ws_frame_end(xnet_unpacker_t *up, xnet_websocket_t *ws) {
+	bool fin = (ws->header[0] & 0x80) != 0;
+	ws->header_len = ws->header_need = 0;
+
+	if (ws->frame_opcode & 0x08) {
+		ws->opcode = ws->frame_opcode;
+		ws->data = ws->control;
+		ws->size = (uint32_t)ws->frame_len;
+		if (ws->opcode == XNET_WS_CLOSE) {
+			if (ws->size == 1) {
+				ws_error(up, ws, XNET_WS_CLOSE_PROTOCOL);
+				return 1;
+			}
+			if (ws->size >= 2) {
+				ws->close_code = (uint16_t)((uint8_t)ws->control[0] << 8 | (uint8_t)ws->control[1]);
+				if (!ws_valid_close_code(ws->close_code)) {
+					ws_error(up, ws, XNET_WS_CLOSE_PROTOCOL);
+					return 1;
+				}
+				if (!ws_valid_utf8(ws->control + 2, ws->size - 2)) {
+					ws_error(up, ws, XNET_WS_CLOSE_INVALID_DATA);
+					return 1;
+				}
+			}
+		}
+		ws->control_ready = true;
+		up->full = true;
+		return 1;
+	}
+	if (!fin) return 0;
+	if (ws->message_opcode == XNET_WS_TEXT &&
+		!ws_valid_utf8(xnet_string_get_str(&ws->message), xnet_string_get_size(&ws->message))) {
+		ws_error(up, ws, XNET_WS_CLOSE_INVALID_DATA);
+		return 1;
+	}
+	ws->opcode = ws->message_opcode;
+	ws->data = xnet_string_get_str(&ws->message);
+	ws->size = xnet_string_get_size(&ws->message);
+	ws->in_message = false;
+	ws->control_ready = false;
+	up->full = true;
+	return 1;
+}
+
+//消息缓存按倍数增长，不按帧头声明的长度一次分配
+static char *
+ws_reserve(xnet_websocket_t *ws, uint32_t n) {
+	xnet_string_t *s = &ws->message;
+	uint32_t cap;
+	if (s->size + n > s->capacity) {
+		cap = s->capacity ? s->capacity : 256;
+		while (cap < s->size + n)
+			cap = (cap > UINT32_MAX / 2) ? s->size + n : cap * 2;
+		s->str = realloc(s->str, cap);
+		assert(s->str);
+		s->capacity = cap;
+	}
+	return s->str + s->size;
+}
+
+uint32_t
+xnet_unpack_websocket(xnet_unpacker_t *up, const char *buffer, uint32_t sz) {
+	xnet_websocket_t *ws = (xnet_websocket_t *)up->arg;
+	uint32_t used = 0, n;
+	uint64_t left;
+	char *dst;
+
+	//出错后已经回调过close，剩余数据丢弃
+	if (ws->error) return sz;
+
+	while (used < sz) {
+		if (ws->header_need == 0 || ws->header_len < ws->header_need) {
+			if (ws->header_need == 0) ws->header_need = 2;
+			n = ws->header_need - ws->header_len;
+			if (n > sz - used) n = sz - used;
+			memcpy(ws->header + ws->header_len, buffer + used, n);
+			ws->header_len += n;
+			used += n;
+			if (ws->header_len < ws->header_need) break;
+			if (ws->header_len == 2) {
+				ws->header_need = ws_header_size(ws);
+				if (ws->header_need > 2) continue;
+			}
+			if (ws_frame_begin(up, ws) != 0) return used;
+			if (ws->frame_len == 0) {
+				if (ws_frame_end(up, ws)) return used;
+				continue;
+			}
+		}
+
+		left = ws->frame_len - ws->frame_recv;
+		n = (left < sz - used) ? (uint32_t)left : sz - used;
+		if (ws->frame_opcode & 0x08)
+			dst = ws->control + ws->frame_recv;
+		else
+			dst = ws_reserve(ws, n);
+		//复制的同时去掉掩码
+		if (ws->masked)
+			xnet_websocket_mask(dst, buffer + used, n, ws->mask, (uint32_t)(ws->frame_recv & 3));
+		else
+			memcpy(dst, buffer + used, n);
+		if (!(ws->frame_opcode & 0x08))
+			ws->message.size += n;
+		ws->frame_recv += n;
+		used += n;
+		if (ws->frame_recv == ws->frame_len && ws_frame_end(up, ws))
+			return used;
+	}
+	return used;
+}
+
+//回调后重置，控制帧不影响正在合并的分片消息
+void
+xnet_clear_websocket(void *arg) {
+	xnet_websocket_t *ws = (xnet_websocket_t *)arg;
+	if (ws->control_ready)
+		ws->control_ready = false;
+	else if (!ws->in_message)
+		ws->message.size = 0;
+	ws->opcode = 0;
+	ws->data = NULL;
+	ws->size = 0;
+	ws->close_code = 0;
+}
+
+void
+xnet_free_websocket(void *arg) {
+	xnet_websocket_t *ws = (xnet_websocket_t *)arg;
+	xnet_string_clear(&ws->message);
+	memset(ws, 0, sizeof(*ws));
+}
+
+/*封包*/
+int
+xnet_pack_websocket_header(uint8_t opcode, bool fin, uint64_t len, const uint8_t *mask, char *out) {
+	uint8_t *p = (uint8_t *)out;
+	uint8_t mb = mask ? 0x80 : 0;
+	int i, n = 2;
+
+	p[0] = (fin ? 0x80 : 0) | (opcode & 0x0F);
+	if (len < 126) {
+		p[1] = mb | (uint8_t)len;
+	} else if (len <= 0xFFFF) {
+		p[1] = mb | 126;
+		p[2] = (uint8_t)(len >> 8);
+		p[3] = (uint8_t)len;
+		n = 4;
+	} else {
+		p[1] = mb | 127;
+		for (i=0; i<8; i++)
+			p[2+i] = (uint8_t)(len >> (56 - i*8));
+		n = 10;
+	}
+	if (mask) {
+		memcpy(p + n, mask, 4);
+		n += 4;
+	}
+	return n;
+}
+
+void
+xnet_pack_websocket(uint8_t opcode, const char *data, uint32_t sz, const uint8_t *mask, xnet_string_t *out) {
+	char header[XNET_WS_HEADER_MAX];
+	uint32_t start;
+	int n = xnet_pack_websocket_header(opcode, true, sz, mask, header);
+	xnet_string_append_buff(out, header, n);
+	if (sz == 0) return;
+	start = xnet_string_get_size(out);
+	xnet_string_append_buff(out, data, sz);
+	if (mask)
+		xnet_websocket_mask(out->str + start, out->str + start, sz, mask, 0);
+}
@@ -0,0 +1,85 @@
+#ifndef _XNET_WEBSOCKET_H_
+#define _XNET_WEBSOCKET_H_
+#include "xnet_packer.h"
+
+/*websocket(RFC 6455) 握手、帧解包和封包*/
+#define XNET_WS_CONTINUATION 0x0
+#define XNET_WS_TEXT 0x1
+#define XNET_WS_BINARY 0x2
+#define XNET_WS_CLOSE 0x8
+#define XNET_WS_PING 0x9
+#define XNET_WS_PONG 0xA
+
+#define XNET_WS_HEADER_MAX 14
+#define XNET_WS_CONTROL_MAX 125
+
+//关闭状态码
+#define XNET_WS_CLOSE_NORMAL 1000
+#define XNET_WS_CLOSE_PROTOCOL 1002
+#define XNET_WS_CLOSE_INVALID_DATA 1007
+#define XNET_WS_CLOSE_TOO_BIG 1009
+
+/*
+ * 回调时opcode为消息类型，data/size为消息内容(分片已合并，掩码已去除)，
+ * 控制帧(ping/pong/close)可以穿插在分片消息之间，单独回调，不影响正在合并的消息。
+ * 格式错误时以opcode为XNET_WS_CLOSE、error为建议回复的状态码回调一次，之后的数据全部丢弃。
+ * up->limit限制消息大小(0表示不限制)，超出时error为XNET_WS_CLOSE_TOO_BIG。
+ * 文本消息和close帧的原因不是合法UTF-8时error为XNET_WS_CLOSE_INVALID_DATA，
+ * close帧的状态码是保留值或未定义时error为XNET_WS_CLOSE_PROTOCOL。
+ */
+typedef struct {
+	uint8_t opcode;
+	const char *data;
+	uint32_t size;
+	uint16_t close_code;//close帧中的状态码，没有时为0
+	uint16_t error;
+	bool client;//作为客户端解析服务端的帧，不要求掩码；创建后设置
+	//以下为解析状态
+	bool in_message;//正在接收分片消息
+	bool control_ready;//本次回调的是控制帧
+	uint8_t message_opcode;
+	uint8_t frame_opcode;
+	uint8_t header_len;
+	uint8_t header_need;
+	uint8_t header[XNET_WS_HEADER_MAX];
+	uint8_t mask[4];
+	bool masked;
+	uint64_t frame_len;
+	uint64_t frame_recv;
+	xnet_string_t message;
+	char control[XNET_WS_CONTROL_MAX];
+} xnet_websocket_t;
+
+/*
+ * up = xnet_unpacker_new(sizeof(xnet_websocket_t), cb, xnet_unpack_websocket, xnet_clear_websocket, limit);
+ * up->fm = xnet_free_websocket;
+ */
+uint32_t xnet_unpack_websocket(xnet_unpacker_t *up, const char *buffer, uint32_t sz);
+void xnet_clear_websocket(void *arg);
+void xnet_free_websocket(void *arg);
+
+/*
+ * 握手：检查Upgrade请求(GET、Upgrade: websocket、Connection: upgrade、版本13、key)，
+ * 成功时把101响应写入out返回0，失败返回-1；protocol为选中的子协议，可以为NULL
+ */
+int xnet_pack_websocket_handshake(xnet_httprequest_t *req, const char *protocol, xnet_string_t *out);
+//由Sec-WebSocket-Key计算Sec-WebSocket-Accept，out需要29字节，返回长度28
+int xnet_websocket_accept_key(const char *key, uint32_t sz, char *out);
+
+/*
+ * 封包：帧头写入out(最多XNET_WS_HEADER_MAX字节)返回长度，payload由调用者放在后面发送，
+ * 服务端发送的帧不加掩码(mask为NULL)，payload可以直接引用不复制
+ */
+int xnet_pack_websocket_header(uint8_t opcode, bool fin, uint64_t len, const uint8_t *mask, char *out);
+//帧头和payload一起写入out，mask不为NULL时对payload加掩码(客户端)
+void xnet_pack_websocket(uint8_t opcode, const char *data, uint32_t sz, const uint8_t *mask, xnet_string_t *out);
+
+/*
+ * dst = src ^ mask，offset为src第一个字节在payload中的位置，dst可以等于src。
+ * 默认按cpu支持选择SSE2/AVX2，xnet_websocket_set_simd可以指定级别(XNET_SIMD_xxx，
+ * XNET_SIMD_SSE42级别使用SSE2指令)，返回实际生效的级别。
+ */
+void xnet_websocket_mask(char *dst, const char *src, uint32_t sz, const uint8_t *mask, uint32_t offset);
+int xnet_websocket_set_simd(int level);
+
+#endif //_XNET_WEBSOCKET_H_
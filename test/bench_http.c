@@ -0,0 +1,82 @@
+#include "../src/xnet_packer.h"
+#include "../src/xnet_util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/*
+ * http请求解析性能测试：bench_http [次数]
+ * 分别在复制模式和slice模式下，依次使用标量、SSE4.2、AVX2解析同一个浏览器风格的请求，
+ * 输出MB/s和req/s
+ */
+
+static const char *g_request =
+"GET /wp-content/uploads/2010/03/hello-kitty-darth-vader-pink.jpg HTTP/1.1\r\n"
+"Host: www.kittyhell.com\r\n"
+"User-Agent: Mozilla/5.0 (Macintosh; U; Intel Mac OS X 10.6; ja-JP-mac; rv:1.9.2.3) Gecko/20100401 Firefox/3.6.3 Pathtraq/0.9\r\n"
+"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+"Accept-Language: ja,en-us;q=0.7,en;q=0.3\r\n"
+"Accept-Encoding: gzip,deflate\r\n"
+"Accept-Charset: Shift_JIS,utf-8;q=0.7,*;q=0.7\r\n"
+"Keep-Alive: 115\r\n"
+"Connection: keep-alive\r\n"
+"Cookie: wp_ozh_wsa_visits=2; wp_ozh_wsa_visit_lasttime=xxxxxxxxxx; "
+"__utma=xxxxxxxxx.xxxxxxxxxx.xxxxxxxxxx.xxxxxxxxxx.xxxxxxxxxx.x; "
+"__utmz=xxxxxxxxx.xxxxxxxxxx.x.x.utmccn=(referral)|utmcsr=reader.livedoor.com|utmcct=/reader/|utmcmd=referral\r\n"
+"\r\n";
+
+static int g_done = 0;
+
+static void
+bench_callback(xnet_unpacker_t *up, void *arg) {
+	xnet_httprequest_t *req = (xnet_httprequest_t *)arg;
+	assert(req->code == 200 && req->header_count == 9);
+	g_done++;
+}
+
+static void
+bench(int level, bool slice, int count) {
+	xnet_unpacker_t *up;
+	uint32_t len = strlen(g_request);
+	uint64_t start, cost;
+	double sec;
+	int i, real;
+
+	real = xnet_http_set_simd(level);
+	if (real != level) {
+		printf("simd level[%d] not supported, skip\n", level);
+		return;
+	}
+	if (slice) {
+		up = xnet_unpacker_new_http(bench_callback, 0);
+	} else {
+		up = xnet_unpacker_new(sizeof(xnet_httprequest_t), bench_callback, xnet_unpack_http, xnet_clear_http, 0);
+	}
+	assert(up);
+	g_done = 0;
+	start = get_time_us();
+	for (i=0; i<count; i++) {
+		xnet_unpacker_recv(up, g_request, len);
+	}
+	cost = get_time_us() - start;
+	assert(g_done == count);
+	xnet_unpacker_free(up);
+
+	sec = cost / 1000000.0;
+	printf("%s simd level[%d]: %d requests(%u bytes) in %.3fs, %.1f MB/s, %.0f req/s\n",
+		slice ? "slice" : "copy ", level, count, len, sec, (double)len * count / sec / (1024*1024), count / sec);
+}
+
+int
+main(int argc, char **argv) {
+	int count = 1000000;
+	if (argc > 1) count = atoi(argv[1]);
+	bench(XNET_SIMD_NONE, false, count);
+	bench(XNET_SIMD_SSE42, false, count);
+	bench(XNET_SIMD_AVX2, false, count);
+	bench(XNET_SIMD_NONE, true, count);
+	bench(XNET_SIMD_SSE42, true, count);
+	bench(XNET_SIMD_AVX2, true, count);
+	return 0;
+}
@@ -0,0 +1,200 @@
+#include "../src/xnet.h"
+#include "../src/xnet_packer.h"
+#include "../src/xnet_util.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * http短连接、keep-alive、pipelining的rps对比：bench_http_rps [连接数] [秒数] [pipeline深度]
+ * 服务端和客户端分别在两个线程中运行各自的context
+ */
+
+#define BENCH_PORT 18090
+#define MAX_SOCKET 65536
+
+#define MODE_CLOSE 0
+#define MODE_KEEP_ALIVE 1
+#define MODE_PIPELINE 2
+
+static const char g_req_close[] = "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n";
+static const char g_req_keep[] = "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+static const char g_rsp_close[] = "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 11\r\n\r\nhello world";
+static const char g_rsp_keep[] = "HTTP/1.1 200 OK\r\nContent-Length: 11\r\n\r\nhello world";
+
+/*server*/
+static void
+server_request(xnet_unpacker_t *up, void *arg) {
+	xnet_httprequest_t *req = (xnet_httprequest_t *)arg;
+	xnet_context_t *ctx = (xnet_context_t *)up->user_ptr;
+	int sock_id = (long)up->user_arg;
+
+	if (req->code != 200) {
+		xnet_close_socket(ctx, sock_id);
+		return;
+	}
+	if (req->keep_alive) {
+		xnet_tcp_send_buffer(ctx, sock_id, g_rsp_keep, sizeof(g_rsp_keep)-1, false);
+	} else {
+		xnet_tcp_send_buffer(ctx, sock_id, g_rsp_close, sizeof(g_rsp_close)-1, false);
+		xnet_close_socket(ctx, sock_id);
+	}
+}
+
+static void
+server_listen(xnet_context_t *ctx, int sock_id, int acc_sock_id) {
+	xnet_socket_t *ns = xnet_get_socket(ctx, acc_sock_id);
+	xnet_unpacker_t *up;
+
+	up = xnet_unpacker_new_http(server_request, 1024);
+	up->user_ptr = ctx;
+	up->user_arg = (void*)(long)acc_sock_id;
+	ns->unpacker = up;
+}
+
+static void
+server_error(xnet_context_t *ctx, int sock_id, short what) {
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	if (s->unpacker) {
+		xnet_unpacker_free(s->unpacker);
+		s->unpacker = NULL;
+	}
+}
+
+static int
+server_recv(xnet_context_t *ctx, int sock_id, char *buffer, int size, xnet_addr_t *addr_info) {
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	if (s->unpacker && xnet_unpacker_recv(s->unpacker, buffer, size) != 0)
+		xnet_close_socket(ctx, sock_id);
+	return 0;
+}
+
+static void *
+server_thread(void *arg) {
+	xnet_dispatch_loop((xnet_context_t *)arg);
+	return NULL;
+}
+
+/*client*/
+static int g_mode;
+static int g_depth;
+static int g_conn;
+static bool g_stop;
+static uint64_t g_count;
+static int g_recv[MAX_SOCKET];
+
+static void
+send_requests(xnet_context_t *ctx, int sock_id, int n) {
+	int i;
+	for (i=0; i<n; i++) {
+		if (g_mode == MODE_CLOSE)
+			xnet_tcp_send_buffer(ctx, sock_id, g_req_close, sizeof(g_req_close)-1, false);
+		else
+			xnet_tcp_send_buffer(ctx, sock_id, g_req_keep, sizeof(g_req_keep)-1, false);
+	}
+}
+
+static void
+client_connected(xnet_context_t *ctx, int sock_id, int error) {
+	if (g_stop) return;
+	if (error != 0) {
+		xnet_tcp_connect(ctx, "127.0.0.1", BENCH_PORT);
+		return;
+	}
+	g_recv[sock_id % MAX_SOCKET] = 0;
+	send_requests(ctx, sock_id, g_mode == MODE_PIPELINE ? g_depth : 1);
+}
+
+static void
+client_error(xnet_context_t *ctx, int sock_id, short what) {
+	//短连接模式下服务端回复后关闭连接，重新建立
+	if (!g_stop)
+		xnet_tcp_connect(ctx, "127.0.0.1", BENCH_PORT);
+}
+
+static int
+client_recv(xnet_context_t *ctx, int sock_id, char *buffer, int size, xnet_addr_t *addr_info) {
+	int *recv_len = &g_recv[sock_id % MAX_SOCKET];
+	int rsp_len = (g_mode == MODE_CLOSE) ? sizeof(g_rsp_close)-1 : sizeof(g_rsp_keep)-1;
+	int n;
+
+	*recv_len += size;
+	n = *recv_len / rsp_len;
+	*recv_len %= rsp_len;
+	g_count += n;
+	if (g_mode != MODE_CLOSE && n > 0 && !g_stop)
+		send_requests(ctx, sock_id, n);
+	return 0;
+}
+
+static void
+client_timeout(xnet_context_t *ctx, int id) {
+	g_stop = true;
+	xnet_exit(ctx);
+}
+
+static void
+bench(int mode, int seconds) {
+	static const char *mode_name[] = {"close", "keep-alive", "pipeline"};
+	xnet_context_t *ctx;
+	uint64_t start, cost;
+	int i;
+
+	g_mode = mode;
+	g_stop = false;
+	g_count = 0;
+	ctx = xnet_create_context();
+	xnet_register_connecter(ctx, client_connected, client_error, client_recv);
+	xnet_register_timeout(ctx, client_timeout);
+	for (i=0; i<g_conn; i++)
+		xnet_tcp_connect(ctx, "127.0.0.1", BENCH_PORT);
+	xnet_add_timer(ctx, 1, seconds * 1000);
+	start = get_time();
+	xnet_dispatch_loop(ctx);
+	cost = get_time() - start;
+	xnet_destroy_context(ctx);
+
+	if (mode == MODE_PIPELINE)
+		printf("%-10s(depth %d): %llu requests in %llums, %.0f req/s\n", mode_name[mode], g_depth,
+			(unsigned long long)g_count, (unsigned long long)cost, g_count * 1000.0 / cost);
+	else
+		printf("%-10s: %llu requests in %llums, %.0f req/s\n", mode_name[mode],
+			(unsigned long long)g_count, (unsigned long long)cost, g_count * 1000.0 / cost);
+}
+
+int
+main(int argc, char **argv) {
+	xnet_context_t *server;
+	pthread_t pid;
+	int seconds = 3;
+
+	g_conn = 50;
+	g_depth = 16;
+	if (argc > 1) g_conn = atoi(argv[1]);
+	if (argc > 2) seconds = atoi(argv[2]);
+	if (argc > 3) g_depth = atoi(argv[3]);
+
+	if (xnet_init(NULL) != 0) {
+		printf("xnet init error\n");
+		return 1;
+	}
+	server = xnet_create_context();
+	xnet_register_listener(server, server_listen, server_error, server_recv);
+	if (xnet_tcp_listen(server, "127.0.0.1", BENCH_PORT, 1024) == -1) {
+		printf("listen error\n");
+		return 1;
+	}
+	pthread_create(&pid, NULL, server_thread, server);
+
+	printf("connections:%d, seconds:%d\n", g_conn, seconds);
+	bench(MODE_CLOSE, seconds);
+	bench(MODE_KEEP_ALIVE, seconds);
+	bench(MODE_PIPELINE, seconds);
+
+	xnet_asyn_exit(server, NULL);
+	pthread_join(pid, NULL);
+	xnet_destroy_context(server);
+	xnet_deinit();
+	return 0;
+}
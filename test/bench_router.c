@@ -0,0 +1,143 @@
+#include "../src/xnet_router.h"
+#include "../src/xnet_util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * 路由查找：bench_router [路由数] [查找次数]
+ * 路由为静态、单参数、双参数、通配符四种各占1/4，请求随机命中其中一条，
+ * 和逐条按路径段比较的线性查找(每个请求做字符串比较)对比
+ */
+
+#define URL_COUNT 4096
+
+static char **g_routes;
+static int g_route_count;
+static char *g_urls[URL_COUNT];
+static long g_expect[URL_COUNT];
+
+//线性查找：按/切分后逐段比较，:匹配一段，*匹配剩下的全部
+static long
+linear_match(const char *path, uint32_t len, xnet_route_match_t *m) {
+	const char *r, *p, *pe, *re;
+	int i;
+
+	for (i=0; i<g_route_count; i++) {
+		r = g_routes[i];
+		p = path;
+		pe = path + len;
+		m->param_count = 0;
+		while (*r && p < pe) {
+			if (*r == '*') {
+				m->params[m->param_count].value = p;
+				m->params[m->param_count++].value_sz = (uint32_t)(pe - p);
+				p = pe;
+				r += strlen(r);
+				break;
+			}
+			if (*r == ':') {
+				for (re=r; *re && *re != '/'; re++);
+				m->params[m->param_count].value = p;
+				while (p < pe && *p != '/') p++;
+				m->params[m->param_count].value_sz = (uint32_t)(p - m->params[m->param_count].value);
+				m->param_count++;
+				r = re;
+				continue;
+			}
+			if (*r != *p) break;
+			r++;
+			p++;
+		}
+		if (*r == 0 && p == pe) return i + 1;
+	}
+	return 0;
+}
+
+static void
+build(int n) {
+	int i, k;
+	char buf[128];
+
+	g_routes = (char **)malloc(sizeof(char *) * n);
+	g_route_count = n;
+	for (i=0; i<n; i++) {
+		switch (i % 4) {
+		case 0: snprintf(buf, sizeof(buf), "/api/v1/res%d/list", i / 4); break;
+		case 1: snprintf(buf, sizeof(buf), "/api/v1/res%d/:id", i / 4); break;
+		case 2: snprintf(buf, sizeof(buf), "/api/v1/res%d/:id/items/:item", i / 4); break;
+		default: snprintf(buf, sizeof(buf), "/files%d/*path", i / 4); break;
+		}
+		g_routes[i] = strdup(buf);
+	}
+	srand(1);
+	for (i=0; i<URL_COUNT; i++) {
+		k = rand() % n;
+		switch (k % 4) {
+		case 0: snprintf(buf, sizeof(buf), "/api/v1/res%d/list", k / 4); break;
+		case 1: snprintf(buf, sizeof(buf), "/api/v1/res%d/%d", k / 4, rand()); break;
+		case 2: snprintf(buf, sizeof(buf), "/api/v1/res%d/%d/items/%d?full=1", k / 4, rand(), rand() % 100); break;
+		default: snprintf(buf, sizeof(buf), "/files%d/img/%d.png", k / 4, rand()); break;
+		}
+		g_urls[i] = strdup(buf);
+		g_expect[i] = k + 1;
+	}
+}
+
+int
+main(int argc, char **argv) {
+	xnet_router_t *r;
+	xnet_route_match_t m;
+	uint64_t start, cost;
+	long i, n, miss = 0, sum = 0;
+	const char *q;
+	uint32_t len;
+	int routes = 1000;
+
+	n = 10000000;
+	if (argc > 1) routes = atoi(argv[1]);
+	if (argc > 2) n = atol(argv[2]);
+	build(routes);
+
+	r = xnet_router_create();
+	for (i=0; i<routes; i++) {
+		if (xnet_router_add(r, "GET", g_routes[i], (void*)(i + 1), NULL) != 0) {
+			printf("add route error: %s\n", g_routes[i]);
+			return 1;
+		}
+	}
+
+	start = get_time_us();
+	for (i=0; i<n; i++) {
+		const char *url = g_urls[i % URL_COUNT];
+		if ((long)xnet_router_match(r, "GET", 3, url, (uint32_t)strlen(url), &m) != g_expect[i % URL_COUNT])
+			miss++;
+		sum += m.param_count;
+	}
+	cost = get_time_us() - start;
+	printf("radix  %d routes: %ld lookups in %llums, %.1f ns/lookup, %.0f lookups/s, miss:%ld\n", routes, n,
+		(unsigned long long)cost / 1000, cost * 1000.0 / n, n * 1000000.0 / cost, miss);
+
+	//线性查找慢得多，次数减少
+	n /= 100;
+	start = get_time_us();
+	for (i=0; i<n; i++) {
+		const char *url = g_urls[i % URL_COUNT];
+		q = strchr(url, '?');
+		len = q ? (uint32_t)(q - url) : (uint32_t)strlen(url);
+		if (linear_match(url, len, &m) != g_expect[i % URL_COUNT])
+			miss++;
+		sum += m.param_count;
+	}
+	cost = get_time_us() - start;
+	printf("linear %d routes: %ld lookups in %llums, %.1f ns/lookup, %.0f lookups/s, miss:%ld\n", routes, n,
+		(unsigned long long)cost / 1000, cost * 1000.0 / n, n * 1000000.0 / cost, miss);
+
+	xnet_router_destroy(r);
+	for (i=0; i<routes; i++)
+		free(g_routes[i]);
+	for (i=0; i<URL_COUNT; i++)
+		free(g_urls[i]);
+	free(g_routes);
+	return sum < 0;
+}
@@ -0,0 +1,235 @@
+#include "../src/xnet.h"
+#include "../src/xnet_packer.h"
+#include "../src/xnet_static.h"
+#include "../src/xnet_util.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/*
+ * 静态小文件的rps：bench_static [连接数] [秒数] [pipeline深度] [文件大小]
+ * 同一个文件分别按内存缓存(引用计数发送)和sendfile(max_file=1，每次打开)发送，
+ * 服务端和客户端分别在两个线程中运行各自的context，客户端用响应解包器计数
+ */
+
+#define BENCH_PORT 18092
+#define NOCACHE_PORT 18093
+
+static const char g_req[] = "GET /bench.html HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+
+/*server*/
+static xnet_static_t *g_cached;
+static xnet_static_t *g_nocache;
+static int g_cached_listen;
+
+static void
+server_request(xnet_unpacker_t *up, void *arg) {
+	xnet_httprequest_t *req = (xnet_httprequest_t *)arg;
+	xnet_context_t *ctx = (xnet_context_t *)up->user_ptr;
+	int sock_id = (long)up->user_arg;
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+
+	if (req->code != 200) {
+		xnet_close_socket(ctx, sock_id);
+		return;
+	}
+	xnet_static_serve((xnet_static_t *)s->user_ptr, ctx, sock_id, req, NULL, 0);
+	if (!req->keep_alive)
+		xnet_close_socket(ctx, sock_id);
+}
+
+static void
+server_listen(xnet_context_t *ctx, int sock_id, int acc_sock_id) {
+	xnet_socket_t *ns = xnet_get_socket(ctx, acc_sock_id);
+	xnet_unpacker_t *up;
+
+	up = xnet_unpacker_new_http(server_request, 1024);
+	up->user_ptr = ctx;
+	up->user_arg = (void*)(long)acc_sock_id;
+	ns->unpacker = up;
+	ns->user_ptr = (sock_id == g_cached_listen) ? g_cached : g_nocache;
+}
+
+static void
+server_error(xnet_context_t *ctx, int sock_id, short what) {
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	if (s->unpacker) {
+		xnet_unpacker_free(s->unpacker);
+		s->unpacker = NULL;
+	}
+}
+
+static int
+server_recv(xnet_context_t *ctx, int sock_id, char *buffer, int size, xnet_addr_t *addr_info) {
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	if (s->unpacker && xnet_unpacker_recv(s->unpacker, buffer, size) != 0)
+		xnet_close_socket(ctx, sock_id);
+	return 0;
+}
+
+static void *
+server_thread(void *arg) {
+	xnet_dispatch_loop((xnet_context_t *)arg);
+	return NULL;
+}
+
+/*client*/
+static int g_port;
+static int g_depth;
+static int g_conn;
+static int g_file_size;
+static bool g_stop;
+static bool g_bad;
+static uint64_t g_count;
+
+static void
+send_requests(xnet_context_t *ctx, int sock_id, int n) {
+	int i;
+	for (i=0; i<n; i++)
+		xnet_tcp_send_buffer(ctx, sock_id, g_req, sizeof(g_req)-1, false);
+}
+
+static void
+client_response(xnet_unpacker_t *up, void *arg) {
+	xnet_httpresponse_t *rsp = (xnet_httpresponse_t *)arg;
+	xnet_context_t *ctx = (xnet_context_t *)up->user_ptr;
+	int sock_id = (long)up->user_arg;
+
+	if (rsp->code != 200 || rsp->body_len != (uint32_t)g_file_size)
+		g_bad = true;
+	g_count++;
+	if (!g_stop)
+		send_requests(ctx, sock_id, 1);
+}
+
+static void
+client_connected(xnet_context_t *ctx, int sock_id, int error) {
+	xnet_socket_t *s;
+	xnet_unpacker_t *up;
+	if (g_stop || error != 0) return;
+	s = xnet_get_socket(ctx, sock_id);
+	up = xnet_unpacker_new(sizeof(xnet_httpresponse_t), client_response, xnet_unpack_http_rsp, xnet_clear_http_rsp_slice, 0);
+	up->fm = xnet_free_http_rsp;
+	up->user_ptr = ctx;
+	up->user_arg = (void*)(long)sock_id;
+	s->unpacker = up;
+	send_requests(ctx, sock_id, g_depth);
+}
+
+static void
+client_error(xnet_context_t *ctx, int sock_id, short what) {
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	if (s->unpacker) {
+		xnet_unpacker_free(s->unpacker);
+		s->unpacker = NULL;
+	}
+}
+
+static int
+client_recv(xnet_context_t *ctx, int sock_id, char *buffer, int size, xnet_addr_t *addr_info) {
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	if (s->unpacker && xnet_unpacker_recv(s->unpacker, buffer, size) != 0)
+		xnet_close_socket(ctx, sock_id);
+	return 0;
+}
+
+static void
+client_timeout(xnet_context_t *ctx, int id) {
+	g_stop = true;
+	xnet_exit(ctx);
+}
+
+static void
+bench(const char *name, int port, int depth, int seconds) {
+	xnet_context_t *ctx;
+	uint64_t start, cost;
+	int i;
+
+	g_port = port;
+	g_depth = depth;
+	g_stop = false;
+	g_bad = false;
+	g_count = 0;
+	ctx = xnet_create_context();
+	xnet_register_connecter(ctx, client_connected, client_error, client_recv);
+	xnet_register_timeout(ctx, client_timeout);
+	for (i=0; i<g_conn; i++)
+		xnet_tcp_connect(ctx, "127.0.0.1", g_port);
+	xnet_add_timer(ctx, 1, seconds * 1000);
+	start = get_time();
+	xnet_dispatch_loop(ctx);
+	cost = get_time() - start;
+	xnet_destroy_context(ctx);
+
+	printf("%-9s(depth %2d): %llu requests in %llums, %.0f req/s%s\n", name, depth,
+		(unsigned long long)g_count, (unsigned long long)cost, g_count * 1000.0 / cost, g_bad ? ", BAD RESPONSE" : "");
+}
+
+int
+main(int argc, char **argv) {
+	xnet_context_t *server;
+	xnet_static_config_t conf = {0};
+	xnet_static_stat_t stat;
+	pthread_t pid;
+	char dir[64], path[128];
+	char *data;
+	FILE *fp;
+	int seconds = 3, depth = 16;
+
+	g_conn = 50;
+	g_file_size = 1024;
+	if (argc > 1) g_conn = atoi(argv[1]);
+	if (argc > 2) seconds = atoi(argv[2]);
+	if (argc > 3) depth = atoi(argv[3]);
+	if (argc > 4) g_file_size = atoi(argv[4]);
+
+	snprintf(dir, sizeof(dir), "/tmp/xnet_bench_static_%d", (int)getpid());
+	mkdir(dir, 0755);
+	snprintf(path, sizeof(path), "%s/bench.html", dir);
+	data = malloc(g_file_size);
+	memset(data, 'x', g_file_size);
+	fp = fopen(path, "wb");
+	fwrite(data, 1, g_file_size, fp);
+	fclose(fp);
+	free(data);
+
+	conf.root = dir;
+	g_cached = xnet_static_create(&conf);
+	conf.max_file = 1;
+	g_nocache = xnet_static_create(&conf);
+
+	if (xnet_init(NULL) != 0) {
+		printf("xnet init error\n");
+		return 1;
+	}
+	server = xnet_create_context();
+	xnet_register_listener(server, server_listen, server_error, server_recv);
+	g_cached_listen = xnet_tcp_listen(server, "127.0.0.1", BENCH_PORT, 1024);
+	if (g_cached_listen == -1 || xnet_tcp_listen(server, "127.0.0.1", NOCACHE_PORT, 1024) == -1) {
+		printf("listen error\n");
+		return 1;
+	}
+	pthread_create(&pid, NULL, server_thread, server);
+
+	printf("connections:%d, seconds:%d, file size:%d\n", g_conn, seconds, g_file_size);
+	bench("cached", BENCH_PORT, 1, seconds);
+	bench("sendfile", NOCACHE_PORT, 1, seconds);
+	bench("cached", BENCH_PORT, depth, seconds);
+	bench("sendfile", NOCACHE_PORT, depth, seconds);
+
+	xnet_asyn_exit(server, NULL);
+	pthread_join(pid, NULL);
+	xnet_static_get_stat(g_cached, &stat);
+	printf("cache hit:%llu, miss:%llu, stat:%llu\n", (unsigned long long)stat.hit,
+		(unsigned long long)stat.miss, (unsigned long long)stat.stat);
+	xnet_destroy_context(server);
+	xnet_static_destroy(g_cached);
+	xnet_static_destroy(g_nocache);
+	xnet_deinit();
+	unlink(path);
+	rmdir(dir);
+	return 0;
+}
@@ -0,0 +1,131 @@
+#include "../src/xnet_websocket.h"
+#include "../src/xnet_util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/*
+ * websocket帧解包/封包性能测试：bench_websocket [总MB]
+ * 解包：依次使用标量、SSE2、AVX2去除掩码，分别测试64字节的小帧和64KB的大帧，
+ * 封包：对比只写帧头(payload引用发送)和帧头+payload复制，输出MB/s和frames/s
+ */
+
+#define SMALL_FRAME 64
+#define LARGE_FRAME (64*1024)
+#define BATCH_BYTES (256*1024)
+
+static const uint8_t g_mask[4] = {0x37, 0xfa, 0x21, 0x3d};
+static uint64_t g_done = 0;
+
+static void
+bench_callback(xnet_unpacker_t *up, void *arg) {
+	xnet_websocket_t *ws = (xnet_websocket_t *)arg;
+	assert(ws->opcode == XNET_WS_BINARY && ws->error == 0);
+	g_done++;
+}
+
+//生成一批客户端发送的帧(带掩码)
+static char *
+make_frames(uint32_t frame_sz, int *count, uint32_t *len) {
+	xnet_string_t out;
+	char *payload = malloc(frame_sz);
+	char *buffer;
+	int i, n = BATCH_BYTES / frame_sz;
+
+	if (n == 0) n = 1;
+	for (i=0; i<(int)frame_sz; i++)
+		payload[i] = (char)(i * 7);
+	xnet_string_init(&out);
+	for (i=0; i<n; i++)
+		xnet_pack_websocket(XNET_WS_BINARY, payload, frame_sz, g_mask, &out);
+	*len = xnet_string_get_size(&out);
+	*count = n;
+	buffer = malloc(*len);
+	memcpy(buffer, out.str, *len);
+	xnet_string_clear(&out);
+	free(payload);
+	return buffer;
+}
+
+static void
+bench_unpack(int level, uint32_t frame_sz, int total_mb) {
+	xnet_unpacker_t *up;
+	char *buffer;
+	uint32_t len;
+	uint64_t start, cost, loops, i;
+	double sec;
+	int count, real;
+
+	real = xnet_websocket_set_simd(level);
+	if (real != level) {
+		printf("simd level[%d] not supported, skip\n", level);
+		return;
+	}
+	buffer = make_frames(frame_sz, &count, &len);
+	loops = (uint64_t)total_mb * 1024 * 1024 / len;
+	if (loops == 0) loops = 1;
+	up = xnet_unpacker_new(sizeof(xnet_websocket_t), bench_callback, xnet_unpack_websocket, xnet_clear_websocket, 0);
+	up->fm = xnet_free_websocket;
+	assert(up);
+	g_done = 0;
+	start = get_time_us();
+	for (i=0; i<loops; i++) {
+		xnet_unpacker_recv(up, buffer, len);
+	}
+	cost = get_time_us() - start;
+	assert(g_done == loops * count);
+	xnet_unpacker_free(up);
+	free(buffer);
+
+	sec = cost / 1000000.0;
+	printf("unpack simd level[%d] %6u bytes: %llu frames in %.3fs, %.1f MB/s, %.0f frames/s\n", level, frame_sz,
+		(unsigned long long)g_done, sec, (double)len * loops / sec / (1024*1024), g_done / sec);
+}
+
+static void
+bench_pack(bool copy, uint32_t frame_sz, int total_mb) {
+	char *payload = calloc(1, frame_sz);
+	char header[XNET_WS_HEADER_MAX];
+	xnet_string_t out;
+	uint64_t start, cost, count, i, bytes = 0;
+	double sec;
+
+	count = (uint64_t)total_mb * 1024 * 1024 / frame_sz;
+	xnet_string_init(&out);
+	start = get_time_us();
+	for (i=0; i<count; i++) {
+		if (copy) {
+			xnet_pack_websocket(XNET_WS_BINARY, payload, frame_sz, NULL, &out);
+			bytes += xnet_string_get_size(&out);
+			out.size = 0;
+		} else {
+			bytes += xnet_pack_websocket_header(XNET_WS_BINARY, true, frame_sz, NULL, header) + frame_sz;
+		}
+	}
+	cost = get_time_us() - start;
+	xnet_string_clear(&out);
+	free(payload);
+
+	if (cost == 0) cost = 1;
+	sec = cost / 1000000.0;
+	printf("pack %s %6u bytes: %llu frames in %.3fs, %.1f MB/s, %.0f frames/s\n", copy ? "copy  " : "header", frame_sz,
+		(unsigned long long)count, sec, (double)bytes / sec / (1024*1024), count / sec);
+}
+
+int
+main(int argc, char **argv) {
+	int total_mb = 1024;
+	if (argc > 1) total_mb = atoi(argv[1]);
+	bench_unpack(XNET_SIMD_NONE, SMALL_FRAME, total_mb);
+	bench_unpack(XNET_SIMD_SSE42, SMALL_FRAME, total_mb);
+	bench_unpack(XNET_SIMD_AVX2, SMALL_FRAME, total_mb);
+	bench_unpack(XNET_SIMD_NONE, LARGE_FRAME, total_mb);
+	bench_unpack(XNET_SIMD_SSE42, LARGE_FRAME, total_mb);
+	bench_unpack(XNET_SIMD_AVX2, LARGE_FRAME, total_mb);
+	bench_pack(false, SMALL_FRAME, total_mb);
+	bench_pack(true, SMALL_FRAME, total_mb);
+	bench_pack(false, LARGE_FRAME, total_mb);
+	bench_pack(true, LARGE_FRAME, total_mb);
+	return 0;
+}
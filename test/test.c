@@ -1,6 +1,7 @@
 #include "../src/xnet.h"
 #include "../src/xnet_timeheap.h"
 #include "../src/xnet_config.h"
+#include "../src/xnet_util.h"
 #include <time.h>
 #include <assert.h>
 
@@ -81,6 +82,24 @@ main(int argc, char** argv) {
 	printf("test config parse finished\n");
 
 
+	printf("--------start test clock--------\n");
+	uint64_t t1, t2, us1, us2, wall;
+	t1 = get_time();
+	us1 = get_time_us();
+	for (i=0; i<1000; i++) {
+		us2 = get_time_us();
+		assert(us2 >= us1);
+		us1 = us2;
+	}
+	t2 = get_time();
+	assert(t2 >= t1);
+	assert(us2 / 1000 >= t1);
+	wall = get_wall_time();
+	printf("monotonic:["TIME_FORMAT"], us:["TIME_FORMAT"], wall:["TIME_FORMAT"]\n", t2, us2, wall);
+	//wall clock must be unix time in milliseconds (after 2020-01-01)
+	assert(wall > 1577836800000ULL);
+	printf("test clock finished\n");
+
 	printf("all test finished!\n");
 	return 0;
 }
\ No newline at end of file
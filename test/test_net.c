@@ -0,0 +1,551 @@
+#include "../src/xnet.h"
+#include "../src/xnet_util.h"
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+/*
+ * 本地回环上的socket测试：每个测试一个context，监听一个端口，客户端也由同一个context连接，
+ * 在回调中按步骤推进，结束时关闭所有socket并退出循环；看门狗计满说明测试卡住了。
+ * 看门狗每个周期唤醒一次循环，退出循环时不用等待一个长定时器到期。
+ */
+#define TIMER_WATCHDOG 1
+#define WATCHDOG_TICK 100
+#define WATCHDOG_MAX 50
+
+typedef struct {
+	xnet_context_t *ctx;
+	int listen_id;
+	int client_id;
+	int server_id;//accept的socket
+	int step;
+	int watchdog;
+} net_case_t;
+
+static net_case_t g_net;
+
+//本地回环上可能立即连接成功，先保存id再回调connect_func
+static void
+net_connect(int port, int *sock_id) {
+	int rc = xnet_connect_tcp_socket(&g_net.ctx->poll, "127.0.0.1", port, sock_id);
+	assert(rc != -1);
+	if (rc == 1)
+		g_net.ctx->connect_func(g_net.ctx, *sock_id, 0);
+}
+
+static int
+net_start(int port, xnet_listen_func_t listen_func, xnet_error_func_t error_func, xnet_recv_func_t recv_func,
+	xnet_connect_func_t connect_func, xnet_timeout_func_t timeout_func) {
+	memset(&g_net, 0, sizeof(g_net));
+	g_net.ctx = xnet_create_context();
+	g_net.server_id = -1;
+	xnet_register_event(g_net.ctx, listen_func, error_func, recv_func, connect_func, timeout_func, NULL);
+	g_net.listen_id = xnet_tcp_listen(g_net.ctx, "127.0.0.1", port, 16);
+	assert(g_net.listen_id >= 0);
+	xnet_add_timer(g_net.ctx, TIMER_WATCHDOG, WATCHDOG_TICK);
+	net_connect(port, &g_net.client_id);
+	return 0;
+}
+
+static void
+net_finish(xnet_context_t *ctx) {
+	xnet_close_socket(ctx, g_net.client_id);
+	xnet_close_socket(ctx, g_net.server_id);
+	xnet_close_socket(ctx, g_net.listen_id);
+	xnet_exit(ctx);
+}
+
+static void
+net_run() {
+	xnet_dispatch_loop(g_net.ctx);
+	xnet_destroy_context(g_net.ctx);
+	g_net.ctx = NULL;
+}
+
+static void
+net_listen(xnet_context_t *ctx, int sock_id, int acc_sock_id) {
+	g_net.server_id = acc_sock_id;
+}
+
+//socket已经关闭，避免结束时重复关闭
+static void
+net_forget(int sock_id) {
+	if (sock_id == g_net.client_id) g_net.client_id = -1;
+	if (sock_id == g_net.server_id) g_net.server_id = -1;
+}
+
+static void
+net_error(xnet_context_t *ctx, int sock_id, short what) {
+	net_forget(sock_id);
+}
+
+static void
+net_timeout(xnet_context_t *ctx, int id) {
+	assert(id == TIMER_WATCHDOG && ++g_net.watchdog < WATCHDOG_MAX);
+	xnet_add_timer(ctx, TIMER_WATCHDOG, WATCHDOG_TICK);
+}
+
+//cork模式下同一轮的多次发送留在写队列中，由一次flush合并发出
+static void
+cork_connect(xnet_context_t *ctx, int sock_id, int error) {
+	assert(error == 0);
+	xnet_tcp_send_buffer(ctx, sock_id, "go", 2, false);
+}
+
+static int
+cork_recv(xnet_context_t *ctx, int sock_id, char *buffer, int size, xnet_addr_t *addr_info) {
+	xnet_socket_t *s;
+	if (sock_id == g_net.client_id) {
+		if (g_net.step == 1) {
+			//三次发送在对端一次收到
+			assert(size == 9 && memcmp(buffer, "aaabbbccc", 9) == 0);
+			g_net.step = 2;
+			xnet_tcp_send_buffer(ctx, sock_id, "again", 5, false);
+		} else {
+			assert(g_net.step == 3 && size == 6 && memcmp(buffer, "xyyzzz", 6) == 0);
+			net_finish(ctx);
+		}
+		return 0;
+	}
+
+	if (g_net.step == 0) {
+		assert(size == 2 && memcmp(buffer, "go", 2) == 0);
+		xnet_set_cork(ctx, true);
+		xnet_tcp_send_buffer(ctx, sock_id, "aaa", 3, false);
+		xnet_tcp_send_buffer(ctx, sock_id, "bbb", 3, false);
+		xnet_tcp_send_buffer(ctx, sock_id, "ccc", 3, false);
+		//没有立即发送，也没有等待可写事件，在本轮循环结束时flush
+		s = xnet_get_socket(ctx, sock_id);
+		assert(s->dirty && !s->writing && s->wb_size == 9);
+		g_net.step = 1;
+	} else {
+		assert(g_net.step == 2 && size == 5 && memcmp(buffer, "again", 5) == 0);
+		xnet_tcp_send_buffer(ctx, sock_id, "x", 1, false);
+		xnet_tcp_send_buffer(ctx, sock_id, "yy", 2, false);
+		xnet_tcp_send_buffer(ctx, sock_id, "zzz", 3, false);
+		s = xnet_get_socket(ctx, sock_id);
+		assert(s->dirty && s->wb_size == 6);
+		//xnet_flush立即发送，一次就清空写队列
+		assert(xnet_flush(ctx, sock_id) == 0);
+		s = xnet_get_socket(ctx, sock_id);
+		assert(!s->dirty && s->wb_size == 0 && wb_list_empty(s));
+		xnet_set_cork(ctx, false);
+		g_net.step = 3;
+	}
+	return 0;
+}
+
+void
+test_cork() {
+printf("--start cork test--\n");
+	net_start(18401, net_listen, net_error, cork_recv, cork_connect, net_timeout);
+	net_run();
+	assert(g_net.step == 3);
+printf("--finshed cork test--\n");
+}
+
+//写队列到达high回调drain_func(false)，回落到low回调drain_func(true)，超过hard关闭socket
+#define WM_CHUNK 1024
+#define WM_COUNT 8
+
+static int wm_drain_false;
+static int wm_drain_true;
+static int wm_recv_bytes;
+static short wm_close_what;
+static bool wm_sending;
+
+static void
+wm_connect(xnet_context_t *ctx, int sock_id, int error) {
+	assert(error == 0);
+	xnet_tcp_send_buffer(ctx, sock_id, "go", 2, false);
+}
+
+static void
+wm_drain(xnet_context_t *ctx, int sock_id, bool writable) {
+	xnet_socket_t *s = xnet_get_socket(ctx, sock_id);
+	//不在发送函数中回调
+	assert(sock_id == g_net.server_id && !wm_sending);
+	if (writable) {
+		assert(!s->wb_blocked && s->wb_size <= s->wb_low);
+		wm_drain_true++;
+	} else {
+		assert(s->wb_blocked && s->wb_size >= s->wb_high);
+		wm_drain_false++;
+	}
+}
+
+static void
+wm_error(xnet_context_t *ctx, int sock_id, short what) {
+	if (sock_id == g_net.server_id) {
+		wm_close_what = what;
+	} else if (sock_id == g_net.client_id) {
+		//服务端超过hard后关闭，客户端收到EOF
+		assert(g_net.step == 2 && wm_close_what == XNET_ERROR_WB_OVERFLOW);
+		g_net.step = 3;
+		net_forget(sock_id);
+		net_finish(ctx);
+		return;
+	}
+	net_forget(sock_id);
+}
+
+static int
+wm_recv(xnet_context_t *ctx, int sock_id, char *buffer, int size, xnet_addr_t *addr_info) {
+	static char chunk[WM_CHUNK * WM_COUNT];
+	xnet_socket_t *s;
+	int i;
+	if (sock_id == g_net.client_id) {
+		assert(g_net.step == 1);
+		wm_recv_bytes += size;
+		assert(wm_recv_bytes <= WM_CHUNK * WM_COUNT);
+		if (wm_recv_bytes == WM_CHUNK * WM_COUNT) {
+			//写队列已经发完，回落到low以下
+			assert(wm_drain_false == 1 && wm_drain_true == 1);
+			g_net.step = 2;
+			xnet_tcp_send_buffer(ctx, sock_id, "hard", 4, false);
+		}
+		return 0;
+	}
+
+	if (g_net.step == 0) {
+		assert(size == 2 && memcmp(buffer, "go", 2) == 0);
+		assert(xnet_set_watermark(ctx, sock_id, WM_CHUNK, WM_CHUNK * 4, 0) == 0);
+		wm_sending = true;
+		for (i=0; i<WM_COUNT; i++) {
+			xnet_tcp_send_buffer(ctx, sock_id, chunk, WM_CHUNK, false);
+			//第4块到达high，drain_func在本轮事件处理完后回调一次
+			s = xnet_get_socket(ctx, sock_id);
+			assert(s->wb_blocked == (i >= 3) && wm_drain_false == 0);
+		}
+		wm_sending = false;
+		s = xnet_get_socket(ctx, sock_id);
+		assert(s->wb_blocked && s->wb_size == WM_CHUNK * WM_COUNT);
+		g_net.step = 1;
+	} else {
+		assert(g_net.step == 2 && size == 4 && memcmp(buffer, "hard", 4) == 0);
+		assert(xnet_set_watermark(ctx, sock_id, 0, 0, WM_CHUNK * 4) == 0);
+		xnet_tcp_send_buffer(ctx, sock_id, chunk, sizeof(chunk), false);
+		//超过hard：写队列被丢弃，本轮结束时关闭
+		s = xnet_get_socket(ctx, sock_id);
+		assert(s->closing && s->wb_size == 0);
+	}
+	return 0;
+}
+
+void
+test_watermark() {
+printf("--start watermark test--\n");
+	net_start(18402, net_listen, wm_error, wm_recv, wm_connect, net_timeout);
+	xnet_register_drain(g_net.ctx, wm_drain);
+	net_run();
+	assert(g_net.step == 3 && wm_close_what == XNET_ERROR_WB_OVERFLOW);
+printf("--finshed watermark test--\n");
+}
+
+//read_link只接受其他存活的tcp连接，对端关闭后关联失效
+static int
+link_recv(xnet_context_t *ctx, int sock_id, char *buffer, int size, xnet_addr_t *addr_info) {
+	xnet_socket_t *s;
+	int client_id = g_net.client_id;
+	assert(sock_id == g_net.server_id && size == 2 && memcmp(buffer, "go", 2) == 0);
+	assert(xnet_set_read_link(ctx, sock_id, sock_id) == -1);
+	assert(xnet_set_read_link(ctx, sock_id, g_net.listen_id) == -1);
+	assert(xnet_set_read_link(ctx, sock_id, MAX_CLIENT_NUM - 1) == -1);
+	assert(xnet_set_read_link(ctx, sock_id, -2) == -1);
+	assert(xnet_set_read_link(ctx, sock_id, client_id) == 0);
+
+	//进入高水位暂停对端读取，取消关联或者回落时恢复
+	assert(xnet_set_watermark(ctx, sock_id, 0, 4, 0) == 0);
+	xnet_tcp_send_buffer(ctx, sock_id, "12345678", 8, false);
+	assert(!xnet_get_socket(ctx, client_id)->reading);
+	assert(xnet_set_read_link(ctx, sock_id, -1) == 0);
+	assert(xnet_get_socket(ctx, client_id)->reading);
+	assert(xnet_set_read_link(ctx, sock_id, client_id) == 0);
+	assert(!xnet_get_socket(ctx, client_id)->reading);
+	assert(xnet_flush(ctx, sock_id) == 0);
+	assert(xnet_get_socket(ctx, client_id)->reading);
+
+	xnet_close_socket(ctx, client_id);
+	net_forget(client_id);
+	s = xnet_get_socket(ctx, sock_id);
+	assert(xnet_get_read_link(&ctx->poll, s) == NULL && s->read_link == -1);
+	g_net.step = 1;
+	net_finish(ctx);
+	return 0;
+}
+
+void
+test_read_link() {
+printf("--start read link test--\n");
+	net_start(18406, net_listen, net_error, link_recv, wm_connect, net_timeout);
+	net_run();
+	assert(g_net.step == 1);
+printf("--finshed read link test--\n");
+}
+
+//读取预算：数据已经全部到达的socket每轮最多读取msgs次或bytes字节，其余留到后续轮次，其他socket照常处理
+#define RB_TOTAL (64 * 1024)
+#define RB_BYTES 4096
+#define RB_MSGS 2
+#define RB_TIMER 2
+
+static int rb_busy_client;
+static int rb_busy_server;
+static int rb_accepted[2];
+static int rb_accept_n;
+static int rb_connect_n;
+static int rb_total;
+static int rb_round_msgs;
+static int rb_round_bytes;
+static int rb_rounds;
+static uint32_t rb_round;
+static bool rb_ping;
+
+static void
+rb_listen(xnet_context_t *ctx, int sock_id, int acc_sock_id) {
+	//先不读，等两个客户端的数据都进入内核缓冲区
+	xnet_enable_read(&ctx->poll, xnet_get_socket(ctx, acc_sock_id), false);
+	rb_accepted[rb_accept_n++] = acc_sock_id;
+}
+
+static void
+rb_connect(xnet_context_t *ctx, int sock_id, int error) {
+	static char busy[RB_TOTAL];
+	assert(error == 0);
+	rb_connect_n++;
+	if (sock_id == rb_busy_client) {
+		memset(busy, 'a', sizeof(busy));
+		xnet_tcp_send_buffer(ctx, sock_id, busy, sizeof(busy), false);
+	} else {
+		xnet_tcp_send_buffer(ctx, sock_id, "ping", 4, false);
+	}
+}
+
+static void
+rb_timeout(xnet_context_t *ctx, int id) {
+	int i;
+	if (id != RB_TIMER) {
+		net_timeout(ctx, id);
+		return;
+	}
+	if (rb_accept_n < 2 || rb_connect_n < 2 ||
+		!wb_list_empty(xnet_get_socket(ctx, g_net.client_id)) ||
+		!wb_list_empty(xnet_get_socket(ctx, rb_busy_client))) {
+		xnet_add_timer(ctx, RB_TIMER, 10);
+		return;
+	}
+	for (i=0; i<2; i++)
+		xnet_enable_read(&ctx->poll, xnet_get_socket(ctx, rb_accepted[i]), true);
+}
+
+static int
+rb_recv(xnet_context_t *ctx, int sock_id, char *buffer, int size, xnet_addr_t *addr_info) {
+	assert(sock_id == rb_accepted[0] || sock_id == rb_accepted[1]);
+	if (size == 4 && memcmp(buffer, "ping", 4) == 0) {
+		//忙碌的socket还没有读完，这个socket也得到了处理
+		assert(rb_total < RB_TOTAL);
+		rb_ping = true;
+		g_net.server_id = sock_id;
+		return 0;
+	}
+
+	rb_busy_server = sock_id;
+	if (ctx->loop_round != rb_round) {
+		rb_round = ctx->loop_round;
+		rb_round_msgs = 0;
+		rb_round_bytes = 0;
+		rb_rounds++;
+	}
+	//同一轮中预算用完后不会再读取
+	assert(rb_round_msgs < RB_MSGS && rb_round_bytes < RB_BYTES);
+	rb_round_msgs++;
+	rb_round_bytes += size;
+	rb_total += size;
+	if (rb_total == RB_TOTAL) {
+		assert(rb_ping);
+		xnet_close_socket(ctx, rb_busy_server);
+		xnet_close_socket(ctx, rb_busy_client);
+		net_finish(ctx);
+	}
+	return 0;
+}
+
+void
+test_read_budget() {
+printf("--start read budget test--\n");
+	net_start(18403, rb_listen, net_error, rb_recv, rb_connect, rb_timeout);
+	xnet_set_read_budget(g_net.ctx, RB_BYTES, RB_MSGS);
+	net_connect(18403, &rb_busy_client);
+	xnet_add_timer(g_net.ctx, RB_TIMER, 10);
+	net_run();
+	//512+1K、2K+4K、8K、16K、32K、512，至少分6轮读完
+	assert(rb_total == RB_TOTAL && rb_rounds >= 6);
+printf("--finshed read budget test--\n");
+}
+
+//连接超时：读超时、写超时、存活时间到期时回调error_func并关闭socket
+#define TO_READ 300
+#define TO_WRITE 300
+#define TO_LIFE 400
+#define TO_STALL (16 * 1024 * 1024)
+
+static int to_life_client;
+static int to_write_client;
+static int to_accepted[3];
+static int to_accept_n;
+static int to_fired;
+static uint64_t to_start[3];
+
+static void
+to_listen(xnet_context_t *ctx, int sock_id, int acc_sock_id) {
+	assert(to_accept_n < 3);
+	to_accepted[to_accept_n++] = acc_sock_id;
+}
+
+static void
+to_connect(xnet_context_t *ctx, int sock_id, int error) {
+	assert(error == 0);
+	if (sock_id == g_net.client_id) {
+		to_start[0] = ctx->nowtime;
+		assert(xnet_set_conn_timeout(ctx, sock_id, TO_READ, 0, 0) == 0);
+	} else if (sock_id == to_life_client) {
+		//有读超时也是存活时间先到期
+		to_start[2] = ctx->nowtime;
+		assert(xnet_set_conn_timeout(ctx, sock_id, TO_READ * 10, 0, TO_LIFE) == 0);
+	} else {
+		//不读取，让服务端的写队列卡住
+		assert(sock_id == to_write_client);
+		xnet_enable_read(&ctx->poll, xnet_get_socket(ctx, sock_id), false);
+		xnet_tcp_send_buffer(ctx, sock_id, "w", 1, false);
+	}
+}
+
+static void
+to_check(xnet_context_t *ctx, int i, int timeout) {
+	uint64_t elapsed = ctx->nowtime - to_start[i];
+	assert(elapsed >= timeout && elapsed < timeout + 1000);
+	to_fired++;
+}
+
+static void
+to_error(xnet_context_t *ctx, int sock_id, short what) {
+	int i;
+	if (sock_id == g_net.client_id) {
+		assert(what == XNET_ERROR_READ_TIMEOUT);
+		to_check(ctx, 0, TO_READ);
+	} else if (sock_id == g_net.server_id && what == XNET_ERROR_WRITE_TIMEOUT) {
+		to_check(ctx, 1, TO_WRITE);
+	} else if (sock_id == to_life_client) {
+		assert(what == XNET_ERROR_LIFE_TIMEOUT);
+		to_check(ctx, 2, TO_LIFE);
+		to_life_client = -1;
+	} else {
+		//客户端超时关闭后，服务端对应的socket收到EOF
+		assert(what != XNET_ERROR_READ_TIMEOUT && what != XNET_ERROR_WRITE_TIMEOUT && what != XNET_ERROR_LIFE_TIMEOUT);
+	}
+	net_forget(sock_id);
+	if (to_fired == 3) {
+		for (i=0; i<to_accept_n; i++)
+			xnet_close_socket(ctx, to_accepted[i]);
+		xnet_close_socket(ctx, to_write_client);
+		net_finish(ctx);
+	}
+}
+
+static int
+to_recv(xnet_context_t *ctx, int sock_id, char *buffer, int size, xnet_addr_t *addr_info) {
+	static char stall[TO_STALL];
+	assert(size == 1 && buffer[0] == 'w');
+	g_net.server_id = sock_id;
+	to_start[1] = ctx->nowtime;
+	assert(xnet_set_conn_timeout(ctx, sock_id, 0, TO_WRITE, 0) == 0);
+	//超过内核缓冲区大小，写队列一直不为空
+	xnet_tcp_send_buffer(ctx, sock_id, stall, sizeof(stall), false);
+	return 0;
+}
+
+void
+test_conn_timeout() {
+printf("--start conn timeout test--\n");
+	net_start(18404, to_listen, to_error, to_recv, to_connect, net_timeout);
+	net_connect(18404, &to_life_client);
+	net_connect(18404, &to_write_client);
+	net_run();
+	assert(to_fired == 3);
+printf("--finshed conn timeout test--\n");
+}
+
+//sendfile的文件比wb_hard大也能完整发送，文件数据不计入硬上限
+#define SF_SIZE (1024 * 1024)
+#define SF_HARD (64 * 1024)
+#define SF_PATH "test_net_sendfile.tmp"
+
+static int sf_recv_bytes;
+
+static void
+sf_connect(xnet_context_t *ctx, int sock_id, int error) {
+	assert(error == 0);
+	xnet_tcp_send_buffer(ctx, sock_id, "go", 2, false);
+}
+
+static int
+sf_recv(xnet_context_t *ctx, int sock_id, char *buffer, int size, xnet_addr_t *addr_info) {
+	xnet_socket_t *s;
+	int i, fd;
+	if (sock_id == g_net.client_id) {
+		for (i=0; i<size; i++, sf_recv_bytes++) {
+			if (sf_recv_bytes < SF_SIZE)
+				assert(buffer[i] == (char)(sf_recv_bytes % 251));
+			else
+				assert(sf_recv_bytes == SF_SIZE && buffer[i] == '!');
+		}
+		if (sf_recv_bytes == SF_SIZE + 1) {
+			g_net.step = 2;
+			net_finish(ctx);
+		}
+		return 0;
+	}
+
+	assert(g_net.step == 0 && size == 2 && memcmp(buffer, "go", 2) == 0);
+	assert(xnet_set_watermark(ctx, sock_id, SF_HARD, SF_HARD * 4, SF_HARD) == 0);
+	fd = util_open(SF_PATH, O_RDONLY);
+	assert(fd >= 0);
+	assert(xnet_tcp_send_file(ctx, sock_id, fd, 0, SF_SIZE) == 0);
+	xnet_tcp_send_buffer(ctx, sock_id, "!", 1, false);
+	//文件超过high进入高水位，但没有超过hard关闭
+	s = xnet_get_socket(ctx, sock_id);
+	assert(!s->closing && s->wb_blocked && s->wb_size == SF_SIZE + 1);
+	g_net.step = 1;
+	return 0;
+}
+
+void
+test_sendfile() {
+	static char data[SF_SIZE];
+	FILE *f;
+	int i;
+printf("--start sendfile test--\n");
+	for (i=0; i<SF_SIZE; i++)
+		data[i] = (char)(i % 251);
+	f = fopen(SF_PATH, "wb");
+	assert(f && fwrite(data, 1, SF_SIZE, f) == SF_SIZE);
+	fclose(f);
+	net_start(18405, net_listen, net_error, sf_recv, sf_connect, net_timeout);
+	net_run();
+	remove(SF_PATH);
+	assert(g_net.step == 2 && sf_recv_bytes == SF_SIZE + 1);
+printf("--finshed sendfile test--\n");
+}
+
+int
+main(int argc, char **argv) {
+	xnet_init(&(xnet_init_config_t){NULL, true});
+	test_cork();
+	test_watermark();
+	test_read_link();
+	test_read_budget();
+	test_conn_timeout();
+	test_sendfile();
+	xnet_deinit();
+	return 0;
+}